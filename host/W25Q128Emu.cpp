@@ -0,0 +1,334 @@
+/**
+ * @class W25Q128Emu
+ * @brief Host emulation of the W25Q128 command set used by the W25Q128 driver.
+ *
+ * The emulation works on the SPI bytes, so the unchanged driver (src/W25Q128.cpp) runs against it through the
+ * SPI shim. Read data (0x03), page program (0x02), sector erase (0x20), 64KB block erase (0xD8), chip erase
+ * (0xC7), write enable/disable, status register and JEDEC ID are implemented with the rules of the datasheet:
+ * program and erase need the write enable latch, a page program wraps within its page, commands other than a
+ * status read are ignored while the chip is busy. A program can only clear bits (the data is ANDed into the
+ * array), an erase sets the bytes to 0xFF. Requested 0 -> 1 changes are counted in bitsLost, they point to a
+ * missing erase.
+ *
+ * Time is simulated: every SPI byte takes 8 clocks, a program or erase makes the chip busy for its datasheet
+ * time. Status polling and delay() advance the time, so the driver waits exactly as long as on the device. CPU
+ * time of the host is not part of the model.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "W25Q128Emu.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define EMU_CMD_WRITE_STATUS 0x01
+#define EMU_CMD_PAGE_PROGRAM 0x02
+#define EMU_CMD_READ_DATA 0x03
+#define EMU_CMD_WRITE_DISABLE 0x04
+#define EMU_CMD_READ_STATUS 0x05
+#define EMU_CMD_WRITE_ENABLE 0x06
+#define EMU_CMD_SECTOR_ERASE 0x20
+#define EMU_CMD_JEDEC_ID 0x9F
+#define EMU_CMD_CHIP_ERASE 0xC7
+#define EMU_CMD_BLOCK_ERASE 0xD8
+
+W25Q128EmuTiming W25Q128EmuTiming::typical()
+{
+    return {8000000, 0, 30000, 2500, 400000, 45000000, 150000000, 40000000000ULL};
+}
+
+W25Q128EmuTiming W25Q128EmuTiming::worst()
+{
+    return {8000000, 0, 50000, 12000, 3000000, 400000000, 2000000000, 200000000000ULL};
+}
+
+W25Q128Emu::W25Q128Emu() : _mem(nullptr), _mapped(false), _fd(-1), _timing(W25Q128EmuTiming::typical()), _now(0), _busyUntil(0),
+                           _selected(false), _wel(false), _cmd(0), _pos(0), _addr(0), _pageCount(0)
+{
+    resetStats();
+}
+
+W25Q128Emu::~W25Q128Emu()
+{
+    close();
+}
+
+/**
+ * @brief Instance behind the SPI shim
+ *
+ * @return the chip
+ */
+W25Q128Emu &W25Q128Emu::chip()
+{
+    static W25Q128Emu instance;
+    return instance;
+}
+
+/**
+ * @brief Use an erased chip in RAM
+ *
+ * @return true if allocated
+ */
+bool W25Q128Emu::openRam()
+{
+    close();
+    _mem = new uint8_t[EMU_FLASH_SIZE];
+    memset(_mem, 0xFF, EMU_FLASH_SIZE);
+    return true;
+}
+
+/**
+ * @brief Use a memory-mapped file as chip content, so it survives the process like the real chip survives a reset
+ *
+ * @param path the file, created erased if it doesn't exist
+ * @return true if mapped
+ */
+bool W25Q128Emu::openFile(const char *path)
+{
+    close();
+    _fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (_fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    const bool created = fstat(_fd, &st) == 0 && st.st_size == 0;
+    if (ftruncate(_fd, EMU_FLASH_SIZE) != 0)
+    {
+        close();
+        return false;
+    }
+    void *map = mmap(nullptr, EMU_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    _mem = static_cast<uint8_t *>(map);
+    _mapped = true;
+    if (created)
+    {
+        memset(_mem, 0xFF, EMU_FLASH_SIZE);
+    }
+    return true;
+}
+
+void W25Q128Emu::close()
+{
+    if (_mapped)
+    {
+        munmap(_mem, EMU_FLASH_SIZE);
+    }
+    else
+    {
+        delete[] _mem;
+    }
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+    _mem = nullptr;
+    _mapped = false;
+    _fd = -1;
+}
+
+void W25Q128Emu::resetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+    _eraseCount.assign(EMU_FLASH_SIZE / EMU_SECTOR_SIZE, 0);
+}
+
+uint32_t W25Q128Emu::eraseCount(uint32_t sector) const
+{
+    return sector < _eraseCount.size() ? _eraseCount[sector] : 0;
+}
+
+/**
+ * @brief Start a transaction
+ */
+void W25Q128Emu::select()
+{
+    _selected = true;
+    _pos = 0;
+    _cmd = 0;
+    _stats.transactions++;
+    _now += _timing.transactionNs;
+}
+
+/**
+ * @brief End a transaction. Program and erase commands start here, like on the chip
+ */
+void W25Q128Emu::deselect()
+{
+    if (!_selected)
+    {
+        return;
+    }
+    _selected = false;
+    if (!_mem)
+    {
+        return;
+    }
+    switch (_cmd)
+    {
+        case EMU_CMD_WRITE_ENABLE:
+            _wel = true;
+            break;
+        case EMU_CMD_WRITE_DISABLE:
+            _wel = false;
+            break;
+        case EMU_CMD_PAGE_PROGRAM:
+            if (_pos > 4)
+            {
+                commitProgram();
+            }
+            break;
+        case EMU_CMD_SECTOR_ERASE:
+        case EMU_CMD_BLOCK_ERASE:
+            if (_pos == 4)
+            {
+                const bool sector = _cmd == EMU_CMD_SECTOR_ERASE;
+                const uint32_t size = sector ? EMU_SECTOR_SIZE : EMU_BLOCK_SIZE;
+                eraseRange(_addr & ~(size - 1), size);
+                (sector ? _stats.sectorErases : _stats.blockErases)++;
+                busyFor(sector ? _timing.tSENs : _timing.tBENs);
+            }
+            break;
+        case EMU_CMD_CHIP_ERASE:
+            if (_pos == 1)
+            {
+                eraseRange(0, EMU_FLASH_SIZE);
+                _stats.chipErases++;
+                busyFor(_timing.tCENs);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Exchange one byte. The first byte of a transaction is the command, 3 address bytes follow
+ *
+ * @param out the byte sent to the chip
+ * @return the byte sent by the chip
+ */
+uint8_t W25Q128Emu::transfer(uint8_t out)
+{
+    _now += 8000000000ULL / _timing.spiHz;
+    _stats.spiBytes++;
+    if (!_selected || !_mem)
+    {
+        return 0xFF;
+    }
+    const uint32_t pos = _pos++;
+    if (pos == 0)
+    {
+        _cmd = out;
+        _addr = 0;
+        _pageCount = 0;
+        memset(_pageUsed, 0, sizeof(_pageUsed));
+        const bool write = out == EMU_CMD_PAGE_PROGRAM || out == EMU_CMD_SECTOR_ERASE || out == EMU_CMD_BLOCK_ERASE || out == EMU_CMD_CHIP_ERASE;
+        if ((busy() && out != EMU_CMD_READ_STATUS) || (write && !_wel))
+        {
+            _cmd = 0; // Ignored by the chip
+            _stats.ignored++;
+        }
+        if (_cmd == EMU_CMD_READ_STATUS)
+        {
+            _stats.statusPolls++;
+        }
+        return 0xFF;
+    }
+
+    switch (_cmd)
+    {
+        case EMU_CMD_READ_STATUS:
+            return status();
+        case EMU_CMD_JEDEC_ID:
+        {
+            static const uint8_t id[3] = {0xEF, 0x40, 0x18};
+            return pos <= 3 ? id[pos - 1] : 0xFF;
+        }
+        case EMU_CMD_READ_DATA:
+        case EMU_CMD_PAGE_PROGRAM:
+        case EMU_CMD_SECTOR_ERASE:
+        case EMU_CMD_BLOCK_ERASE:
+            if (pos <= 3)
+            {
+                _addr = ((_addr << 8) | out) & (EMU_FLASH_SIZE - 1);
+                return 0xFF;
+            }
+            if (_cmd == EMU_CMD_READ_DATA)
+            {
+                const uint8_t in = _mem[_addr];
+                _addr = (_addr + 1) & (EMU_FLASH_SIZE - 1);
+                _stats.readBytes++;
+                return in;
+            }
+            if (_cmd == EMU_CMD_PAGE_PROGRAM)
+            {
+                // Wraps within the page, more than 256 bytes keep the last 256
+                const uint32_t offset = ((_addr & (EMU_PAGE_SIZE - 1)) + _pageCount) & (EMU_PAGE_SIZE - 1);
+                _page[offset] = out;
+                _pageUsed[offset] = true;
+                _pageCount++;
+            }
+            return 0xFF;
+        default:
+            return 0xFF;
+    }
+}
+
+uint8_t W25Q128Emu::status() const
+{
+    return (busy() ? 0x01 : 0x00) | (_wel ? 0x02 : 0x00);
+}
+
+/**
+ * @brief Start a program or erase: busy for its time, the write enable latch is reset at the end
+ *
+ * @param ns the time of the operation
+ */
+void W25Q128Emu::busyFor(uint64_t ns)
+{
+    _busyUntil = _now + ns;
+    _stats.busyNs += ns;
+    _wel = false;
+}
+
+void W25Q128Emu::eraseRange(uint32_t addr, uint32_t size)
+{
+    memset(_mem + addr, 0xFF, size);
+    for (uint32_t sector = addr / EMU_SECTOR_SIZE; sector < (addr + size) / EMU_SECTOR_SIZE; sector++)
+    {
+        _eraseCount[sector]++;
+    }
+}
+
+/**
+ * @brief Program the bytes of a page program into the array. Only 1 -> 0 changes take effect
+ */
+void W25Q128Emu::commitProgram()
+{
+    const uint32_t page = _addr & ~(uint32_t)(EMU_PAGE_SIZE - 1);
+    uint32_t bytes = 0;
+    for (uint32_t i = 0; i < EMU_PAGE_SIZE; i++)
+    {
+        if (!_pageUsed[i])
+        {
+            continue;
+        }
+        uint8_t &cell = _mem[page + i];
+        _stats.bitsLost += __builtin_popcount(_page[i] & ~cell & 0xFF);
+        cell &= _page[i];
+        bytes++;
+    }
+    _stats.programBytes += bytes;
+    _stats.pagePrograms++;
+    const uint64_t ns = (uint64_t)_timing.tBP1Ns + (uint64_t)(bytes - 1) * _timing.tBP2Ns;
+    busyFor(ns < _timing.tPPNs ? ns : _timing.tPPNs);
+}
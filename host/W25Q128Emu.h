@@ -0,0 +1,104 @@
+#pragma once
+/**
+ * @file        W25Q128Emu.h
+ * @brief       Host emulation of the W25Q128 behind the SPI shim, with NOR semantics and a datasheet
+ *              timing model. The simulated time drives millis()/micros()/delay() of the host shims
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define EMU_FLASH_SIZE (16 * 1024 * 1024) // 16MB, like FLASH_SIZE_W25Q128
+#define EMU_SECTOR_SIZE 4096              // Erase sector
+#define EMU_BLOCK_SIZE 65536              // 64KB erase block
+#define EMU_PAGE_SIZE 256                 // Program page
+
+// Timing of the chip in ns. typical() and worst() follow the W25Q128JV datasheet
+struct W25Q128EmuTiming
+{
+    uint32_t spiHz;         // SPI clock, 8MHz like W25Q128::select()
+    uint32_t transactionNs; // Overhead per chip select (software, CS setup and hold)
+    uint32_t tBP1Ns;        // Program of the first byte of a page
+    uint32_t tBP2Ns;        // Program of each additional byte
+    uint32_t tPPNs;         // Program of a full page, upper bound of tBP1 + n * tBP2
+    uint32_t tSENs;         // Sector erase (4KB)
+    uint32_t tBENs;         // Block erase (64KB)
+    uint64_t tCENs;         // Chip erase
+
+    static W25Q128EmuTiming typical();
+    static W25Q128EmuTiming worst();
+};
+
+// Counters of the emulated chip
+struct W25Q128EmuStats
+{
+    uint64_t spiBytes;     // Bytes on the SPI bus, commands and addresses included
+    uint64_t transactions; // Chip selects
+    uint64_t readBytes;    // Data bytes read
+    uint64_t programBytes; // Data bytes programmed
+    uint64_t pagePrograms; // Page program commands
+    uint64_t sectorErases; // Sector erase commands
+    uint64_t blockErases;  // 64KB block erase commands
+    uint64_t chipErases;   // Chip erase commands
+    uint64_t statusPolls;  // Status register reads
+    uint64_t busyNs;       // Time the chip was busy programming or erasing
+    uint64_t ignored;      // Commands ignored because the chip was busy or not write enabled
+    uint64_t bitsLost;     // 0 -> 1 bit changes requested by a program, which NOR flash can't do
+};
+
+class W25Q128Emu
+{
+  public:
+    W25Q128Emu();
+    ~W25Q128Emu();
+
+    bool openRam();                  // RAM backed chip, erased
+    bool openFile(const char *path); // Chip backed by a memory-mapped file, created erased if missing
+    void close();
+
+    // SPI side, called by the SPI shim
+    void select();
+    void deselect();
+    uint8_t transfer(uint8_t out);
+
+    // Simulated time in ns, advanced by SPI transfers and delay()
+    inline uint64_t now() const { return _now; }
+    inline void advance(uint64_t ns) { _now += ns; }
+
+    inline W25Q128EmuTiming &timing() { return _timing; }
+    inline const W25Q128EmuStats &stats() const { return _stats; }
+    void resetStats();                                   // Counters and erase counts to zero, the time keeps running
+    uint32_t eraseCount(uint32_t sector) const;          // Erases of a 4KB sector since resetStats()
+    inline uint8_t *data() { return _mem; }              // Content of the chip, for inspection
+    inline bool busy() const { return _now < _busyUntil; } // Program or erase running
+
+    static W25Q128Emu &chip(); // Instance behind the SPI shim
+
+  private:
+    uint8_t status() const;
+    void busyFor(uint64_t ns);
+    void eraseRange(uint32_t addr, uint32_t size);
+    void commitProgram();
+
+    uint8_t *_mem;                    // Content of the chip
+    bool _mapped;                     // _mem is a file mapping
+    int _fd;                          // File of the mapping
+    W25Q128EmuTiming _timing;         // Timing model
+    W25Q128EmuStats _stats;           // Counters
+    std::vector<uint32_t> _eraseCount; // Erases per sector
+    uint64_t _now;                    // Simulated time
+    uint64_t _busyUntil;              // End of the running program or erase
+    bool _selected;                   // Chip select active
+    bool _wel;                        // Write enable latch
+    uint8_t _cmd;                     // Command of the current transaction, 0 if ignored
+    uint32_t _pos;                    // Bytes of the current transaction
+    uint32_t _addr;                   // Address of the current transaction
+    uint8_t _page[EMU_PAGE_SIZE];     // Data of a page program
+    bool _pageUsed[EMU_PAGE_SIZE];    // Page bytes sent
+    uint32_t _pageCount;              // Data bytes of a page program
+};
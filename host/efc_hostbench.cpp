@@ -0,0 +1,219 @@
+/**
+ * @file        efc_hostbench.cpp
+ * @brief       Runs the workloads of "efc bench" on the host, against the W25Q128 emulation and
+ *              ext_LittleFSImpl, and prints the results as JSON
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ *
+ * Usage: efc_hostbench [options]
+ *   --block <bytes>      lfs block_size, a multiple of 4096 (4096)
+ *   --cache <bytes>      lfs cache_size (256)
+ *   --lookahead <bytes>  lfs lookahead_size (16)
+ *   --read <bytes>       lfs read_size (256)
+ *   --prog <bytes>       lfs prog_size (256)
+ *   --cycles <n>         lfs block_cycles (500)
+ *   --seed <n>           seed of the workloads
+ *   --worst              worst case datasheet timing instead of typical
+ *   --image <file>       keep the chip in a file instead of RAM
+ *   --raw | --fs         only the raw or the filesystem workloads
+ *
+ * Per workload the JSON has the results of the device benchmark (latencies from the simulated micros()) and the
+ * counters of the emulation: simulated device time, SPI bytes, programs, erases, and the littlefs callbacks.
+ * littlefs syncs once per metadata commit, so "lfs_syncs" counts the commits.
+ */
+#include "ExtFlashBench.h"
+#include "ExtFlashPartitions.h"
+#include "W25Q128Emu.h"
+#include "ext_LittleFS.h"
+
+// Counted littlefs callbacks around the ones of the driver
+static uint64_t lfsReads = 0;
+static uint64_t lfsProgs = 0;
+static uint64_t lfsErases = 0;
+static uint64_t lfsSyncs = 0;
+
+static int countRead(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
+{
+    lfsReads++;
+    return W25Q128::lfs_read(c, block, off, buffer, size);
+}
+
+static int countProg(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+    lfsProgs++;
+    return W25Q128::lfs_prog(c, block, off, buffer, size);
+}
+
+static int countErase(const struct lfs_config *c, lfs_block_t block)
+{
+    lfsErases++;
+    return W25Q128::lfs_erase(c, block);
+}
+
+static int countSync(const struct lfs_config *c)
+{
+    lfsSyncs++;
+    return W25Q128::lfs_sync(c);
+}
+
+// Counters at the start of the running workload
+static W25Q128EmuStats startStats;
+static uint64_t startNs = 0;
+static uint64_t startLfs[4] = {0};
+static bool firstResult = true;
+
+static void onStart(const char *)
+{
+    startStats = W25Q128Emu::chip().stats();
+    startNs = W25Q128Emu::chip().now();
+    startLfs[0] = lfsReads;
+    startLfs[1] = lfsProgs;
+    startLfs[2] = lfsErases;
+    startLfs[3] = lfsSyncs;
+}
+
+static void onResult(const ExtFlashBenchResult &r)
+{
+    const W25Q128EmuStats &s = W25Q128Emu::chip().stats();
+    printf("%s\n    {\"name\": \"%s\", \"ops\": %lu, \"bytes\": %lu, \"op_us\": %lu, \"p50_us\": %lu, \"p99_us\": %lu, \"max_us\": %lu, "
+           "\"mbps\": %.4f, \"ops_per_s\": %.1f,\n     \"device_us\": %llu, \"spi_bytes\": %llu, \"transactions\": %llu, "
+           "\"read_bytes\": %llu, \"program_bytes\": %llu, \"page_programs\": %llu, \"sector_erases\": %llu, \"block_erases\": %llu, "
+           "\"status_polls\": %llu, \"busy_us\": %llu, \"bits_lost\": %llu,\n     \"lfs_reads\": %llu, \"lfs_progs\": %llu, "
+           "\"lfs_erases\": %llu, \"lfs_syncs\": %llu}",
+           firstResult ? "" : ",", r.name, (unsigned long)r.ops, (unsigned long)r.bytes, (unsigned long)r.totalUs, (unsigned long)r.p50Us,
+           (unsigned long)r.p99Us, (unsigned long)r.maxUs, r.mbps(), r.opsps(), (unsigned long long)((W25Q128Emu::chip().now() - startNs) / 1000),
+           (unsigned long long)(s.spiBytes - startStats.spiBytes), (unsigned long long)(s.transactions - startStats.transactions),
+           (unsigned long long)(s.readBytes - startStats.readBytes), (unsigned long long)(s.programBytes - startStats.programBytes),
+           (unsigned long long)(s.pagePrograms - startStats.pagePrograms), (unsigned long long)(s.sectorErases - startStats.sectorErases),
+           (unsigned long long)(s.blockErases - startStats.blockErases), (unsigned long long)(s.statusPolls - startStats.statusPolls),
+           (unsigned long long)((s.busyNs - startStats.busyNs) / 1000), (unsigned long long)(s.bitsLost - startStats.bitsLost),
+           (unsigned long long)(lfsReads - startLfs[0]), (unsigned long long)(lfsProgs - startLfs[1]), (unsigned long long)(lfsErases - startLfs[2]),
+           (unsigned long long)(lfsSyncs - startLfs[3]));
+    firstResult = false;
+}
+
+static uint32_t argValue(int &i, int argc, char **argv)
+{
+    return (i + 1 < argc) ? strtoul(argv[++i], nullptr, 0) : 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t blockSize = SECTOR_SIZE_W25Q128_4KB;
+    uint32_t cacheSize = PAGE_SIZE_W25Q128_256B;
+    uint32_t lookahead = 16;
+    uint32_t readSize = PAGE_SIZE_W25Q128_256B;
+    uint32_t progSize = PAGE_SIZE_W25Q128_256B;
+    int32_t cycles = 500;
+    uint32_t seed = BENCH_DEFAULT_SEED;
+    bool worst = false;
+    bool raw = true;
+    bool fs = true;
+    const char *image = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "--block"))
+            blockSize = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--cache"))
+            cacheSize = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--lookahead"))
+            lookahead = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--read"))
+            readSize = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--prog"))
+            progSize = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--cycles"))
+            cycles = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--seed"))
+            seed = argValue(i, argc, argv);
+        else if (!strcmp(arg, "--worst"))
+            worst = true;
+        else if (!strcmp(arg, "--image") && i + 1 < argc)
+            image = argv[++i];
+        else if (!strcmp(arg, "--raw"))
+            fs = false;
+        else if (!strcmp(arg, "--fs"))
+            raw = false;
+        else
+        {
+            fprintf(stderr, "Unknown option %s, see the head of efc_hostbench.cpp\n", arg);
+            return 2;
+        }
+    }
+    if (!blockSize || blockSize % SECTOR_SIZE_W25Q128_4KB)
+    {
+        fprintf(stderr, "--block must be a multiple of %u\n", SECTOR_SIZE_W25Q128_4KB);
+        return 2;
+    }
+
+    W25Q128Emu &chip = W25Q128Emu::chip();
+    if (image ? !chip.openFile(image) : !chip.openRam())
+    {
+        fprintf(stderr, "Failed to open the flash image\n");
+        return 1;
+    }
+    chip.timing() = worst ? W25Q128EmuTiming::worst() : W25Q128EmuTiming::typical();
+
+    // Same setup as ExternalFlash::setup(): partition table, then LittleFS on the littlefs partition
+    W25Q128 spiFlash;
+    spiFlash.begin();
+    ExtFlashPartitions partitions;
+    partitions.begin(&spiFlash);
+    const ExtFlashPartition *fsPartition = partitions.find(EFP_TYPE_LITTLEFS);
+    static uint32_t fsOffset = fsPartition ? fsPartition->offset : SECTOR_SIZE_W25Q128_4KB;
+    const uint32_t fsSize = fsPartition ? fsPartition->size - fsPartition->size % blockSize : 0;
+
+    lfs_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.context = &fsOffset;
+    cfg.read = countRead;
+    cfg.prog = countProg;
+    cfg.erase = countErase;
+    cfg.sync = countSync;
+    cfg.read_size = readSize;
+    cfg.prog_size = progSize;
+    cfg.block_size = blockSize;
+    cfg.block_count = fsSize / blockSize;
+    cfg.block_cycles = cycles;
+    cfg.cache_size = cacheSize;
+    cfg.lookahead_size = lookahead;
+    cfg.name_max = 255;
+
+    uint8_t start = 0;
+    auto *impl = new ext_littlefs_impl::ext_LittleFSImpl(&start, fsSize, progSize, blockSize, 16);
+    impl->setLFSConfig(cfg);
+    FS extFs = FS(FSImplPtr(impl));
+    const bool mounted = fsSize && extFs.begin();
+
+    printf("{\n  \"config\": {\"block_size\": %lu, \"block_count\": %lu, \"cache_size\": %lu, \"lookahead_size\": %lu, "
+           "\"read_size\": %lu, \"prog_size\": %lu, \"block_cycles\": %ld, \"seed\": %lu, \"timing\": \"%s\", \"mounted\": %s},\n"
+           "  \"workloads\": [",
+           (unsigned long)blockSize, (unsigned long)cfg.block_count, (unsigned long)cacheSize, (unsigned long)lookahead,
+           (unsigned long)readSize, (unsigned long)progSize, (long)cycles, (unsigned long)seed, worst ? "worst" : "typical",
+           mounted ? "true" : "false");
+
+    ExtFlashBench bench(seed);
+    bench.onStart(onStart);
+    int rc = 0;
+    if (raw)
+    {
+        // ext_LittleFSImpl::begin() points W25Q128::instance to its own driver, raw access uses the same one
+        ExtFlashRawPartition area;
+        if (!area.begin(W25Q128::instance, partitions.find("ota")) || !bench.runRaw(area, onResult))
+        {
+            rc = 1;
+        }
+    }
+    if (fs && (!mounted || !bench.runFs(extFs, onResult)))
+    {
+        rc = 1;
+    }
+    printf("\n  ]\n}\n");
+    extFs.end();
+    return rc;
+}
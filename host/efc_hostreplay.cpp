@@ -0,0 +1,210 @@
+/**
+ * @file        efc_hostreplay.cpp
+ * @brief       Replays a block device trace recorded with "efc trace" against the W25Q128 emulation and prints
+ *              the device time per operation as JSON
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ *
+ * Usage: efc_hostreplay [options] <console log of "efc trace dump">
+ *   --worst              worst case datasheet timing instead of typical
+ *   --spi <hz>           SPI clock of the emulation (8000000)
+ *   --cache <bytes>      model a read cache of this size in front of the device, like the lfs rcache (0: off)
+ *
+ * The lines of the dump ("TR <us> <op> <block> <off> <size>") may carry a console prefix. The calls go through the
+ * unchanged W25Q128 lfs callbacks with the block size of the trace. The cache model serves reads that fall into the
+ * last line read from the same block, a miss reads a cache aligned line. A prog or erase of the block drops the
+ * line. Prog merging of the lfs pcache is not modeled, the progs are replayed as recorded.
+ */
+#include "ExtFlashTrace.h"
+#include "W25Q128Emu.h"
+#include <algorithm>
+#include <vector>
+
+// Replay results of one op
+struct ReplayOp
+{
+    const char *name;             // Name in the JSON
+    uint64_t bytes = 0;           // Bytes of the recorded calls
+    uint64_t deviceNs = 0;        // Simulated time of the calls
+    std::vector<uint32_t> samples; // Latency of each call in us
+};
+
+int main(int argc, char **argv)
+{
+    bool worst = false;
+    uint32_t spiHz = 0;
+    uint32_t cacheSize = 0;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--worst"))
+            worst = true;
+        else if (!strcmp(argv[i], "--spi") && i + 1 < argc)
+            spiHz = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--cache") && i + 1 < argc)
+            cacheSize = strtoul(argv[++i], nullptr, 0);
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            fprintf(stderr, "Unknown option %s, see the head of efc_hostreplay.cpp\n", argv[i]);
+            return 2;
+        }
+    }
+    FILE *in = path ? fopen(path, "r") : stdin;
+    if (!in)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+
+    W25Q128Emu &chip = W25Q128Emu::chip();
+    chip.openRam();
+    chip.timing() = worst ? W25Q128EmuTiming::worst() : W25Q128EmuTiming::typical();
+    if (spiHz)
+    {
+        chip.timing().spiHz = spiHz;
+    }
+    W25Q128 flash;
+    flash.begin();
+
+    // The filesystem starts behind the partition table like in the default layout
+    static uint32_t fsOffset = SECTOR_SIZE_W25Q128_4KB;
+    lfs_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.context = &fsOffset;
+    cfg.block_size = SECTOR_SIZE_W25Q128_4KB;
+
+    ReplayOp ops[4];
+    ops[0].name = "read";
+    ops[1].name = "prog";
+    ops[2].name = "erase";
+    ops[3].name = "sync";
+    std::vector<uint8_t> buffer;
+    int32_t lineBlock = -1; // Block of the cached line, -1 if none
+    uint32_t lineOff = 0;   // Start of the cached line
+    uint32_t lineSize = 0;  // Size of the cached line
+    uint64_t hits = 0, misses = 0, calls = 0;
+    uint32_t firstUs = 0, lastUs = 0;
+    const W25Q128EmuStats start = chip.stats();
+    const uint64_t startNs = chip.now();
+
+    char line[256];
+    while (fgets(line, sizeof(line), in))
+    {
+        const char *tr = strstr(line, "TR ");
+        if (!tr)
+        {
+            continue;
+        }
+        unsigned long blockSize, blockCount;
+        if (sscanf(tr, "TR config %lu %lu", &blockSize, &blockCount) == 2)
+        {
+            cfg.block_size = blockSize ? blockSize : SECTOR_SIZE_W25Q128_4KB;
+            cfg.block_count = blockCount;
+            continue;
+        }
+        unsigned long us, block, off, size;
+        char op;
+        if (sscanf(tr, "TR %lu %c %lu %lu %lu", &us, &op, &block, &off, &size) != 5 || islower((uint8_t)op))
+        {
+            // File operations are replayed by efc_hosttune
+            continue;
+        }
+        if (fsOffset + (block + 1) * cfg.block_size > FLASH_SIZE_W25Q128 || off + size > cfg.block_size)
+        {
+            fprintf(stderr, "Skipped call outside of the chip: %s", tr);
+            continue;
+        }
+        firstUs = calls++ ? firstUs : us;
+        lastUs = us;
+        if (buffer.size() < size)
+        {
+            buffer.resize(size, 0x00);
+        }
+
+        const uint64_t t0 = chip.now();
+        ReplayOp *r = nullptr;
+        switch (op)
+        {
+            case TRACE_OP_READ:
+                r = &ops[0];
+                if (!cacheSize)
+                {
+                    W25Q128::lfs_read(&cfg, block, off, buffer.data(), size);
+                }
+                else if ((int32_t)block == lineBlock && off >= lineOff && off + size <= lineOff + lineSize)
+                {
+                    hits++;
+                }
+                else
+                {
+                    // Miss: read the cache aligned line, at least the requested bytes, within the block
+                    misses++;
+                    lineOff = off - off % cacheSize;
+                    lineSize = std::max<uint32_t>(cacheSize, off + size - lineOff);
+                    lineSize = std::min<uint32_t>(lineSize, cfg.block_size - lineOff);
+                    lineBlock = block;
+                    if (buffer.size() < lineSize)
+                    {
+                        buffer.resize(lineSize, 0x00);
+                    }
+                    W25Q128::lfs_read(&cfg, block, lineOff, buffer.data(), lineSize);
+                }
+                break;
+            case TRACE_OP_PROG:
+                r = &ops[1];
+                lineBlock = (int32_t)block == lineBlock ? -1 : lineBlock;
+                memset(buffer.data(), 0x00, size);
+                W25Q128::lfs_prog(&cfg, block, off, buffer.data(), size);
+                break;
+            case TRACE_OP_ERASE:
+                r = &ops[2];
+                lineBlock = (int32_t)block == lineBlock ? -1 : lineBlock;
+                W25Q128::lfs_erase(&cfg, block);
+                break;
+            case TRACE_OP_SYNC:
+                r = &ops[3];
+                W25Q128::lfs_sync(&cfg);
+                break;
+            default:
+                continue;
+        }
+        const uint64_t ns = chip.now() - t0;
+        r->bytes += size;
+        r->deviceNs += ns;
+        r->samples.push_back(ns / 1000);
+    }
+    if (path)
+    {
+        fclose(in);
+    }
+
+    const W25Q128EmuStats &s = chip.stats();
+    printf("{\n  \"config\": {\"block_size\": %lu, \"block_count\": %lu, \"timing\": \"%s\", \"spi_hz\": %lu, \"cache_size\": %lu},\n",
+           (unsigned long)cfg.block_size, (unsigned long)cfg.block_count, worst ? "worst" : "typical", (unsigned long)chip.timing().spiHz,
+           (unsigned long)cacheSize);
+    printf("  \"calls\": %llu, \"recorded_us\": %lu, \"device_us\": %llu, \"spi_bytes\": %llu, \"transactions\": %llu, "
+           "\"page_programs\": %llu, \"sector_erases\": %llu, \"status_polls\": %llu, \"busy_us\": %llu, \"cache_hits\": %llu, "
+           "\"cache_misses\": %llu,\n  \"ops\": [",
+           (unsigned long long)calls, (unsigned long)(lastUs - firstUs), (unsigned long long)((chip.now() - startNs) / 1000),
+           (unsigned long long)(s.spiBytes - start.spiBytes), (unsigned long long)(s.transactions - start.transactions),
+           (unsigned long long)(s.pagePrograms - start.pagePrograms), (unsigned long long)(s.sectorErases - start.sectorErases),
+           (unsigned long long)(s.statusPolls - start.statusPolls), (unsigned long long)((s.busyNs - start.busyNs) / 1000),
+           (unsigned long long)hits, (unsigned long long)misses);
+    for (int i = 0; i < 4; i++)
+    {
+        std::vector<uint32_t> &v = ops[i].samples;
+        std::sort(v.begin(), v.end());
+        const size_t n = v.size();
+        printf("%s\n    {\"name\": \"%s\", \"ops\": %zu, \"bytes\": %llu, \"device_us\": %llu, \"p50_us\": %lu, \"p99_us\": %lu, \"max_us\": %lu}",
+               i ? "," : "", ops[i].name, n, (unsigned long long)ops[i].bytes, (unsigned long long)(ops[i].deviceNs / 1000),
+               (unsigned long)(n ? v[(n - 1) * 50 / 100] : 0), (unsigned long)(n ? v[(n - 1) * 99 / 100] : 0),
+               (unsigned long)(n ? v[n - 1] : 0));
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
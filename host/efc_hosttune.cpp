@@ -0,0 +1,491 @@
+/**
+ * @file        efc_hosttune.cpp
+ * @brief       Runs the file operations of a trace recorded with "efc trace" with a sweep of LittleFS
+ *              configurations on the W25Q128 emulation and prints the Pareto-optimal ones as JSON
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ *
+ * Usage: efc_hosttune [options] <console log of "efc trace dump">
+ *   --cache <list>       cache_size values in bytes (256,512,1024)
+ *   --lookahead <list>   lookahead_size values in bytes, multiples of 8 (16,64)
+ *   --block <list>       block_size values in bytes, multiples of 4096 (4096,8192)
+ *   --inline <list>      inline_max values in bytes, 0 default, -1 off (0,-1)
+ *   --metadata <list>    metadata_max values in percent of the block size, 0 default (0,50)
+ *   --compact <list>     compact_thresh values in percent of the block size, 0 default, >= 50 (0)
+ *   --worst              worst case datasheet timing instead of typical
+ *
+ * Every combination gets a freshly formatted filesystem on an erased chip, with the directories and the files the
+ * trace uses before it creates them. Names are the path hashes, in the directory tree of the trace. Then the file operations run through ext_LittleFSImpl with the lfs callbacks of the driver, like
+ * on the device. Each configuration is rated by:
+ *   - p99_us     p99 latency of the file operations (simulated device time)
+ *   - device_us  device time of the whole trace, the inverse of the throughput
+ *   - ram        heap of littlefs: read and program cache, lookahead buffer, one cache per open file
+ *   - erases     sector erases, the wear
+ * A configuration is Pareto-optimal if no other one is at least as good in all four and better in one. The
+ * recommendation is the Pareto-optimal one with the smallest sum of the four relative to their best values.
+ */
+#include "ExtFlashPartitions.h"
+#include "ExtFlashTrace.h"
+#include "W25Q128Emu.h"
+#include "ext_LittleFS.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace ext_littlefs_impl;
+
+// Configuration of one run
+struct TuneConfig
+{
+    uint32_t cacheSize;
+    uint32_t lookahead;
+    uint32_t blockSize;
+    int32_t inlineMax;    // 0 default, -1 off
+    uint32_t metadataPct; // Percent of the block size, 0 default
+    uint32_t compactPct;  // Percent of the block size, 0 default
+};
+
+// Ratings of one run
+struct TuneResult
+{
+    TuneConfig cfg;
+    bool ok;             // Mounted and all operations ran
+    uint64_t deviceUs;   // Device time of the trace
+    uint32_t p50Us;      // Median latency of the file operations
+    uint32_t p99Us;      // p99 latency of the file operations
+    uint32_t ram;        // Heap of littlefs
+    uint64_t erases;     // Sector erases
+    uint32_t maxErases;  // Erases of the most erased sector
+    uint64_t spiBytes;   // SPI bytes
+    bool pareto;         // Pareto-optimal
+};
+
+static std::vector<ExtFlashTraceRecord> fileOps; // File operations of the trace
+static std::map<uint32_t, uint32_t> preSize;     // Path hash -> size of a file that exists before the trace
+static std::map<uint32_t, uint32_t> parents;     // Path hash -> hash of the parent directory, 0 at the root
+static std::map<uint32_t, uint16_t> preDirs;     // Hash of a directory that exists before the trace -> depth
+static uint32_t maxOpen = 1;                     // Max files open at the same time
+
+static std::vector<long> parseList(const char *arg)
+{
+    std::vector<long> values;
+    for (const char *p = arg; p && *p;)
+    {
+        char *end;
+        values.push_back(strtol(p, &end, 0));
+        p = *end == ',' ? end + 1 : nullptr;
+    }
+    return values;
+}
+
+/**
+ * @brief Path of a hash in the directory tree of the trace, one component "t<hash>" per level
+ */
+static void pathOf(uint32_t hash, char *path, size_t size)
+{
+    uint32_t chain[EXTFLASH_PATH_MAX / 10];
+    uint8_t depth = 0;
+    for (uint32_t h = hash; h && depth < sizeof(chain) / sizeof(chain[0]); h = parents.count(h) ? parents[h] : 0)
+    {
+        chain[depth++] = h;
+    }
+    int len = 0;
+    path[0] = 0;
+    while (depth && len < (int)size)
+    {
+        len += snprintf(path + len, size - len, "/t%08lx", (unsigned long)chain[--depth]);
+    }
+}
+
+static time_t replayTime()
+{
+    return 1767225600 + millis() / 1000;
+}
+
+/**
+ * @brief Read the file operations of the trace. Files that are read without being created or truncated first
+ *        existed on the device, they are created with the size read from them
+ */
+static bool loadTrace(FILE *in)
+{
+    char line[256];
+    std::map<uint16_t, uint32_t> handles; // Open handle -> path hash
+    std::map<uint16_t, uint32_t> pos;     // Open handle -> position
+    std::map<uint32_t, bool> known;       // Path hash -> created or truncated by the trace
+    std::map<uint32_t, uint16_t> depths;  // Path hash -> depth
+    std::map<uint32_t, bool> made;        // Hash of a directory -> created by the trace
+    while (fgets(line, sizeof(line), in))
+    {
+        const char *tr = strstr(line, "TR ");
+        unsigned long us, block, off, size;
+        char op;
+        if (!tr || sscanf(tr, "TR %lu %c %lu %lu %lu", &us, &op, &block, &off, &size) != 5 || !islower((uint8_t)op))
+        {
+            continue;
+        }
+        if (op == TRACE_OP_PATH)
+        {
+            parents[off] = size;
+            depths[off] = block;
+            if (size && !made.count(size))
+            {
+                made[size] = false; // A directory used before the trace creates it
+            }
+            continue;
+        }
+        if (op != TRACE_OP_REMOVE && op != TRACE_OP_MKDIR && op != TRACE_OP_RENAME_FROM && op != TRACE_OP_RENAME_TO &&
+            (block == TRACE_NO_FILE || (op != TRACE_OP_OPEN && !handles.count(block))))
+        {
+            continue; // File opened before the trace started
+        }
+        if (op == TRACE_OP_MKDIR && !made.count(off))
+        {
+            made[off] = true;
+        }
+        ExtFlashTraceRecord r = {(uint32_t)us, (uint16_t)block, (uint8_t)op, 0, (uint32_t)off, (uint32_t)size};
+        fileOps.push_back(r);
+        switch (op)
+        {
+            case TRACE_OP_OPEN:
+                handles[block] = off;
+                pos[block] = 0;
+                if (!known.count(off))
+                {
+                    known[off] = (size & LFS_O_TRUNC) || !(size & LFS_O_RDONLY);
+                }
+                maxOpen = std::max<uint32_t>(maxOpen, handles.size());
+                break;
+            case TRACE_OP_READFILE:
+                pos[block] += size;
+                if (!known[handles[block]])
+                {
+                    preSize[handles[block]] = std::max(preSize[handles[block]], pos[block]);
+                }
+                break;
+            case TRACE_OP_WRITE:
+                pos[block] += size;
+                known[handles[block]] = true;
+                break;
+            case TRACE_OP_SEEK:
+                pos[block] = size;
+                break;
+            case TRACE_OP_CLOSE:
+                handles.erase(block);
+                break;
+            default:
+                break;
+        }
+    }
+    for (auto &dir : made)
+    {
+        if (!dir.second)
+        {
+            preDirs[dir.first] = depths[dir.first];
+        }
+    }
+    return !fileOps.empty();
+}
+
+/**
+ * @brief Format, prepare and run the trace with one configuration
+ */
+static TuneResult run(const TuneConfig &tc, bool worst)
+{
+    TuneResult res;
+    memset(&res, 0, sizeof(res));
+    res.cfg = tc;
+
+    W25Q128Emu &chip = W25Q128Emu::chip();
+    chip.openRam();
+    chip.timing() = worst ? W25Q128EmuTiming::worst() : W25Q128EmuTiming::typical();
+    W25Q128 spiFlash;
+    spiFlash.begin();
+    ExtFlashPartitions partitions;
+    partitions.begin(&spiFlash);
+    const ExtFlashPartition *fsPartition = partitions.find(EFP_TYPE_LITTLEFS);
+    static uint32_t fsOffset;
+    fsOffset = fsPartition ? fsPartition->offset : SECTOR_SIZE_W25Q128_4KB;
+    const uint32_t fsSize = fsPartition ? fsPartition->size : 0;
+
+    // Same as ExternalFlash::setupExternalConfig() with the values of the sweep
+    lfs_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.context = &fsOffset;
+    cfg.read = W25Q128::lfs_read;
+    cfg.prog = W25Q128::lfs_prog;
+    cfg.erase = W25Q128::lfs_erase;
+    cfg.sync = W25Q128::lfs_sync;
+    cfg.read_size = PAGE_SIZE_W25Q128_256B;
+    cfg.prog_size = PAGE_SIZE_W25Q128_256B;
+    cfg.block_size = tc.blockSize;
+    cfg.block_count = fsSize / tc.blockSize;
+    cfg.block_cycles = 500;
+    cfg.cache_size = tc.cacheSize;
+    cfg.lookahead_size = tc.lookahead;
+    cfg.compact_thresh = tc.compactPct ? tc.blockSize / 100 * tc.compactPct : 0;
+    cfg.name_max = 255;
+    cfg.metadata_max = tc.metadataPct ? tc.blockSize / 100 * tc.metadataPct / tc.cacheSize * tc.cacheSize : 0;
+    cfg.inline_max = tc.inlineMax;
+
+    uint8_t start = 0;
+    auto *impl = new ext_LittleFSImpl(&start, fsSize, PAGE_SIZE_W25Q128_256B, tc.blockSize, 16);
+    impl->setLFSConfig(cfg);
+    FS fs = FS(FSImplPtr(impl));
+    if (!fs.format() || !fs.begin())
+    {
+        return res;
+    }
+    fs.setTimeCallback(replayTime);
+
+    char path[EXTFLASH_PATH_MAX];
+    std::vector<uint8_t> buffer(4096, 0x5A);
+    for (uint16_t depth = 1; depth <= EXTFLASH_PATH_MAX / 10; depth++)
+    {
+        // Parents first
+        for (auto &dir : preDirs)
+        {
+            if (dir.second == depth)
+            {
+                pathOf(dir.first, path, sizeof(path));
+                impl->mkdir(path);
+            }
+        }
+    }
+    for (auto &file : preSize)
+    {
+        pathOf(file.first, path, sizeof(path));
+        File f = fs.open(path, "w");
+        for (uint32_t left = file.second; left;)
+        {
+            const uint32_t n = std::min<uint32_t>(left, buffer.size());
+            f.write(buffer.data(), n);
+            left -= n;
+        }
+        f.close();
+    }
+
+    chip.resetStats();
+    const uint64_t startNs = chip.now();
+    std::map<uint16_t, FileImplPtr> files;
+    std::vector<uint32_t> samples;
+    char renameFrom[EXTFLASH_PATH_MAX] = "";
+    res.ok = true;
+    for (const ExtFlashTraceRecord &r : fileOps)
+    {
+        if (buffer.size() < r.size && (r.op == TRACE_OP_WRITE || r.op == TRACE_OP_READFILE))
+        {
+            buffer.resize(r.size, 0x5A);
+        }
+        const uint64_t t0 = chip.now();
+        FileImplPtr file = files.count(r.block) ? files[r.block] : FileImplPtr();
+        pathOf(r.off, path, sizeof(path));
+        switch (r.op)
+        {
+            case TRACE_OP_OPEN:
+                file = impl->open(path, (OpenMode)(((r.size & LFS_O_CREAT) ? OM_CREATE : 0) | ((r.size & LFS_O_APPEND) ? OM_APPEND : 0) |
+                                                   ((r.size & LFS_O_TRUNC) ? OM_TRUNCATE : 0)),
+                                  (AccessMode)(((r.size & LFS_O_RDONLY) ? AM_READ : 0) | ((r.size & LFS_O_WRONLY) ? AM_WRITE : 0)));
+                if (file)
+                {
+                    file->setTimeCallback(replayTime);
+                    files[r.block] = file;
+                }
+                break;
+            case TRACE_OP_WRITE:
+                if (file)
+                    file->write(buffer.data(), r.size);
+                break;
+            case TRACE_OP_READFILE:
+                if (file)
+                    file->read(buffer.data(), r.size);
+                break;
+            case TRACE_OP_FLUSH:
+                if (file)
+                    file->flush();
+                break;
+            case TRACE_OP_SEEK:
+                if (file)
+                    file->seek(r.size, SeekSet);
+                break;
+            case TRACE_OP_TRUNCATE:
+                if (file)
+                    file->truncate(r.size);
+                break;
+            case TRACE_OP_CLOSE:
+                if (file)
+                    file->close();
+                files.erase(r.block);
+                break;
+            case TRACE_OP_REMOVE:
+                impl->remove(path);
+                break;
+            case TRACE_OP_MKDIR:
+                impl->mkdir(path);
+                break;
+            case TRACE_OP_RENAME_FROM:
+                strcpy(renameFrom, path);
+                continue;
+            case TRACE_OP_RENAME_TO:
+                impl->rename(renameFrom, path);
+                break;
+            default:
+                continue;
+        }
+        samples.push_back((chip.now() - t0) / 1000);
+    }
+    files.clear();
+    res.deviceUs = (chip.now() - startNs) / 1000;
+    fs.end();
+
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    res.p50Us = n ? samples[(n - 1) * 50 / 100] : 0;
+    res.p99Us = n ? samples[(n - 1) * 99 / 100] : 0;
+    res.ram = 2 * tc.cacheSize + tc.lookahead + maxOpen * tc.cacheSize;
+    const W25Q128EmuStats &s = chip.stats();
+    res.erases = s.sectorErases + s.blockErases * (EMU_BLOCK_SIZE / EMU_SECTOR_SIZE);
+    res.spiBytes = s.spiBytes;
+    for (uint32_t sector = 0; sector < EMU_FLASH_SIZE / EMU_SECTOR_SIZE; sector++)
+    {
+        res.maxErases = std::max(res.maxErases, chip.eraseCount(sector));
+    }
+    return res;
+}
+
+/**
+ * @brief Check the limits littlefs asserts on
+ */
+static bool valid(const TuneConfig &tc)
+{
+    const uint32_t metadataMax = tc.metadataPct ? tc.blockSize / 100 * tc.metadataPct / tc.cacheSize * tc.cacheSize : tc.blockSize;
+    return tc.cacheSize >= PAGE_SIZE_W25Q128_256B && tc.cacheSize % PAGE_SIZE_W25Q128_256B == 0 && tc.blockSize % tc.cacheSize == 0 &&
+           tc.blockSize % SECTOR_SIZE_W25Q128_4KB == 0 && tc.lookahead && tc.lookahead % 8 == 0 && tc.metadataPct <= 100 && metadataMax &&
+           (tc.compactPct == 0 || (tc.compactPct >= 50 && tc.compactPct <= 100)) &&
+           (tc.inlineMax <= 0 || ((uint32_t)tc.inlineMax <= tc.cacheSize && (uint32_t)tc.inlineMax <= metadataMax / 8));
+}
+
+static bool dominates(const TuneResult &a, const TuneResult &b)
+{
+    const bool le = a.p99Us <= b.p99Us && a.deviceUs <= b.deviceUs && a.ram <= b.ram && a.erases <= b.erases;
+    const bool lt = a.p99Us < b.p99Us || a.deviceUs < b.deviceUs || a.ram < b.ram || a.erases < b.erases;
+    return le && lt;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<long> caches = {256, 512, 1024};
+    std::vector<long> lookaheads = {16, 64};
+    std::vector<long> blocks = {4096, 8192};
+    std::vector<long> inlines = {0, -1};
+    std::vector<long> metadatas = {0, 50};
+    std::vector<long> compacts = {0};
+    bool worst = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--worst"))
+            worst = true;
+        else if (!strcmp(arg, "--cache") && value)
+            caches = parseList(argv[++i]);
+        else if (!strcmp(arg, "--lookahead") && value)
+            lookaheads = parseList(argv[++i]);
+        else if (!strcmp(arg, "--block") && value)
+            blocks = parseList(argv[++i]);
+        else if (!strcmp(arg, "--inline") && value)
+            inlines = parseList(argv[++i]);
+        else if (!strcmp(arg, "--metadata") && value)
+            metadatas = parseList(argv[++i]);
+        else if (!strcmp(arg, "--compact") && value)
+            compacts = parseList(argv[++i]);
+        else if (arg[0] != '-' && !path)
+            path = arg;
+        else
+        {
+            fprintf(stderr, "Unknown option %s, see the head of efc_hosttune.cpp\n", arg);
+            return 2;
+        }
+    }
+    FILE *in = path ? fopen(path, "r") : stdin;
+    if (!in || !loadTrace(in))
+    {
+        fprintf(stderr, "No file operations in the trace\n");
+        return 1;
+    }
+
+    std::vector<TuneResult> results;
+    for (long block : blocks)
+        for (long cache : caches)
+            for (long lookahead : lookaheads)
+                for (long inlineMax : inlines)
+                    for (long metadata : metadatas)
+                        for (long compact : compacts)
+                        {
+                            const TuneConfig tc = {(uint32_t)cache, (uint32_t)lookahead, (uint32_t)block, (int32_t)inlineMax, (uint32_t)metadata,
+                                                   (uint32_t)compact};
+                            if (!valid(tc))
+                            {
+                                continue;
+                            }
+                            const TuneResult r = run(tc, worst);
+                            if (r.ok)
+                            {
+                                results.push_back(r);
+                            }
+                        }
+    if (results.empty())
+    {
+        fprintf(stderr, "No valid configuration\n");
+        return 1;
+    }
+
+    // Pareto front and the recommendation
+    TuneResult best = results[0];
+    for (const TuneResult &r : results)
+    {
+        best.p99Us = std::min(best.p99Us, r.p99Us);
+        best.deviceUs = std::min(best.deviceUs, r.deviceUs);
+        best.ram = std::min(best.ram, r.ram);
+        best.erases = std::min(best.erases, r.erases);
+    }
+    int recommended = -1;
+    double recommendedScore = 0;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        TuneResult &r = results[i];
+        r.pareto = std::none_of(results.begin(), results.end(), [&](const TuneResult &o) { return dominates(o, r); });
+        const double score = (double)r.p99Us / std::max<uint32_t>(best.p99Us, 1) + (double)r.deviceUs / std::max<uint64_t>(best.deviceUs, 1) +
+                             (double)r.ram / std::max<uint32_t>(best.ram, 1) + (double)r.erases / std::max<uint64_t>(best.erases, 1);
+        if (r.pareto && (recommended < 0 || score < recommendedScore))
+        {
+            recommended = i;
+            recommendedScore = score;
+        }
+    }
+
+    printf("{\n  \"file_ops\": %zu, \"files_before\": %zu, \"max_open\": %lu, \"timing\": \"%s\",\n  \"results\": [", fileOps.size(), preSize.size(),
+           (unsigned long)maxOpen, worst ? "worst" : "typical");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const TuneResult &r = results[i];
+        printf("%s\n    {\"block_size\": %lu, \"cache_size\": %lu, \"lookahead_size\": %lu, \"inline_max\": %ld, \"metadata_pct\": %lu, "
+               "\"compact_pct\": %lu,\n     \"p50_us\": %lu, \"p99_us\": %lu, \"device_us\": %llu, \"ram\": %lu, \"erases\": %llu, "
+               "\"max_sector_erases\": %lu, \"spi_bytes\": %llu, \"pareto\": %s}",
+               i ? "," : "", (unsigned long)r.cfg.blockSize, (unsigned long)r.cfg.cacheSize, (unsigned long)r.cfg.lookahead, (long)r.cfg.inlineMax,
+               (unsigned long)r.cfg.metadataPct, (unsigned long)r.cfg.compactPct, (unsigned long)r.p50Us, (unsigned long)r.p99Us,
+               (unsigned long long)r.deviceUs, (unsigned long)r.ram, (unsigned long long)r.erases, (unsigned long)r.maxErases,
+               (unsigned long long)r.spiBytes, r.pareto ? "true" : "false");
+    }
+    const TuneConfig &rc = results[recommended].cfg;
+    const uint32_t compactThresh = rc.compactPct ? rc.blockSize / 100 * rc.compactPct : 0;
+    const uint32_t metadataMax = rc.metadataPct ? rc.blockSize / 100 * rc.metadataPct / rc.cacheSize * rc.cacheSize : 0;
+    printf("\n  ],\n  \"recommended\": %d,\n  \"build_flags\": \"-DEXTFLASH_LFS_BLOCK_SIZE=%lu -DEXTFLASH_LFS_CACHE_SIZE=%lu "
+           "-DEXTFLASH_LFS_LOOKAHEAD_SIZE=%lu -DEXTFLASH_LFS_INLINE_MAX=%ld -DEXTFLASH_LFS_METADATA_MAX=%lu -DEXTFLASH_LFS_COMPACT_THRESH=%lu\"\n}\n",
+           recommended, (unsigned long)rc.blockSize, (unsigned long)rc.cacheSize, (unsigned long)rc.lookahead, (long)rc.inlineMax,
+           (unsigned long)metadataMax, (unsigned long)compactThresh);
+    return 0;
+}
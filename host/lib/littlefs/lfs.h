@@ -0,0 +1,4 @@
+#pragma once
+// W25Q128.h includes "../lib/littlefs/lfs.h", which resolves to this file with -Ihost/shim.
+// The littlefs sources come from the include path, see host/README.md
+#include <lfs.h>
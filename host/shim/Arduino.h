@@ -0,0 +1,133 @@
+#pragma once
+/**
+ * @file        Arduino.h
+ * @brief       Host shim of the Arduino API used by the ExternalFlash sources. Time is the simulated
+ *              time of the flash emulation, GPIOs are ignored
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define XIP_BASE 0x10000000
+
+#define DEBUGV(...) \
+    do              \
+    {               \
+    } while (0)
+#define __not_in_flash_func(x) x
+
+using std::max;
+using std::min;
+
+// Time, simulated by the flash emulation
+unsigned long millis();
+unsigned long micros();
+uint64_t time_us_64();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// GPIOs and interrupts, no effect on the host
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline uint32_t get_core_num() { return 0; }
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// Minimal String, as far as the sources use it
+class String
+{
+  public:
+    String(const char *s = "") : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    inline const char *c_str() const { return _s.c_str(); }
+    inline unsigned length() const { return _s.length(); }
+    inline char operator[](unsigned i) const { return _s[i]; }
+    inline String &operator+=(const String &s) { _s += s._s; return *this; }
+    inline String &operator+=(const char *s) { _s += s; return *this; }
+    inline String &operator+=(char c) { _s += c; return *this; }
+    inline bool operator==(const String &s) const { return _s == s._s; }
+    inline bool startsWith(const String &s) const { return _s.compare(0, s._s.length(), s._s) == 0; }
+    inline String substring(unsigned from, unsigned to = ~0u) const { return String(_s.substr(from, to - from)); }
+
+  private:
+    std::string _s;
+};
+inline String operator+(const String &a, const String &b) { return String(std::string(a.c_str()) + b.c_str()); }
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (n < size && write(buffer[n]))
+        {
+            n++;
+        }
+        return n;
+    }
+    inline size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    inline size_t print(const char *s) { return write(s); }
+    inline size_t println(const char *s = "") { return print(s) + print("\n"); }
+    size_t printf(const char *format, ...);
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// Serial writes to stdout
+class HostSerial : public Stream
+{
+  public:
+    inline void begin(unsigned long) {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    inline int available() override { return 0; }
+    inline int read() override { return -1; }
+    inline int peek() override { return -1; }
+    inline operator bool() const { return true; }
+};
+extern HostSerial Serial;
+
+// rp2040 core object, the other core doesn't exist on the host
+struct HostRP2040
+{
+    inline void idleOtherCore() {}
+    inline void resumeOtherCore() {}
+    inline void reboot() { exit(0); }
+    inline uint32_t getFreeHeap() { return 0; }
+};
+extern HostRP2040 rp2040;
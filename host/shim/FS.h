@@ -0,0 +1,233 @@
+#pragma once
+/**
+ * @file        FS.h
+ * @brief       Host shim of the arduino-pico FS interfaces implemented by ext_LittleFSImpl, and the
+ *              File/Dir/FS wrappers around them
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include "Arduino.h"
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+    enum OpenMode
+    {
+        OM_DEFAULT = 0,
+        OM_CREATE = 1,
+        OM_APPEND = 2,
+        OM_TRUNCATE = 4
+    };
+    enum AccessMode
+    {
+        AM_READ = 1,
+        AM_WRITE = 2,
+        AM_RW = AM_READ | AM_WRITE
+    };
+
+    struct FSInfo
+    {
+        size_t totalBytes;
+        size_t usedBytes;
+        size_t blockSize;
+        size_t pageSize;
+        size_t maxOpenFiles;
+        size_t maxPathLength;
+    };
+
+    struct FSStat
+    {
+        size_t size;
+        size_t blocksize;
+        time_t ctime;
+        time_t atime;
+        bool isDir;
+    };
+
+    class FSConfig
+    {
+      public:
+        FSConfig(uint32_t type = 0, bool autoFormat = true) : _type(type), _autoFormat(autoFormat) {}
+        uint32_t _type;
+        bool _autoFormat;
+    };
+
+    class FileImpl
+    {
+      public:
+        virtual ~FileImpl() {}
+        virtual size_t write(const uint8_t *buf, size_t size) = 0;
+        virtual int read(uint8_t *buf, size_t size) = 0;
+        virtual void flush() = 0;
+        virtual bool seek(uint32_t pos, SeekMode mode) = 0;
+        virtual size_t position() const = 0;
+        virtual size_t size() const = 0;
+        virtual bool truncate(uint32_t size) = 0;
+        virtual void close() = 0;
+        virtual time_t getLastWrite() { return 0; }
+        virtual time_t getCreationTime() { return 0; }
+        virtual const char *name() const = 0;
+        virtual const char *fullName() const = 0;
+        virtual bool isFile() const = 0;
+        virtual bool isDirectory() const = 0;
+        inline void setTimeCallback(time_t (*cb)(void)) { _timeCallback = cb; }
+
+      protected:
+        time_t (*_timeCallback)(void) = nullptr;
+    };
+    typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+    class DirImpl
+    {
+      public:
+        virtual ~DirImpl() {}
+        virtual FileImplPtr openFile(OpenMode openMode, AccessMode accessMode) = 0;
+        virtual const char *fileName() = 0;
+        virtual size_t fileSize() = 0;
+        virtual time_t fileTime() { return 0; }
+        virtual time_t fileCreationTime() { return 0; }
+        virtual bool isFile() const = 0;
+        virtual bool isDirectory() const = 0;
+        virtual bool next() = 0;
+        virtual bool rewind() = 0;
+        inline void setTimeCallback(time_t (*cb)(void)) { _timeCallback = cb; }
+
+      protected:
+        time_t (*_timeCallback)(void) = nullptr;
+    };
+    typedef std::shared_ptr<DirImpl> DirImplPtr;
+
+    class FSImpl
+    {
+      public:
+        virtual ~FSImpl() {}
+        virtual bool setConfig(const FSConfig &cfg) = 0;
+        virtual bool begin() = 0;
+        virtual void end() = 0;
+        virtual bool format() = 0;
+        virtual bool info(FSInfo &info) = 0;
+        virtual FileImplPtr open(const char *path, OpenMode openMode, AccessMode accessMode) = 0;
+        virtual bool exists(const char *path) = 0;
+        virtual DirImplPtr openDir(const char *path) = 0;
+        virtual bool rename(const char *pathFrom, const char *pathTo) = 0;
+        virtual bool remove(const char *path) = 0;
+        virtual bool mkdir(const char *path) = 0;
+        virtual bool rmdir(const char *path) = 0;
+        virtual bool stat(const char *path, FSStat *st) = 0;
+        virtual time_t getCreationTime() { return 0; }
+        inline void setTimeCallback(time_t (*cb)(void)) { _timeCallback = cb; }
+
+      protected:
+        time_t (*_timeCallback)(void) = nullptr;
+    };
+    typedef std::shared_ptr<FSImpl> FSImplPtr;
+
+    class File : public Stream
+    {
+      public:
+        File(FileImplPtr p = FileImplPtr()) : _p(p) {}
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buf, size_t size) override { return _p ? _p->write(buf, size) : 0; }
+        using Print::write;
+        int available() override { return _p ? (int)(_p->size() - _p->position()) : 0; }
+        int read() override;
+        int peek() override;
+        int read(uint8_t *buf, size_t size) { return _p ? _p->read(buf, size) : -1; }
+        void flush() override
+        {
+            if (_p)
+                _p->flush();
+        }
+        bool seek(uint32_t pos, SeekMode mode = SeekSet) { return _p && _p->seek(pos, mode); }
+        size_t position() const { return _p ? _p->position() : 0; }
+        size_t size() const { return _p ? _p->size() : 0; }
+        bool truncate(uint32_t size) { return _p && _p->truncate(size); }
+        void close()
+        {
+            if (_p)
+                _p->close();
+            _p = nullptr;
+        }
+        operator bool() const { return !!_p; }
+        const char *name() const { return _p ? _p->name() : nullptr; }
+        const char *fullName() const { return _p ? _p->fullName() : nullptr; }
+        bool isFile() const { return _p && _p->isFile(); }
+        bool isDirectory() const { return _p && _p->isDirectory(); }
+        time_t getLastWrite() { return _p ? _p->getLastWrite() : 0; }
+        time_t getCreationTime() { return _p ? _p->getCreationTime() : 0; }
+
+      protected:
+        FileImplPtr _p;
+    };
+
+    class Dir
+    {
+      public:
+        Dir(DirImplPtr p = DirImplPtr()) : _p(p) {}
+        File openFile(const char *mode);
+        String fileName() { return _p ? String(_p->fileName()) : String(); }
+        size_t fileSize() { return _p ? _p->fileSize() : 0; }
+        time_t fileTime() { return _p ? _p->fileTime() : 0; }
+        time_t fileCreationTime() { return _p ? _p->fileCreationTime() : 0; }
+        bool isFile() const { return _p && _p->isFile(); }
+        bool isDirectory() const { return _p && _p->isDirectory(); }
+        bool next() { return _p && _p->next(); }
+        bool rewind() { return _p && _p->rewind(); }
+
+      protected:
+        DirImplPtr _p;
+    };
+
+    class FS
+    {
+      public:
+        FS(FSImplPtr impl) : _impl(impl) {}
+
+        bool setConfig(const FSConfig &cfg) { return _impl && _impl->setConfig(cfg); }
+        bool begin() { return _impl && _impl->begin(); }
+        void end()
+        {
+            if (_impl)
+                _impl->end();
+        }
+        bool format() { return _impl && _impl->format(); }
+        bool info(FSInfo &info) { return _impl && _impl->info(info); }
+        File open(const char *path, const char *mode);
+        bool exists(const char *path) { return _impl && _impl->exists(path); }
+        Dir openDir(const char *path) { return Dir(_impl ? _impl->openDir(path) : DirImplPtr()); }
+        bool remove(const char *path) { return _impl && _impl->remove(path); }
+        bool rename(const char *pathFrom, const char *pathTo) { return _impl && _impl->rename(pathFrom, pathTo); }
+        bool mkdir(const char *path) { return _impl && _impl->mkdir(path); }
+        bool rmdir(const char *path) { return _impl && _impl->rmdir(path); }
+        bool stat(const char *path, FSStat *st) { return _impl && _impl->stat(path, st); }
+        time_t getCreationTime() { return _impl ? _impl->getCreationTime() : 0; }
+        void setTimeCallback(time_t (*cb)(void))
+        {
+            if (_impl)
+                _impl->setTimeCallback(cb);
+        }
+
+      protected:
+        FSImplPtr _impl;
+    };
+
+    bool getModes(const char *mode, OpenMode *openMode, AccessMode *accessMode); // fopen() style mode to modes
+} // namespace fs
+
+using fs::Dir;
+using fs::File;
+using fs::FS;
+using fs::FSInfo;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
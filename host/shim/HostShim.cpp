@@ -0,0 +1,138 @@
+/**
+ * @file        HostShim.cpp
+ * @brief       Implementation of the host shims: time from the flash emulation, SPI transfers into the
+ *              emulation, Serial to stdout and the FS wrappers
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include "../W25Q128Emu.h"
+#include "Arduino.h"
+#include "FS.h"
+#include "SPI.h"
+
+HostSerial Serial;
+HostRP2040 rp2040;
+SPIClass SPI;
+SPIClass SPI1;
+
+unsigned long millis() { return W25Q128Emu::chip().now() / 1000000ULL; }
+unsigned long micros() { return W25Q128Emu::chip().now() / 1000ULL; }
+uint64_t time_us_64() { return W25Q128Emu::chip().now() / 1000ULL; }
+void delay(unsigned long ms) { W25Q128Emu::chip().advance(ms * 1000000ULL); }
+void delayMicroseconds(unsigned int us) { W25Q128Emu::chip().advance(us * 1000ULL); }
+
+// Reproducible sequence, independent of the libc
+static uint32_t hostRandomState = 1;
+
+void randomSeed(unsigned long seed) { hostRandomState = seed ? seed : 1; }
+
+long random(long max)
+{
+    hostRandomState ^= hostRandomState << 13; // xorshift32
+    hostRandomState ^= hostRandomState >> 17;
+    hostRandomState ^= hostRandomState << 5;
+    return max > 0 ? (long)(hostRandomState % (uint32_t)max) : 0;
+}
+
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return n > 0 ? write((const uint8_t *)buffer, min<size_t>(n, sizeof(buffer) - 1)) : 0;
+}
+
+size_t HostSerial::write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+size_t HostSerial::write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+
+void SPIClass::beginTransaction(SPISettings) { W25Q128Emu::chip().select(); }
+void SPIClass::endTransaction() { W25Q128Emu::chip().deselect(); }
+uint8_t SPIClass::transfer(uint8_t data) { return W25Q128Emu::chip().transfer(data); }
+
+void SPIClass::transfer(const void *tx, void *rx, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        const uint8_t in = transfer(tx ? static_cast<const uint8_t *>(tx)[i] : 0xFF);
+        if (rx)
+        {
+            static_cast<uint8_t *>(rx)[i] = in;
+        }
+    }
+}
+
+namespace fs
+{
+    int File::read()
+    {
+        uint8_t c;
+        return (_p && _p->read(&c, 1) == 1) ? c : -1;
+    }
+
+    int File::peek()
+    {
+        if (!_p)
+        {
+            return -1;
+        }
+        const size_t pos = _p->position();
+        const int c = read();
+        _p->seek(pos, SeekSet);
+        return c;
+    }
+
+    bool getModes(const char *mode, OpenMode *openMode, AccessMode *accessMode)
+    {
+        if (!mode || !mode[0])
+        {
+            return false;
+        }
+        const bool plus = mode[1] == '+';
+        switch (mode[0])
+        {
+            case 'r':
+                *openMode = OM_DEFAULT;
+                *accessMode = plus ? AM_RW : AM_READ;
+                return true;
+            case 'w':
+                *openMode = OpenMode(OM_CREATE | OM_TRUNCATE);
+                *accessMode = plus ? AM_RW : AM_WRITE;
+                return true;
+            case 'a':
+                *openMode = OpenMode(OM_CREATE | OM_APPEND);
+                *accessMode = plus ? AM_RW : AM_WRITE;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    File FS::open(const char *path, const char *mode)
+    {
+        OpenMode openMode;
+        AccessMode accessMode;
+        if (!_impl || !getModes(mode, &openMode, &accessMode))
+        {
+            return File();
+        }
+        return File(_impl->open(path, openMode, accessMode));
+    }
+
+    File Dir::openFile(const char *mode)
+    {
+        OpenMode openMode;
+        AccessMode accessMode;
+        if (!_p || !getModes(mode, &openMode, &accessMode))
+        {
+            return File();
+        }
+        return File(_p->openFile(openMode, accessMode));
+    }
+} // namespace fs
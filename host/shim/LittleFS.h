@@ -0,0 +1,11 @@
+#pragma once
+/**
+ * @file        LittleFS.h
+ * @brief       Host shim, ext_LittleFS.h only needs the FS interfaces
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include "FS.h"
@@ -0,0 +1,19 @@
+#pragma once
+/**
+ * @file        OpenKNX.h
+ * @brief       Host shim of the parts of OpenKNX used by the flash driver and the raw partitions.
+ *              Log macros print to stdout
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include "Arduino.h"
+
+#define logDebugP(...) \
+    do                 \
+    {                  \
+    } while (0)
+#define logInfoP(...) (printf(__VA_ARGS__), printf("\n"))
+#define logErrorP(...) (printf("ERROR: "), printf(__VA_ARGS__), printf("\n"))
@@ -0,0 +1,45 @@
+#pragma once
+/**
+ * @file        SPI.h
+ * @brief       Host shim of the SPI class. All instances talk to the W25Q128 emulation
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include "Arduino.h"
+
+// Pins and instance of the external flash, values don't matter on the host
+#ifndef OKNXHW_REG2_EXTFLASH_SPI_INST
+    #define OKNXHW_REG2_EXTFLASH_SPI_INST SPI1
+    #define OKNXHW_REG2_EXTFLASH_SPI_SCK 10
+    #define OKNXHW_REG2_EXTFLASH_SPI_MOSI 11
+    #define OKNXHW_REG2_EXTFLASH_SPI_MISO 12
+    #define OKNXHW_REG2_EXTFLASH_SPI_CS 13
+    #define OKNXHW_REG2_EXTFLASH_SPI_WP 14
+    #define OKNXHW_REG2_EXTFLASH_SPI_HOLD 15
+#endif
+
+struct SPISettings
+{
+    SPISettings(uint32_t, int, int) {}
+};
+
+// The chip select is part of the transaction: the driver pulls CS low right before beginTransaction()
+// and releases it right after endTransaction()
+class SPIClass
+{
+  public:
+    inline void setSCK(int) {}
+    inline void setTX(int) {}
+    inline void setRX(int) {}
+    inline void begin() {}
+    inline void end() {}
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+    uint8_t transfer(uint8_t data);
+    void transfer(const void *tx, void *rx, size_t size);
+};
+extern SPIClass SPI;
+extern SPIClass SPI1;
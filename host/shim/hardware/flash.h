@@ -0,0 +1,16 @@
+#pragma once
+/**
+ * @file        flash.h
+ * @brief       Host shim of the internal flash functions. Only referenced by the internal flash callbacks
+ *              of ext_LittleFSImpl, which are not used with the external flash
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+inline void flash_range_program(uint32_t, const uint8_t *, size_t) { abort(); }
+inline void flash_range_erase(uint32_t, size_t) { abort(); }
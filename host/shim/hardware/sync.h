@@ -0,0 +1,27 @@
+#pragma once
+/**
+ * @file        sync.h
+ * @brief       Host shim of the hardware spin locks. The host runs on one thread, a lock only has to exist
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include <stdint.h>
+
+#define PICO_SPINLOCK_ID_STRIPED_FIRST 16
+
+typedef volatile uint32_t spin_lock_t;
+
+inline spin_lock_t *spin_lock_instance(unsigned lock_num)
+{
+    static spin_lock_t locks[32];
+    return &locks[lock_num];
+}
+inline uint32_t spin_lock_blocking(spin_lock_t *lock)
+{
+    *lock = 1;
+    return 0;
+}
+inline void spin_unlock(spin_lock_t *lock, uint32_t) { *lock = 0; }
@@ -0,0 +1,12 @@
+#pragma once
+/**
+ * @file        watchdog.h
+ * @brief       Host shim of the watchdog functions. There is no watchdog on the host, feeding it does nothing
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+
+inline void watchdog_update() {}
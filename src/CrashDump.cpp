@@ -0,0 +1,410 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class CrashDump
+ * @brief Captures hard faults into a pre-erased raw partition of the external flash.
+ *
+ * The hard fault handler saves the exception frame and r4-r11, then writes the stack above the fault frame and
+ * the registered RAM regions page by page, followed by the header in the first page. It doesn't use the W25Q128
+ * driver, the Arduino SPI class or interrupts: a minimal routine drives the SDK SPI instance by polling. Only
+ * page programs are needed, because loop() keeps the partition erased as long as no dump is stored. So the
+ * capture takes a few milliseconds (about 1ms per page) and is done long before the watchdog fires. The
+ * device reboots afterwards.
+ *
+ * After the reboot the dump stays until it is cleared with "efc crash clear". The other core is not stopped
+ * during the capture.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "CrashDump.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+#include <hardware/exception.h>
+#include <hardware/gpio.h>
+#include <hardware/spi.h>
+#include <hardware/watchdog.h>
+
+#define CRASH_RAM_START 0x20000000 // Start of the SRAM of the RP2040
+#define CRASH_RAM_END 0x20042000   // End of the SRAM of the RP2040
+
+// State shared with the fault handler
+static uint32_t crashAddr = 0;                        // Start address of the partition on the chip
+static uint32_t crashSize = 0;                        // Size of the partition
+static volatile bool crashArmed = false;              // The partition is erased
+static CrashRegion crashRegions[CRASH_MAX_REGIONS];   // Registered RAM regions
+static uint8_t crashRegionCount = 0;                  // Number of registered RAM regions
+extern "C" uint32_t crashDumpRegs[8];                 // r4 - r11 saved by the fault entry
+uint32_t crashDumpRegs[8];
+
+extern "C" void crashDumpFault(uint32_t *frame, uint32_t excReturn);
+
+/**
+ * @brief Hard fault entry. Finds the stack with the exception frame, saves r4-r11 and calls crashDumpFault()
+ */
+extern "C" void __attribute__((naked)) crashDumpFaultEntry()
+{
+    asm volatile(
+        "movs r0, #4            \n"
+        "mov r1, lr             \n"
+        "tst r0, r1             \n"
+        "beq 1f                 \n"
+        "mrs r0, psp            \n"
+        "b 2f                   \n"
+        "1:                     \n"
+        "mrs r0, msp            \n"
+        "2:                     \n"
+        "ldr r2, =crashDumpRegs \n"
+        "stmia r2!, {r4-r7}     \n"
+        "mov r3, r8             \n"
+        "str r3, [r2, #0]       \n"
+        "mov r3, r9             \n"
+        "str r3, [r2, #4]       \n"
+        "mov r3, r10            \n"
+        "str r3, [r2, #8]       \n"
+        "mov r3, r11            \n"
+        "str r3, [r2, #12]      \n"
+        "ldr r2, =crashDumpFault\n"
+        "bx r2                  \n"
+        ".ltorg                 \n");
+}
+
+// Minimal interrupt free access to the external flash for the fault handler
+
+static uint8_t crashStatus()
+{
+    const uint8_t cmd = CMD_READ_STATUS_REG;
+    uint8_t status;
+    gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 0);
+    spi_write_blocking(OKNXHW_REG2_EXTFLASH_SPI_HW, &cmd, 1);
+    spi_read_blocking(OKNXHW_REG2_EXTFLASH_SPI_HW, 0, &status, 1);
+    gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 1);
+    return status;
+}
+
+static void crashWaitReady()
+{
+    while (crashStatus() & 0x01)
+    {
+        watchdog_update();
+    }
+}
+
+// Program up to one page, the range must not cross a page boundary
+static void crashProgramPage(uint32_t addr, const uint8_t *data, size_t len)
+{
+    const uint8_t wren = CMD_WRITE_ENABLE;
+    const uint8_t cmd[4] = {CMD_PAGE_PROGRAM, (uint8_t)(addr >> 16), (uint8_t)(addr >> 8), (uint8_t)addr};
+    crashWaitReady();
+    gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 0);
+    spi_write_blocking(OKNXHW_REG2_EXTFLASH_SPI_HW, &wren, 1);
+    gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 1);
+    gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 0);
+    spi_write_blocking(OKNXHW_REG2_EXTFLASH_SPI_HW, cmd, sizeof(cmd));
+    spi_write_blocking(OKNXHW_REG2_EXTFLASH_SPI_HW, data, len);
+    gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 1);
+    crashWaitReady();
+}
+
+// Program a range sequentially, split at page boundaries. Returns the bytes written
+static uint32_t crashWrite(uint32_t &pos, const uint8_t *data, uint32_t len, uint32_t &crc)
+{
+    len = min<uint32_t>(len, crashSize - pos);
+    uint32_t done = 0;
+    while (done < len)
+    {
+        const uint32_t chunk = min<uint32_t>(len - done, PAGE_SIZE_W25Q128_256B - (pos % PAGE_SIZE_W25Q128_256B));
+        crashProgramPage(crashAddr + pos, data + done, chunk);
+        pos += chunk;
+        done += chunk;
+    }
+    crc = extFlashCrc32(data, len, crc);
+    return len;
+}
+
+/**
+ * @brief Capture the fault and reboot. Called by crashDumpFaultEntry() on the stack of the fault
+ *
+ * @param frame the exception frame: r0-r3, r12, lr, pc, xpsr
+ * @param excReturn the EXC_RETURN value
+ */
+extern "C" void crashDumpFault(uint32_t *frame, uint32_t excReturn)
+{
+    if (crashArmed)
+    {
+        crashArmed = false; // A fault in here must not capture again
+
+        CrashDumpHeader header;
+        memset(&header, 0xFF, sizeof(header));
+        header.magic = CRASH_MAGIC;
+        header.version = CRASH_VERSION;
+        header.core = get_core_num();
+        header.uptime = millis();
+        header.excReturn = excReturn;
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            header.r[i] = frame[i];
+        }
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            header.r[4 + i] = crashDumpRegs[i];
+        }
+        header.r[12] = frame[4];
+        header.lr = frame[5];
+        header.pc = frame[6];
+        header.xpsr = frame[7];
+        header.sp = (uint32_t)(uintptr_t)(frame + 8) + ((frame[7] & (1 << 9)) ? 4 : 0); // Stack was realigned if bit 9 is set
+
+        // Release a transfer the fault may have interrupted and wait for a running program or erase
+        gpio_put(OKNXHW_REG2_EXTFLASH_SPI_CS, 1);
+        crashWaitReady();
+
+        uint32_t pos = PAGE_SIZE_W25Q128_256B; // The header page is written last
+        uint32_t crc = 0;
+        const uint32_t stackStart = (uint32_t)(uintptr_t)frame;
+        const uint32_t stackSize = (stackStart >= CRASH_RAM_START && stackStart < CRASH_RAM_END)
+                                       ? min<uint32_t>(CRASH_STACK_BYTES, CRASH_RAM_END - stackStart)
+                                       : 0;
+        header.stackSize = crashWrite(pos, (const uint8_t *)(uintptr_t)stackStart, stackSize, crc);
+
+        header.regionCount = 0;
+        for (uint8_t i = 0; i < crashRegionCount; i++)
+        {
+            header.regions[i].addr = crashRegions[i].addr;
+            header.regions[i].size = crashWrite(pos, (const uint8_t *)(uintptr_t)crashRegions[i].addr, crashRegions[i].size, crc);
+            header.regionCount++;
+        }
+        header.size = pos - PAGE_SIZE_W25Q128_256B;
+        header.crc = crc;
+        crashProgramPage(crashAddr, (const uint8_t *)&header, sizeof(header));
+    }
+    watchdog_reboot(0, 0, 0);
+    while (true)
+    {
+    }
+}
+
+/**
+ * @brief Construct a new Crash Dump object
+ */
+CrashDump::CrashDump() : _hasDump(false), _checking(false), _checked(0), _erased(0)
+{
+}
+
+/**
+ * @brief Attach to the raw partition, install the fault handler and look for a dump.
+ *        Without a dump the partition is checked and erased in the background by loop()
+ *
+ * @param partition the raw partition
+ * @return true if the partition can be used
+ */
+bool CrashDump::begin(const ExtFlashRawPartition &partition)
+{
+    crashArmed = false;
+    _partition = partition;
+    if (!_partition.isReady() || _partition.size() < 2 * PAGE_SIZE_W25Q128_256B)
+    {
+        _partition.begin(nullptr, nullptr);
+        return false;
+    }
+    crashAddr = _partition.offset();
+    crashSize = _partition.size();
+
+    static bool installed = false;
+    if (!installed)
+    {
+        exception_set_exclusive_handler(HARDFAULT_EXCEPTION, crashDumpFaultEntry);
+        installed = true;
+    }
+
+    CrashDumpHeader dump;
+    _hasDump = header(dump);
+    _checking = !_hasDump;
+    _checked = 0;
+    _erased = _partition.size(); // Nothing to erase until the check finds programmed bytes
+    return true;
+}
+
+/**
+ * @brief Check a chunk of the partition for erased state or start the next erase. Arms the
+ *        fault handler when the whole partition is erased
+ */
+void CrashDump::loop()
+{
+    if (!isReady() || _hasDump || crashArmed || _partition.flash()->isBusy())
+    {
+        return;
+    }
+    if (_checking)
+    {
+        uint8_t buffer[CRASH_CHECK_CHUNK];
+        const uint32_t n = min<uint32_t>(sizeof(buffer), _partition.size() - _checked);
+        _partition.read(_checked, buffer, n);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (buffer[i] != 0xFF)
+            {
+                _checking = false;
+                _erased = 0; // Programmed bytes found, erase the whole partition
+                return;
+            }
+        }
+        _checked += n;
+        if (_checked >= _partition.size())
+        {
+            _checking = false;
+            crashArmed = true;
+        }
+        return;
+    }
+    if (_erased < _partition.size())
+    {
+        if (_partition.size() - _erased >= BLOCK_SIZE_W25Q128_64KB && _partition.eraseBlockAsync(_erased))
+        {
+            _erased += BLOCK_SIZE_W25Q128_64KB;
+        }
+        else if (_partition.eraseAsync(_erased))
+        {
+            _erased += SECTOR_SIZE_W25Q128_4KB;
+        }
+        return;
+    }
+    crashArmed = true;
+}
+
+/**
+ * @brief Drop the dump. loop() erases the partition and arms the handler again
+ *
+ * @return true if the partition is attached
+ */
+bool CrashDump::clear()
+{
+    if (!isReady())
+    {
+        return false;
+    }
+    crashArmed = false;
+    _hasDump = false;
+    _checking = false;
+    _erased = 0;
+    return true;
+}
+
+/**
+ * @brief Add a RAM region to future dumps, e.g. a state structure of a module
+ *
+ * @param addr the start of the region
+ * @param size the size of the region
+ * @return true if added
+ */
+bool CrashDump::addRegion(const void *addr, uint32_t size)
+{
+    const uint32_t start = (uint32_t)(uintptr_t)addr;
+    if (crashRegionCount >= CRASH_MAX_REGIONS || start < CRASH_RAM_START || start >= CRASH_RAM_END || size > CRASH_RAM_END - start)
+    {
+        return false;
+    }
+    crashRegions[crashRegionCount].addr = start;
+    crashRegions[crashRegionCount].size = size;
+    crashRegionCount++;
+    return true;
+}
+
+/**
+ * @brief Check if a fault will be captured
+ *
+ * @return true if the partition is erased and the handler is armed
+ */
+bool CrashDump::armed() const
+{
+    return crashArmed;
+}
+
+/**
+ * @brief Read the header of the dump
+ *
+ * @param header the header
+ * @return true if a complete dump is stored
+ */
+bool CrashDump::header(CrashDumpHeader &header)
+{
+    return isReady() && _partition.read(0, (uint8_t *)&header, sizeof(header)) && header.magic == CRASH_MAGIC &&
+           header.version == CRASH_VERSION && header.regionCount <= CRASH_MAX_REGIONS &&
+           header.size <= _partition.size() - PAGE_SIZE_W25Q128_256B;
+}
+
+/**
+ * @brief Print the dump line by line
+ *
+ * @param cb the callback for each line
+ * @param full true to include the stack and the RAM regions as hex
+ * @return the number of lines
+ */
+uint32_t CrashDump::print(LineCallback cb, bool full)
+{
+    CrashDumpHeader dump;
+    if (!cb || !header(dump))
+    {
+        return 0;
+    }
+    uint32_t lines = 0;
+    char line[100];
+
+    // Check the data against the CRC of the header
+    uint8_t buffer[64];
+    uint32_t crc = 0;
+    for (uint32_t pos = 0; pos < dump.size; pos += sizeof(buffer))
+    {
+        const uint32_t n = min<uint32_t>(sizeof(buffer), dump.size - pos);
+        _partition.read(PAGE_SIZE_W25Q128_256B + pos, buffer, n);
+        crc = extFlashCrc32(buffer, n, crc);
+    }
+
+    snprintf(line, sizeof(line), "Hard fault on core %u after %lu ms, %lu bytes, crc %s", dump.core, (unsigned long)dump.uptime,
+             (unsigned long)dump.size, crc == dump.crc ? "ok" : "BAD");
+    cb(line), lines++;
+    snprintf(line, sizeof(line), "PC %08lX  LR %08lX  SP %08lX  xPSR %08lX  EXC_RETURN %08lX", (unsigned long)dump.pc,
+             (unsigned long)dump.lr, (unsigned long)dump.sp, (unsigned long)dump.xpsr, (unsigned long)dump.excReturn);
+    cb(line), lines++;
+    for (uint8_t i = 0; i < 13; i += 4)
+    {
+        int len = 0;
+        for (uint8_t j = i; j < i + 4 && j < 13 && len < (int)sizeof(line); j++)
+        {
+            len += snprintf(line + len, sizeof(line) - len, "r%-2u %08lX  ", j, (unsigned long)dump.r[j]);
+        }
+        cb(line), lines++;
+    }
+    if (!full)
+    {
+        return lines;
+    }
+
+    // Stack and regions as hex, 16 bytes per line with the RAM address
+    // The stack is captured from the exception frame, 8 words below the SP before the fault plus the realignment word
+    const uint32_t stackAddr = dump.sp - 8 * sizeof(uint32_t) - ((dump.xpsr & (1 << 9)) ? 4 : 0);
+    uint32_t pos = PAGE_SIZE_W25Q128_256B;
+    for (int8_t region = -1; region < dump.regionCount; region++)
+    {
+        const uint32_t addr = region < 0 ? stackAddr : dump.regions[region].addr;
+        const uint32_t size = region < 0 ? dump.stackSize : dump.regions[region].size;
+        snprintf(line, sizeof(line), region < 0 ? "Stack at %08lX, %lu bytes" : "Region at %08lX, %lu bytes", (unsigned long)addr,
+                 (unsigned long)size);
+        cb(line), lines++;
+        for (uint32_t offset = 0; offset < size; offset += 16)
+        {
+            const uint32_t n = min<uint32_t>(16, size - offset);
+            _partition.read(pos + offset, buffer, n);
+            int len = snprintf(line, sizeof(line), "%08lX: ", (unsigned long)(addr + offset));
+            for (uint32_t i = 0; i < n && len < (int)sizeof(line); i++)
+            {
+                len += snprintf(line + len, sizeof(line) - len, "%02X ", buffer[i]);
+            }
+            cb(line), lines++;
+        }
+        pos += size;
+    }
+    return lines;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,84 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        CrashDump.h
+ * @brief       Writes registers, stack and registered RAM regions of a hard fault into a pre-erased
+ *              raw partition, read back after the reboot with "efc crash"
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+#include <functional>
+
+#ifndef OKNXHW_REG2_EXTFLASH_SPI_HW
+    #define OKNXHW_REG2_EXTFLASH_SPI_HW spi1 // SDK SPI instance behind OKNXHW_REG2_EXTFLASH_SPI_INST, used by the fault handler
+#endif
+
+#define CRASH_MAGIC 0x48535243          // "CRSH"
+#define CRASH_VERSION 1                 // Version of the dump layout
+#define CRASH_MAX_REGIONS 8             // Max number of registered RAM regions
+#define CRASH_CHECK_CHUNK 1024          // Bytes checked for erased state per loop()
+
+#ifndef CRASH_STACK_BYTES
+    #define CRASH_STACK_BYTES 2048 // Bytes of the stack in the dump, from the fault frame up
+#endif
+
+// RAM region that goes into the dump
+struct __attribute__((packed)) CrashRegion
+{
+    uint32_t addr; // Start address
+    uint32_t size; // Size in bytes
+};
+
+// Header in the first page of the dump. Written last, so only a complete dump has a valid header
+struct __attribute__((packed)) CrashDumpHeader
+{
+    uint32_t magic;         // CRASH_MAGIC
+    uint16_t version;       // CRASH_VERSION
+    uint8_t core;           // Core that faulted
+    uint8_t regionCount;    // Number of RAM regions after the stack
+    uint32_t size;          // Bytes of the dump after the header page
+    uint32_t uptime;        // millis() at the fault
+    uint32_t excReturn;     // EXC_RETURN value of the fault
+    uint32_t r[13];         // r0 - r12
+    uint32_t sp;            // Stack pointer before the fault
+    uint32_t lr;            // Link register before the fault
+    uint32_t pc;            // Faulting instruction
+    uint32_t xpsr;          // Program status
+    uint32_t stackSize;     // Stack bytes after the header page
+    CrashRegion regions[CRASH_MAX_REGIONS]; // RAM regions following the stack
+    uint32_t crc;           // CRC32 of the data after the header page
+};
+
+class CrashDump
+{
+  public:
+    using LineCallback = std::function<void(const char *line)>;
+
+    CrashDump();
+
+    bool begin(const ExtFlashRawPartition &partition); // Install the fault handler, look for a dump
+    void loop();                                       // Check the region is erased and erase it in the background
+    bool clear();                                      // Drop the dump, the region is erased by loop()
+    static bool addRegion(const void *addr, uint32_t size); // Add a RAM region to future dumps
+
+    bool header(CrashDumpHeader &header);                       // Read the header of the dump
+    uint32_t print(LineCallback cb, bool full);                 // Print the dump, full includes stack and regions as hex
+    inline bool hasDump() const { return _hasDump; }            // A valid dump is stored
+    bool armed() const;                                         // The region is erased, a fault will be captured
+    inline bool isReady() const { return _partition.isReady(); }
+
+  private:
+    ExtFlashRawPartition _partition; // Raw partition of the dump
+    bool _hasDump;                   // A valid dump is stored
+    bool _checking;                  // Checking the region for erased state
+    uint32_t _checked;               // Bytes checked
+    uint32_t _erased;                // Erase frontier while erasing
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,444 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class DeltaPatch
+ * @brief Streaming decoder for binary delta patches against the running firmware.
+ *
+ * A patch is a header followed by operations in the style of bsdiff: DIFF adds patch bytes to bytes of the
+ * running firmware, EXTRA inserts new bytes and SEEK moves the position in the running firmware. The running
+ * firmware is read directly from the memory mapped internal flash (XIP_BASE). Diff bytes are mostly zero for
+ * typical updates (code moved by a few bytes, unchanged tables), so they are zero run length encoded.
+ *
+ * The decoder works byte by byte with a fixed state, the new image goes through a one page output buffer into
+ * the OtaStager. RAM use is constant, independent of the image size. When the stager can't take more bytes
+ * (erase behind), write() consumes fewer patch bytes, like OtaStager::write(). Before the first operation the
+ * CRC of the running firmware is checked in steps in loop(), a patch for another firmware is rejected. The new
+ * image is verified by the stager against the target CRC of the header.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "DeltaPatch.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+
+/**
+ * @brief Construct a new Delta Patch object
+ */
+DeltaPatch::DeltaPatch() : _stager(nullptr), _state(DeltaState::Idle), _headerFill(0), _op(0), _varint(0), _shift(0), _remaining(0),
+                           _zeroRun(0), _srcPos(0), _checked(0), _sourceCrc(0), _consumed(0), _produced(0), _outFill(0)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+/**
+ * @brief Start decoding a patch that is fed with write()
+ *
+ * @param stager the staging area for the new image
+ * @return true if started
+ */
+bool DeltaPatch::begin(OtaStager *stager)
+{
+    if (!stager || !stager->isReady())
+    {
+        return false;
+    }
+    _file.close();
+    _stager = stager;
+    _state = DeltaState::Header;
+    _headerFill = 0;
+    _zeroRun = 0;
+    _srcPos = 0;
+    _consumed = 0;
+    _produced = 0;
+    _outFill = 0;
+    return true;
+}
+
+/**
+ * @brief Start decoding a patch file. loop() feeds the file in small chunks
+ *
+ * @param stager the staging area for the new image
+ * @param fs the filesystem with the patch
+ * @param path the path of the patch
+ * @return true if the file is open
+ */
+bool DeltaPatch::begin(OtaStager *stager, FS *fs, const char *path)
+{
+    if (!fs || !begin(stager))
+    {
+        return false;
+    }
+    _file = fs->open(path, "r");
+    if (!_file)
+    {
+        _state = DeltaState::Idle;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Feed patch bytes
+ *
+ * @param data the patch bytes
+ * @param len the number of bytes
+ * @return the number of bytes consumed, the rest has to be fed again later
+ */
+size_t DeltaPatch::write(const uint8_t *data, size_t len)
+{
+    size_t used = 0;
+    while (used < len)
+    {
+        if (_state == DeltaState::Idle || _state == DeltaState::SourceCheck || _state == DeltaState::Done || _state == DeltaState::Failed)
+        {
+            break;
+        }
+        if (!drainZeroRun())
+        {
+            break;
+        }
+        if ((_state == DeltaState::Diff || _state == DeltaState::Extra) && !room())
+        {
+            break;
+        }
+        if (!consume(data[used]))
+        {
+            break;
+        }
+        used++;
+        _consumed++;
+    }
+    return used;
+}
+
+/**
+ * @brief Check a chunk of the running firmware, emit pending output, finish the image and feed a patch file
+ */
+void DeltaPatch::loop()
+{
+    switch (_state)
+    {
+        case DeltaState::SourceCheck:
+        {
+            const uint32_t n = min<uint32_t>(DELTA_SOURCE_CHECK_CHUNK, _header.sourceSize - _checked);
+            _sourceCrc = extFlashCrc32((const uint8_t *)XIP_BASE + _checked, n, _sourceCrc);
+            _checked += n;
+            if (_checked >= _header.sourceSize)
+            {
+                if (_sourceCrc != _header.sourceCrc || !_stager->start(_header.targetSize, _header.targetCrc))
+                {
+                    fail(); // Patch for another firmware or the image doesn't fit
+                    return;
+                }
+                _state = DeltaState::Op;
+            }
+            return;
+        }
+        case DeltaState::Done:
+            // Hand the rest to the stager, it verifies the image
+            if (_outFill)
+            {
+                flushOut();
+            }
+            else if (_stager->state() == OtaState::Receiving)
+            {
+                _stager->finish();
+            }
+            _file.close();
+            return;
+        case DeltaState::Idle:
+        case DeltaState::Failed:
+            return;
+        default:
+            break;
+    }
+
+    drainZeroRun();
+    if (_file)
+    {
+        uint8_t buffer[DELTA_FILE_CHUNK];
+        const size_t pos = _file.position();
+        const size_t n = _file.read(buffer, sizeof(buffer));
+        if (!n)
+        {
+            fail(); // Patch ended without END
+            return;
+        }
+        const size_t used = write(buffer, n);
+        if (used < n)
+        {
+            _file.seek(pos + used);
+        }
+    }
+}
+
+/**
+ * @brief Stop decoding. A partly written image in the stager is dropped
+ */
+void DeltaPatch::abort()
+{
+    if (_state != DeltaState::Idle && _state != DeltaState::Done && _stager)
+    {
+        _stager->abort();
+    }
+    _file.close();
+    _state = DeltaState::Idle;
+}
+
+/**
+ * @brief Name of a state
+ *
+ * @param state the state
+ * @return the name
+ */
+const char *DeltaPatch::stateName(DeltaState state)
+{
+    switch (state)
+    {
+        case DeltaState::Idle:
+            return "idle";
+        case DeltaState::Header:
+            return "header";
+        case DeltaState::SourceCheck:
+            return "checking source";
+        case DeltaState::Done:
+            return "done";
+        case DeltaState::Failed:
+            return "failed";
+        default:
+            return "patching";
+    }
+}
+
+/**
+ * @brief Decode one patch byte. The caller made sure the output buffer has room for DIFF and EXTRA bytes
+ *
+ * @param c the patch byte
+ * @return true if the byte was consumed
+ */
+bool DeltaPatch::consume(uint8_t c)
+{
+    switch (_state)
+    {
+        case DeltaState::Header:
+            ((uint8_t *)&_header)[_headerFill++] = c;
+            if (_headerFill == sizeof(_header))
+            {
+                if (_header.magic != DELTA_MAGIC || _header.version != DELTA_VERSION || !_header.targetSize ||
+                    _header.targetSize > _stager->maxImageSize() || _header.sourceSize > _stager->maxImageSize())
+                {
+                    fail();
+                    return true;
+                }
+                _checked = 0;
+                _sourceCrc = 0;
+                _state = DeltaState::SourceCheck;
+            }
+            return true;
+
+        case DeltaState::Op:
+            _op = c;
+            _varint = 0;
+            _shift = 0;
+            if (c == DELTA_OP_END)
+            {
+                if (_produced != _header.targetSize)
+                {
+                    fail();
+                    return true;
+                }
+                _state = DeltaState::Done;
+            }
+            else if (c == DELTA_OP_DIFF || c == DELTA_OP_EXTRA)
+            {
+                _state = DeltaState::Length;
+            }
+            else if (c == DELTA_OP_SEEK)
+            {
+                _state = DeltaState::Seek;
+            }
+            else
+            {
+                fail();
+            }
+            return true;
+
+        case DeltaState::Length:
+            if (varint(c))
+            {
+                _remaining = _varint;
+                if (_remaining > _header.targetSize - _produced)
+                {
+                    fail();
+                    return true;
+                }
+                _state = !_remaining ? DeltaState::Op : (_op == DELTA_OP_DIFF ? DeltaState::Diff : DeltaState::Extra);
+            }
+            return true;
+
+        case DeltaState::Seek:
+            if (varint(c))
+            {
+                const int32_t offset = (int32_t)(_varint >> 1) ^ -(int32_t)(_varint & 1); // Zigzag decoding
+                const int64_t pos = (int64_t)_srcPos + offset;
+                if (pos < 0 || pos > _header.sourceSize)
+                {
+                    fail();
+                    return true;
+                }
+                _srcPos = (uint32_t)pos;
+                _state = DeltaState::Op;
+            }
+            return true;
+
+        case DeltaState::Diff:
+            if (c == 0)
+            {
+                _varint = 0;
+                _shift = 0;
+                _state = DeltaState::ZeroRun;
+                return true;
+            }
+            emit(sourceByte() + c);
+            if (!--_remaining)
+            {
+                _state = DeltaState::Op;
+            }
+            return true;
+
+        case DeltaState::ZeroRun:
+            if (varint(c))
+            {
+                if (!_varint || _varint > _remaining)
+                {
+                    fail();
+                    return true;
+                }
+                _zeroRun = _varint;
+                _state = DeltaState::Diff; // drainZeroRun() emits the bytes
+            }
+            return true;
+
+        case DeltaState::Extra:
+            emit(c);
+            if (!--_remaining)
+            {
+                _state = DeltaState::Op;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Collect a LEB128 varint byte
+ *
+ * @param c the byte
+ * @return true if the varint is complete
+ */
+bool DeltaPatch::varint(uint8_t c)
+{
+    if (_shift > 28)
+    {
+        fail();
+        return false;
+    }
+    _varint |= (uint32_t)(c & 0x7F) << _shift;
+    _shift += 7;
+    return !(c & 0x80);
+}
+
+/**
+ * @brief Put one image byte into the output buffer, the caller checked room()
+ *
+ * @param c the byte
+ * @return true
+ */
+bool DeltaPatch::emit(uint8_t c)
+{
+    _out[_outFill++] = c;
+    _produced++;
+    return true;
+}
+
+/**
+ * @brief Make room in the output buffer
+ *
+ * @return true if there is room for one byte
+ */
+bool DeltaPatch::room()
+{
+    if (_outFill < sizeof(_out))
+    {
+        return true;
+    }
+    flushOut();
+    return _outFill < sizeof(_out);
+}
+
+/**
+ * @brief Hand the output buffer to the stager
+ *
+ * @return true if the stager took over bytes
+ */
+bool DeltaPatch::flushOut()
+{
+    const size_t n = _stager->write(_out, _outFill);
+    if (n)
+    {
+        memmove(_out, _out + n, _outFill - n);
+        _outFill -= n;
+    }
+    return n > 0;
+}
+
+/**
+ * @brief Emit the pending bytes of a zero run: the source bytes unchanged
+ *
+ * @return true if the run is complete
+ */
+bool DeltaPatch::drainZeroRun()
+{
+    while (_zeroRun)
+    {
+        if (!room())
+        {
+            return false;
+        }
+        emit(sourceByte());
+        _zeroRun--;
+        if (!--_remaining)
+        {
+            _state = DeltaState::Op;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Next byte of the running firmware from the memory mapped internal flash
+ *
+ * @return the byte, 0 behind the end of the source
+ */
+uint8_t DeltaPatch::sourceByte()
+{
+    return (_srcPos < _header.sourceSize) ? ((const uint8_t *)XIP_BASE)[_srcPos++] : 0;
+}
+
+/**
+ * @brief Stop with an error and drop the partly written image
+ */
+void DeltaPatch::fail()
+{
+    if (_stager && _stager->state() == OtaState::Receiving)
+    {
+        _stager->abort();
+    }
+    _file.close();
+    _state = DeltaState::Failed;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,102 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        DeltaPatch.h
+ * @brief       Streaming decoder for binary delta patches against the running firmware. The new image
+ *              is written into the OTA staging area with constant RAM
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "OtaStager.h"
+#include <FS.h>
+
+#define DELTA_MAGIC 0x50444645          // "EFDP"
+#define DELTA_VERSION 1                 // Version of the patch format
+#define DELTA_SOURCE_CHECK_CHUNK 8192   // Bytes of the running firmware checked per loop()
+#define DELTA_FILE_CHUNK 256            // Bytes of a patch file fed per loop()
+
+// Operations of the patch, lengths and offsets follow as LEB128 varints
+#define DELTA_OP_END 0x00   // End of the patch
+#define DELTA_OP_DIFF 0x01  // <len> bytes: source byte + diff byte, the diff bytes are zero run length encoded (0x00 <n>)
+#define DELTA_OP_EXTRA 0x02 // <len> bytes copied from the patch
+#define DELTA_OP_SEEK 0x03  // Move the source position by a zigzag encoded signed offset
+
+// Header of a patch
+struct __attribute__((packed)) DeltaPatchHeader
+{
+    uint32_t magic;      // DELTA_MAGIC
+    uint16_t version;    // DELTA_VERSION
+    uint16_t reserved;
+    uint32_t sourceSize; // Size of the firmware the patch was made against
+    uint32_t sourceCrc;  // CRC32 of that firmware
+    uint32_t targetSize; // Size of the new image
+    uint32_t targetCrc;  // CRC32 of the new image
+};
+
+enum class DeltaState : uint8_t
+{
+    Idle,        // No patch running
+    Header,      // Collecting the header
+    SourceCheck, // Checking the CRC of the running firmware
+    Op,          // Waiting for the next operation
+    Length,      // Reading the length of a DIFF or EXTRA operation
+    Seek,        // Reading the offset of a SEEK operation
+    Diff,        // Decoding DIFF bytes
+    ZeroRun,     // Reading the length of a zero run in DIFF bytes
+    Extra,       // Copying EXTRA bytes
+    Done,        // Patch applied, the stager verifies the image
+    Failed,      // Broken patch or wrong source
+};
+
+class DeltaPatch
+{
+  public:
+    DeltaPatch();
+
+    bool begin(OtaStager *stager);                   // Start decoding a patch that is fed with write()
+    bool begin(OtaStager *stager, FS *fs, const char *path); // Start decoding a patch file, fed by loop()
+    size_t write(const uint8_t *data, size_t len);   // Feed patch bytes, returns the bytes consumed (backpressure)
+    void loop();                                     // Source check step, output flush and file feeding
+    void abort();                                    // Stop decoding
+
+    inline DeltaState state() const { return _state; }        // Current state
+    inline uint32_t consumed() const { return _consumed; }    // Patch bytes consumed
+    inline uint32_t produced() const { return _produced; }    // Image bytes produced
+    inline uint32_t targetSize() const { return _header.targetSize; } // Size of the new image
+    static const char *stateName(DeltaState state);           // Name of a state
+
+  private:
+    bool consume(uint8_t c);     // Decode one patch byte
+    bool varint(uint8_t c);      // Collect a varint byte, true when complete
+    bool emit(uint8_t c);        // Put one image byte into the output buffer
+    bool room();                 // Make room in the output buffer, false on backpressure
+    bool flushOut();             // Hand the output buffer to the stager
+    bool drainZeroRun();         // Emit pending bytes of a zero run
+    uint8_t sourceByte();        // Next byte of the running firmware
+    void fail();                 // Stop with an error
+
+    OtaStager *_stager;                    // Destination of the new image
+    File _file;                            // Patch file fed by loop(), if any
+    DeltaState _state;                     // Decoder state
+    DeltaPatchHeader _header;              // Header of the patch
+    uint8_t _headerFill;                   // Header bytes collected
+    uint8_t _op;                           // Current operation
+    uint32_t _varint;                      // Varint being collected
+    uint8_t _shift;                        // Bit position of the next varint byte
+    uint32_t _remaining;                   // Bytes left in the current operation
+    uint32_t _zeroRun;                     // Pending zero diff bytes
+    uint32_t _srcPos;                      // Position in the running firmware
+    uint32_t _checked;                     // Bytes of the running firmware checked
+    uint32_t _sourceCrc;                   // CRC32 of the checked bytes
+    uint32_t _consumed;                    // Patch bytes consumed
+    uint32_t _produced;                    // Image bytes produced
+    uint8_t _out[PAGE_SIZE_W25Q128_256B];  // Output buffer
+    uint16_t _outFill;                     // Bytes in the output buffer
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,269 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashBench
+ * @brief Benchmark workloads for the external flash.
+ *
+ * Raw workloads on a scratch partition: sequential read (1KB reads), random page reads, page programs, sector
+ * erases and 64KB block erases. Filesystem workloads in BENCH_DIR: create small files, list the directory,
+ * append records to a log file with a flush each, delete the files. Every workload is seeded from the same
+ * xorshift32 generator, so addresses and data are the same on every run and platform. Each operation is timed
+ * with micros(), the latencies give p50/p99/max, the sum of the latencies gives MB/s and ops/s.
+ *
+ * The workloads block the loop, a run takes about ten seconds. The watchdog is fed after every operation, a 64KB
+ * block erase is the longest one. The program and sequential read workloads cover the whole BENCH_RAW_AREA to
+ * measure the sustained throughput, their latencies are sampled evenly across it.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashBench.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include <hardware/watchdog.h>
+
+/**
+ * @brief Construct a new Ext Flash Bench object
+ *
+ * @param seed the seed of the workloads
+ */
+ExtFlashBench::ExtFlashBench(uint32_t seed) : _seed(seed ? seed : BENCH_DEFAULT_SEED), _state(_seed), _count(0), _stride(1)
+{
+    memset(&_result, 0, sizeof(_result));
+}
+
+/**
+ * @brief Run the raw workloads. The first BENCH_RAW_AREA bytes of the partition are overwritten
+ *
+ * @param area the scratch partition, 64KB aligned on the chip for the block erases
+ * @param cb called with the result of each workload
+ * @return true if the partition is large enough and aligned, and every block erase was started
+ */
+bool ExtFlashBench::runRaw(ExtFlashRawPartition &area, ResultCallback cb)
+{
+    if (!area.isReady() || area.size() < BENCH_RAW_AREA || (area.offset() % BLOCK_SIZE_W25Q128_64KB))
+    {
+        return false;
+    }
+    _state = _seed;
+    uint8_t buffer[1024];
+
+    // Page programs into an erased area, the erase is not part of the workload
+    for (uint32_t addr = 0; addr < BENCH_RAW_AREA; addr += BLOCK_SIZE_W25Q128_64KB)
+    {
+        if (!area.eraseBlockAsync(addr))
+        {
+            return false; // The programs would not start from erased flash
+        }
+        watchdog_update();
+    }
+    area.flash()->waitUntilReady();
+    begin("program", BENCH_RAW_AREA / PAGE_SIZE_W25Q128_256B);
+    for (uint32_t addr = 0; addr < BENCH_RAW_AREA; addr += PAGE_SIZE_W25Q128_256B)
+    {
+        fill(buffer, PAGE_SIZE_W25Q128_256B);
+        const uint32_t start = startOp();
+        area.program(addr, buffer, PAGE_SIZE_W25Q128_256B);
+        endOp(start, PAGE_SIZE_W25Q128_256B);
+    }
+    end(cb);
+
+    begin("seqread", BENCH_RAW_AREA / sizeof(buffer));
+    for (uint32_t addr = 0; addr < BENCH_RAW_AREA; addr += sizeof(buffer))
+    {
+        const uint32_t start = startOp();
+        area.read(addr, buffer, sizeof(buffer));
+        endOp(start, sizeof(buffer));
+    }
+    end(cb);
+
+    begin("randread");
+    for (uint16_t i = 0; i < BENCH_MAX_SAMPLES; i++)
+    {
+        const uint32_t addr = (random() % (BENCH_RAW_AREA / PAGE_SIZE_W25Q128_256B)) * PAGE_SIZE_W25Q128_256B;
+        const uint32_t start = startOp();
+        area.read(addr, buffer, PAGE_SIZE_W25Q128_256B);
+        endOp(start, PAGE_SIZE_W25Q128_256B);
+    }
+    end(cb);
+
+    begin("erase4k");
+    for (uint32_t addr = 0; addr < BLOCK_SIZE_W25Q128_64KB; addr += SECTOR_SIZE_W25Q128_4KB)
+    {
+        const uint32_t start = startOp();
+        area.erase(addr);
+        endOp(start, SECTOR_SIZE_W25Q128_4KB);
+    }
+    end(cb);
+
+    begin("erase64k", BENCH_RAW_AREA / BLOCK_SIZE_W25Q128_64KB);
+    for (uint32_t addr = 0; addr < BENCH_RAW_AREA; addr += BLOCK_SIZE_W25Q128_64KB)
+    {
+        const uint32_t start = startOp();
+        if (!area.eraseBlockAsync(addr))
+        {
+            return false; // No erase to time
+        }
+        area.flash()->waitUntilReady();
+        endOp(start, BLOCK_SIZE_W25Q128_64KB);
+    }
+    area.flash()->isBusy(); // The driver sees the erase finished
+    end(cb);
+    return true;
+}
+
+/**
+ * @brief Run the filesystem workloads in BENCH_DIR, the directory is removed afterwards
+ *
+ * @param fs the filesystem
+ * @param cb called with the result of each workload
+ * @return true if the directory could be created
+ */
+bool ExtFlashBench::runFs(FS &fs, ResultCallback cb)
+{
+    if (!fs.exists(BENCH_DIR) && !fs.mkdir(BENCH_DIR))
+    {
+        return false;
+    }
+    _state = _seed;
+    uint8_t buffer[64];
+    char path[32];
+
+    begin("create");
+    for (uint16_t i = 0; i < BENCH_FILES; i++)
+    {
+        snprintf(path, sizeof(path), BENCH_DIR "/f%03u", (unsigned)i);
+        fill(buffer, sizeof(buffer));
+        const uint32_t start = startOp();
+        File file = fs.open(path, "w");
+        file.write(buffer, sizeof(buffer));
+        file.close();
+        endOp(start, sizeof(buffer));
+    }
+    end(cb);
+
+    begin("list");
+    for (uint16_t i = 0; i < 10; i++)
+    {
+        const uint32_t start = startOp();
+        Dir dir = fs.openDir(BENCH_DIR);
+        while (dir.next())
+        {
+        }
+        endOp(start, 0);
+    }
+    end(cb);
+
+    begin("append");
+    File log = fs.open(BENCH_DIR "/log", "a");
+    for (uint16_t i = 0; i < BENCH_APPENDS; i++)
+    {
+        fill(buffer, 32);
+        const uint32_t start = startOp();
+        log.write(buffer, 32);
+        log.flush();
+        endOp(start, 32);
+    }
+    log.close();
+    end(cb);
+
+    begin("delete");
+    for (uint16_t i = 0; i < BENCH_FILES; i++)
+    {
+        snprintf(path, sizeof(path), BENCH_DIR "/f%03u", (unsigned)i);
+        const uint32_t start = startOp();
+        fs.remove(path);
+        endOp(start, 0);
+    }
+    end(cb);
+
+    fs.remove(BENCH_DIR "/log");
+    fs.rmdir(BENCH_DIR);
+    return true;
+}
+
+/**
+ * @brief Start a workload
+ *
+ * @param name the name of the workload
+ * @param ops the operations of the workload, more than BENCH_MAX_SAMPLES are sampled evenly
+ */
+void ExtFlashBench::begin(const char *name, uint32_t ops)
+{
+    memset(&_result, 0, sizeof(_result));
+    _result.name = name;
+    _count = 0;
+    _stride = (ops + BENCH_MAX_SAMPLES - 1) / BENCH_MAX_SAMPLES;
+    _stride = _stride ? _stride : 1;
+    if (_onStart)
+    {
+        _onStart(name);
+    }
+}
+
+/**
+ * @brief Record an operation
+ *
+ * @param start micros() at the start of the operation
+ * @param bytes data bytes of the operation
+ */
+void ExtFlashBench::endOp(uint32_t start, uint32_t bytes)
+{
+    const uint32_t us = micros() - start;
+    if (_count < BENCH_MAX_SAMPLES && _result.ops % _stride == 0)
+    {
+        _samples[_count++] = us;
+    }
+    _result.ops++;
+    _result.bytes += bytes;
+    _result.totalUs += us;
+    watchdog_update(); // A run takes longer than the watchdog timeout
+}
+
+/**
+ * @brief Compute the percentiles and report the workload
+ *
+ * @param cb the result callback
+ */
+void ExtFlashBench::end(ResultCallback &cb)
+{
+    if (_count)
+    {
+        std::sort(_samples, _samples + _count);
+        _result.p50Us = _samples[(_count - 1) * 50 / 100];
+        _result.p99Us = _samples[(_count - 1) * 99 / 100];
+        _result.maxUs = _samples[_count - 1];
+    }
+    if (cb)
+    {
+        cb(_result);
+    }
+}
+
+/**
+ * @brief xorshift32, independent of the random() of the platform
+ *
+ * @return the next random number
+ */
+uint32_t ExtFlashBench::random()
+{
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+}
+
+/**
+ * @brief Fill a buffer with random data
+ *
+ * @param buffer the buffer
+ * @param size the size of the buffer
+ */
+void ExtFlashBench::fill(uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        buffer[i] = random();
+    }
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
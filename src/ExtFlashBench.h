@@ -0,0 +1,72 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashBench.h
+ * @brief       Reproducible benchmark workloads for the raw flash and the filesystem, with throughput and
+ *              latency percentiles measured with the microsecond timer
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+#include <FS.h>
+#include <functional>
+
+#define BENCH_DEFAULT_SEED 0x4B4E5846     // Seed of the workloads if none is given
+#define BENCH_MAX_SAMPLES 256             // Latency samples per workload, every workload stays below
+#ifndef BENCH_RAW_AREA
+    #define BENCH_RAW_AREA (1024 * 1024) // Bytes of the raw partition used (and destroyed) by the raw workloads
+#endif
+#define BENCH_DIR "/bench"                // Directory of the filesystem workloads, removed afterwards
+#define BENCH_FILES 50                    // Files of the create, list and delete workloads
+#define BENCH_APPENDS 200                 // Records of the append workload
+
+// Result of one workload
+struct ExtFlashBenchResult
+{
+    const char *name; // Name of the workload
+    uint32_t ops;     // Operations
+    uint32_t bytes;   // Data bytes
+    uint32_t totalUs; // Sum of the operation latencies
+    uint32_t p50Us;   // Median latency
+    uint32_t p99Us;   // 99th percentile latency
+    uint32_t maxUs;   // Max latency
+
+    inline float mbps() const { return totalUs ? (float)bytes / totalUs : 0; }          // MB/s (bytes per us)
+    inline float opsps() const { return totalUs ? ops * 1000000.0f / totalUs : 0; }      // Operations per second
+};
+
+class ExtFlashBench
+{
+  public:
+    using ResultCallback = std::function<void(const ExtFlashBenchResult &result)>;
+    using WorkloadCallback = std::function<void(const char *name)>;
+
+    ExtFlashBench(uint32_t seed = BENCH_DEFAULT_SEED);
+
+    bool runRaw(ExtFlashRawPartition &area, ResultCallback cb); // Raw workloads, destroy the first BENCH_RAW_AREA bytes
+    bool runFs(FS &fs, ResultCallback cb);                      // Filesystem workloads in BENCH_DIR
+    inline void onStart(WorkloadCallback cb) { _onStart = cb; } // Called before each workload, e.g. to reset counters
+
+  private:
+    void begin(const char *name, uint32_t ops = BENCH_MAX_SAMPLES); // Start a workload of about ops operations
+    inline uint32_t startOp() const { return micros(); }
+    void endOp(uint32_t start, uint32_t bytes);    // Record the latency of an operation
+    void end(ResultCallback &cb);                  // Compute the percentiles and report the workload
+    uint32_t random();                             // xorshift32, same sequence on every platform
+    void fill(uint8_t *buffer, size_t size);       // Random data
+
+    uint32_t _seed;                       // Seed of the workloads
+    uint32_t _state;                      // State of the random generator
+    ExtFlashBenchResult _result;          // Running workload
+    uint32_t _samples[BENCH_MAX_SAMPLES]; // Latencies of the running workload
+    uint16_t _count;                      // Samples taken
+    uint32_t _stride;                     // Every _stride-th operation is sampled
+    WorkloadCallback _onStart;            // Called before each workload
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
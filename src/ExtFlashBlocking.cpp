@@ -0,0 +1,101 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashBlocking
+ * @brief Longest blocking time per call site.
+ *
+ * The ExternalFlash API and the steps of ExternalFlash::loop() measure their time with an ExtFlashBlockingScope.
+ * Nested scopes (copyDir calls copyFile) count for the outermost call site only, so every entry is one
+ * uninterrupted stretch the OpenKNX loop had to wait. The table keeps the EXTFLASH_BLOCKING_TOP call sites with
+ * the longest call, with the path of that call. A full table replaces its shortest entry.
+ *
+ * Calls over the limit are overruns, counted per call site and in total.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashBlocking.h"
+#if defined(ARDUINO_ARCH_RP2040)
+
+uint8_t ExtFlashBlocking::depth = 0;
+
+/**
+ * @brief Construct a new Ext Flash Blocking object
+ */
+ExtFlashBlocking::ExtFlashBlocking() : _count(0), _limitUs(EXTFLASH_BLOCKING_LIMIT_US), _overruns(0)
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+/**
+ * @brief Add a measured call of a call site
+ *
+ * @param op the call site, a string literal
+ * @param path the path of the call, nullptr if none
+ * @param us the blocking time
+ */
+void ExtFlashBlocking::add(const char *op, const char *path, uint32_t us)
+{
+    if (us > _limitUs)
+    {
+        _overruns++;
+    }
+
+    int8_t i = 0;
+    while (i < _count && strcmp(_entries[i].op, op) != 0)
+    {
+        i++;
+    }
+    if (i == _count)
+    {
+        if (_count == EXTFLASH_BLOCKING_TOP)
+        {
+            // Table full, the call site replaces the shortest entry if it took longer
+            if (us <= _entries[_count - 1].us)
+            {
+                return;
+            }
+            i = _count - 1;
+        }
+        else
+        {
+            _count++;
+        }
+        memset(&_entries[i], 0, sizeof(_entries[i]));
+        _entries[i].op = op;
+    }
+
+    ExtFlashBlockingEntry &e = _entries[i];
+    e.calls++;
+    e.overruns += us > _limitUs ? 1 : 0;
+    if (us < e.us)
+    {
+        return;
+    }
+    e.us = us;
+    e.lastMs = millis();
+    const size_t len = path ? strlen(path) : 0;
+    strncpy(e.path, path ? path + (len >= sizeof(e.path) ? len - sizeof(e.path) + 1 : 0) : "", sizeof(e.path) - 1);
+    e.path[sizeof(e.path) - 1] = 0;
+
+    // Keep the table sorted, the entry only moves up
+    while (i > 0 && _entries[i - 1].us < _entries[i].us)
+    {
+        const ExtFlashBlockingEntry tmp = _entries[i - 1];
+        _entries[i - 1] = _entries[i];
+        _entries[i] = tmp;
+        i--;
+    }
+}
+
+/**
+ * @brief Clear the table and the overruns
+ */
+void ExtFlashBlocking::reset()
+{
+    memset(_entries, 0, sizeof(_entries));
+    _count = 0;
+    _overruns = 0;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
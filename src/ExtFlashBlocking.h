@@ -0,0 +1,80 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashBlocking.h
+ * @brief       Longest blocking time per call site of the ExternalFlash API and loop steps, to find the flash work
+ *              that makes the OpenKNX loop miss its deadlines
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include <Arduino.h>
+
+#define EXTFLASH_BLOCKING_TOP 8   // Call sites in the table
+#define EXTFLASH_BLOCKING_PATH 24 // Bytes of the path kept per call site, the end of longer paths
+
+#ifndef EXTFLASH_BLOCKING_LIMIT_US
+    #define EXTFLASH_BLOCKING_LIMIT_US 20000 // Blocking time counted as overrun of the loop deadline
+#endif
+
+// Longest call of a call site
+struct ExtFlashBlockingEntry
+{
+    const char *op;                     // Call site, a string literal
+    char path[EXTFLASH_BLOCKING_PATH];  // Path of the longest call, empty if none
+    uint32_t us;                        // Longest call
+    uint32_t calls;                     // Calls measured
+    uint32_t overruns;                  // Calls over the limit
+    uint32_t lastMs;                    // millis() of the longest call
+};
+
+class ExtFlashBlocking
+{
+  public:
+    ExtFlashBlocking();
+
+    void add(const char *op, const char *path, uint32_t us); // Add a measured call
+    void reset();                                            // Clear the table
+
+    inline void setLimit(uint32_t us) { _limitUs = us; }                 // Overrun limit, EXTFLASH_BLOCKING_LIMIT_US
+    inline uint32_t limit() const { return _limitUs; }
+    inline uint8_t count() const { return _count; }                      // Call sites in the table
+    inline const ExtFlashBlockingEntry &entry(uint8_t i) const { return _entries[i]; } // Longest first
+    inline uint32_t overruns() const { return _overruns; }               // Calls over the limit, all call sites
+
+    static uint8_t depth; // Nesting of ExtFlashBlockingScope, only the outermost call is measured
+
+  private:
+    ExtFlashBlockingEntry _entries[EXTFLASH_BLOCKING_TOP]; // Sorted by us, longest first
+    uint8_t _count;                                         // Used entries
+    uint32_t _limitUs;                                      // Overrun limit
+    uint32_t _overruns;                                     // Calls over the limit
+};
+
+// Measures the time from construction to destruction of the outermost scope with the 64-bit us timer
+class ExtFlashBlockingScope
+{
+  public:
+    inline ExtFlashBlockingScope(ExtFlashBlocking &blocking, const char *op, const char *path = nullptr)
+        : _blocking(blocking), _op(op), _path(path), _start(ExtFlashBlocking::depth++ ? 0 : time_us_64()) {}
+    inline ~ExtFlashBlockingScope()
+    {
+        if (--ExtFlashBlocking::depth == 0)
+        {
+            const uint64_t us = time_us_64() - _start;
+            _blocking.add(_op, _path, us > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)us);
+        }
+    }
+
+  private:
+    ExtFlashBlocking &_blocking;
+    const char *_op;
+    const char *_path;
+    uint64_t _start;
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
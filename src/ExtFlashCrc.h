@@ -0,0 +1,38 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashCrc.h
+ * @brief       CRC32 used by the on-flash formats of this module
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief CRC32 (IEEE 802.3, reflected). Bitwise, we don't want to spend 1KB RAM/flash for a table here
+ *
+ * @param data the data
+ * @param len the length of the data
+ * @param crc the crc of the previous chunk, 0 to start
+ * @return the crc
+ */
+inline uint32_t extFlashCrc32(const void *data, size_t len, uint32_t crc = 0)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *p++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#endif // EXTERNAL_FLASH_MODULE
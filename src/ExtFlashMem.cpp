@@ -0,0 +1,91 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @brief Heap accounting of the flash subsystem.
+ *
+ * Every block gets a header of EXTFLASH_MEM_HEADER bytes with its size and category, so a free needs only the
+ * pointer, like LFS_FREE. The header keeps the 8 byte alignment of malloc(). The counters are updated under a
+ * hardware spin lock, which also turns the interrupts of the own core off, so both cores may allocate and free.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashMem.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include <Arduino.h>
+#include <hardware/sync.h>
+
+ExtFlashMemUsage extFlashMem[EXTFLASH_MEM_COUNT];
+const char *const extFlashMemNames[EXTFLASH_MEM_COUNT] = {"lfs", "handle", "module"};
+
+// Shared striped lock of the SDK, only held for the few counter updates
+static spin_lock_t *const extFlashMemLock = spin_lock_instance(PICO_SPINLOCK_ID_STRIPED_FIRST);
+
+// Header in front of a block
+struct ExtFlashMemHeader
+{
+    uint32_t size;    // Bytes of the block including the header
+    uint8_t category; // ExtFlashMemCategory
+    uint8_t reserved[3];
+};
+static_assert(sizeof(ExtFlashMemHeader) == EXTFLASH_MEM_HEADER, "Header size");
+
+/**
+ * @brief Allocate a block and count it for a category
+ *
+ * @param category the category of the block
+ * @param size the bytes
+ * @return the block or nullptr
+ */
+void *extFlashMemAlloc(ExtFlashMemCategory category, size_t size)
+{
+    ExtFlashMemHeader *header = static_cast<ExtFlashMemHeader *>(malloc(size + EXTFLASH_MEM_HEADER));
+    ExtFlashMemUsage &usage = extFlashMem[category];
+    const uint32_t save = spin_lock_blocking(extFlashMemLock);
+    if (!header)
+    {
+        usage.failures++;
+        spin_unlock(extFlashMemLock, save);
+        return nullptr;
+    }
+    header->size = size + EXTFLASH_MEM_HEADER;
+    header->category = category;
+    usage.current += header->size;
+    usage.peak = max(usage.peak, usage.current);
+    usage.allocs++;
+    spin_unlock(extFlashMemLock, save);
+    return header + 1;
+}
+
+/**
+ * @brief Free a block of extFlashMemAlloc()
+ *
+ * @param ptr the block, nullptr is ignored
+ */
+void extFlashMemFree(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+    ExtFlashMemHeader *header = static_cast<ExtFlashMemHeader *>(ptr) - 1;
+    ExtFlashMemUsage &usage = extFlashMem[header->category < EXTFLASH_MEM_COUNT ? header->category : (uint8_t)EXTFLASH_MEM_MODULE];
+    const uint32_t save = spin_lock_blocking(extFlashMemLock);
+    usage.current -= header->size;
+    usage.frees++;
+    spin_unlock(extFlashMemLock, save);
+    free(header);
+}
+
+// Allocations of littlefs itself, the buffers of ext_LittleFSImpl are in its config and don't come here
+extern "C" void *extFlashLfsMalloc(size_t size)
+{
+    return extFlashMemAlloc(EXTFLASH_MEM_LFS, size);
+}
+
+extern "C" void extFlashLfsFree(void *ptr)
+{
+    extFlashMemFree(ptr);
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,156 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashMem.h
+ * @brief       Heap accounting of the flash subsystem per category, with the LFS_MALLOC/LFS_FREE hooks of
+ *              littlefs and an allocator for the handles of ext_LittleFS. C compatible for the littlefs sources
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040) && !defined(__ASSEMBLER__)
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    // Build littlefs with -DLFS_MALLOC=extFlashLfsMalloc -DLFS_FREE=extFlashLfsFree to count its buffers
+    void *extFlashLfsMalloc(size_t size);
+    void extFlashLfsFree(void *ptr);
+#ifdef __cplusplus
+}
+
+#define EXTFLASH_MEM_HEADER 8 // Bytes in front of every block, keep the size and category for the free
+
+enum ExtFlashMemCategory : uint8_t
+{
+    EXTFLASH_MEM_LFS,    // littlefs: caches and lookahead buffer, allocations of littlefs itself (LFS_MALLOC)
+    EXTFLASH_MEM_HANDLE, // lfs_file_t and lfs_dir_t handles, file and directory objects of ext_LittleFS and their paths
+    EXTFLASH_MEM_MODULE, // Buffers of the flash modules (trace ring, wear counters)
+    EXTFLASH_MEM_COUNT
+};
+
+// Heap use of a category, the bytes include the EXTFLASH_MEM_HEADER of each block
+struct ExtFlashMemUsage
+{
+    uint32_t current;  // Bytes allocated now
+    uint32_t peak;     // High-water mark of current
+    uint32_t allocs;   // Allocations
+    uint32_t frees;    // Frees
+    uint32_t failures; // Failed allocations
+};
+
+extern ExtFlashMemUsage extFlashMem[EXTFLASH_MEM_COUNT];       // Heap use per category since boot
+extern const char *const extFlashMemNames[EXTFLASH_MEM_COUNT]; // Names of the categories for the console
+
+void *extFlashMemAlloc(ExtFlashMemCategory category, size_t size); // malloc() with accounting, nullptr on failure
+void extFlashMemFree(void *ptr);                                   // free() of a block of extFlashMemAlloc(), nullptr is ignored
+
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Allocator of the control blocks of extFlashMemMakeShared(). The standard library has no way to report a failed
+// allocation without exceptions, so the allocator sets a flag instead and hands out a static spare of exactly the
+// requested type. extFlashMemMakeShared() sees the flag, drops the pointer and returns nullptr. A shared_ptr only
+// allocates one control block, n is always 1. The spare is per type and only used for that moment
+template <typename T, ExtFlashMemCategory C>
+struct ExtFlashMemAllocator
+{
+    using value_type = T;
+    template <typename U>
+    struct rebind
+    {
+        using other = ExtFlashMemAllocator<U, C>;
+    };
+
+    bool *failed = nullptr; // Set if an allocation didn't get a block
+
+    explicit ExtFlashMemAllocator(bool *failed) : failed(failed) {}
+    template <typename U>
+    ExtFlashMemAllocator(const ExtFlashMemAllocator<U, C> &other) : failed(other.failed) {}
+
+    inline T *allocate(size_t n)
+    {
+        T *p = static_cast<T *>(extFlashMemAlloc(C, n * sizeof(T)));
+        if (!p)
+        {
+            *failed = true;
+            p = spare();
+        }
+        return p;
+    }
+    inline void deallocate(T *p, size_t)
+    {
+        if (p != spare())
+        {
+            extFlashMemFree(p);
+        }
+    }
+
+    template <typename U>
+    inline bool operator==(const ExtFlashMemAllocator<U, C> &) const { return true; }
+    template <typename U>
+    inline bool operator!=(const ExtFlashMemAllocator<U, C> &) const { return false; }
+
+  private:
+    static T *spare()
+    {
+        static typename std::aligned_storage<sizeof(T), alignof(T)>::type block;
+        return reinterpret_cast<T *>(&block);
+    }
+};
+
+// Block of an object of extFlashMemMakeShared(), the object is only destroyed if it was constructed
+template <typename T>
+struct ExtFlashMemSlot
+{
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage; // The object
+    bool constructed;                                                  // The object exists
+};
+
+template <typename T>
+struct ExtFlashMemDeleter
+{
+    inline void operator()(T *p) const
+    {
+        ExtFlashMemSlot<T> *slot = reinterpret_cast<ExtFlashMemSlot<T> *>(p);
+        if (slot->constructed)
+        {
+            p->~T();
+        }
+        extFlashMemFree(slot);
+    }
+};
+
+// std::make_shared with accounting, nullptr if the heap has no room for the object or its control block. The
+// object is constructed only after both exist, so a failure has no side effects of its constructor
+template <typename T, ExtFlashMemCategory C, typename... Args>
+std::shared_ptr<T> extFlashMemMakeShared(Args &&...args)
+{
+    ExtFlashMemSlot<T> *slot = static_cast<ExtFlashMemSlot<T> *>(extFlashMemAlloc(C, sizeof(ExtFlashMemSlot<T>)));
+    if (!slot)
+    {
+        return std::shared_ptr<T>();
+    }
+    slot->constructed = false;
+    T *object = reinterpret_cast<T *>(&slot->storage);
+    bool failed = false;
+    std::shared_ptr<T> ptr(object, ExtFlashMemDeleter<T>(), ExtFlashMemAllocator<T, C>(&failed));
+    if (failed)
+    {
+        return std::shared_ptr<T>(); // ptr frees the slot, its control block was the spare
+    }
+    new (object) T(std::forward<Args>(args)...);
+    slot->constructed = true;
+    return ptr;
+}
+#endif // __cplusplus
+
+#endif // ARDUINO_ARCH_RP2040 && !__ASSEMBLER__
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,507 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashPartitions
+ * @brief Partition table in the first sector of the external flash.
+ *
+ * The table is a header with a CRC followed by up to EFP_MAX_PARTITIONS entries (name, offset, size, type).
+ * LittleFS gets one partition, raw partitions are used directly through the W25Q128 driver by the log ring,
+ * OTA staging or crash dumps, without any filesystem overhead. The default layout is written to a blank chip only.
+ * A chip that was used as one LittleFS from address 0 keeps it as a legacy layout without raw partitions, until
+ * "efc part reset" writes the default table (and the filesystem is formatted). Default partitions missing in a
+ * stored table, e.g. added by a newer firmware, are placed into free space, the filesystem is never moved.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashPartitions.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+
+// Raw partitions of the default layout, from the end of the chip. New ones are appended, so a stored table gets them
+static const struct
+{
+    const char *name;
+    uint32_t size;
+    ExtFlashPartitionType type;
+} efpDefaults[] = {
+    {"log", EXTFLASH_LOG_SIZE, EFP_TYPE_LOG},          {"rawlog", EXTFLASH_RAWLOG_SIZE, EFP_TYPE_RAWLOG},
+    {"ota", EXTFLASH_OTA_SIZE, EFP_TYPE_OTA},          {"crash", EXTFLASH_CRASH_SIZE, EFP_TYPE_CRASH},
+    {"store", EXTFLASH_STORE_SIZE, EFP_TYPE_STORE},    {"trace", EXTFLASH_TRACE_SIZE, EFP_TYPE_TRACE},
+    {"wear", EXTFLASH_WEAR_SIZE, EFP_TYPE_WEAR},
+};
+
+/**
+ * @brief Construct a new Ext Flash Partitions object
+ */
+ExtFlashPartitions::ExtFlashPartitions() : _flash(nullptr), _count(0), _added(0), _created(false), _legacy(false)
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+/**
+ * @brief Read the partition table from the first sector.
+ *
+ * A valid table is loaded and gets the default partitions it is missing. A LittleFS from address 0 is kept as
+ * the legacy layout in RAM. Only a blank chip gets the default table written, anything else is left untouched:
+ * it may be a bad read, and the table is then only written by an explicit "efc part reset".
+ *
+ * @param flash the flash driver
+ * @return true if a table is loaded, the table is empty otherwise
+ */
+bool ExtFlashPartitions::begin(W25Q128 *flash)
+{
+    _flash = flash;
+    _created = false;
+    _legacy = false;
+    _added = 0;
+    clear();
+    if (!_flash)
+    {
+        return false;
+    }
+
+    ExtFlashPartitionHeader header;
+    _flash->read(EFP_TABLE_ADDR, (uint8_t *)&header, sizeof(header));
+    if (header.magic == EFP_MAGIC && header.version == EFP_VERSION && header.count <= EFP_MAX_PARTITIONS)
+    {
+        _flash->read(EFP_TABLE_ADDR + sizeof(header), (uint8_t *)_entries, header.count * sizeof(ExtFlashPartition));
+        _count = header.count;
+        if (header.crc == extFlashCrc32(_entries, _count * sizeof(ExtFlashPartition)) && validate())
+        {
+            addMissing();
+            return true;
+        }
+        clear();
+        return false;
+    }
+
+    if (isLegacyFs())
+    {
+        // One LittleFS on the whole chip, as before the partition table. Never written, it would destroy the filesystem
+        _legacy = true;
+        add("fs", 0, FLASH_SIZE_W25Q128, EFP_TYPE_LITTLEFS);
+        return true;
+    }
+
+    if (isBlank())
+    {
+        setDefaults();
+        _created = write();
+        if (!_created)
+        {
+            clear();
+        }
+        return _created;
+    }
+    return false;
+}
+
+/**
+ * @brief Empty the table in RAM
+ */
+void ExtFlashPartitions::clear()
+{
+    _count = 0;
+    memset(_entries, 0, sizeof(_entries));
+}
+
+/**
+ * @brief Check for a LittleFS that uses the whole chip from address 0. Its superblock pair is in the first two
+ *        blocks: revision count, name tag, "littlefs", struct tag, then version, block size and block count.
+ *        The second block is also the first block of a filesystem partition behind the table, so there only the
+ *        geometry of the whole chip counts
+ *
+ * @return true if the chip holds a legacy filesystem
+ */
+bool ExtFlashPartitions::isLegacyFs()
+{
+    for (uint32_t addr = 0; addr <= SECTOR_SIZE_W25Q128_4KB; addr += SECTOR_SIZE_W25Q128_4KB)
+    {
+        uint8_t superblock[32];
+        _flash->read(addr, superblock, sizeof(superblock));
+        if (memcmp(superblock + 8, "littlefs", 8) != 0)
+        {
+            continue;
+        }
+        uint32_t blockSize, blockCount;
+        memcpy(&blockSize, superblock + 24, sizeof(blockSize));
+        memcpy(&blockCount, superblock + 28, sizeof(blockCount));
+        if (addr == 0 || (uint64_t)blockSize * blockCount == FLASH_SIZE_W25Q128)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check for a blank chip: the table sector and the first block behind it are erased, and the chip answers
+ *        with a JEDEC ID, so a bus that reads 0xFF is not taken for a blank chip
+ *
+ * @return true if the chip is blank
+ */
+bool ExtFlashPartitions::isBlank()
+{
+    const ChipID id = _flash->readID();
+    if (id.manufacturerID == 0x00 || id.manufacturerID == 0xFF)
+    {
+        return false;
+    }
+    uint8_t buffer[PAGE_SIZE_W25Q128_256B];
+    for (uint32_t addr = EFP_TABLE_ADDR; addr < EFP_TABLE_ADDR + 2 * SECTOR_SIZE_W25Q128_4KB; addr += sizeof(buffer))
+    {
+        _flash->read(addr, buffer, sizeof(buffer));
+        for (size_t i = 0; i < sizeof(buffer); i++)
+        {
+            if (buffer[i] != 0xFF)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Add the default partitions missing in a stored table into free space and write the table. The
+ *        filesystem keeps its place, a partition that doesn't fit is left out
+ */
+void ExtFlashPartitions::addMissing()
+{
+    for (const auto &partition : efpDefaults)
+    {
+        if (!partition.size || find(partition.name))
+        {
+            continue;
+        }
+        const uint32_t offset = findFree(partition.size);
+        if (offset && add(partition.name, offset, partition.size, partition.type))
+        {
+            _added++;
+        }
+    }
+    if (_added && !write())
+    {
+        // Keep the stored table, the new partitions would only exist in RAM
+        _count -= _added;
+        _added = 0;
+    }
+}
+
+/**
+ * @brief Find free space for a partition, as close to the end of the chip as possible
+ *
+ * @param size the size of the partition
+ * @return the offset or 0 if there is no space
+ */
+uint32_t ExtFlashPartitions::findFree(uint32_t size) const
+{
+    uint32_t best = 0;
+    for (int16_t i = -1; i < _count; i++)
+    {
+        // Candidates end at the end of the chip or at the start of a partition
+        const uint32_t end = i < 0 ? FLASH_SIZE_W25Q128 : _entries[i].offset;
+        if (end < size || end - size < EFP_TABLE_ADDR + SECTOR_SIZE_W25Q128_4KB || end - size <= best)
+        {
+            continue;
+        }
+        const uint32_t offset = end - size;
+        bool free = true;
+        for (uint8_t j = 0; j < _count && free; j++)
+        {
+            free = offset >= _entries[j].offset + _entries[j].size || _entries[j].offset >= offset + size;
+        }
+        if (free)
+        {
+            best = offset;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Write the table in RAM to the first sector
+ *
+ * @return true if the table is valid and written
+ */
+bool ExtFlashPartitions::write()
+{
+    if (!_flash || !validate())
+    {
+        return false;
+    }
+    ExtFlashPartitionHeader header;
+    header.magic = EFP_MAGIC;
+    header.version = EFP_VERSION;
+    header.count = _count;
+    header.reserved = 0xFF;
+    header.crc = extFlashCrc32(_entries, _count * sizeof(ExtFlashPartition));
+
+    uint8_t table[sizeof(header) + sizeof(_entries)];
+    memcpy(table, &header, sizeof(header));
+    memcpy(table + sizeof(header), _entries, _count * sizeof(ExtFlashPartition));
+
+    _flash->erase(EFP_TABLE_ADDR);
+    _flash->program(EFP_TABLE_ADDR, table, sizeof(header) + _count * sizeof(ExtFlashPartition));
+
+    // Read back, a write protected chip must not leave us with a table that only exists in RAM
+    ExtFlashPartitionHeader check;
+    _flash->read(EFP_TABLE_ADDR, (uint8_t *)&check, sizeof(check));
+    return memcmp(&check, &header, sizeof(header)) == 0;
+}
+
+/**
+ * @brief Replace the table in RAM by the default layout: the table sector, the filesystem, EXTFLASH_PART_RESERVE
+ *        of free space for partitions of later firmware and the raw partitions at the end of the chip
+ */
+void ExtFlashPartitions::setDefaults()
+{
+    clear();
+    _legacy = false;
+    uint32_t end = FLASH_SIZE_W25Q128;
+    for (const auto &partition : efpDefaults)
+    {
+        if (partition.size)
+        {
+            end -= partition.size;
+            add(partition.name, end, partition.size, partition.type);
+        }
+    }
+    end -= EXTFLASH_PART_RESERVE;
+    add("fs", SECTOR_SIZE_W25Q128_4KB, end - SECTOR_SIZE_W25Q128_4KB, EFP_TYPE_LITTLEFS);
+}
+
+/**
+ * @brief Add an entry to the table in RAM. write() persists it
+ *
+ * @param name the name, max EFP_NAME_LEN - 1 characters
+ * @param offset the start address, sector aligned
+ * @param size the size, multiple of the sector size
+ * @param type the type
+ * @return true if the entry was added
+ */
+bool ExtFlashPartitions::add(const char *name, uint32_t offset, uint32_t size, ExtFlashPartitionType type)
+{
+    if (_count >= EFP_MAX_PARTITIONS || !name || strlen(name) >= EFP_NAME_LEN || find(name))
+    {
+        return false;
+    }
+    ExtFlashPartition &entry = _entries[_count];
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.name, name, EFP_NAME_LEN - 1);
+    entry.offset = offset;
+    entry.size = size;
+    entry.type = type;
+    entry.flags = 0xFF;
+    entry.reserved = 0xFFFF;
+    _count++;
+    return true;
+}
+
+/**
+ * @brief Check the table: sector aligned, inside the chip, not in the table sector, no overlaps
+ *
+ * @return true if the table is valid
+ */
+bool ExtFlashPartitions::validate() const
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const ExtFlashPartition &a = _entries[i];
+        if (!a.size || (a.offset % SECTOR_SIZE_W25Q128_4KB) || (a.size % SECTOR_SIZE_W25Q128_4KB) ||
+            a.offset < EFP_TABLE_ADDR + SECTOR_SIZE_W25Q128_4KB || a.offset > FLASH_SIZE_W25Q128 ||
+            a.size > FLASH_SIZE_W25Q128 - a.offset || a.name[EFP_NAME_LEN - 1] != 0)
+        {
+            return false;
+        }
+        for (uint8_t j = i + 1; j < _count; j++)
+        {
+            const ExtFlashPartition &b = _entries[j];
+            if (a.offset < b.offset + b.size && b.offset < a.offset + a.size)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Find a partition by name
+ *
+ * @param name the name
+ * @return the partition or nullptr
+ */
+const ExtFlashPartition *ExtFlashPartitions::find(const char *name) const
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (strncmp(_entries[i].name, name, EFP_NAME_LEN) == 0)
+        {
+            return &_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Find the first partition of a type
+ *
+ * @param type the type
+ * @return the partition or nullptr
+ */
+const ExtFlashPartition *ExtFlashPartitions::find(ExtFlashPartitionType type) const
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (_entries[i].type == type)
+        {
+            return &_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Name of a partition type
+ *
+ * @param type the type
+ * @return the name
+ */
+const char *ExtFlashPartitions::typeName(uint8_t type)
+{
+    switch (type)
+    {
+        case EFP_TYPE_LITTLEFS:
+            return "littlefs";
+        case EFP_TYPE_RAW:
+            return "raw";
+        case EFP_TYPE_LOG:
+            return "log";
+        case EFP_TYPE_RAWLOG:
+            return "rawlog";
+        case EFP_TYPE_OTA:
+            return "ota";
+        case EFP_TYPE_CRASH:
+            return "crash";
+        case EFP_TYPE_STORE:
+            return "store";
+        case EFP_TYPE_TRACE:
+            return "trace";
+        case EFP_TYPE_WEAR:
+            return "wear";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @brief Attach to a partition of the table
+ *
+ * @param flash the flash driver
+ * @param partition the partition, nullptr detaches
+ * @return true if attached
+ */
+bool ExtFlashRawPartition::begin(W25Q128 *flash, const ExtFlashPartition *partition)
+{
+    _flash = (flash && partition) ? flash : nullptr;
+    _offset = partition ? partition->offset : 0;
+    _size = partition ? partition->size : 0;
+    return _flash != nullptr;
+}
+
+/**
+ * @brief Read from the partition
+ *
+ * @param addr the address relative to the partition
+ * @param buffer the buffer
+ * @param size the number of bytes
+ * @return true if the range is inside the partition
+ */
+bool ExtFlashRawPartition::read(uint32_t addr, uint8_t *buffer, size_t size)
+{
+    if (!_flash || !inside(addr, size))
+    {
+        return false;
+    }
+    return _flash->read(_offset + addr, buffer, size) == 0;
+}
+
+/**
+ * @brief Program erased bytes of the partition. The write is split at page boundaries, the chip
+ *        would otherwise wrap around within the page
+ *
+ * @param addr the address relative to the partition
+ * @param buffer the data
+ * @param size the number of bytes
+ * @return true if the range is inside the partition
+ */
+bool ExtFlashRawPartition::program(uint32_t addr, const uint8_t *buffer, size_t size)
+{
+    if (!_flash || !inside(addr, size))
+    {
+        return false;
+    }
+    while (size)
+    {
+        const size_t chunk = min<size_t>(size, PAGE_SIZE_W25Q128_256B - (addr % PAGE_SIZE_W25Q128_256B));
+        if (_flash->program(_offset + addr, buffer, chunk) != 0)
+        {
+            return false;
+        }
+        addr += chunk;
+        buffer += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+/**
+ * @brief Erase a sector of the partition and wait for it
+ *
+ * @param addr an address in the sector, relative to the partition
+ * @return true if the sector is inside the partition
+ */
+bool ExtFlashRawPartition::erase(uint32_t addr)
+{
+    if (!_flash || !inside(addr, 1))
+    {
+        return false;
+    }
+    return _flash->erase(_offset + addr - (addr % SECTOR_SIZE_W25Q128_4KB)) == 0;
+}
+
+/**
+ * @brief Start the erase of a sector of the partition, see W25Q128::eraseAsync()
+ *
+ * @param addr an address in the sector, relative to the partition
+ * @return true if the sector is inside the partition
+ */
+bool ExtFlashRawPartition::eraseAsync(uint32_t addr)
+{
+    if (!_flash || !inside(addr, 1))
+    {
+        return false;
+    }
+    _flash->eraseAsync(_offset + addr - (addr % SECTOR_SIZE_W25Q128_4KB));
+    return true;
+}
+
+/**
+ * @brief Start the erase of a 64KB block of the partition, see W25Q128::eraseBlockAsync()
+ *
+ * @param addr the address of the block relative to the partition, the block must be 64KB aligned on the chip
+ * @return true if the block is inside the partition and aligned
+ */
+bool ExtFlashRawPartition::eraseBlockAsync(uint32_t addr)
+{
+    if (!_flash || !inside(addr, BLOCK_SIZE_W25Q128_64KB) || ((_offset + addr) % BLOCK_SIZE_W25Q128_64KB))
+    {
+        return false;
+    }
+    _flash->eraseBlockAsync(_offset + addr);
+    return true;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
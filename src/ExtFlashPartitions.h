@@ -0,0 +1,145 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashPartitions.h
+ * @brief       Partition table in the first sector of the external flash. Splits the chip into
+ *              one LittleFS partition and raw partitions with direct W25Q128 access
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "W25Q128.h"
+
+#define EFP_MAGIC 0x54504645            // "EFPT"
+#define EFP_VERSION 1                   // Version of the table layout
+#define EFP_TABLE_ADDR 0                // The table lives in the first sector of the chip
+#define EFP_MAX_PARTITIONS 16           // Max number of partitions in the table
+#define EFP_NAME_LEN 12                 // Max length of a partition name, including the terminating zero
+
+// Default layout. The table sector comes first, the filesystem takes everything that is not used by raw partitions
+#ifndef EXTFLASH_LOG_SIZE
+    #define EXTFLASH_LOG_SIZE (64 * SECTOR_SIZE_W25Q128_4KB) // Size of the "log" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_OTA_SIZE
+    #define EXTFLASH_OTA_SIZE (2 * 1024 * 1024) // Size of the "ota" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_RAWLOG_SIZE
+    #define EXTFLASH_RAWLOG_SIZE (256 * SECTOR_SIZE_W25Q128_4KB) // Size of the "rawlog" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_CRASH_SIZE
+    #define EXTFLASH_CRASH_SIZE (16 * SECTOR_SIZE_W25Q128_4KB) // Size of the "crash" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_STORE_SIZE
+    #define EXTFLASH_STORE_SIZE (16 * SECTOR_SIZE_W25Q128_4KB) // Size of the "store" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_TRACE_SIZE
+    #define EXTFLASH_TRACE_SIZE (64 * SECTOR_SIZE_W25Q128_4KB) // Size of the "trace" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_WEAR_SIZE
+    #define EXTFLASH_WEAR_SIZE (16 * SECTOR_SIZE_W25Q128_4KB) // Size of the "wear" partition, 0 leaves it out
+#endif
+#ifndef EXTFLASH_PART_RESERVE
+    #define EXTFLASH_PART_RESERVE (128 * SECTOR_SIZE_W25Q128_4KB) // Free space behind the filesystem for later partitions
+#endif
+
+enum ExtFlashPartitionType : uint8_t
+{
+    EFP_TYPE_LITTLEFS = 1, // LittleFS filesystem
+    EFP_TYPE_RAW = 2,      // Raw data, free use
+    EFP_TYPE_LOG = 3,      // Log ring
+    EFP_TYPE_RAWLOG = 4,   // Append log of CRC framed records
+    EFP_TYPE_OTA = 5,      // Staging area for firmware images
+    EFP_TYPE_CRASH = 6,    // Hard fault dump
+    EFP_TYPE_STORE = 7,    // Module data slots
+    EFP_TYPE_TRACE = 8,    // Spilled block device trace
+    EFP_TYPE_WEAR = 9,     // Erase count checkpoints
+};
+
+// One entry of the partition table
+struct __attribute__((packed)) ExtFlashPartition
+{
+    char name[EFP_NAME_LEN]; // Zero terminated name
+    uint32_t offset;         // Start address, sector aligned
+    uint32_t size;           // Size in bytes, multiple of the sector size
+    uint8_t type;            // ExtFlashPartitionType
+    uint8_t flags;           // Reserved, 0xFF
+    uint16_t reserved;
+};
+
+// Header of the partition table, followed by the entries
+struct __attribute__((packed)) ExtFlashPartitionHeader
+{
+    uint32_t magic;   // EFP_MAGIC
+    uint16_t version; // EFP_VERSION
+    uint8_t count;    // Number of entries
+    uint8_t reserved;
+    uint32_t crc;     // CRC32 over the entries
+};
+
+class ExtFlashPartitions
+{
+  public:
+    ExtFlashPartitions();
+
+    bool begin(W25Q128 *flash); // Read the table, write the default layout to a blank chip
+    bool write();               // Validate the table in RAM and write it to the first sector
+    void setDefaults();         // Replace the table in RAM by the default layout
+    bool add(const char *name, uint32_t offset, uint32_t size, ExtFlashPartitionType type); // Add an entry to the table in RAM
+    bool validate() const;      // Check alignment, bounds and overlaps
+
+    const ExtFlashPartition *find(const char *name) const;             // Find a partition by name
+    const ExtFlashPartition *find(ExtFlashPartitionType type) const;   // First partition of a type
+    inline uint8_t count() const { return _count; }                    // Number of partitions
+    inline const ExtFlashPartition &at(uint8_t index) const { return _entries[index]; } // Partition by index
+    inline bool created() const { return _created; }                   // The default layout was written at begin()
+    inline bool legacy() const { return _legacy; }                     // One LittleFS on the whole chip, no table
+    inline uint8_t added() const { return _added; }                    // Default partitions added to the table at begin()
+
+    static const char *typeName(uint8_t type); // Name of a partition type
+
+  private:
+    void clear();                           // Empty the table in RAM
+    bool isLegacyFs();                      // A LittleFS superblock of the whole chip at address 0
+    bool isBlank();                         // The table sector and the block behind it are erased
+    void addMissing();                      // Add the missing default partitions into free space
+    uint32_t findFree(uint32_t size) const; // Free space for a partition, 0 if none
+
+    W25Q128 *_flash;                                // Flash driver
+    ExtFlashPartition _entries[EFP_MAX_PARTITIONS]; // Entries of the table
+    uint8_t _count;                                 // Number of entries
+    uint8_t _added;                                 // Default partitions added to the table at begin()
+    bool _created;                                  // The default layout was written at begin()
+    bool _legacy;                                   // One LittleFS on the whole chip, no table
+};
+
+// Bounds checked access to a raw partition
+class ExtFlashRawPartition
+{
+  public:
+    ExtFlashRawPartition() : _flash(nullptr), _offset(0), _size(0) {}
+
+    bool begin(W25Q128 *flash, const ExtFlashPartition *partition); // Attach to a partition of the table
+    bool read(uint32_t addr, uint8_t *buffer, size_t size);         // Read at an address relative to the partition
+    bool program(uint32_t addr, const uint8_t *buffer, size_t size); // Program erased bytes, never crosses a page
+    bool erase(uint32_t addr);                                      // Erase the sector at addr (blocking)
+    bool eraseAsync(uint32_t addr);                                 // Start the erase of the sector at addr
+    bool eraseBlockAsync(uint32_t addr);                            // Start the erase of the 64KB block at addr, must be aligned
+
+    inline bool isReady() const { return _flash != nullptr; } // Attached to a partition
+    inline uint32_t offset() const { return _offset; }        // Start address on the chip
+    inline uint32_t size() const { return _size; }            // Size of the partition
+    inline W25Q128 *flash() const { return _flash; }          // Flash driver
+
+  private:
+    inline bool inside(uint32_t addr, size_t size) const { return addr <= _size && size <= _size - addr; }
+
+    W25Q128 *_flash;  // Flash driver or nullptr
+    uint32_t _offset; // Start address on the chip
+    uint32_t _size;   // Size of the partition
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
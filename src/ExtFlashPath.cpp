@@ -0,0 +1,145 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashPath
+ * @brief Normalized path on the stack.
+ *
+ * The filesystem API takes paths from string literals, parts of console commands and joined directory entries.
+ * ExtFlashPath copies them into a buffer of EXTFLASH_PATH_MAX bytes, the same form for all of them, so the
+ * hot paths of ext_LittleFS need no strdup and no String. Too long paths are invalid instead of truncated, a
+ * truncated path would name another file.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashPath.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include <string.h>
+
+/**
+ * @brief Construct a normalized path
+ *
+ * @param path the path, need not be terminated
+ * @param len the bytes of the path
+ */
+ExtFlashPath::ExtFlashPath(const char *path, size_t len) : _len(1), _valid(true)
+{
+    _path[0] = '/';
+    _path[1] = 0;
+    if (!path && len)
+    {
+        invalidate();
+        return;
+    }
+    append(std::string_view(path ? path : "", len));
+}
+
+/**
+ * @brief Construct a normalized path
+ *
+ * @param path the terminated path, nullptr is invalid
+ */
+ExtFlashPath::ExtFlashPath(const char *path) : ExtFlashPath(path, path ? strlen(path) : 0)
+{
+    if (!path)
+    {
+        invalidate();
+    }
+}
+
+/**
+ * @brief Construct a path of a directory and a name in it
+ *
+ * @param dir the directory
+ * @param name the name, can have components
+ */
+ExtFlashPath::ExtFlashPath(std::string_view dir, std::string_view name) : ExtFlashPath(dir.data(), dir.size())
+{
+    append(name);
+}
+
+/**
+ * @brief Add the components of a path
+ *
+ * @param path the path, leading slashes are ignored
+ * @return true if the path is still valid
+ */
+bool ExtFlashPath::append(std::string_view path)
+{
+    size_t i = 0;
+    while (_valid && i < path.size())
+    {
+        while (i < path.size() && path[i] == '/')
+        {
+            i++;
+        }
+        const size_t start = i;
+        while (i < path.size() && path[i] != '/')
+        {
+            if (!path[i])
+            {
+                invalidate();
+                return false;
+            }
+            i++;
+        }
+        const size_t len = i - start;
+        if (!len || (len == 1 && path[start] == '.'))
+        {
+            continue;
+        }
+        const size_t at = _len == 1 ? 1 : _len + 1; // The root has its slash already
+        if (len >= LFS_NAME_MAX || at + len >= EXTFLASH_PATH_MAX)
+        {
+            invalidate();
+            return false;
+        }
+        _path[at - 1] = '/';
+        memcpy(_path + at, path.data() + start, len);
+        _len = at + len;
+        _path[_len] = 0;
+    }
+    return _valid;
+}
+
+/**
+ * @brief Remove the last component
+ *
+ * @return true if a component was removed, false at the root or if invalid
+ */
+bool ExtFlashPath::parent()
+{
+    if (!_valid || _len == 1)
+    {
+        return false;
+    }
+    _len = name() - _path - 1;
+    if (!_len)
+    {
+        _len = 1; // Keep the slash of the root
+    }
+    _path[_len] = 0;
+    return true;
+}
+
+/**
+ * @brief Get the last component
+ *
+ * @return the name, "" at the root or if invalid
+ */
+const char *ExtFlashPath::name() const
+{
+    return _len ? strrchr(_path, '/') + 1 : _path;
+}
+
+/**
+ * @brief Mark the path invalid, c_str() is "" then
+ */
+void ExtFlashPath::invalidate()
+{
+    _path[0] = 0;
+    _len = 0;
+    _valid = false;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,52 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashPath.h
+ * @brief       Normalized path in a bounded buffer on the stack, for the filesystem calls without heap
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "../lib/littlefs/lfs.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#ifndef EXTFLASH_PATH_MAX
+    #define EXTFLASH_PATH_MAX 128 // Bytes of a path including the terminator, longer paths are invalid (see README)
+#endif
+
+// A path from a pointer and a length, normalized to "/a/b": one leading slash, no repeated or trailing slashes,
+// no "." components. The root is "/". Components of LFS_NAME_MAX bytes or more, embedded zeros and paths over
+// EXTFLASH_PATH_MAX make the path invalid, c_str() is "" then
+class ExtFlashPath
+{
+  public:
+    ExtFlashPath(const char *path, size_t len);                                     // Normalize len bytes
+    explicit ExtFlashPath(const char *path);                                        // Normalize a terminated path, nullptr is invalid
+    explicit ExtFlashPath(std::string_view path) : ExtFlashPath(path.data(), path.size()) {}
+    ExtFlashPath(std::string_view dir, std::string_view name);                      // Join a directory and a name
+
+    bool append(std::string_view path); // Add the components of a relative path, false if it gets invalid
+    bool parent();                      // Remove the last component, false at the root
+
+    inline bool isValid() const { return _valid; }
+    inline bool isRoot() const { return _valid && _len == 1; }
+    inline const char *c_str() const { return _path; }
+    inline size_t length() const { return _len; }
+    inline std::string_view view() const { return std::string_view(_path, _len); }
+    const char *name() const; // Last component, "" at the root
+
+  private:
+    void invalidate();
+
+    char _path[EXTFLASH_PATH_MAX]; // Terminated path
+    uint16_t _len;                 // Bytes without the terminator
+    bool _valid;                   // Fits and all components are valid
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
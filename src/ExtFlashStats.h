@@ -0,0 +1,199 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashStats.h
+ * @brief       Always-on counters and latency histograms of the flash driver, the LittleFS callbacks and the
+ *              filesystem, plain increments cheap enough for production builds
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EXTFLASH_LAT_BUCKETS 24 // Log2 buckets of the latency histograms, 1 us up to 8.4 s and more in the last one
+#define EXTFLASH_WA_DIRS 8      // Top-level directories with their own write amplification, entry 0 collects the rest
+#define EXTFLASH_WA_NAME 12     // Bytes of a directory name, longer names are cut
+
+// Operations with a latency histogram
+enum ExtFlashLatOp : uint8_t
+{
+    EXTFLASH_LAT_READ,    // W25Q128::read()
+    EXTFLASH_LAT_PROGRAM, // W25Q128::program()
+    EXTFLASH_LAT_ERASE,   // W25Q128::erase()
+    EXTFLASH_LAT_BUSY,    // W25Q128::waitUntilReady()
+    EXTFLASH_LAT_OPEN,    // File open, ExternalFlash::open() and ext_LittleFS.open()
+    EXTFLASH_LAT_FREAD,   // File read
+    EXTFLASH_LAT_FWRITE,  // File write
+    EXTFLASH_LAT_CLOSE,   // File close
+    EXTFLASH_LAT_STAT,    // ExternalFlash::Statistics() and ext_LittleFS.stat()
+    EXTFLASH_LAT_COUNT
+};
+
+// Latency histogram, bucket i counts the calls of 2^i to 2^(i+1)-1 us, bucket 0 also those below 1 us
+struct ExtFlashHistogram
+{
+    uint32_t buckets[EXTFLASH_LAT_BUCKETS]; // Calls per bucket
+    uint32_t count;                         // Calls
+    uint32_t maxUs;                         // Longest call
+    uint64_t sumUs;                         // Time of all calls
+
+    inline void add(uint32_t us)
+    {
+        const uint8_t i = us ? 31 - __builtin_clz(us) : 0;
+        buckets[i < EXTFLASH_LAT_BUCKETS ? i : EXTFLASH_LAT_BUCKETS - 1]++;
+        count++;
+        maxUs = us > maxUs ? us : maxUs;
+        sumUs += us;
+    }
+
+    // Upper bound of the bucket holding the given percentile, limited by the longest call
+    inline uint32_t percentile(uint8_t pct) const
+    {
+        const uint32_t rank = (uint64_t)count * pct / 100;
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < EXTFLASH_LAT_BUCKETS; i++)
+        {
+            seen += buckets[i];
+            if (seen > rank)
+            {
+                const uint32_t upper = (2u << i) - 1;
+                return upper < maxUs ? upper : maxUs;
+            }
+        }
+        return maxUs;
+    }
+};
+
+// Bytes of the file writes and the flash work they caused, per top-level directory
+struct ExtFlashWaDir
+{
+    char name[EXTFLASH_WA_NAME]; // Top-level directory, "/" for files in the root, empty for entry 0
+    uint64_t logicalBytes;       // Bytes written to files
+    uint64_t progBytes;          // Bytes programmed by littlefs
+    uint64_t eraseBytes;         // Bytes erased by littlefs
+};
+
+// Counters since boot or the last reset()
+struct ExtFlashStats
+{
+    // SPI bus (W25Q128)
+    uint64_t spiBytesOut;     // Command, address and program data bytes sent
+    uint64_t spiBytesIn;      // Read data, status and ID bytes received
+    uint32_t cmdRead;         // Read data commands (0x03)
+    uint32_t cmdPageProgram;  // Page program commands (0x02)
+    uint32_t cmdSectorErase;  // Sector erase commands (0x20)
+    uint32_t cmdBlockErase;   // 64KB block erase commands (0xD8)
+    uint32_t cmdChipErase;    // Chip erase commands (0xC7)
+    uint32_t cmdWriteEnable;  // Write enable commands (0x06)
+    uint32_t cmdWriteDisable; // Write disable commands (0x04)
+    uint32_t cmdReadStatus;   // Status register reads (0x05), mostly busy polling
+    uint32_t cmdOther;        // Other commands (ID, write status)
+    uint64_t busyWaitUs;      // Time spent in W25Q128::waitUntilReady()
+
+    // LittleFS block device callbacks, the rest of the driver traffic comes from the raw partitions
+    uint32_t lfsReads;       // Read callbacks, the read cache of littlefs missed
+    uint32_t lfsProgs;       // Prog callbacks
+    uint32_t lfsErases;      // Erase callbacks (blocks)
+    uint32_t lfsSyncs;       // Sync callbacks, one per metadata commit or file sync
+    uint64_t lfsReadBytes;   // Bytes read by littlefs
+    uint64_t lfsProgBytes;   // Bytes programmed by littlefs
+
+    // Driver operations, filesystem and raw partitions
+    uint64_t readBytes;    // Bytes read
+    uint64_t programBytes; // Bytes programmed
+    uint32_t erases;       // Blocking sector erases
+    uint32_t asyncErases;  // Background sector and block erases
+
+    // Filesystem (ext_LittleFSImpl)
+    uint32_t opens;          // Files opened
+    uint32_t openFailures;   // Failed opens
+    uint32_t fdRefused;      // Opens refused with all file descriptors open
+    uint32_t closes;         // Files closed
+    uint32_t dirOpens;       // Directories opened
+    uint32_t fileReads;      // File read calls
+    uint32_t fileWrites;     // File write calls
+    uint32_t flushes;        // File flushes (lfs_file_sync)
+    uint64_t fileReadBytes;  // Bytes read from files
+    uint64_t fileWriteBytes; // Bytes written to files
+    uint32_t cacheHits;      // File reads served by the caches, without a read callback
+    uint32_t cacheMisses;    // File reads that read from the flash
+
+    ExtFlashHistogram latency[EXTFLASH_LAT_COUNT]; // Latency per ExtFlashLatOp
+
+    // Write amplification. Entry 0 gets the flash work outside of file operations (mount, directory reads, lfs
+    // housekeeping) and the directories that don't fit into the table
+    ExtFlashWaDir wa[EXTFLASH_WA_DIRS];
+    uint8_t waDir; // Entry of the running file operation, set by ExtFlashWaScope
+
+    inline void reset() { memset(this, 0, sizeof(*this)); }
+
+    // Entry of the top-level directory of a path, added if new
+    inline uint8_t waIndex(const char *path)
+    {
+        if (!path)
+        {
+            return 0;
+        }
+        char name[EXTFLASH_WA_NAME] = "/";
+        path += *path == '/' ? 1 : 0;
+        const char *end = strchr(path, '/');
+        if (end)
+        {
+            const size_t len = end - path < EXTFLASH_WA_NAME - 1 ? end - path : EXTFLASH_WA_NAME - 1;
+            memcpy(name, path, len);
+            name[len] = 0;
+        }
+        for (uint8_t i = 1; i < EXTFLASH_WA_DIRS; i++)
+        {
+            if (!wa[i].name[0])
+            {
+                memcpy(wa[i].name, name, sizeof(name));
+                return i;
+            }
+            if (!strcmp(wa[i].name, name))
+            {
+                return i;
+            }
+        }
+        return 0;
+    }
+};
+
+extern ExtFlashStats extFlashStats; // Counters of the flash subsystem
+
+// Adds the time from construction to destruction to a latency histogram, measured with the 64-bit us timer
+class ExtFlashLatencyScope
+{
+  public:
+    inline explicit ExtFlashLatencyScope(ExtFlashLatOp op) : _op(op), _start(time_us_64()) {}
+    inline ~ExtFlashLatencyScope()
+    {
+        const uint64_t us = time_us_64() - _start;
+        extFlashStats.latency[_op].add(us > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)us);
+    }
+
+  private:
+    ExtFlashLatOp _op;
+    uint64_t _start;
+};
+
+// Books the flash work of littlefs to the top-level directory of a path until the end of the scope
+class ExtFlashWaScope
+{
+  public:
+    inline explicit ExtFlashWaScope(const char *path) : _prev(extFlashStats.waDir) { extFlashStats.waDir = extFlashStats.waIndex(path); }
+    inline ~ExtFlashWaScope() { extFlashStats.waDir = _prev; }
+
+  private:
+    uint8_t _prev;
+};
+
+extern const char *const extFlashLatNames[EXTFLASH_LAT_COUNT]; // Names of the ExtFlashLatOp for the console
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
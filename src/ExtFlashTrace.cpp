@@ -0,0 +1,404 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashTrace
+ * @brief Trace of the LittleFS block device calls.
+ *
+ * The lfs_config of the filesystem uses the callbacks of this class, they forward to the W25Q128 callbacks. While
+ * a trace runs, every call is recorded with its op, block, offset, size and micros() into a RAM ring of
+ * TRACE_RING_RECORDS. Without a spill the ring keeps the latest records. With a spill loop() writes the ring page
+ * by page into the "trace" partition. The sectors are erased in the background while no lfs call was recorded for
+ * TRACE_ERASE_IDLE_MS, or once half of the ring waits for the next sector. A spill stops at the end of
+ * the partition and survives a reboot, the header in the first page keeps the block size and count of the
+ * filesystem. Records that don't fit into the ring before loop() writes them are counted as dropped.
+ *
+ * ext_LittleFSImpl::fileOpCallback adds the file operations (open, write, read, flush, seek, truncate, close,
+ * remove, mkdir, rename) with a handle per open file and a hash of the normalized path, so the workload can be run
+ * again with another LittleFS configuration. Each path is preceded by one record per component with its hash and
+ * the hash of its parent, the directory tree is rebuilt from them.
+ *
+ * The records are dumped as text lines "TR <us> <op> <block> <off> <size>" by "efc trace dump". The host tool
+ * efc_hostreplay runs the block device calls against the emulated chip with other timings and cache sizes,
+ * efc_hosttune runs the file operations with a sweep of LittleFS configurations.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashTrace.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+#include "ExtFlashMem.h"
+#include "ExtFlashPath.h"
+
+ExtFlashTrace *ExtFlashTrace::instance = nullptr;
+
+/**
+ * @brief Construct a new Ext Flash Trace object
+ */
+ExtFlashTrace::ExtFlashTrace() : _ring(nullptr), _head(0), _tail(0), _dropped(0), _spilled(0), _erased(0), _spill(false)
+{
+    memset(&_header, 0, sizeof(_header));
+    memset(_files, 0, sizeof(_files));
+}
+
+ExtFlashTrace::~ExtFlashTrace()
+{
+    clear();
+}
+
+/**
+ * @brief Attach the spill partition. A trace spilled before the reboot can be read with forEach()
+ *
+ * @param partition the raw partition, at least 2 sectors
+ * @return true if the partition can be used
+ */
+bool ExtFlashTrace::begin(const ExtFlashRawPartition &partition)
+{
+    _partition = partition;
+    if (!_partition.isReady() || _partition.size() < 2 * SECTOR_SIZE_W25Q128_4KB)
+    {
+        _partition.begin(nullptr, nullptr);
+        return false;
+    }
+    _spill = readHeader();
+    return true;
+}
+
+/**
+ * @brief Start recording. A running trace is restarted
+ *
+ * @param blockSize block_size of the filesystem
+ * @param blockCount block_count of the filesystem
+ * @param spill write the records into the partition, erases its first sectors (blocking)
+ * @return true if started
+ */
+bool ExtFlashTrace::start(uint32_t blockSize, uint32_t blockCount, bool spill)
+{
+    stop();
+    if ((spill && !_partition.isReady()) || blockCount > 0xFFFF)
+    {
+        return false;
+    }
+    if (!_ring)
+    {
+        _ring = static_cast<ExtFlashTraceRecord *>(extFlashMemAlloc(EXTFLASH_MEM_MODULE, TRACE_RING_RECORDS * sizeof(ExtFlashTraceRecord)));
+        if (!_ring)
+        {
+            return false;
+        }
+    }
+    _head = 0;
+    _tail = 0;
+    _dropped = 0;
+    _spilled = 0;
+    _spill = spill;
+    memset(_files, 0, sizeof(_files));
+
+    memset(&_header, 0, sizeof(_header));
+    _header.magic = TRACE_MAGIC;
+    _header.version = TRACE_VERSION;
+    _header.blockSize = blockSize;
+    _header.blockCount = blockCount;
+    _header.startUs = micros();
+    _header.crc = extFlashCrc32(&_header, offsetof(ExtFlashTraceHeader, crc));
+    if (_spill)
+    {
+        _erased = 2 * SECTOR_SIZE_W25Q128_4KB;
+        if (!_partition.erase(0) || !_partition.erase(SECTOR_SIZE_W25Q128_4KB) ||
+            !_partition.program(0, (const uint8_t *)&_header, sizeof(_header)))
+        {
+            _spill = false;
+            return false;
+        }
+    }
+    instance = this;
+    return true;
+}
+
+/**
+ * @brief Stop recording. Records left in the ring are written to the partition by loop()
+ */
+void ExtFlashTrace::stop()
+{
+    if (instance == this)
+    {
+        instance = nullptr;
+    }
+}
+
+/**
+ * @brief Stop recording and free the RAM ring. A spilled trace stays in the partition
+ */
+void ExtFlashTrace::clear()
+{
+    stop();
+    extFlashMemFree(_ring);
+    _ring = nullptr;
+    if (_spill)
+    {
+        _dropped += _head - _tail;
+    }
+    _tail = _head;
+}
+
+/**
+ * @brief Write one page of records to the partition. Waits for a full page while recording
+ */
+void ExtFlashTrace::loop()
+{
+    const uint32_t pending = _head - _tail;
+    if (!_spill || !_ring || !pending)
+    {
+        return;
+    }
+    const uint32_t addr = PAGE_SIZE_W25Q128_256B + _spilled * sizeof(ExtFlashTraceRecord);
+    if (addr >= _partition.size())
+    {
+        // Partition full, the trace ends here
+        stop();
+        _dropped += pending;
+        _tail = _head;
+        return;
+    }
+    const uint32_t toPageEnd = TRACE_RECORDS_PER_PAGE - _spilled % TRACE_RECORDS_PER_PAGE;
+    if (isRecording() && pending < toPageEnd)
+    {
+        return;
+    }
+    if (_erased < _partition.size() && _erased < addr + 2 * SECTOR_SIZE_W25Q128_4KB)
+    {
+        // The erase holds the chip, every filesystem call in the meantime waits for it. So the next sector is erased
+        // ahead only while the filesystem is idle, the sector of this page also once half of the ring is pending
+        const bool idle = !isRecording() || micros() - _ring[(_head - 1) % TRACE_RING_RECORDS].us >= TRACE_ERASE_IDLE_MS * 1000;
+        if (idle || (_erased <= addr && pending >= TRACE_RING_RECORDS / 2))
+        {
+            _partition.eraseAsync(_erased);
+            _erased += SECTOR_SIZE_W25Q128_4KB;
+            return;
+        }
+        if (_erased <= addr)
+        {
+            return;
+        }
+    }
+    if (_partition.flash()->isBusy())
+    {
+        return;
+    }
+
+    ExtFlashTraceRecord page[TRACE_RECORDS_PER_PAGE];
+    const uint32_t count = min(pending, toPageEnd);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        page[i] = _ring[(_tail + i) % TRACE_RING_RECORDS];
+    }
+    _partition.program(addr, (const uint8_t *)page, count * sizeof(ExtFlashTraceRecord));
+    _tail += count;
+    _spilled += count;
+}
+
+/**
+ * @brief Stream the records, oldest first. From the partition after a spill, from the RAM ring otherwise
+ *
+ * @param callback called for each record
+ * @return the number of records
+ */
+uint32_t ExtFlashTrace::forEach(Callback callback)
+{
+    uint32_t count = 0;
+    if (_spill)
+    {
+        if (!readHeader())
+        {
+            return 0;
+        }
+        ExtFlashTraceRecord page[TRACE_RECORDS_PER_PAGE];
+        for (uint32_t addr = PAGE_SIZE_W25Q128_256B; addr < _partition.size(); addr += PAGE_SIZE_W25Q128_256B)
+        {
+            _partition.read(addr, (uint8_t *)page, sizeof(page));
+            for (uint32_t i = 0; i < TRACE_RECORDS_PER_PAGE; i++)
+            {
+                if (page[i].op == 0xFF)
+                {
+                    return count; // Erased, end of the trace
+                }
+                callback(page[i]);
+                count++;
+            }
+        }
+        return count;
+    }
+    if (!_ring)
+    {
+        return 0;
+    }
+    for (uint32_t n = _head > TRACE_RING_RECORDS ? _head - TRACE_RING_RECORDS : 0; n < _head; n++)
+    {
+        callback(_ring[n % TRACE_RING_RECORDS]);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Add a record to the ring. Overwrites the oldest one without a spill, drops the new one with a spill
+ */
+void ExtFlashTrace::record(ExtFlashTraceOp op, lfs_block_t block, lfs_off_t off, lfs_size_t size)
+{
+    if (_head - _tail >= TRACE_RING_RECORDS)
+    {
+        _dropped++;
+        if (_spill)
+        {
+            return;
+        }
+        // Without a spill the oldest record is overwritten
+    }
+    ExtFlashTraceRecord &r = _ring[_head % TRACE_RING_RECORDS];
+    r.us = micros();
+    r.block = block;
+    r.op = op;
+    r.flags = 0;
+    r.off = off;
+    r.size = size;
+    _head++;
+    if (!_spill)
+    {
+        _tail = _head > TRACE_RING_RECORDS ? _head - TRACE_RING_RECORDS : 0;
+    }
+}
+
+/**
+ * @brief Read and check the header in the first page of the partition
+ *
+ * @return true if the partition holds a trace
+ */
+bool ExtFlashTrace::readHeader()
+{
+    ExtFlashTraceHeader header;
+    if (!_partition.read(0, (uint8_t *)&header, sizeof(header)) || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+        header.crc != extFlashCrc32(&header, offsetof(ExtFlashTraceHeader, crc)))
+    {
+        return false;
+    }
+    _header = header;
+    return true;
+}
+
+/**
+ * @brief Handle of an open file, the index in _files
+ *
+ * @param file the lfs file
+ * @param open assign a free handle
+ * @return the handle, TRACE_NO_FILE if unknown or no handle is free
+ */
+uint16_t ExtFlashTrace::handle(const void *file, bool open)
+{
+    for (uint16_t i = 0; i < TRACE_MAX_FILES; i++)
+    {
+        if (_files[i] == (open ? nullptr : file))
+        {
+            _files[i] = file;
+            return i;
+        }
+    }
+    return TRACE_NO_FILE;
+}
+
+uint32_t ExtFlashTrace::pathHash(const char *path)
+{
+    uint32_t hash = 2166136261u;
+    while (path && *path)
+    {
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Record the components of a normalized path, each with its hash and the hash of its parent
+ *
+ * @param path the normalized path
+ */
+void ExtFlashTrace::recordPath(const char *path)
+{
+    uint32_t hash = 2166136261u; // pathHash() of the prefix
+    uint32_t parent = 0;
+    uint16_t depth = 0;
+    for (const char *p = path; p[0] && p[1];) // The root alone has no component
+    {
+        do
+        {
+            hash = (hash ^ (uint8_t)*p++) * 16777619u;
+        } while (*p && *p != '/');
+        record(TRACE_OP_PATH, ++depth, hash, parent);
+        parent = hash;
+    }
+}
+
+/**
+ * @brief Record a file operation of ext_LittleFSImpl
+ *
+ * @param op the ExtFlashTraceOp
+ * @param file the lfs file of an open file, nullptr for path operations
+ * @param path the path of open, remove, mkdir and rename
+ * @param size bytes, open flags or position
+ */
+void ExtFlashTrace::fileOp(char op, const void *file, const char *path, uint32_t size)
+{
+    if (!instance)
+    {
+        return;
+    }
+    uint16_t id = file ? instance->handle(file, op == TRACE_OP_OPEN) : 0;
+    if (op == TRACE_OP_CLOSE && id != TRACE_NO_FILE)
+    {
+        instance->_files[id] = nullptr;
+    }
+    uint32_t hash = 0;
+    if (path)
+    {
+        const ExtFlashPath normalized(path);
+        instance->recordPath(normalized.c_str());
+        hash = pathHash(normalized.c_str());
+    }
+    instance->record((ExtFlashTraceOp)op, id, hash, size);
+}
+
+int ExtFlashTrace::lfs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
+{
+    if (instance)
+    {
+        instance->record(TRACE_OP_READ, block, off, size);
+    }
+    return W25Q128::lfs_read(c, block, off, buffer, size);
+}
+
+int ExtFlashTrace::lfs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+    if (instance)
+    {
+        instance->record(TRACE_OP_PROG, block, off, size);
+    }
+    return W25Q128::lfs_prog(c, block, off, buffer, size);
+}
+
+int ExtFlashTrace::lfs_erase(const struct lfs_config *c, lfs_block_t block)
+{
+    if (instance)
+    {
+        instance->record(TRACE_OP_ERASE, block, 0, c->block_size);
+    }
+    return W25Q128::lfs_erase(c, block);
+}
+
+int ExtFlashTrace::lfs_sync(const struct lfs_config *c)
+{
+    if (instance)
+    {
+        instance->record(TRACE_OP_SYNC, 0, 0, 0);
+    }
+    return W25Q128::lfs_sync(c);
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
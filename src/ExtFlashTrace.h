@@ -0,0 +1,131 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashTrace.h
+ * @brief       Trace of the LittleFS block device calls (read, prog, erase, sync) and file operations into a
+ *              RAM ring, with optional spill to the "trace" partition. Replayed on the host with
+ *              host/efc_hostreplay.cpp and host/efc_hosttune.cpp
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+#include <functional>
+
+#define TRACE_MAGIC 0x52544645            // "EFTR" in the first page of the trace partition
+#define TRACE_VERSION 2                   // Version of the record layout
+#define TRACE_RECORDS_PER_PAGE (PAGE_SIZE_W25Q128_256B / sizeof(ExtFlashTraceRecord))
+
+#ifndef TRACE_RING_RECORDS
+    #define TRACE_RING_RECORDS 512 // Records of the RAM ring (16 bytes each), allocated by start()
+#endif
+#ifndef TRACE_ERASE_IDLE_MS
+    #define TRACE_ERASE_IDLE_MS 20 // A spill erases the next sector after the lfs calls paused this long
+#endif
+#define TRACE_MAX_FILES 16           // Open files with a handle in the trace, like the max open files of the filesystem
+#define TRACE_NO_FILE 0xFFFF         // Handle of a file opened before start() or beyond TRACE_MAX_FILES
+
+enum ExtFlashTraceOp : uint8_t
+{
+    TRACE_OP_READ = 'R',  // lfs read
+    TRACE_OP_PROG = 'P',  // lfs prog
+    TRACE_OP_ERASE = 'E', // lfs erase of a block
+    TRACE_OP_SYNC = 'S',  // lfs sync
+    // File operations of ext_LittleFSImpl (lower case). The block device calls they cause follow them, except for open
+    // and seek: they are recorded after the call, with the handle and the new position, their calls precede them
+    TRACE_OP_PATH = 'p',        // block: depth, off: path hash, size: hash of the parent, 0 at the root. One per
+                                // component before each path of an open, remove, mkdir and rename
+    TRACE_OP_OPEN = 'o',        // block: handle, off: path hash, size: lfs open flags
+    TRACE_OP_WRITE = 'w',       // block: handle, size: bytes
+    TRACE_OP_READFILE = 'r',    // block: handle, size: bytes
+    TRACE_OP_FLUSH = 'f',       // block: handle
+    TRACE_OP_SEEK = 'k',        // block: handle, size: new position
+    TRACE_OP_TRUNCATE = 't',    // block: handle, size: new size
+    TRACE_OP_CLOSE = 'c',       // block: handle
+    TRACE_OP_REMOVE = 'd',      // off: path hash
+    TRACE_OP_MKDIR = 'm',       // off: path hash
+    TRACE_OP_RENAME_FROM = 'n', // off: path hash, followed by TRACE_OP_RENAME_TO
+    TRACE_OP_RENAME_TO = 'v',   // off: path hash
+};
+
+// One block device call or file operation
+struct __attribute__((packed)) ExtFlashTraceRecord
+{
+    uint32_t us;    // micros() at the start of the call
+    uint16_t block; // lfs block, handle of a file operation
+    uint8_t op;     // ExtFlashTraceOp
+    uint8_t flags;  // Reserved, 0
+    uint32_t off;   // Offset in the block, path hash of a file operation
+    uint32_t size;  // Bytes
+};
+
+// First page of the trace partition, the records follow in the next pages
+struct __attribute__((packed)) ExtFlashTraceHeader
+{
+    uint32_t magic;      // TRACE_MAGIC
+    uint16_t version;    // TRACE_VERSION
+    uint16_t reserved;
+    uint32_t blockSize;  // lfs block_size of the trace
+    uint32_t blockCount; // lfs block_count of the trace
+    uint32_t startUs;    // micros() at start()
+    uint32_t crc;        // CRC32 of the fields above
+};
+
+class ExtFlashTrace
+{
+  public:
+    using Callback = std::function<void(const ExtFlashTraceRecord &record)>;
+
+    ExtFlashTrace();
+    ~ExtFlashTrace();
+
+    bool begin(const ExtFlashRawPartition &partition);            // Attach the spill partition, optional
+    bool start(uint32_t blockSize, uint32_t blockCount, bool spill); // Start recording, a spill erases the partition first
+    void stop();                                                  // Stop recording, loop() writes the rest of a spill
+    void clear();                                                 // Stop and free the RAM ring
+    void loop();                                                  // Write one page of a spill
+    uint32_t forEach(Callback callback);                          // Records of the spill, or of the RAM ring without one
+
+    inline bool isRecording() const { return instance == this; } // The lfs calls are recorded
+    inline bool isSpilling() const { return _spill; }           // Records go to the partition
+    inline bool hasPartition() const { return _partition.isReady(); }
+    inline uint32_t recorded() const { return _head; }          // Records since start()
+    inline uint32_t dropped() const { return _dropped; }        // Records lost, overwritten in the ring or not spilled
+    inline uint32_t spilled() const { return _spilled; }        // Records written to the partition
+    inline uint32_t capacity() const { return _partition.isReady() ? (_partition.size() - PAGE_SIZE_W25Q128_256B) / sizeof(ExtFlashTraceRecord) : 0; }
+    inline uint32_t blockSize() const { return _header.blockSize; }
+    inline uint32_t blockCount() const { return _header.blockCount; }
+
+    // LittleFS callbacks. Forward to the W25Q128 callbacks and record the call while a trace is running
+    static int lfs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
+    static int lfs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
+    static int lfs_erase(const struct lfs_config *c, lfs_block_t block);
+    static int lfs_sync(const struct lfs_config *c);
+    static void fileOp(char op, const void *file, const char *path, uint32_t size); // ext_LittleFSImpl::fileOpCallback
+
+    static ExtFlashTrace *instance; // Running trace, nullptr if none
+
+  private:
+    void record(ExtFlashTraceOp op, lfs_block_t block, lfs_off_t off, lfs_size_t size); // Add a record to the ring
+    bool readHeader();                                                                 // Read the header of a spilled trace
+    uint16_t handle(const void *file, bool open);                                      // Handle of an open file
+    static uint32_t pathHash(const char *path);                                        // FNV-1a hash of a path
+    void recordPath(const char *path);                                                 // TRACE_OP_PATH records of a path
+
+    ExtFlashRawPartition _partition; // Spill partition
+    ExtFlashTraceHeader _header;     // Config of the trace
+    ExtFlashTraceRecord *_ring;      // RAM ring, TRACE_RING_RECORDS
+    uint32_t _head;                  // Records added to the ring
+    uint32_t _tail;                  // Records written to the partition, spill only
+    uint32_t _dropped;               // Records lost
+    uint32_t _spilled;               // Records in the partition
+    uint32_t _erased;                // End of the erased area of the partition
+    const void *_files[TRACE_MAX_FILES]; // lfs files of the handles
+    bool _spill;                     // Records go to the partition
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,90 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashTracepoints
+ * @brief Rings of the compile-time tracepoints.
+ *
+ * Built with -DEXTFLASH_TRACEPOINTS the EXTFLASH_TP and EXTFLASH_TP_SCOPE macros at the driver commands, the
+ * LittleFS callbacks, the file operations and the ExternalFlash API record an event with micros(), name, argument
+ * and core into the ring of the calling core. A full ring overwrites its oldest events. "efc tp dump" merges both
+ * rings into one timeline. Without the flag the macros are empty and this file compiles to nothing.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashTracepoints.h"
+#if defined(ARDUINO_ARCH_RP2040) && defined(EXTFLASH_TRACEPOINTS)
+
+ExtFlashTracepointEvent ExtFlashTracepoints::_ring[EXTFLASH_TP_CORES][EXTFLASH_TP_RECORDS];
+volatile uint32_t ExtFlashTracepoints::_head[EXTFLASH_TP_CORES] = {0};
+
+/**
+ * @brief Stream the events of both cores merged by time. Events recorded meanwhile may be skipped
+ *
+ * @param callback called for each event
+ * @return the number of events
+ */
+uint32_t ExtFlashTracepoints::forEach(Callback callback)
+{
+    uint32_t next[EXTFLASH_TP_CORES];
+    uint32_t end[EXTFLASH_TP_CORES];
+    for (uint8_t core = 0; core < EXTFLASH_TP_CORES; core++)
+    {
+        end[core] = _head[core];
+        next[core] = end[core] > EXTFLASH_TP_RECORDS ? end[core] - EXTFLASH_TP_RECORDS : 0;
+    }
+    uint32_t count = 0;
+    while (true)
+    {
+        // Oldest pending event of the cores
+        int8_t oldest = -1;
+        for (uint8_t core = 0; core < EXTFLASH_TP_CORES; core++)
+        {
+            if (next[core] < end[core] &&
+                (oldest < 0 || (int32_t)(_ring[core][next[core] & (EXTFLASH_TP_RECORDS - 1)].us -
+                                         _ring[oldest][next[oldest] & (EXTFLASH_TP_RECORDS - 1)].us) < 0))
+            {
+                oldest = core;
+            }
+        }
+        if (oldest < 0)
+        {
+            return count;
+        }
+        callback(_ring[oldest][next[oldest]++ & (EXTFLASH_TP_RECORDS - 1)]);
+        count++;
+    }
+}
+
+/**
+ * @brief Drop the events of both cores
+ */
+void ExtFlashTracepoints::clear()
+{
+    for (uint8_t core = 0; core < EXTFLASH_TP_CORES; core++)
+    {
+        _head[core] = 0;
+    }
+}
+
+uint32_t ExtFlashTracepoints::recorded()
+{
+    uint32_t count = 0;
+    for (uint8_t core = 0; core < EXTFLASH_TP_CORES; core++)
+    {
+        count += _head[core];
+    }
+    return count;
+}
+
+uint32_t ExtFlashTracepoints::dropped()
+{
+    uint32_t count = 0;
+    for (uint8_t core = 0; core < EXTFLASH_TP_CORES; core++)
+    {
+        count += _head[core] > EXTFLASH_TP_RECORDS ? _head[core] - EXTFLASH_TP_RECORDS : 0;
+    }
+    return count;
+}
+
+#endif // ARDUINO_ARCH_RP2040 && EXTFLASH_TRACEPOINTS
+#endif // EXTERNAL_FLASH_MODULE
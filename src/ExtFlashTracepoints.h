@@ -0,0 +1,93 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashTracepoints.h
+ * @brief       Compile-time tracepoints of the flash driver, the LittleFS callbacks and the filesystem API.
+ *              Without -DEXTFLASH_TRACEPOINTS the macros compile to nothing
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include <Arduino.h>
+#include <functional>
+
+#define EXTFLASH_TP_CONCAT_(a, b) a##b
+#define EXTFLASH_TP_CONCAT(a, b) EXTFLASH_TP_CONCAT_(a, b)
+
+#ifdef EXTFLASH_TRACEPOINTS
+    #define EXTFLASH_TP(name, arg) ExtFlashTracepoints::record('I', name, arg)                                   // Single event
+    #define EXTFLASH_TP_SCOPE(name, arg) ExtFlashTracepointScope EXTFLASH_TP_CONCAT(_tracepoint, __LINE__)(name, arg) // Entry and exit of the scope
+#else
+    #define EXTFLASH_TP(name, arg) \
+        do                         \
+        {                          \
+        } while (0)
+    #define EXTFLASH_TP_SCOPE(name, arg) \
+        do                               \
+        {                                \
+        } while (0)
+#endif
+
+#ifdef EXTFLASH_TRACEPOINTS
+    #ifndef EXTFLASH_TP_RECORDS
+        #define EXTFLASH_TP_RECORDS 512 // Events per core, a power of two
+    #endif
+    #define EXTFLASH_TP_CORES 2 // One ring per core of the RP2040
+
+// One tracepoint event
+struct ExtFlashTracepointEvent
+{
+    uint32_t us;      // micros() of the event
+    const char *name; // Name of the tracepoint, a string literal
+    uint32_t arg;     // Opcode, block, size or 0
+    char phase;       // 'B' entry, 'E' exit, 'I' single event
+    uint8_t core;     // Core of the event
+};
+
+// Per-core rings of the events. Only the own core writes to its ring, so recording needs no lock. Tracepoints are
+// not placed in interrupt handlers
+class ExtFlashTracepoints
+{
+  public:
+    using Callback = std::function<void(const ExtFlashTracepointEvent &event)>;
+
+    static inline void record(char phase, const char *name, uint32_t arg)
+    {
+        const uint8_t core = get_core_num();
+        const uint32_t n = _head[core];
+        ExtFlashTracepointEvent &e = _ring[core][n & (EXTFLASH_TP_RECORDS - 1)];
+        e.us = micros();
+        e.name = name;
+        e.arg = arg;
+        e.phase = phase;
+        e.core = core;
+        _head[core] = n + 1;
+    }
+
+    static uint32_t forEach(Callback callback); // Events of both cores in time order, oldest first
+    static void clear();                        // Drop all events
+    static uint32_t recorded();                 // Events since boot or clear()
+    static uint32_t dropped();                  // Events overwritten in the rings
+
+  private:
+    static ExtFlashTracepointEvent _ring[EXTFLASH_TP_CORES][EXTFLASH_TP_RECORDS];
+    static volatile uint32_t _head[EXTFLASH_TP_CORES]; // Events added per core
+};
+
+// Records the entry at construction and the exit at destruction
+class ExtFlashTracepointScope
+{
+  public:
+    inline ExtFlashTracepointScope(const char *name, uint32_t arg) : _name(name) { ExtFlashTracepoints::record('B', name, arg); }
+    inline ~ExtFlashTracepointScope() { ExtFlashTracepoints::record('E', _name, 0); }
+
+  private:
+    const char *_name;
+};
+#endif // EXTFLASH_TRACEPOINTS
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
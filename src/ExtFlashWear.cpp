@@ -0,0 +1,299 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ExtFlashWear
+ * @brief Erase count and erase time per sector.
+ *
+ * W25Q128::eraseCallback reports every sector, block and chip erase. The erases since the last checkpoint are
+ * counted per sector in RAM (16 bit), the erase time of blocking sector erases is kept as a moving average per
+ * sector, since it grows with the wear of the cells. Background erases are counted but not timed, their end is
+ * only seen when polled.
+ *
+ * A checkpoint writes the counts of the latest checkpoint plus the erases since into the other of two slots of
+ * the "wear" partition: one sector erase and one page per loop() call, the header with the sequence number last.
+ * It runs every EXTFLASH_WEAR_CHECKPOINT_MS after sectors were erased, or earlier when one sector reaches
+ * EXTFLASH_WEAR_CHECKPOINT_ERASES. Erases after the last checkpoint are lost at a power loss. The operating
+ * minutes of all boots are part of the checkpoint, they give the erase rate for the lifetime prediction.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ExtFlashWear.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+#include "ExtFlashMem.h"
+
+ExtFlashWear *ExtFlashWear::instance = nullptr;
+
+/**
+ * @brief Construct a new Ext Flash Wear object
+ */
+ExtFlashWear::ExtFlashWear()
+    : _pending(nullptr), _eraseTime(nullptr), _state(ExtFlashWearState::Idle), _slot(-1), _seq(0), _minutes(0), _unsaved(0),
+      _lastCheckpoint(0), _step(0), _crc(0), _full(false)
+{
+}
+
+ExtFlashWear::~ExtFlashWear()
+{
+    if (instance == this)
+    {
+        instance = nullptr;
+        W25Q128::eraseCallback = nullptr;
+    }
+    extFlashMemFree(_pending);
+    extFlashMemFree(_eraseTime);
+}
+
+/**
+ * @brief Load the latest checkpoint and start counting the erases
+ *
+ * @param partition the raw partition, at least two slots
+ * @return true if the partition can be used
+ */
+bool ExtFlashWear::begin(const ExtFlashRawPartition &partition)
+{
+    _partition = partition;
+    if (!_partition.isReady() || _partition.size() < 2 * WEAR_SLOT_SIZE)
+    {
+        return false;
+    }
+    if (!_eraseTime)
+    {
+        _eraseTime = static_cast<uint8_t *>(extFlashMemAlloc(EXTFLASH_MEM_MODULE, WEAR_SECTORS));
+    }
+    if (!_pending)
+    {
+        _pending = static_cast<uint16_t *>(extFlashMemAlloc(EXTFLASH_MEM_MODULE, WEAR_SECTORS * sizeof(uint16_t)));
+    }
+    if (!_pending || !_eraseTime)
+    {
+        // isReady() stays false without the counters
+        extFlashMemFree(_pending);
+        _pending = nullptr;
+        return false;
+    }
+    memset(_pending, 0, WEAR_SECTORS * sizeof(uint16_t));
+    memset(_eraseTime, 0, WEAR_SECTORS);
+    _slot = -1;
+    _seq = 0;
+    _minutes = 0;
+    _unsaved = 0;
+    _state = ExtFlashWearState::Idle;
+
+    ExtFlashWearHeader header;
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        if (readSlot(slot, header) && (_slot < 0 || (int32_t)(header.seq - _seq) > 0))
+        {
+            _slot = slot;
+            _seq = header.seq;
+            _minutes = header.minutes;
+        }
+    }
+    if (_slot >= 0)
+    {
+        _partition.read(_slot * WEAR_SLOT_SIZE + (1 + WEAR_COUNT_PAGES) * PAGE_SIZE_W25Q128_256B, _eraseTime, WEAR_SECTORS);
+    }
+    _lastCheckpoint = millis();
+    instance = this;
+    W25Q128::eraseCallback = onErase;
+    return true;
+}
+
+/**
+ * @brief One erase step or one page of a running checkpoint, start a checkpoint when it is due
+ */
+void ExtFlashWear::loop()
+{
+    if (!isReady())
+    {
+        return;
+    }
+    switch (_state)
+    {
+        case ExtFlashWearState::Idle:
+            if (_unsaved && (_full || millis() - _lastCheckpoint >= EXTFLASH_WEAR_CHECKPOINT_MS))
+            {
+                checkpoint();
+            }
+            break;
+        case ExtFlashWearState::Erasing:
+            if (_partition.flash()->isBusy())
+            {
+                return;
+            }
+            if (_step < WEAR_SLOT_SIZE / SECTOR_SIZE_W25Q128_4KB)
+            {
+                _partition.eraseAsync((_slot < 0 ? 0 : 1 - _slot) * WEAR_SLOT_SIZE + _step++ * SECTOR_SIZE_W25Q128_4KB);
+                return;
+            }
+            _state = ExtFlashWearState::Writing;
+            _step = 0;
+            _crc = 0;
+            break;
+        case ExtFlashWearState::Writing:
+            if (!_partition.flash()->isBusy())
+            {
+                writePage();
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Start a checkpoint, loop() writes it in the background
+ */
+void ExtFlashWear::checkpoint()
+{
+    if (!isReady() || _state != ExtFlashWearState::Idle)
+    {
+        return;
+    }
+    _state = ExtFlashWearState::Erasing;
+    _step = 0;
+    _full = false;
+}
+
+/**
+ * @brief Stream the erase count and erase time of every sector, the checkpoint plus the erases since
+ *
+ * @param callback called for each sector
+ * @return true if counting
+ */
+bool ExtFlashWear::forEach(Callback callback)
+{
+    if (!isReady())
+    {
+        return false;
+    }
+    const int8_t next = _slot < 0 ? 0 : 1 - _slot;
+    uint32_t counts[PAGE_SIZE_W25Q128_256B / sizeof(uint32_t)];
+    for (uint32_t page = 0; page < WEAR_COUNT_PAGES; page++)
+    {
+        // Pages already written by a running checkpoint no longer have their erases in _pending
+        const int8_t slot = (_state == ExtFlashWearState::Writing && page < _step) ? next : _slot;
+        memset(counts, 0, sizeof(counts));
+        if (slot >= 0)
+        {
+            _partition.read(slot * WEAR_SLOT_SIZE + (1 + page) * PAGE_SIZE_W25Q128_256B, (uint8_t *)counts, sizeof(counts));
+        }
+        for (uint8_t i = 0; i < PAGE_SIZE_W25Q128_256B / sizeof(uint32_t); i++)
+        {
+            const uint16_t sector = page * (PAGE_SIZE_W25Q128_256B / sizeof(uint32_t)) + i;
+            callback(sector, counts[i] + _pending[sector], _eraseTime[sector] * WEAR_TIME_UNIT_MS);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Count an erase of the chip. Blocking sector erases also update the erase time of the sector
+ *
+ * @param addr the start address of the erase
+ * @param size the bytes erased
+ * @param us the erase time, 0 if not measured
+ */
+void ExtFlashWear::onErase(uint32_t addr, uint32_t size, uint32_t us)
+{
+    ExtFlashWear *w = instance;
+    if (!w)
+    {
+        return;
+    }
+    for (uint32_t sector = addr / SECTOR_SIZE_W25Q128_4KB; sector < (addr + size) / SECTOR_SIZE_W25Q128_4KB && sector < WEAR_SECTORS; sector++)
+    {
+        if (w->_pending[sector] < 0xFFFF)
+        {
+            w->_pending[sector]++;
+            w->_unsaved++;
+        }
+        w->_full |= w->_pending[sector] >= EXTFLASH_WEAR_CHECKPOINT_ERASES;
+    }
+    if (us && size == SECTOR_SIZE_W25Q128_4KB && addr / SECTOR_SIZE_W25Q128_4KB < WEAR_SECTORS)
+    {
+        const uint8_t sample = min<uint32_t>(max<uint32_t>((us / 1000 + WEAR_TIME_UNIT_MS / 2) / WEAR_TIME_UNIT_MS, 1), 0xFF);
+        uint8_t &time = w->_eraseTime[addr / SECTOR_SIZE_W25Q128_4KB];
+        time = time ? (3 * time + sample + 2) / 4 : sample;
+    }
+}
+
+/**
+ * @brief Read the header of a slot and check the CRCs of the header and the data pages
+ *
+ * @param slot the slot, 0 or 1
+ * @param header the header of the slot
+ * @return true if the slot holds a valid checkpoint
+ */
+bool ExtFlashWear::readSlot(uint8_t slot, ExtFlashWearHeader &header)
+{
+    const uint32_t base = slot * WEAR_SLOT_SIZE;
+    if (!_partition.read(base, (uint8_t *)&header, sizeof(header)) || header.magic != WEAR_MAGIC || header.version != WEAR_VERSION ||
+        header.sectors != WEAR_SECTORS || header.headerCrc != extFlashCrc32(&header, offsetof(ExtFlashWearHeader, headerCrc)))
+    {
+        return false;
+    }
+    uint8_t page[PAGE_SIZE_W25Q128_256B];
+    uint32_t crc = 0;
+    for (uint32_t i = 0; i < WEAR_DATA_PAGES; i++)
+    {
+        _partition.read(base + (1 + i) * PAGE_SIZE_W25Q128_256B, page, sizeof(page));
+        crc = extFlashCrc32(page, sizeof(page), crc);
+    }
+    return crc == header.crc;
+}
+
+/**
+ * @brief Write the next data page of the checkpoint, the header after the last one
+ */
+void ExtFlashWear::writePage()
+{
+    const int8_t next = _slot < 0 ? 0 : 1 - _slot;
+    const uint32_t base = next * WEAR_SLOT_SIZE;
+    uint8_t page[PAGE_SIZE_W25Q128_256B];
+    if (_step < WEAR_COUNT_PAGES)
+    {
+        // Counts of the checkpoint plus the erases since, which move from RAM into this page
+        uint32_t *counts = (uint32_t *)page;
+        memset(page, 0, sizeof(page));
+        if (_slot >= 0)
+        {
+            _partition.read(_slot * WEAR_SLOT_SIZE + (1 + _step) * PAGE_SIZE_W25Q128_256B, page, sizeof(page));
+        }
+        for (uint8_t i = 0; i < PAGE_SIZE_W25Q128_256B / sizeof(uint32_t); i++)
+        {
+            const uint16_t sector = _step * (PAGE_SIZE_W25Q128_256B / sizeof(uint32_t)) + i;
+            counts[i] += _pending[sector];
+            _unsaved -= _pending[sector];
+            _pending[sector] = 0;
+        }
+    }
+    else if (_step < WEAR_DATA_PAGES)
+    {
+        memcpy(page, _eraseTime + (_step - WEAR_COUNT_PAGES) * PAGE_SIZE_W25Q128_256B, sizeof(page));
+    }
+    else
+    {
+        ExtFlashWearHeader header;
+        header.magic = WEAR_MAGIC;
+        header.version = WEAR_VERSION;
+        header.sectors = WEAR_SECTORS;
+        header.seq = _seq + 1;
+        header.minutes = minutes();
+        header.crc = _crc;
+        header.headerCrc = extFlashCrc32(&header, offsetof(ExtFlashWearHeader, headerCrc));
+        if (_partition.program(base, (const uint8_t *)&header, sizeof(header)))
+        {
+            _slot = next;
+            _seq = header.seq;
+        }
+        _state = ExtFlashWearState::Idle;
+        _lastCheckpoint = millis();
+        return;
+    }
+    _crc = extFlashCrc32(page, sizeof(page), _crc);
+    _partition.program(base + (1 + _step) * PAGE_SIZE_W25Q128_256B, page, sizeof(page));
+    _step++;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
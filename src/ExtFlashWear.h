@@ -0,0 +1,97 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ExtFlashWear.h
+ * @brief       Erase count and erase time per sector of the chip, checkpointed to the "wear" partition,
+ *              with a heatmap and the predicted remaining lifetime
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+#include <functional>
+
+#define WEAR_MAGIC 0x52574645 // "EFWR"
+#define WEAR_VERSION 1        // Version of the slot layout
+#define WEAR_SECTORS (FLASH_SIZE_W25Q128 / SECTOR_SIZE_W25Q128_4KB)
+#define WEAR_COUNT_PAGES (WEAR_SECTORS * sizeof(uint32_t) / PAGE_SIZE_W25Q128_256B) // Erase counts after the header page
+#define WEAR_TIME_PAGES (WEAR_SECTORS / PAGE_SIZE_W25Q128_256B)                     // Erase times after the counts
+#define WEAR_DATA_PAGES (WEAR_COUNT_PAGES + WEAR_TIME_PAGES)
+#define WEAR_SLOT_SIZE (6 * SECTOR_SIZE_W25Q128_4KB) // Header page and data pages, two slots are written in turn
+#define WEAR_TIME_UNIT_MS 2                          // Resolution of the erase time, up to 510 ms
+
+#ifndef EXTFLASH_WEAR_ENDURANCE
+    #define EXTFLASH_WEAR_ENDURANCE 100000 // Erase cycles of a sector, datasheet minimum
+#endif
+#ifndef EXTFLASH_WEAR_CHECKPOINT_MS
+    #define EXTFLASH_WEAR_CHECKPOINT_MS (60 * 60 * 1000UL) // Checkpoint interval while sectors were erased
+#endif
+#ifndef EXTFLASH_WEAR_CHECKPOINT_ERASES
+    #define EXTFLASH_WEAR_CHECKPOINT_ERASES 1000 // Erases of one sector that start a checkpoint early
+#endif
+
+// Header in the first page of a slot. Written last, so a torn checkpoint leaves the other slot valid
+struct __attribute__((packed)) ExtFlashWearHeader
+{
+    uint32_t magic;     // WEAR_MAGIC
+    uint16_t version;   // WEAR_VERSION
+    uint16_t sectors;   // WEAR_SECTORS
+    uint32_t seq;       // Sequence number, increments with every checkpoint
+    uint32_t minutes;   // Operating minutes of all boots until the checkpoint
+    uint32_t crc;       // CRC32 over the data pages
+    uint32_t headerCrc; // CRC32 over the fields above
+};
+
+enum class ExtFlashWearState : uint8_t
+{
+    Idle,    // Counting in RAM
+    Erasing, // Erasing the next slot in the background
+    Writing, // Writing the data pages into the next slot
+};
+
+class ExtFlashWear
+{
+  public:
+    // Called for every sector: erases of the sector and its erase time in ms, 0 if never measured
+    using Callback = std::function<void(uint16_t sector, uint32_t erases, uint16_t eraseMs)>;
+
+    ExtFlashWear();
+    ~ExtFlashWear();
+
+    bool begin(const ExtFlashRawPartition &partition); // Load the latest checkpoint and count the erases
+    void loop();                                       // One erase step or one page of a checkpoint
+    void checkpoint();                                 // Start a checkpoint now
+    bool forEach(Callback callback);                   // Checkpointed counts plus the erases since, per sector
+
+    inline bool isReady() const { return _pending != nullptr; }        // Counting
+    inline ExtFlashWearState state() const { return _state; }
+    inline uint32_t sequence() const { return _seq; }                  // Sequence number of the latest checkpoint
+    inline uint32_t minutes() const { return _minutes + time_us_64() / 60000000; } // Operating minutes of all boots
+    inline uint32_t erasesSinceCheckpoint() const { return _unsaved; }
+
+    static void onErase(uint32_t addr, uint32_t size, uint32_t us); // W25Q128::eraseCallback
+    static ExtFlashWear *instance;                                  // Counting instance, nullptr if none
+
+  private:
+    bool readSlot(uint8_t slot, ExtFlashWearHeader &header); // Read and check a slot
+    void writePage();                                        // Write the next data page or the header
+
+    ExtFlashRawPartition _partition; // "wear" partition
+    uint16_t *_pending;              // Erases per sector since the checkpoint
+    uint8_t *_eraseTime;             // Average erase time per sector in WEAR_TIME_UNIT_MS, 0 unknown
+    ExtFlashWearState _state;        // Checkpoint state
+    int8_t _slot;                    // Slot of the latest checkpoint or -1
+    uint32_t _seq;                   // Sequence number of the latest checkpoint
+    uint32_t _minutes;               // Operating minutes of the previous boots
+    uint32_t _unsaved;               // Erases since the checkpoint
+    uint32_t _lastCheckpoint;        // millis() of the last checkpoint
+    uint32_t _step;                  // Sector to erase or page to write of the running checkpoint
+    uint32_t _crc;                   // CRC32 of the written data pages
+    bool _full;                      // A sector reached EXTFLASH_WEAR_CHECKPOINT_ERASES
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
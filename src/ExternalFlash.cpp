@@ -22,7 +22,9 @@ ExternalFlash extFlashModule; // External flash module instance
  * @brief Construct a new External Flash:: External Flash object
  */
 ExternalFlash::ExternalFlash() : _extFlashLfs(FSImplPtr(nullptr)),     // Initialize the LittleFS object
-                                 _SpiFlashInit(false), _mounted(false) // Initialize the flags
+                                 _fsOffset(0), _fsSize(0),              // Filesystem partition, set in setup()
+                                 _SpiFlashInit(false), _mounted(false), // Initialize the flags
+                                 _rollupLost(0)                         // No rollup bucket lost yet
 {
 }
 
@@ -66,20 +68,58 @@ void ExternalFlash::setup(bool configured)
     // Create the external LittleFS instance with the start and end address of the flash memory
     logDebugP("Setting up the spi flash instance");
 
+    // Read the partition table, LittleFS only gets its own partition
+    if (!_partitions.begin(flashDriver()))
+    {
+        logErrorP("No valid partition table, 'efc part reset' writes the default one (formats the filesystem)");
+    }
+    else if (_partitions.created())
+    {
+        logInfoP("Default partition table written");
+    }
+    else if (_partitions.legacy())
+    {
+        logInfoP("LittleFS uses the whole chip, 'efc part reset' adds the raw partitions (formats the filesystem)");
+    }
+    else if (_partitions.added())
+    {
+        logInfoP("%u partition(s) added to the partition table", _partitions.added());
+    }
+    // A staged firmware image marked for apply is installed before anything else, apply() reboots on success
+    ExtFlashRawPartition otaPartition;
+    if (openPartition("ota", otaPartition) && _otaStager.begin(otaPartition) && _otaStager.applyPending())
+    {
+        logInfoP("Applying staged firmware image (%lu bytes), attempt %u of %u", (unsigned long)_otaStager.imageSize(),
+                 _otaStager.applyAttempts() + 1, OTA_APPLY_ATTEMPTS);
+        if (!_otaStager.apply())
+        {
+            logErrorP("Failed to apply the staged firmware image");
+        }
+    }
+    else if (_otaStager.applyAttempts() >= OTA_APPLY_ATTEMPTS)
+    {
+        logErrorP("Staged firmware image failed %u times, no longer applied. Stage it again", _otaStager.applyAttempts());
+    }
+
+    const ExtFlashPartition *fsPartition = _partitions.find(EFP_TYPE_LITTLEFS);
+    _fsOffset = fsPartition ? fsPartition->offset : SECTOR_SIZE_W25Q128_4KB;
+    _fsSize = fsPartition ? fsPartition->size : 0;
+
     // Get now the ext_LittleFSImpl instance from the FS object
     logDebugP("Initializing LFS Settings");
     setupExternalConfig();                              // ToDo EC: Make a configuration wrapper for the external flash settings
     uint8_t extFlash_FS_start_addr = 0x000;             // Start address of the W25q128 flash memory
-    uint32_t extFLash_FS_end_addr = FLASH_SIZE_W25Q128; // End address of the W25q128 flash memory
+    uint32_t extFLash_FS_end_addr = _fsSize;            // Size of the filesystem partition
 
     ext_littlefs_impl::ext_LittleFSImpl *extLittleFSImpl =
         new ext_littlefs_impl::ext_LittleFSImpl(
             &extFlash_FS_start_addr, extFLash_FS_end_addr, // Start and end address of the flash memory
             PAGE_SIZE_W25Q128_256B,                        // Size of a page in flash
-            SECTOR_SIZE_W25Q128_4KB, 16);                  // Size of a block in flash, Maximum number of open file descriptors
+            EXTFLASH_LFS_BLOCK_SIZE,                       // Size of a block in flash
+            EXTFLASH_LFS_MAX_OPEN_FILES);                  // Maximum number of open file descriptors
 
     logDebugP("Setting up external ext_LittleFS configuration");
-    if (extLittleFSImpl->setLFSConfig(_extFlashLfsConfig))
+    if (_fsSize && extLittleFSImpl->setLFSConfig(_extFlashLfsConfig))
     {
         _extFlashLfs = FS(FSImplPtr(extLittleFSImpl)); // Set the external flash filesystem
         logDebugP("Mounting external flash with ext_LittleFS");
@@ -117,16 +157,182 @@ void ExternalFlash::setup(bool configured)
     {
         // Set the time callback for the external flash, this is optional.
         _extFlashLfs.setTimeCallback([]() -> time_t { return openknx.time.getLocalTime().toTime_t(); });
+
+        // Restore the group object values first, so the other modules start with them
+        const uint16_t restored = _goSnapshot.restore(&_extFlashLfs);
+        logDebugP("Restored %u group object value(s) from the snapshot", restored);
+
+        if (!_telegramLog.begin(&_extFlashLfs) || !_telegramRollup.begin(&_extFlashLfs, &_telegramLog))
+        {
+            logErrorP("Failed to open the telegram log");
+        }
+    }
+
+    const ExtFlashPartition *logPartition = _partitions.find(EFP_TYPE_LOG);
+    if (logPartition)
+    {
+        if (_logRing.begin(flashDriver(), logPartition->offset, logPartition->size))
+        {
+            extFlashLogTee.attach(&_logRing);
+            logDebugP("Log ring ready at 0x%06lX, %lu KB, sector %lu", (unsigned long)logPartition->offset,
+                      (unsigned long)(logPartition->size / 1024), (unsigned long)_logRing.sequence());
+        }
+        else
+        {
+            logErrorP("Failed to open the log ring");
+        }
+    }
+
+    // Attach the stager again, now to the driver instance shared with LittleFS
+    if (openPartition("ota", otaPartition))
+    {
+        _otaStager.begin(otaPartition);
+    }
+
+    const ExtFlashPartition *rawLogPartition = _partitions.find(EFP_TYPE_RAWLOG);
+    ExtFlashRawPartition raw;
+    if (rawLogPartition && raw.begin(flashDriver(), rawLogPartition))
+    {
+        if (_rawLog.begin(raw))
+        {
+            logDebugP("Raw log ready, head in sector %lu at %lu", (unsigned long)_rawLog.headSector(), (unsigned long)_rawLog.headOffset());
+        }
+        else
+        {
+            logErrorP("Failed to open the raw log");
+        }
+    }
+
+    ExtFlashRawPartition storePartition;
+    if (openPartition("store", storePartition) && _moduleStore.begin(storePartition))
+    {
+        logDebugP("Module store ready, %u slots, latest %d", _moduleStore.slots(), _moduleStore.slot());
+    }
+
+    ExtFlashRawPartition tracePartition;
+    if (openPartition("trace", tracePartition))
+    {
+        _trace.begin(tracePartition);
+    }
+
+    ExtFlashRawPartition wearPartition;
+    if (openPartition("wear", wearPartition) && _wear.begin(wearPartition))
+    {
+        logDebugP("Wear counters ready, checkpoint %lu", (unsigned long)_wear.sequence());
+    }
+
+    ExtFlashRawPartition crashPartition;
+    if (openPartition("crash", crashPartition) && _crashDump.begin(crashPartition) && _crashDump.hasDump())
+    {
+        CrashDumpHeader dump;
+        _crashDump.header(dump);
+        logInfoP("Hard fault dump stored: PC %08lX, LR %08lX after %lu ms. Use 'efc crash'", (unsigned long)dump.pc, (unsigned long)dump.lr,
+                 (unsigned long)dump.uptime);
     }
 }
 
+/**
+ * @brief Attach to a raw partition of the partition table
+ *
+ * @param name the name of the partition
+ * @param partition the raw partition to attach
+ * @return true if the partition exists
+ */
+bool ExternalFlash::openPartition(const char *name, ExtFlashRawPartition &partition)
+{
+    return partition.begin(flashDriver(), _partitions.find(name));
+}
+
+/**
+ * @brief Driver instance for raw access. ext_LittleFSImpl shares the driver of W25Q128::instance, raw partitions
+ *        use the same one, so a background erase is seen by the LittleFS callbacks
+ *
+ * @return the flash driver
+ */
+W25Q128 *ExternalFlash::flashDriver()
+{
+    return W25Q128::instance ? W25Q128::instance : &_SpiFlash;
+}
+
 /**
  * @brief loop for the ExternalFlash module
  * @param configured, true if OpenKNX is configured
  */
 void ExternalFlash::loop(bool configured)
 {
-    /*NOOP*/
+    if (_mounted)
+    {
+        {
+            ExtFlashBlockingScope blocking(_blocking, "loop.tlg");
+            _telegramLog.loop(); // Periodic flush of the active telegram segment
+        }
+        {
+            ExtFlashBlockingScope blocking(_blocking, "loop.rollup");
+            _telegramRollup.loop((uint32_t)openknx.time.getLocalTime().toTime_t()); // One step of the background downsampling
+        }
+        if (_telegramRollup.bucketsLost() != _rollupLost)
+        {
+            logErrorP("Rollup: %lu bucket(s) lost, their file or the journal could not be written",
+                      (unsigned long)(_telegramRollup.bucketsLost() - _rollupLost));
+            _rollupLost = _telegramRollup.bucketsLost();
+        }
+        {
+            ExtFlashBlockingScope blocking(_blocking, "loop.gos");
+            _goSnapshot.loop(); // Debounced write of changed group object values
+        }
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.log");
+        _logRing.loop(); // Write one batch of buffered log output
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.ota");
+        _deltaPatch.loop(); // One step of a running delta patch
+        _otaStager.loop();  // One erase or verify step of a firmware image
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.crash");
+        _crashDump.loop(); // One check or erase step until a fault can be captured
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.store");
+        _moduleStore.loop(); // One erase step or one page of a module data save
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.rawlog");
+        _rawLog.loop(); // Pre-erase of the next raw log sector once the log is quiet
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.trace");
+        _trace.loop(); // One page of a spilled block device trace
+    }
+    {
+        ExtFlashBlockingScope blocking(_blocking, "loop.wear");
+        _wear.loop(); // One erase step or one page of a wear checkpoint
+    }
+}
+
+/**
+ * @brief Looks up the group address of a group object in the association and group address tables.
+ * @param ko The group object.
+ * @param ga Receives the first group address associated with the group object (its sending address).
+ * @return True if the group object is associated with a group address, false otherwise.
+ */
+static bool koGroupAddress(GroupObject &ko, uint16_t &ga)
+{
+    AssociationTableObject *assocTable = (AssociationTableObject *)knx.bau().getInterfaceObject(OT_ASSOC_TABLE, 0);
+    AddressTableObject *addrTable = (AddressTableObject *)knx.bau().getInterfaceObject(OT_ADDR_TABLE, 0);
+    if (!assocTable || !addrTable)
+    {
+        return false;
+    }
+    const int32_t tsap = assocTable->translateAsap(ko.asap());
+    if (tsap < 0)
+    {
+        return false;
+    }
+    ga = addrTable->getGroupAddress((uint16_t)tsap);
+    return true;
 }
 
 /**
@@ -135,7 +341,28 @@ void ExternalFlash::loop(bool configured)
  */
 void ExternalFlash::processInputKo(GroupObject &ko)
 {
-    /*NOOP*/
+    _goSnapshot.processInputKo(ko); // Take over values of group objects in the snapshot
+
+    uint16_t ga;
+    if (_mounted && koGroupAddress(ko, ga))
+    {
+        logTelegram(ga, ko.valueRef(), (uint8_t)ko.valueSize()); // Received values go to the telegram log
+    }
+}
+
+/**
+ * @brief Write pending data on power loss
+ */
+void ExternalFlash::savePower()
+{
+    if (_mounted)
+    {
+        _goSnapshot.flush();
+    }
+    if (_moduleStore.isReady() && !_moduleStore.flush())
+    {
+        logErrorP("Module store save failed, the blocks kept changing");
+    }
 }
 
 void ExternalFlash::showHelp()
@@ -175,6 +402,25 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
             openknx.console.printHelpLine("efc ll /<path>", "List files in a directory in the external flash with details");
             openknx.console.printHelpLine("efc format", "ATTENTION: Will Format the external flash");
             openknx.console.printHelpLine("efc test", "Creating files, folders, writing and reading files");
+            openknx.console.printHelpLine("efc bench [raw|fs] [seed]", "Benchmark raw flash (uses the idle ota partition) and filesystem");
+            openknx.console.printHelpLine("efc query <GA> <from> <to>", "Logged telegrams of a GA (1/2/3 or *), time in s (<=0: relative)");
+            openknx.console.printHelpLine("efc trend <m|h|d> <GA> <from> <to>", "Min/avg/max of a GA per minute, hour or day");
+            openknx.console.printHelpLine("efc gos [add <ko>|clear]", "Group object snapshot status, add a GO or clear it");
+            openknx.console.printHelpLine("efc part [reset]", "Partition table, reset writes the default layout");
+            openknx.console.printHelpLine("efc log [tail <n>|dump|clear]", "Persistent log status, last n lines, all lines or clear it");
+            openknx.console.printHelpLine("efc ota [begin <size> [crc]|data <hex>|end|apply|abort]", "Stage a firmware image and apply it at reboot");
+            openknx.console.printHelpLine("efc ota patch /<file>", "Stage the image built from a delta patch file");
+            openknx.console.printHelpLine("efc rawlog [add <text>|dump|clear]", "Raw append log status, append a record, dump or clear it");
+            openknx.console.printHelpLine("efc store [save]", "Module data store status, save the registered blocks now");
+            openknx.console.printHelpLine("efc crash [dump|clear|trigger]", "Hard fault dump, with stack and regions, clear it or test it");
+            openknx.console.printHelpLine("efc trace [start [spill]|stop|dump|clear]", "Trace the LittleFS block device calls, dump them for efc_hostreplay");
+            openknx.console.printHelpLine("efc stats [reset]", "Counters of the SPI bus, the flash driver and the filesystem");
+            openknx.console.printHelpLine("efc stats lat", "Latency histograms of the flash and file operations, p50/p99/max");
+            openknx.console.printHelpLine("efc stats wa", "Write amplification per top-level directory");
+            openknx.console.printHelpLine("efc stats mem", "Heap of the flash subsystem per category, current and peak");
+            openknx.console.printHelpLine("efc stats blocking [reset|limit <ms>]", "Longest blocking time per call site and overruns of the limit");
+            openknx.console.printHelpLine("efc wear [save]", "Erase count heatmap, erase times and predicted lifetime, save a checkpoint");
+            openknx.console.printHelpLine("efc tp [dump|clear]", "Tracepoint timeline of both cores, builds with -DEXTFLASH_TRACEPOINTS");
             openknx.logger.color(CONSOLE_HEADLINE_COLOR);
             openknx.logger.log("----------------------------------------------------------------------------------------"); // 88 characters
             openknx.logger.color(0);
@@ -272,17 +518,43 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
             }
             logInfoP("Files and folders created. To show the list of files use 'efc ls /' or 'efc ll /'");
         }
-        else if (command.compare(4, 4, "add ") == 0)
+        else if (command.compare(4, 5, "bench") == 0)
         {
-            String fileName = command.substr(8).c_str();
-            if (fileName[0] != '/')
+            const bool raw = command.compare(9, 4, " raw") == 0;
+            const bool fs = command.compare(9, 3, " fs") == 0;
+            const size_t seedPos = command.find_last_of(' ');
+            const uint32_t seed = (seedPos != std::string::npos && isdigit(command[seedPos + 1])) ? strtoul(command.c_str() + seedPos + 1, nullptr, 0) : 0;
+            ExtFlashBench *bench = new ExtFlashBench(seed);
+            auto print = [](const ExtFlashBenchResult &r) {
+                openknx.logger.logWithValues("%-9s %5lu ops %8.3f MB/s %8.1f ops/s  p50 %6lu us  p99 %6lu us  max %6lu us", r.name,
+                                             (unsigned long)r.ops, r.mbps(), r.opsps(), (unsigned long)r.p50Us, (unsigned long)r.p99Us,
+                                             (unsigned long)r.maxUs);
+            };
+            logInfoP("Benchmark, seed %lu. This takes about ten seconds...", (unsigned long)(seed ? seed : BENCH_DEFAULT_SEED));
+            openknx.logger.begin();
+            if (!fs)
             {
-                fileName = "/" + fileName;
+                // The raw workloads overwrite the start of the ota partition, only while no image is staged
+                ExtFlashRawPartition area;
+                if (_otaStager.state() != OtaState::Idle || _deltaPatch.state() != DeltaState::Idle || !openPartition("ota", area) ||
+                    !bench->runRaw(area, print))
+                {
+                    openknx.logger.logWithValues("Raw benchmark skipped, needs an idle, 64 KB aligned ota partition of at least %u KB", BENCH_RAW_AREA / 1024);
+                }
             }
-
-            if (fileName.length() > 0 && fileName.length() <= 255 && fileName[0] == '/' && createFile(fileName.c_str()))
+            if (!raw && (!_mounted || !bench->runFs(_extFlashLfs, print)))
             {
-                logInfoP(String("File created: " + fileName).c_str());
+                openknx.logger.logWithValues("Filesystem benchmark skipped, filesystem not mounted");
+            }
+            openknx.logger.end();
+            delete bench;
+        }
+        else if (command.compare(4, 4, "add ") == 0)
+        {
+            const ExtFlashPath fileName(std::string_view(command).substr(8));
+            if (fileName.isValid() && !fileName.isRoot() && createFile(fileName.c_str()))
+            {
+                logInfoP("File created: %s", fileName.c_str());
             }
             else
             {
@@ -292,14 +564,10 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         }
         else if (command.compare(4, 3, "rm ") == 0)
         {
-            String fileName = command.substr(7).c_str();
-            if (fileName[0] != '/')
-            {
-                fileName = "/" + fileName;
-            }
-            if (fileName.length() > 0 && remove(fileName.c_str()))
+            const ExtFlashPath fileName(std::string_view(command).substr(7));
+            if (fileName.isValid() && !fileName.isRoot() && remove(fileName.c_str()))
             {
-                logInfoP(String("File removed: " + fileName).c_str());
+                logInfoP("File removed: %s", fileName.c_str());
             }
             else
             {
@@ -309,18 +577,14 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         }
         else if (command.compare(4, 4, "cat ") == 0)
         {
-            String fileName = command.substr(9).c_str();
-            if (fileName[0] != '/')
-            {
-                fileName = "/" + fileName;
-            }
-            if (fileName.length() > 0)
+            const ExtFlashPath fileName(std::string_view(command).substr(8));
+            if (fileName.isValid() && !fileName.isRoot())
             {
                 uint8_t buffer[256];
                 size_t bytesRead = read(fileName.c_str(), buffer, sizeof(buffer));
                 if (bytesRead > 0)
                 {
-                    logInfoP(String("Read from file: " + String((char *)buffer)).c_str());
+                    logInfoP("Read from file: %.*s", (int)bytesRead, (const char *)buffer);
                 }
                 else
                 {
@@ -337,11 +601,13 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         else if (command.compare(4, 5, "echo ") == 0)
         {
             // Get the file name which begins with / and ends with space
-            String fileName = command.substr(9, command.find(' ', 9) - 9).c_str();
+            const std::string_view args = std::string_view(command).substr(9);
+            const size_t space = args.find(' ');
+            const ExtFlashPath fileName(args.substr(0, space));
 
             // After the file name, get the content to write to the file it will begin after the space of the file name
-            String content = command.substr(command.find(' ', 9) + 1).c_str();
-            if (fileName.length() > 0 && content.length() > 0)
+            const std::string_view content = space == std::string_view::npos ? std::string_view() : args.substr(space + 1);
+            if (fileName.isValid() && !fileName.isRoot() && content.length() > 0)
             {
                 File file = open(fileName.c_str(), "a");
                 if (!file)
@@ -354,17 +620,15 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
                     }
                     else
                     {
-                        logInfoP(String("File created: " + fileName).c_str());
-                        file.println(content);
-                        file.close();
-                        logInfoP(String("Appended to file: " + fileName).c_str());
+                        logInfoP("File created: %s", fileName.c_str());
                     }
                 }
-                else
+                if (file)
                 {
-                    file.println(content);
+                    file.write((const uint8_t *)content.data(), content.size());
+                    file.println();
                     file.close();
-                    logInfoP(String("Appended to file: " + fileName).c_str());
+                    logInfoP("Appended to file: %s", fileName.c_str());
                 }
             }
             else
@@ -375,19 +639,13 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         }
         else if (command.compare(4, 3, "mv ") == 0)
         {
-            String oldName = command.substr(7, command.find(' ', 7) - 7).c_str();
-            if (oldName[0] != '/')
-            {
-                oldName = "/" + oldName;
-            }
-            String newName = command.substr(command.find(' ', 7) + 1).c_str();
-            if (newName[0] != '/')
-            {
-                newName = "/" + newName;
-            }
-            if (oldName.length() > 0 && newName.length() > 0 && rename(oldName.c_str(), newName.c_str()))
+            const std::string_view args = std::string_view(command).substr(7);
+            const size_t space = args.find(' ');
+            const ExtFlashPath oldName(args.substr(0, space));
+            const ExtFlashPath newName(space == std::string_view::npos ? std::string_view() : args.substr(space + 1));
+            if (oldName.isValid() && newName.isValid() && !oldName.isRoot() && !newName.isRoot() && rename(oldName.c_str(), newName.c_str()))
             {
-                logInfoP(String("Renamed from " + oldName + " to " + newName).c_str());
+                logInfoP("Renamed from %s to %s", oldName.c_str(), newName.c_str());
             }
             else
             {
@@ -397,14 +655,10 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         }
         else if (command.compare(4, 6, "mkdir ") == 0)
         {
-            String dirName = command.substr(11).c_str();
-            if (dirName[0] != '/')
+            const ExtFlashPath dirName(std::string_view(command).substr(10));
+            if (dirName.isValid() && !dirName.isRoot() && mkdir(dirName.c_str()))
             {
-                dirName = "/" + dirName;
-            }
-            if (dirName.length() > 0 && mkdir(dirName.c_str()))
-            {
-                logInfoP(String("Directory created: " + dirName).c_str());
+                logInfoP("Directory created: %s", dirName.c_str());
             }
             else
             {
@@ -414,14 +668,10 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         }
         else if (command.compare(4, 6, "rmdir ") == 0)
         {
-            String dirName = command.substr(11).c_str();
-            if (dirName[0] != '/')
-            {
-                dirName = "/" + dirName;
-            }
-            if (dirName.length() > 0 && rmdir(dirName.c_str()))
+            const ExtFlashPath dirName(std::string_view(command).substr(10));
+            if (dirName.isValid() && !dirName.isRoot() && rmdir(dirName.c_str()))
             {
-                logInfoP(String("Directory removed: " + dirName).c_str());
+                logInfoP("Directory removed: %s", dirName.c_str());
             }
             else
             {
@@ -432,8 +682,7 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         else if (command.compare(4, 3, "ll ") == 0)
         {
             logInfoP("External Flash Files:");
-            String path = command.substr(7).c_str();
-            std::vector<String> files = ls(path.length() == 0 ? "/" : path.c_str());
+            std::vector<String> files = ls(std::string_view(command).substr(7));
             openknx.logger.begin();
             openknx.logger.log("");
             openknx.logger.color(CONSOLE_HEADLINE_COLOR);
@@ -552,14 +801,592 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
         }
         else if (command.compare(4, 3, "ls ") == 0)
         {
-            String path = command.substr(7).c_str();
             logInfoP("External Flash Files:");
-            std::vector<String> files = ls(path.length() == 0 ? "/" : path.c_str());
+            std::vector<String> files = ls(std::string_view(command).substr(7));
             for (String file : files)
             {
                 logInfoP(file.c_str());
             }
         }
+        else if (command.compare(4, 6, "query ") == 0)
+        {
+            // efc query <GA> <from> <to>
+            const size_t gaEnd = command.find(' ', 10);
+            const size_t fromEnd = (gaEnd == std::string::npos) ? std::string::npos : command.find(' ', gaEnd + 1);
+            int32_t ga;
+            if (gaEnd == std::string::npos || fromEnd == std::string::npos || !TelegramLog::parseGa(command.substr(10, gaEnd - 10).c_str(), ga))
+            {
+                logErrorP("Usage: efc query <GA|*> <from> <to>");
+                return false;
+            }
+            const time_t from = parseTime(command.substr(gaEnd + 1, fromEnd - gaEnd - 1));
+            const time_t to = parseTime(command.substr(fromEnd + 1));
+
+            openknx.logger.begin();
+            const uint32_t matches = queryTelegrams(ga, from, to, [](const TelegramRecord &record) -> bool {
+                char formattedTime[25];
+                const time_t t = record.time;
+                strftime(formattedTime, sizeof(formattedTime), "%d.%m.%y %H:%M:%S", localtime(&t));
+                char payload[sizeof(record.data) * 3 + 1] = {0};
+                for (uint8_t i = 0; i < record.len; i++)
+                {
+                    sprintf(payload + i * 3, "%02X ", record.data[i]);
+                }
+                openknx.logger.logWithValues("%s  %-10s %s", formattedTime, TelegramLog::gaToString(record.ga).c_str(), payload);
+                return true;
+            });
+            openknx.logger.logWithValues("%lu telegram(s), %lu segment(s) scanned, %lu skipped",
+                                         (unsigned long)matches,
+                                         (unsigned long)_telegramLog.segmentsScanned(),
+                                         (unsigned long)_telegramLog.segmentsSkipped());
+            openknx.logger.end();
+        }
+        else if (command.compare(4, 6, "trend ") == 0 && command.length() > 12)
+        {
+            // efc trend <m|h|d> <GA> <from> <to>
+            const TelegramRollupLevel level = TelegramRollup::parseLevel(command[10]);
+            const size_t gaEnd = command.find(' ', 12);
+            const size_t fromEnd = (gaEnd == std::string::npos) ? std::string::npos : command.find(' ', gaEnd + 1);
+            int32_t ga;
+            if (gaEnd == std::string::npos || fromEnd == std::string::npos || !TelegramLog::parseGa(command.substr(12, gaEnd - 12).c_str(), ga) ||
+                ga == TLG_ANY_GA)
+            {
+                logErrorP("Usage: efc trend <m|h|d> <GA> <from> <to>");
+                return false;
+            }
+            const time_t from = parseTime(command.substr(gaEnd + 1, fromEnd - gaEnd - 1));
+            const time_t to = parseTime(command.substr(fromEnd + 1));
+
+            openknx.logger.begin();
+            openknx.logger.logWithValues("%-17s | %-8s | %-10s | %-10s | %-10s", "Start", "Count", "Min", "Avg", "Max");
+            const uint32_t buckets = queryTrend(level, ga, from, to, [](const RollupRecord &record) -> bool {
+                char formattedTime[25];
+                const time_t t = record.start;
+                strftime(formattedTime, sizeof(formattedTime), "%d.%m.%y %H:%M:%S", localtime(&t));
+                openknx.logger.logWithValues("%-17s | %-8lu | %-10.2f | %-10.2f | %-10.2f", formattedTime, (unsigned long)record.count,
+                                             record.min, record.count ? record.sum / record.count : 0.0f, record.max);
+                return true;
+            });
+            openknx.logger.logWithValues("%lu bucket(s), %lu raw segment(s) rolled up and %lu bucket(s) lost since boot", (unsigned long)buckets,
+                                         (unsigned long)_telegramRollup.segmentsConsumed(), (unsigned long)_telegramRollup.bucketsLost());
+            openknx.logger.end();
+        }
+        else if (command.compare(4, 3, "gos") == 0)
+        {
+            if (command.compare(7, 5, " add ") == 0)
+            {
+                const uint16_t koNumber = atoi(command.substr(12).c_str());
+                if (_goSnapshot.add(koNumber))
+                {
+                    logInfoP("Group object %u added to the snapshot", koNumber);
+                }
+                else
+                {
+                    logErrorP("Failed to add group object %u to the snapshot", koNumber);
+                    bRet = false;
+                }
+            }
+            else if (command.compare(7, 6, " clear") == 0)
+            {
+                if (_goSnapshot.clear())
+                {
+                    logInfoP("Group object snapshot cleared");
+                }
+                else
+                {
+                    logErrorP("Failed to clear the group object snapshot");
+                    bRet = false;
+                }
+            }
+            logInfoP("Group object snapshot: %u GO(s), %u bytes, %s, %lu write(s) since boot", _goSnapshot.count(), _goSnapshot.bytes(),
+                     _goSnapshot.dirty() ? "dirty" : "clean", (unsigned long)_goSnapshot.writes());
+        }
+        else if (command.compare(4, 4, "part") == 0)
+        {
+            if (command.compare(8, 6, " reset") == 0)
+            {
+                // The only way a table is written over an existing one or a legacy filesystem. Takes effect with the
+                // next boot, the filesystem is formatted if its partition moved
+                ExtFlashPartitions partitions;
+                partitions.begin(flashDriver());
+                partitions.setDefaults();
+                if (partitions.write())
+                {
+                    logInfoP("Default partition table written, restart the device");
+                }
+                else
+                {
+                    logErrorP("Failed to write the partition table");
+                    bRet = false;
+                }
+            }
+            openknx.logger.begin();
+            openknx.logger.logWithValues("%-12s | %-8s | %-10s | %-10s", "Name", "Type", "Offset", "Size");
+            for (uint8_t i = 0; i < _partitions.count(); i++)
+            {
+                const ExtFlashPartition &partition = _partitions.at(i);
+                openknx.logger.logWithValues("%-12s | %-8s | 0x%08lX | %lu KB", partition.name, ExtFlashPartitions::typeName(partition.type),
+                                             (unsigned long)partition.offset, (unsigned long)(partition.size / 1024));
+            }
+            openknx.logger.end();
+        }
+        else if (command.compare(4, 3, "ota") == 0)
+        {
+            if (!_otaStager.isReady())
+            {
+                logErrorP("OTA partition not available");
+                return false;
+            }
+            if (command.compare(7, 7, " begin ") == 0)
+            {
+                // efc ota begin <size> [crc]
+                char *end = nullptr;
+                const uint32_t size = strtoul(command.c_str() + 14, &end, 10);
+                const uint32_t crc = strtoul(end, nullptr, 16);
+                if (!_otaStager.start(size, crc))
+                {
+                    logErrorP("Image does not fit, max %lu bytes", (unsigned long)_otaStager.maxImageSize());
+                    bRet = false;
+                }
+            }
+            else if (command.compare(7, 6, " data ") == 0)
+            {
+                // efc ota data <hex>, the console line is short, so this is a few bytes per command
+                uint8_t data[64];
+                size_t len = 0;
+                for (size_t i = 13; i + 1 < command.length() && len < sizeof(data); i += 2)
+                {
+                    data[len++] = strtoul(command.substr(i, 2).c_str(), nullptr, 16);
+                }
+                const size_t accepted = _otaStager.write(data, len);
+                if (accepted != len)
+                {
+                    logErrorP("Busy, %u of %u bytes taken over, send the rest again", (unsigned)accepted, (unsigned)len);
+                    bRet = false;
+                }
+            }
+            else if (command.compare(7, 4, " end") == 0)
+            {
+                if (!_otaStager.finish())
+                {
+                    logErrorP("Image incomplete");
+                    bRet = false;
+                }
+            }
+            else if (command.compare(7, 6, " apply") == 0)
+            {
+                if (_otaStager.requestApply())
+                {
+                    logInfoP("Rebooting to apply the staged image");
+                    delay(100);
+                    rp2040.reboot();
+                }
+                logErrorP("No verified image staged");
+                bRet = false;
+            }
+            else if (command.compare(7, 7, " patch ") == 0)
+            {
+                if (!_deltaPatch.begin(&_otaStager, &_extFlashLfs, command.substr(14).c_str()))
+                {
+                    logErrorP("Failed to open the patch %s", command.substr(14).c_str());
+                    bRet = false;
+                }
+            }
+            else if (command.compare(7, 6, " abort") == 0)
+            {
+                _deltaPatch.abort();
+                _otaStager.abort();
+            }
+            if (_deltaPatch.state() != DeltaState::Idle)
+            {
+                logInfoP("Patch: %s, %lu bytes consumed, %lu/%lu bytes produced", DeltaPatch::stateName(_deltaPatch.state()),
+                         (unsigned long)_deltaPatch.consumed(), (unsigned long)_deltaPatch.produced(), (unsigned long)_deltaPatch.targetSize());
+            }
+            logInfoP("OTA: %s, %lu/%lu bytes, %lu written, crc %08lX, %u apply attempt(s)", OtaStager::stateName(_otaStager.state()),
+                     (unsigned long)_otaStager.received(), (unsigned long)_otaStager.imageSize(), (unsigned long)_otaStager.written(),
+                     (unsigned long)_otaStager.crc(), _otaStager.applyAttempts());
+        }
+        else if (command.compare(4, 5, "store") == 0)
+        {
+            if (!_moduleStore.isReady())
+            {
+                logErrorP("Module store not available");
+                return false;
+            }
+            if (command.compare(9, 5, " save") == 0)
+            {
+                _moduleStore.save();
+                if (!_moduleStore.flush())
+                {
+                    logErrorP("Save failed, the blocks kept changing");
+                    bRet = false;
+                }
+            }
+            logInfoP("Module store: %u slots, latest %d (seq %lu), %u block(s) with %lu bytes, %lu save(s) since boot, %lu retried, %lu failed",
+                     _moduleStore.slots(), _moduleStore.slot(), (unsigned long)_moduleStore.sequence(), _moduleStore.count(),
+                     (unsigned long)_moduleStore.used(), (unsigned long)_moduleStore.saves(), (unsigned long)_moduleStore.retries(),
+                     (unsigned long)_moduleStore.failures());
+        }
+        else if (command.compare(4, 5, "crash") == 0)
+        {
+            if (!_crashDump.isReady())
+            {
+                logErrorP("Crash dump not available");
+                return false;
+            }
+            if (command.compare(9, 6, " clear") == 0)
+            {
+                _crashDump.clear();
+            }
+            else if (command.compare(9, 8, " trigger") == 0)
+            {
+                if (!_crashDump.armed())
+                {
+                    logErrorP("Crash dump not armed yet");
+                    return false;
+                }
+                logInfoP("Triggering a hard fault");
+                delay(100);
+                asm volatile("udf #0");
+            }
+            else if (_crashDump.hasDump())
+            {
+                openknx.logger.begin();
+                _crashDump.print([](const char *line) { openknx.logger.logWithValues("%s", line); }, command.compare(9, 5, " dump") == 0);
+                openknx.logger.end();
+            }
+            logInfoP("Crash dump: %s", _crashDump.hasDump() ? "stored" : (_crashDump.armed() ? "armed" : "preparing"));
+        }
+        else if (command.compare(4, 5, "trace") == 0)
+        {
+            if (command.compare(9, 6, " start") == 0)
+            {
+                const bool spill = command.compare(15, 6, " spill") == 0;
+                if (spill && !_trace.hasPartition())
+                {
+                    logErrorP("Trace partition not available");
+                    return false;
+                }
+                if (!_trace.start(_extFlashLfsConfig.block_size, _extFlashLfsConfig.block_count, spill))
+                {
+                    logErrorP("Failed to start the trace");
+                    bRet = false;
+                }
+            }
+            else if (command.compare(9, 5, " stop") == 0)
+            {
+                _trace.stop();
+            }
+            else if (command.compare(9, 6, " clear") == 0)
+            {
+                _trace.clear();
+            }
+            else if (command.compare(9, 5, " dump") == 0)
+            {
+                // One line per call, efc_hostreplay reads the lines starting with "TR "
+                openknx.logger.begin();
+                openknx.logger.logWithValues("TR config %lu %lu", (unsigned long)_trace.blockSize(), (unsigned long)_trace.blockCount());
+                const uint32_t records = _trace.forEach([](const ExtFlashTraceRecord &r) {
+                    openknx.logger.logWithValues("TR %lu %c %u %lu %lu", (unsigned long)r.us, r.op, r.block, (unsigned long)r.off, (unsigned long)r.size);
+                });
+                openknx.logger.logWithValues("%lu record(s)", (unsigned long)records);
+                openknx.logger.end();
+            }
+            logInfoP("Trace: %s%s, %lu call(s) recorded, %lu dropped, %lu/%lu spilled", _trace.isRecording() ? "recording" : "stopped",
+                     _trace.isSpilling() ? " (spill)" : "", (unsigned long)_trace.recorded(), (unsigned long)_trace.dropped(),
+                     (unsigned long)_trace.spilled(), (unsigned long)_trace.capacity());
+        }
+        else if (command.compare(4, 4, "wear") == 0)
+        {
+            if (!_wear.isReady())
+            {
+                logErrorP("Wear partition not available");
+                return false;
+            }
+            if (command.compare(8, 5, " save") == 0)
+            {
+                _wear.checkpoint();
+            }
+            // One character per 64KB block, the most erased sector of the block relative to the most erased one
+            uint32_t blockMax[FLASH_SIZE_W25Q128 / BLOCK_SIZE_W25Q128_64KB] = {0};
+            uint64_t erases = 0, eraseMs = 0;
+            uint32_t maxErases = 0, timed = 0;
+            uint16_t maxSector = 0, slowSector = 0, slowMs = 0;
+            _wear.forEach([&](uint16_t sector, uint32_t count, uint16_t ms) {
+                const uint16_t block = sector * SECTOR_SIZE_W25Q128_4KB / BLOCK_SIZE_W25Q128_64KB;
+                blockMax[block] = max(blockMax[block], count);
+                erases += count;
+                if (count > maxErases)
+                {
+                    maxErases = count;
+                    maxSector = sector;
+                }
+                if (ms)
+                {
+                    eraseMs += ms;
+                    timed++;
+                    if (ms > slowMs)
+                    {
+                        slowMs = ms;
+                        slowSector = sector;
+                    }
+                }
+            });
+            static const char levels[] = " .:-=+*#%@";
+            openknx.logger.begin();
+            for (uint16_t row = 0; row < FLASH_SIZE_W25Q128 / BLOCK_SIZE_W25Q128_64KB; row += 64)
+            {
+                char line[65];
+                for (uint8_t i = 0; i < 64; i++)
+                {
+                    line[i] = levels[maxErases ? (uint64_t)blockMax[row + i] * (sizeof(levels) - 2) / maxErases : 0];
+                }
+                line[64] = 0;
+                openknx.logger.logWithValues("%06lX |%s|", (unsigned long)row * BLOCK_SIZE_W25Q128_64KB, line);
+            }
+            openknx.logger.logWithValues("Erases: %llu, avg %lu, max %lu (sector at 0x%06lX)", (unsigned long long)erases,
+                                         (unsigned long)(erases / WEAR_SECTORS), (unsigned long)maxErases,
+                                         (unsigned long)maxSector * SECTOR_SIZE_W25Q128_4KB);
+            if (timed)
+            {
+                openknx.logger.logWithValues("Erase time: avg %lu ms of %lu sector(s), slowest %u ms (sector at 0x%06lX)", (unsigned long)(eraseMs / timed),
+                                             (unsigned long)timed, slowMs, (unsigned long)slowSector * SECTOR_SIZE_W25Q128_4KB);
+            }
+            // Remaining lifetime of the most erased sector at the average erase rate so far
+            const uint32_t minutes = _wear.minutes();
+            if (maxErases && minutes)
+            {
+                const uint32_t left = maxErases < EXTFLASH_WEAR_ENDURANCE ? EXTFLASH_WEAR_ENDURANCE - maxErases : 0;
+                openknx.logger.logWithValues("Lifetime: %lu.%02lu%% used after %lu h, about %lu days left at the current rate",
+                                             (unsigned long)(maxErases * 100ULL / EXTFLASH_WEAR_ENDURANCE),
+                                             (unsigned long)(maxErases * 10000ULL / EXTFLASH_WEAR_ENDURANCE % 100), (unsigned long)(minutes / 60),
+                                             (unsigned long)((uint64_t)left * minutes / maxErases / (24 * 60)));
+            }
+            openknx.logger.end();
+            logInfoP("Wear: checkpoint %lu, %lu erase(s) since, %s", (unsigned long)_wear.sequence(), (unsigned long)_wear.erasesSinceCheckpoint(),
+                     _wear.state() == ExtFlashWearState::Idle ? "idle" : "saving");
+        }
+        else if (command.compare(4, 2, "tp") == 0)
+        {
+#ifdef EXTFLASH_TRACEPOINTS
+            if (command.compare(6, 6, " clear") == 0)
+            {
+                ExtFlashTracepoints::clear();
+            }
+            else if (command.compare(6, 5, " dump") == 0)
+            {
+                // One line per event of both cores in time order, B/E are the entry and exit of a scope
+                openknx.logger.begin();
+                ExtFlashTracepoints::forEach([](const ExtFlashTracepointEvent &e) {
+                    openknx.logger.logWithValues("TP %lu %u %c %s %lu", (unsigned long)e.us, e.core, e.phase, e.name, (unsigned long)e.arg);
+                });
+                openknx.logger.end();
+            }
+            logInfoP("Tracepoints: %lu event(s) recorded, %lu overwritten", (unsigned long)ExtFlashTracepoints::recorded(),
+                     (unsigned long)ExtFlashTracepoints::dropped());
+#else
+            logErrorP("Tracepoints not available, build with -DEXTFLASH_TRACEPOINTS");
+            return false;
+#endif
+        }
+        else if (command.compare(4, 14, "stats blocking") == 0)
+        {
+            if (command.compare(18, 6, " reset") == 0)
+            {
+                _blocking.reset();
+            }
+            else if (command.compare(18, 7, " limit ") == 0 && command.length() > 25)
+            {
+                _blocking.setLimit(strtoul(command.c_str() + 25, nullptr, 10) * 1000);
+            }
+            openknx.logger.begin();
+            for (uint8_t i = 0; i < _blocking.count(); i++)
+            {
+                const ExtFlashBlockingEntry &e = _blocking.entry(i);
+                openknx.logger.logWithValues("%-12s %7lu us %6lu call(s) %4lu over, %lus ago %s", e.op, (unsigned long)e.us, (unsigned long)e.calls,
+                                             (unsigned long)e.overruns, (unsigned long)((millis() - e.lastMs) / 1000), e.path);
+            }
+            openknx.logger.end();
+            logInfoP("Blocking: %lu overrun(s) over %lu ms", (unsigned long)_blocking.overruns(), (unsigned long)(_blocking.limit() / 1000));
+        }
+        else if (command.compare(4, 8, "stats wa") == 0)
+        {
+            // Factor of the programmed bytes, and of the programmed and erased bytes, per written byte
+            openknx.logger.begin();
+            openknx.logger.logWithValues("%-12s %10s %10s %10s %7s %7s", "dir", "written", "programmed", "erased", "prog", "+erase");
+            for (uint8_t i = 0; i < EXTFLASH_WA_DIRS; i++)
+            {
+                const ExtFlashWaDir &d = extFlashStats.wa[i];
+                if (!d.logicalBytes && !d.progBytes && !d.eraseBytes)
+                {
+                    continue;
+                }
+                const uint64_t logical = d.logicalBytes ? d.logicalBytes : 1;
+                openknx.logger.logWithValues("%-12s %10llu %10llu %10llu %4lu.%02lu %4lu.%02lu", i ? d.name : "(other)", (unsigned long long)d.logicalBytes,
+                                             (unsigned long long)d.progBytes, (unsigned long long)d.eraseBytes,
+                                             (unsigned long)(d.progBytes / logical), (unsigned long)(d.progBytes * 100 / logical % 100),
+                                             (unsigned long)((d.progBytes + d.eraseBytes) / logical),
+                                             (unsigned long)((d.progBytes + d.eraseBytes) * 100 / logical % 100));
+            }
+            const uint64_t logical = extFlashStats.fileWriteBytes ? extFlashStats.fileWriteBytes : 1;
+            openknx.logger.logWithValues("Total: %llu byte(s) written, %lu.%02lux programmed", (unsigned long long)extFlashStats.fileWriteBytes,
+                                         (unsigned long)(extFlashStats.lfsProgBytes / logical), (unsigned long)(extFlashStats.lfsProgBytes * 100 / logical % 100));
+            openknx.logger.end();
+        }
+        else if (command.compare(4, 9, "stats mem") == 0)
+        {
+            // Heap of the flash subsystem, the bytes include the tracking header of each block
+            openknx.logger.begin();
+            openknx.logger.logWithValues("%-8s %8s %8s %8s %8s %6s", "category", "current", "peak", "allocs", "frees", "failed");
+            uint32_t current = 0;
+            uint32_t peak = 0;
+            for (uint8_t i = 0; i < EXTFLASH_MEM_COUNT; i++)
+            {
+                const ExtFlashMemUsage &m = extFlashMem[i];
+                openknx.logger.logWithValues("%-8s %8lu %8lu %8lu %8lu %6lu", extFlashMemNames[i], (unsigned long)m.current, (unsigned long)m.peak,
+                                             (unsigned long)m.allocs, (unsigned long)m.frees, (unsigned long)m.failures);
+                current += m.current;
+                peak += m.peak;
+            }
+            openknx.logger.logWithValues("Total: %lu byte(s), peaks %lu, static %u (module)", (unsigned long)current, (unsigned long)peak,
+                                         (unsigned)sizeof(ExternalFlash));
+            openknx.logger.end();
+        }
+        else if (command.compare(4, 9, "stats lat") == 0)
+        {
+            // One line per operation, then the non-empty buckets as <first us of the bucket>:<calls>
+            openknx.logger.begin();
+            for (uint8_t op = 0; op < EXTFLASH_LAT_COUNT; op++)
+            {
+                const ExtFlashHistogram &h = extFlashStats.latency[op];
+                if (!h.count)
+                {
+                    continue;
+                }
+                openknx.logger.logWithValues("%s: %lu call(s), avg %lu us, p50 %lu us, p99 %lu us, max %lu us", extFlashLatNames[op],
+                                             (unsigned long)h.count, (unsigned long)(h.sumUs / h.count), (unsigned long)h.percentile(50),
+                                             (unsigned long)h.percentile(99), (unsigned long)h.maxUs);
+                // snprintf returns the untruncated length, stop once the line is full instead of running past its end
+                char line[EXTFLASH_LAT_BUCKETS * 16];
+                size_t len = 0;
+                line[0] = 0;
+                for (uint8_t i = 0; i < EXTFLASH_LAT_BUCKETS && len < sizeof(line); i++)
+                {
+                    if (h.buckets[i])
+                    {
+                        len += snprintf(line + len, sizeof(line) - len, " %lu:%lu", 1ul << i, (unsigned long)h.buckets[i]);
+                    }
+                }
+                openknx.logger.logWithValues(" %s", line);
+            }
+            openknx.logger.end();
+        }
+        else if (command.compare(4, 5, "stats") == 0)
+        {
+            const ExtFlashStats &s = extFlashStats;
+            openknx.logger.begin();
+            openknx.logger.logWithValues("SPI: %llu byte(s) out, %llu in, %llu ms busy wait", (unsigned long long)s.spiBytesOut,
+                                         (unsigned long long)s.spiBytesIn, (unsigned long long)(s.busyWaitUs / 1000));
+            openknx.logger.logWithValues("Commands: read %lu, program %lu, erase %lu/%lu/%lu (4K/64K/chip), wren %lu, wrdi %lu, status %lu, other %lu",
+                                         (unsigned long)s.cmdRead, (unsigned long)s.cmdPageProgram, (unsigned long)s.cmdSectorErase,
+                                         (unsigned long)s.cmdBlockErase, (unsigned long)s.cmdChipErase, (unsigned long)s.cmdWriteEnable,
+                                         (unsigned long)s.cmdWriteDisable, (unsigned long)s.cmdReadStatus, (unsigned long)s.cmdOther);
+            openknx.logger.logWithValues("Driver: %llu byte(s) read, %llu programmed, %lu erase(s), %lu async erase(s)",
+                                         (unsigned long long)s.readBytes, (unsigned long long)s.programBytes, (unsigned long)s.erases,
+                                         (unsigned long)s.asyncErases);
+            // The driver traffic not caused by littlefs comes from the raw partitions
+            openknx.logger.logWithValues("LittleFS: %lu read(s) %llu byte(s), %lu prog(s) %llu byte(s), %lu erase(s), %lu commit(s)",
+                                         (unsigned long)s.lfsReads, (unsigned long long)s.lfsReadBytes, (unsigned long)s.lfsProgs,
+                                         (unsigned long long)s.lfsProgBytes, (unsigned long)s.lfsErases, (unsigned long)s.lfsSyncs);
+            openknx.logger.logWithValues("Raw: %llu byte(s) read, %llu programmed", (unsigned long long)(s.readBytes - s.lfsReadBytes),
+                                         (unsigned long long)(s.programBytes - s.lfsProgBytes));
+            openknx.logger.logWithValues("Files: %lu open(s), %lu failed (%lu at the max open files), %lu close(s), %lu dir(s), %lu flush(es)",
+                                         (unsigned long)s.opens, (unsigned long)s.openFailures, (unsigned long)s.fdRefused, (unsigned long)s.closes,
+                                         (unsigned long)s.dirOpens, (unsigned long)s.flushes);
+            openknx.logger.logWithValues("Files: %lu read(s) %llu byte(s), %lu write(s) %llu byte(s), cache %lu hit(s) %lu miss(es)",
+                                         (unsigned long)s.fileReads, (unsigned long long)s.fileReadBytes, (unsigned long)s.fileWrites,
+                                         (unsigned long long)s.fileWriteBytes, (unsigned long)s.cacheHits, (unsigned long)s.cacheMisses);
+            openknx.logger.end();
+            if (command.compare(9, 6, " reset") == 0)
+            {
+                extFlashStats.reset();
+                logInfoP("Counters reset");
+            }
+        }
+        else if (command.compare(4, 6, "rawlog") == 0)
+        {
+            if (!_rawLog.isReady())
+            {
+                logErrorP("Raw log not available");
+                return false;
+            }
+            if (command.compare(10, 5, " add ") == 0 && command.length() > 15)
+            {
+                const std::string text = command.substr(15);
+                if (!_rawLog.append((const uint8_t *)text.c_str(), min<size_t>(text.length(), RAWLOG_MAX_RECORD)))
+                {
+                    logErrorP("Failed to append the record");
+                    bRet = false;
+                }
+            }
+            else if (command.compare(10, 5, " dump") == 0)
+            {
+                openknx.logger.begin();
+                const uint32_t records = _rawLog.forEach([](const uint8_t *data, uint16_t len) -> bool {
+                    char hex[16 * 3 + 1] = {0};
+                    for (uint16_t i = 0; i < len && i < 16; i++)
+                    {
+                        sprintf(hex + i * 3, "%02X ", data[i]);
+                    }
+                    openknx.logger.logWithValues("%4u bytes: %s%s", len, hex, len > 16 ? "..." : "");
+                    return true;
+                });
+                openknx.logger.logWithValues("%lu record(s), %lu torn record(s) skipped", (unsigned long)records, (unsigned long)_rawLog.skipped());
+                openknx.logger.end();
+            }
+            else if (command.compare(10, 6, " clear") == 0)
+            {
+                if (!_rawLog.clear())
+                {
+                    logErrorP("Failed to clear the raw log");
+                    bRet = false;
+                }
+            }
+            logInfoP("Raw log: %lu KB, sector seq %lu, head %lu:%lu, %lu record(s) appended since boot", (unsigned long)(_rawLog.size() / 1024),
+                     (unsigned long)_rawLog.sequence(), (unsigned long)_rawLog.headSector(), (unsigned long)_rawLog.headOffset(),
+                     (unsigned long)_rawLog.appended());
+        }
+        else if (command.compare(4, 3, "log") == 0)
+        {
+            if (!_logRing.isReady())
+            {
+                logErrorP("Log ring not available");
+                return false;
+            }
+            // Don't capture our own output while reading the log
+            _logRing.pause(true);
+            if (command.compare(7, 5, " tail") == 0 || command.compare(7, 5, " dump") == 0)
+            {
+                const bool tail = command.compare(8, 4, "tail") == 0;
+                const uint32_t lines = (tail && command.length() > 13) ? atoi(command.substr(13).c_str()) : 20;
+                auto print = [](const char *line) { openknx.logger.logWithValues("%s", line); };
+                openknx.logger.begin();
+                const uint32_t count = tail ? _logRing.tail(lines, print) : _logRing.dump(print);
+                openknx.logger.logWithValues("%lu line(s)", (unsigned long)count);
+                openknx.logger.end();
+            }
+            else if (command.compare(7, 6, " clear") == 0)
+            {
+                if (!_logRing.clear())
+                {
+                    logErrorP("Failed to clear the log ring");
+                    bRet = false;
+                }
+            }
+            logInfoP("Log ring: %lu KB, sector %lu, %lu byte(s) buffered, %lu dropped", (unsigned long)(_logRing.size() / 1024),
+                     (unsigned long)_logRing.sequence(), (unsigned long)_logRing.buffered(), (unsigned long)_logRing.dropped());
+            _logRing.pause(false);
+        }
         else
         {
             logErrorP("Invalid command. Use 'efs ?' for help.");
@@ -578,6 +1405,8 @@ bool ExternalFlash::processCommand(const std::string command, bool diagnose)
  */
 bool ExternalFlash::format()
 {
+    EXTFLASH_TP_SCOPE("api.format", 0);
+    ExtFlashBlockingScope blocking(_blocking, "format");
     return _extFlashLfs.format();
 }
 
@@ -591,6 +1420,8 @@ bool ExternalFlash::format()
  */
 bool ExternalFlash::info(FSInfo &info)
 {
+    EXTFLASH_TP_SCOPE("api.info", 0);
+    ExtFlashBlockingScope blocking(_blocking, "info");
     return _extFlashLfs.info(info);
 }
 
@@ -603,8 +1434,10 @@ bool ExternalFlash::info(FSInfo &info)
  * @param stat A reference to an FSStat object to store the statistics.
  * @return True if the statistics are successfully retrieved, false otherwise.
  */
-bool ExternalFlash::Statistics(const String path, FSStat &stat)
+bool ExternalFlash::Statistics(const char *path, FSStat &stat)
 {
+    EXTFLASH_TP_SCOPE("api.Statistics", 0);
+    ExtFlashBlockingScope blocking(_blocking, "Statistics", path);
     return _extFlashLfs.stat(path, &stat);
 }
 
@@ -619,6 +1452,8 @@ bool ExternalFlash::Statistics(const String path, FSStat &stat)
  */
 File ExternalFlash::open(const char *path, const char *mode)
 {
+    EXTFLASH_TP_SCOPE("api.open", 0);
+    ExtFlashBlockingScope blocking(_blocking, "open", path);
     return _extFlashLfs.open(path, mode);
 }
 
@@ -632,6 +1467,8 @@ File ExternalFlash::open(const char *path, const char *mode)
  */
 bool ExternalFlash::createFile(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.createFile", 0);
+    ExtFlashBlockingScope blocking(_blocking, "createFile", path);
     File file = _extFlashLfs.open(path, "w");
     if (!file)
     {
@@ -651,6 +1488,8 @@ bool ExternalFlash::createFile(const char *path)
  */
 bool ExternalFlash::remove(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.remove", 0);
+    ExtFlashBlockingScope blocking(_blocking, "remove", path);
 
     return _extFlashLfs.remove(path);
 }
@@ -665,6 +1504,8 @@ bool ExternalFlash::remove(const char *path)
  */
 bool ExternalFlash::exists(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.exists", 0);
+    ExtFlashBlockingScope blocking(_blocking, "exists", path);
     return _extFlashLfs.exists(path);
 }
 
@@ -680,6 +1521,8 @@ bool ExternalFlash::exists(const char *path)
  */
 size_t ExternalFlash::read(const char *path, uint8_t *buffer, size_t size)
 {
+    EXTFLASH_TP_SCOPE("api.read", size);
+    ExtFlashBlockingScope blocking(_blocking, "read", path);
     File file = _extFlashLfs.open(path, "r");
     if (!file)
     {
@@ -702,6 +1545,8 @@ size_t ExternalFlash::read(const char *path, uint8_t *buffer, size_t size)
  */
 size_t ExternalFlash::write(const char *path, const uint8_t *buffer, size_t size)
 {
+    EXTFLASH_TP_SCOPE("api.write", size);
+    ExtFlashBlockingScope blocking(_blocking, "write", path);
     File file = _extFlashLfs.open(path, "w");
     if (!file)
     {
@@ -723,6 +1568,8 @@ size_t ExternalFlash::write(const char *path, const uint8_t *buffer, size_t size
  */
 bool ExternalFlash::rename(const char *oldPath, const char *newPath)
 {
+    EXTFLASH_TP_SCOPE("api.rename", 0);
+    ExtFlashBlockingScope blocking(_blocking, "rename", oldPath);
     return _extFlashLfs.rename(oldPath, newPath);
 }
 
@@ -736,6 +1583,8 @@ bool ExternalFlash::rename(const char *oldPath, const char *newPath)
  */
 bool ExternalFlash::mkdir(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.mkdir", 0);
+    ExtFlashBlockingScope blocking(_blocking, "mkdir", path);
     return _extFlashLfs.mkdir(path);
 }
 
@@ -749,6 +1598,8 @@ bool ExternalFlash::mkdir(const char *path)
  */
 bool ExternalFlash::createDir(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.createDir", 0);
+    ExtFlashBlockingScope blocking(_blocking, "createDir", path);
     return _extFlashLfs.mkdir(path);
 }
 
@@ -762,6 +1613,8 @@ bool ExternalFlash::createDir(const char *path)
  */
 bool ExternalFlash::rmdir(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.rmdir", 0);
+    ExtFlashBlockingScope blocking(_blocking, "rmdir", path);
     return _extFlashLfs.rmdir(path);
 }
 
@@ -775,6 +1628,8 @@ bool ExternalFlash::rmdir(const char *path)
  */
 std::vector<String> ExternalFlash::ls(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.ls", 0);
+    ExtFlashBlockingScope blocking(_blocking, "ls", path);
     std::vector<String> fileList;
     File dir = _extFlashLfs.open(path, "r");
     if (!dir || !dir.isDirectory())
@@ -801,6 +1656,8 @@ std::vector<String> ExternalFlash::ls(const char *path)
  */
 bool ExternalFlash::move(const char *oldPath, const char *newPath)
 {
+    EXTFLASH_TP_SCOPE("api.move", 0);
+    ExtFlashBlockingScope blocking(_blocking, "move", oldPath);
     return rename(oldPath, newPath);
 }
 
@@ -815,6 +1672,8 @@ bool ExternalFlash::move(const char *oldPath, const char *newPath)
  */
 bool ExternalFlash::copyFile(const char *srcPath, const char *destPath)
 {
+    EXTFLASH_TP_SCOPE("api.copyFile", 0);
+    ExtFlashBlockingScope blocking(_blocking, "copyFile", srcPath);
     File srcFile = _extFlashLfs.open(srcPath, "r");
     if (!srcFile)
     {
@@ -847,6 +1706,8 @@ bool ExternalFlash::copyFile(const char *srcPath, const char *destPath)
  */
 bool ExternalFlash::copyDir(const char *srcPath, const char *destPath)
 {
+    EXTFLASH_TP_SCOPE("api.copyDir", 0);
+    ExtFlashBlockingScope blocking(_blocking, "copyDir", srcPath);
     File srcDir = _extFlashLfs.open(srcPath, "r");
     if (!srcDir || !srcDir.isDirectory())
     {
@@ -859,8 +1720,8 @@ bool ExternalFlash::copyDir(const char *srcPath, const char *destPath)
     File file = srcDir.openNextFile();
     while (file)
     {
-        String srcFilePath = String(srcPath) + "/" + file.name();
-        String destFilePath = String(destPath) + "/" + file.name();
+        const ExtFlashPath srcFilePath(srcPath, file.name());
+        const ExtFlashPath destFilePath(destPath, file.name());
         if (file.isDirectory())
         {
             if (!copyDir(srcFilePath.c_str(), destFilePath.c_str()))
@@ -890,6 +1751,8 @@ bool ExternalFlash::copyDir(const char *srcPath, const char *destPath)
  */
 size_t ExternalFlash::getSize(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.getSize", 0);
+    ExtFlashBlockingScope blocking(_blocking, "getSize", path);
     File file = _extFlashLfs.open(path, "r");
     if (!file)
     {
@@ -910,6 +1773,8 @@ size_t ExternalFlash::getSize(const char *path)
  */
 time_t ExternalFlash::getCreationTime(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.getCreationTime", 0);
+    ExtFlashBlockingScope blocking(_blocking, "getCreationTime", path);
     FSStat stat;
     if (_extFlashLfs.stat(path, &stat))
     {
@@ -931,6 +1796,8 @@ time_t ExternalFlash::getCreationTime(const char *path)
  */
 time_t ExternalFlash::getModificationTime(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.getModificationTime", 0);
+    ExtFlashBlockingScope blocking(_blocking, "getModificationTime", path);
     return getAccessTime(path);
 }
 
@@ -944,6 +1811,8 @@ time_t ExternalFlash::getModificationTime(const char *path)
  */
 time_t ExternalFlash::getAccessTime(const char *path)
 {
+    EXTFLASH_TP_SCOPE("api.getAccessTime", 0);
+    ExtFlashBlockingScope blocking(_blocking, "getAccessTime", path);
     FSStat stat;
     if (_extFlashLfs.stat(path, &stat))
     {
@@ -955,6 +1824,89 @@ time_t ExternalFlash::getAccessTime(const char *path)
     }
 }
 
+/**
+ * @brief Appends a telegram to the telegram log, using the current local time.
+ *
+ * @param ga The group address.
+ * @param data The payload of the telegram.
+ * @param len The length of the payload.
+ * @param valueType How the rollups decode the payload (TLG_VALUE_*), guessed by the length by default.
+ * @return True if the telegram was logged, false otherwise.
+ */
+bool ExternalFlash::logTelegram(uint16_t ga, const uint8_t *data, uint8_t len, uint8_t valueType)
+{
+    EXTFLASH_TP_SCOPE("api.logTelegram", ga);
+    ExtFlashBlockingScope blocking(_blocking, "logTelegram");
+    if (!_mounted)
+    {
+        return false;
+    }
+    return _telegramLog.append(ga, data, len, (uint32_t)openknx.time.getLocalTime().toTime_t(), valueType);
+}
+
+/**
+ * @brief Queries the telegram log.
+ *
+ * Only segments whose footer overlaps the time range and whose group address bitmap contains the
+ * group address are read. The matching records are passed to the callback one by one.
+ *
+ * @param ga The group address, TLG_ANY_GA for all.
+ * @param from The start of the time range.
+ * @param to The end of the time range.
+ * @param callback Called for every matching record, return false to stop.
+ * @return The number of matching records.
+ */
+uint32_t ExternalFlash::queryTelegrams(int32_t ga, time_t from, time_t to, TelegramLog::Callback callback)
+{
+    EXTFLASH_TP_SCOPE("api.queryTelegrams", ga);
+    ExtFlashBlockingScope blocking(_blocking, "queryTelegrams");
+    if (!_mounted)
+    {
+        return 0;
+    }
+    return _telegramLog.query(ga, (uint32_t)max<time_t>(from, 0), (uint32_t)max<time_t>(to, 0), callback);
+}
+
+/**
+ * @brief Queries the downsampled values of a group address.
+ *
+ * Reads only the rollup file of the group address and level, so long-range trends cost a few
+ * kilobytes instead of the raw segments.
+ *
+ * @param level The resolution (TLR_MINUTE, TLR_HOUR or TLR_DAY).
+ * @param ga The group address.
+ * @param from The start of the time range.
+ * @param to The end of the time range.
+ * @param callback Called for every bucket, return false to stop.
+ * @return The number of buckets.
+ */
+uint32_t ExternalFlash::queryTrend(TelegramRollupLevel level, uint16_t ga, time_t from, time_t to, TelegramRollup::Callback callback)
+{
+    EXTFLASH_TP_SCOPE("api.queryTrend", ga);
+    ExtFlashBlockingScope blocking(_blocking, "queryTrend");
+    if (!_mounted)
+    {
+        return 0;
+    }
+    return _telegramRollup.query(level, ga, (uint32_t)max<time_t>(from, 0), (uint32_t)max<time_t>(to, 0), callback);
+}
+
+/**
+ * @brief Parses a time argument of a console command.
+ *
+ * @param arg Seconds since epoch, or seconds relative to now if <= 0 (0 is now).
+ * @return The absolute time.
+ */
+time_t ExternalFlash::parseTime(const std::string &arg)
+{
+    const long long value = atoll(arg.c_str());
+    if (value <= 0)
+    {
+        return openknx.time.getLocalTime().toTime_t() + value;
+    }
+    return (time_t)value;
+}
+
 /**
  * @brief Sets up the external flash configuration.
  *
@@ -964,13 +1916,14 @@ void ExternalFlash::setupExternalConfig() // ToDo EC: Make a configuration wrapp
 {
     // COnfiguration for LittleFS with the W25Q128 Flash
 
-    _extFlashLfsConfig.context = nullptr; // User defined context, we don't need it here
+    _extFlashLfsConfig.context = &_fsOffset; // Start address of the filesystem partition, used by the W25Q128 callbacks
 
-    // Lets set the callbacks for our W25Q128 Flash
-    _extFlashLfsConfig.read = W25Q128::lfs_read;   // read callback for our W25Q128 Flash
-    _extFlashLfsConfig.prog = W25Q128::lfs_prog;   // program callback for our W25Q128 Flash
-    _extFlashLfsConfig.erase = W25Q128::lfs_erase; // erase callback for our W25Q128 Flash
-    _extFlashLfsConfig.sync = W25Q128::lfs_sync;   // sync callback for pur W25Q128 Flash
+    // Lets set the callbacks for our W25Q128 Flash. They forward to the W25Q128 callbacks and record the calls while 'efc trace' runs
+    _extFlashLfsConfig.read = ExtFlashTrace::lfs_read;   // read callback for our W25Q128 Flash
+    _extFlashLfsConfig.prog = ExtFlashTrace::lfs_prog;   // program callback for our W25Q128 Flash
+    _extFlashLfsConfig.erase = ExtFlashTrace::lfs_erase; // erase callback for our W25Q128 Flash
+    _extFlashLfsConfig.sync = ExtFlashTrace::lfs_sync;   // sync callback for pur W25Q128 Flash
+    ext_littlefs_impl::ext_LittleFSImpl::fileOpCallback = ExtFlashTrace::fileOp; // File operations for 'efc trace'
 
 #ifdef LFS_THREADSAFE
     _extFlashLfsConfig.lock = nullptr;   // If thread-safety is needed
@@ -980,13 +1933,13 @@ void ExternalFlash::setupExternalConfig() // ToDo EC: Make a configuration wrapp
     // Size configuration for the W25Q128 Flash
     _extFlashLfsConfig.read_size = PAGE_SIZE_W25Q128_256B;                         // Minimale read size
     _extFlashLfsConfig.prog_size = PAGE_SIZE_W25Q128_256B;                         // Minimale program size
-    _extFlashLfsConfig.block_size = SECTOR_SIZE_W25Q128_4KB;                       // Sector size of the flash device (4KB)
-    _extFlashLfsConfig.block_count = FLASH_SIZE_W25Q128 / SECTOR_SIZE_W25Q128_4KB; // Number of sectors of the flash device
+    _extFlashLfsConfig.block_size = EXTFLASH_LFS_BLOCK_SIZE;                       // Block size, a multiple of the sector size (4KB)
+    _extFlashLfsConfig.block_count = _fsSize / EXTFLASH_LFS_BLOCK_SIZE;            // Number of blocks of the filesystem partition
 
-    _extFlashLfsConfig.block_cycles = 500;                  // Number of write cycles per block
-    _extFlashLfsConfig.cache_size = PAGE_SIZE_W25Q128_256B; // Cache size
-    _extFlashLfsConfig.lookahead_size = 16;                 // Lookahead buffer size
-    _extFlashLfsConfig.compact_thresh = 0;                  // Default compaxt threshold
+    _extFlashLfsConfig.block_cycles = EXTFLASH_LFS_BLOCK_CYCLES;     // Number of write cycles per block
+    _extFlashLfsConfig.cache_size = EXTFLASH_LFS_CACHE_SIZE;         // Cache size
+    _extFlashLfsConfig.lookahead_size = EXTFLASH_LFS_LOOKAHEAD_SIZE; // Lookahead buffer size
+    _extFlashLfsConfig.compact_thresh = EXTFLASH_LFS_COMPACT_THRESH; // Default compaxt threshold
 
     // Static buffers for LittleFS (if needed) we don't need them here
     _extFlashLfsConfig.read_buffer = nullptr;
@@ -997,8 +1950,8 @@ void ExternalFlash::setupExternalConfig() // ToDo EC: Make a configuration wrapp
     _extFlashLfsConfig.name_max = 255;   // Max filname length
     _extFlashLfsConfig.file_max = 0;     // Max number of files open at the same time, 0 for default
     _extFlashLfsConfig.attr_max = 0;     // Max number of attributes, 0 for default
-    _extFlashLfsConfig.metadata_max = 0; // Max metadata size, 0 for default
-    _extFlashLfsConfig.inline_max = 0;   // Max inline data size. 0 for default
+    _extFlashLfsConfig.metadata_max = EXTFLASH_LFS_METADATA_MAX; // Max metadata size, 0 for default
+    _extFlashLfsConfig.inline_max = EXTFLASH_LFS_INLINE_MAX;     // Max inline data size. 0 for default, -1 off
 
 #ifdef LFS_MULTIVERSION
     _extFlashLfsConfig.disk_version = 0; // default disk version. 0 seems to be the recent version
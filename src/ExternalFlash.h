@@ -11,13 +11,59 @@
  *              Licensed under GNU GPL v3.0
  */
 #if defined(ARDUINO_ARCH_RP2040)
+#include "CrashDump.h"
+#include "DeltaPatch.h"
+#include "ExtFlashBench.h"
+#include "ExtFlashBlocking.h"
+#include "ExtFlashMem.h"
+#include "ExtFlashPartitions.h"
+#include "ExtFlashPath.h"
+#include "ExtFlashTrace.h"
+#include "ExtFlashWear.h"
+#include "GoSnapshot.h"
+#include "LogRing.h"
+#include "ModuleStore.h"
 #include "OpenKNX.h"
+#include "OtaStager.h"
+#include "RawLog.h"
+#include "TelegramLog.h"
+#include "TelegramRollup.h"
 #include "W25Q128.h"
 #include "ext_LittleFS.h"
 
 #define ExternalFlash_Display_Name "ExternalFlash" // Display name
 #define ExternalFlash_Display_Version "0.0.1"      // Display version
 
+// LittleFS configuration, see host/efc_hosttune.cpp to find the values for a recorded workload. A changed block size
+// doesn't mount the existing filesystem, it is formatted
+#ifndef EXTFLASH_LFS_BLOCK_SIZE
+    #define EXTFLASH_LFS_BLOCK_SIZE SECTOR_SIZE_W25Q128_4KB // Block size, a multiple of the sector size
+#endif
+#ifndef EXTFLASH_LFS_CACHE_SIZE
+    #define EXTFLASH_LFS_CACHE_SIZE PAGE_SIZE_W25Q128_256B // Read and program cache, one more per open file
+#endif
+#ifndef EXTFLASH_LFS_MAX_OPEN_FILES
+    #define EXTFLASH_LFS_MAX_OPEN_FILES 16 // Slots of the file descriptor table, each with a cache, up to 32
+#endif
+#if EXTFLASH_LFS_MAX_OPEN_FILES > EXTFLASH_FD_MAX
+    #error "EXTFLASH_LFS_MAX_OPEN_FILES is limited to 32 (EXTFLASH_FD_MAX)"
+#endif
+#ifndef EXTFLASH_LFS_LOOKAHEAD_SIZE
+    #define EXTFLASH_LFS_LOOKAHEAD_SIZE 16 // Lookahead buffer of the block allocator, a multiple of 8
+#endif
+#ifndef EXTFLASH_LFS_BLOCK_CYCLES
+    #define EXTFLASH_LFS_BLOCK_CYCLES 500 // Erase cycles before metadata is moved to another block
+#endif
+#ifndef EXTFLASH_LFS_INLINE_MAX
+    #define EXTFLASH_LFS_INLINE_MAX 0 // Max size of files inlined in the metadata, 0 default, -1 off
+#endif
+#ifndef EXTFLASH_LFS_METADATA_MAX
+    #define EXTFLASH_LFS_METADATA_MAX 0 // Max metadata size of a block, 0 for the block size
+#endif
+#ifndef EXTFLASH_LFS_COMPACT_THRESH
+    #define EXTFLASH_LFS_COMPACT_THRESH 0 // Metadata size that triggers a compaction, 0 default
+#endif
+
 // Extend LittleFS to support dynamic configuration for external flash
 class ExternalFlash : public OpenKNX::Module
 {
@@ -29,6 +75,7 @@ class ExternalFlash : public OpenKNX::Module
     void processInputKo(GroupObject &ko) override;                          // Process GroupObjects
     void showHelp() override;                                               // Show help for console commands
     bool processCommand(const std::string command, bool diagnose) override; // Process console commands
+    void savePower() override;                                              // Write pending data on power loss
 
     // Constructor for ExternalFlash
     ExternalFlash();
@@ -38,7 +85,8 @@ class ExternalFlash : public OpenKNX::Module
     inline bool isMounted() { return _mounted; }      // Check if the filesystem is mounted
     bool format();                                    // Format the filesystem
     bool info(FSInfo &info);                          // Get filesystem information
-    bool Statistics(const String path, FSStat &stat); // Get file statistics
+    bool Statistics(const char *path, FSStat &stat); // Get file statistics
+    inline bool Statistics(const String &path, FSStat &stat) { return Statistics(path.c_str(), stat); }
 
     File open(const char *path, const char *mode);                      // Open a file
     bool createFile(const char *path);                                  // Create a file
@@ -65,6 +113,66 @@ class ExternalFlash : public OpenKNX::Module
     time_t getModificationTime(const char *path); // Get the modification time of a file or directory
     time_t getAccessTime(const char *path);       // Get the access time of a file or directory
 
+    // Overloads for paths without terminator, e.g. parts of a command. They are normalized on the stack, a path
+    // longer than EXTFLASH_PATH_MAX fails like a missing file
+    inline bool Statistics(std::string_view path, FSStat &stat) { const ExtFlashPath p(path); return p.isValid() && Statistics(p.c_str(), stat); }
+    inline File open(std::string_view path, const char *mode) { const ExtFlashPath p(path); return p.isValid() ? open(p.c_str(), mode) : File(); }
+    inline bool createFile(std::string_view path) { const ExtFlashPath p(path); return p.isValid() && createFile(p.c_str()); }
+    inline bool remove(std::string_view path) { const ExtFlashPath p(path); return p.isValid() && remove(p.c_str()); }
+    inline bool exists(std::string_view path) { const ExtFlashPath p(path); return p.isValid() && exists(p.c_str()); }
+    inline size_t read(std::string_view path, uint8_t *buffer, size_t size) { const ExtFlashPath p(path); return p.isValid() ? read(p.c_str(), buffer, size) : 0; }
+    inline size_t write(std::string_view path, const uint8_t *buffer, size_t size) { const ExtFlashPath p(path); return p.isValid() ? write(p.c_str(), buffer, size) : 0; }
+    inline bool rename(std::string_view oldPath, std::string_view newPath) { const ExtFlashPath o(oldPath), n(newPath); return o.isValid() && n.isValid() && rename(o.c_str(), n.c_str()); }
+    inline bool mkdir(std::string_view path) { const ExtFlashPath p(path); return p.isValid() && mkdir(p.c_str()); }
+    inline bool createDir(std::string_view path) { const ExtFlashPath p(path); return p.isValid() && createDir(p.c_str()); }
+    inline bool rmdir(std::string_view path) { const ExtFlashPath p(path); return p.isValid() && rmdir(p.c_str()); }
+    inline std::vector<String> ls(std::string_view path) { const ExtFlashPath p(path); return p.isValid() ? ls(p.c_str()) : std::vector<String>(); }
+    inline bool move(std::string_view oldPath, std::string_view newPath) { const ExtFlashPath o(oldPath), n(newPath); return o.isValid() && n.isValid() && move(o.c_str(), n.c_str()); }
+    inline bool copyFile(std::string_view srcPath, std::string_view destPath) { const ExtFlashPath s(srcPath), d(destPath); return s.isValid() && d.isValid() && copyFile(s.c_str(), d.c_str()); }
+    inline bool copyDir(std::string_view srcPath, std::string_view destPath) { const ExtFlashPath s(srcPath), d(destPath); return s.isValid() && d.isValid() && copyDir(s.c_str(), d.c_str()); }
+    inline size_t getSize(std::string_view path) { const ExtFlashPath p(path); return p.isValid() ? getSize(p.c_str()) : 0; }
+    inline time_t getCreationTime(std::string_view path) { const ExtFlashPath p(path); return p.isValid() ? getCreationTime(p.c_str()) : 0; }
+    inline time_t getModificationTime(std::string_view path) { const ExtFlashPath p(path); return p.isValid() ? getModificationTime(p.c_str()) : 0; }
+    inline time_t getAccessTime(std::string_view path) { const ExtFlashPath p(path); return p.isValid() ? getAccessTime(p.c_str()) : 0; }
+
+    // Telegram log
+    bool logTelegram(uint16_t ga, const uint8_t *data, uint8_t len, uint8_t valueType = TLG_VALUE_AUTO); // Append a telegram with the current time
+    uint32_t queryTelegrams(int32_t ga, time_t from, time_t to, TelegramLog::Callback callback);         // Stream logged telegrams through the callback
+    uint32_t queryTrend(TelegramRollupLevel level, uint16_t ga, time_t from, time_t to,
+                        TelegramRollup::Callback callback);                                              // Stream min/max/avg buckets through the callback
+    inline TelegramLog &telegramLog() { return _telegramLog; }                                          // Access the telegram log
+
+    // Group object snapshot
+    inline GoSnapshot &goSnapshot() { return _goSnapshot; } // Add group objects with goSnapshot().add(koNumber)
+
+    // Partitions
+    inline const ExtFlashPartitions &partitions() const { return _partitions; } // Partition table of the chip
+    bool openPartition(const char *name, ExtFlashRawPartition &partition);     // Attach to a raw partition by name
+
+    // Persistent log
+    inline LogRing &logRing() { return _logRing; } // Print to it directly or capture the console with extFlashLogTee
+
+    // Firmware staging
+    inline OtaStager &otaStager() { return _otaStager; }   // Stream an image with start(), write(), finish()
+    inline DeltaPatch &deltaPatch() { return _deltaPatch; } // Build the image from a delta patch against the running firmware
+
+    // Append log of binary records
+    inline RawLog &rawLog() { return _rawLog; } // High rate telemetry without filesystem overhead
+
+    // Hard fault dump
+    inline CrashDump &crashDump() { return _crashDump; } // Add RAM regions with CrashDump::addRegion()
+
+    // Module data
+    inline ModuleStore &moduleStore() { return _moduleStore; } // Module data without internal flash writes
+
+    // Block device trace
+    inline ExtFlashTrace &trace() { return _trace; } // Record the LittleFS read/prog/erase/sync calls
+
+    // Performance counters
+    inline ExtFlashStats &stats() { return extFlashStats; } // Counters since boot, ExtFlashStats::reset() clears them
+    inline ExtFlashWear &wear() { return _wear; }             // Erase count and erase time per sector
+    inline ExtFlashBlocking &blocking() { return _blocking; } // Longest blocking time per call site
+
     // OpenKNX Module interface
     inline const std::string name() { return ExternalFlash_Display_Name; }
     inline const std::string version() { return ExternalFlash_Display_Version; }
@@ -73,10 +181,28 @@ class ExternalFlash : public OpenKNX::Module
     W25Q128 _SpiFlash;             // Instance of external flash
     lfs_config _extFlashLfsConfig; // Configuration for external flash
     FS _extFlashLfs;               // LittleFS object for external flash
+    ExtFlashPartitions _partitions; // Partition table in the first sector
+    uint32_t _fsOffset;            // Start address of the LittleFS partition, context of the lfs callbacks
+    uint32_t _fsSize;              // Size of the LittleFS partition
     bool _SpiFlashInit;            // Flag to check if the external flash is initialized
     bool _mounted;                 // Flag to check if the filesystem is mounted
+    TelegramLog _telegramLog;      // Segmented telegram log on the filesystem
+    TelegramRollup _telegramRollup; // Background downsampling of the telegram log
+    uint32_t _rollupLost;          // Lost rollup buckets already logged
+    GoSnapshot _goSnapshot;        // Snapshot of selected group object values
+    LogRing _logRing;              // Persistent log in the "log" partition
+    RawLog _rawLog;                // Append log in the "rawlog" partition
+    OtaStager _otaStager;          // Firmware staging in the "ota" partition
+    DeltaPatch _deltaPatch;        // Delta patch decoder writing into _otaStager
+    CrashDump _crashDump;          // Hard fault dump in the "crash" partition
+    ModuleStore _moduleStore;      // Module data in the "store" partition
+    ExtFlashTrace _trace;          // Block device trace, spilled to the "trace" partition
+    ExtFlashBlocking _blocking;    // Longest blocking time per call site
+    ExtFlashWear _wear;            // Erase counts, checkpointed to the "wear" partition
 
     void setupExternalConfig();
+    W25Q128 *flashDriver(); // Driver instance shared with the LittleFS callbacks
+    time_t parseTime(const std::string &arg); // Parse absolute or relative (negative) seconds of a console argument
 }; // class ExternalFlash
 
 extern ExternalFlash extFlashModule; // External flash module instance
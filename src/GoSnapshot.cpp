@@ -0,0 +1,332 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class GoSnapshot
+ * @brief Keeps the values of selected group objects in a compact image and restores them at boot.
+ *
+ * The image consists of a header and one entry per group object (number, size, value). It is kept in RAM
+ * and updated in place, when a value arrives from the bus or a polled value differs from the image. Dirty
+ * images are written debounced as one page aligned write of the whole image, so LittleFS replaces the file
+ * in one commit. At boot the file is read with a single sequential read and the values are copied back into
+ * the group objects, without sending or reading anything on the bus.
+ *
+ * The list of group objects is part of the image, so the values are restored even before the modules
+ * that add() them are set up. Entries whose group object no longer exists or has another value size after a
+ * reconfiguration are dropped at restore, the module adds them again with the new size.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "GoSnapshot.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+
+/**
+ * @brief Construct a new Go Snapshot object
+ */
+GoSnapshot::GoSnapshot() : _fs(nullptr), _count(0), _used(0), _poll(0), _firstChange(0), _lastChange(0), _writes(0), _dirty(false)
+{
+    memset(_image, 0, sizeof(_image));
+}
+
+/**
+ * @brief Read the snapshot file with one sequential read and restore the values of the group objects
+ *
+ * @param fs the filesystem that holds the snapshot
+ * @return the number of restored group objects
+ */
+uint16_t GoSnapshot::restore(FS *fs)
+{
+    _fs = fs;
+    _count = 0;
+    _used = 0;
+    if (!_fs)
+    {
+        return 0;
+    }
+
+    File file = _fs->open(GOS_FILE, "r");
+    if (!file)
+    {
+        return 0;
+    }
+    const int size = file.read(_image, min<size_t>(file.size(), sizeof(_image)));
+    file.close();
+
+    GoSnapshotHeader header;
+    memcpy(&header, _image, sizeof(header));
+    if (size < (int)sizeof(header) || header.magic != GOS_MAGIC || header.version != GOS_VERSION ||
+        header.used > sizeof(_image) - sizeof(header) || sizeof(header) + header.used > (size_t)size ||
+        header.crc != extFlashCrc32(_image + sizeof(header), header.used))
+    {
+        return 0; // No or broken snapshot, start empty
+    }
+
+    // Rebuild the index and copy the values into the group objects, the kept entries move down over dropped ones
+    uint16_t restored = 0;
+    uint16_t dropped = 0;
+    uint16_t pos = sizeof(header);
+    uint16_t out = sizeof(header);
+    const uint16_t end = sizeof(header) + header.used;
+    const bool configured = knx.configured();
+    while (pos + 3 <= end && _count < GOS_MAX_OBJECTS)
+    {
+        uint16_t koNumber;
+        memcpy(&koNumber, _image + pos, sizeof(koNumber));
+        const uint8_t valueSize = _image[pos + 2];
+        if (pos + 3 + valueSize > end)
+        {
+            break;
+        }
+        const uint16_t entry = pos;
+        pos += 3 + valueSize;
+        if (configured && (!koValid(koNumber) || knx.getGroupObject(koNumber).valueSize() != valueSize))
+        {
+            dropped++; // Reconfigured, take() could never update the entry
+            continue;
+        }
+        memmove(_image + out, _image + entry, 3 + valueSize);
+        _ko[_count] = koNumber;
+        _offset[_count] = out + 3;
+        _count++;
+        out += 3 + valueSize;
+
+        if (configured)
+        {
+            GroupObject &ko = knx.getGroupObject(koNumber);
+            memcpy(ko.valueRef(), _image + _offset[_count - 1], valueSize);
+            ko.commFlag(ComFlag::Ok);
+            restored++;
+        }
+    }
+    _used = out - sizeof(header);
+    _dirty = false;
+    if (dropped)
+    {
+        markDirty();
+    }
+    return restored;
+}
+
+/**
+ * @brief Compare a few group objects per call against the image and write the image debounced
+ */
+void GoSnapshot::loop()
+{
+    if (!_fs || !_count)
+    {
+        return;
+    }
+
+    // Values changed by the modules themselves never pass processInputKo(), so we poll them round robin
+    if (knx.configured())
+    {
+        for (uint8_t i = 0; i < GOS_POLL_PER_LOOP && i < _count; i++)
+        {
+            if (_poll >= _count)
+            {
+                _poll = 0;
+            }
+            const uint16_t koNumber = _ko[_poll];
+            if (koValid(koNumber))
+            {
+                take(_poll, knx.getGroupObject(koNumber));
+            }
+            _poll++;
+        }
+    }
+
+    if (_dirty && ((millis() - _lastChange >= GOS_DEBOUNCE_MS) || (millis() - _firstChange >= GOS_MAX_DELAY_MS)))
+    {
+        flush();
+    }
+}
+
+/**
+ * @brief Take over a value received from the bus
+ *
+ * @param ko the group object
+ */
+void GoSnapshot::processInputKo(GroupObject &ko)
+{
+    const int16_t index = find(ko.asap());
+    if (index >= 0)
+    {
+        take(index, ko);
+    }
+}
+
+/**
+ * @brief Add a group object to the snapshot. Its current value is taken over with the next loop()
+ *
+ * @param koNumber the group object number
+ * @return true if the group object is (already) part of the snapshot
+ */
+bool GoSnapshot::add(uint16_t koNumber)
+{
+    if (find(koNumber) >= 0)
+    {
+        return true;
+    }
+    if (_count >= GOS_MAX_OBJECTS || !koValid(koNumber))
+    {
+        return false;
+    }
+    const uint8_t valueSize = knx.getGroupObject(koNumber).valueSize();
+    if (sizeof(GoSnapshotHeader) + _used + 3 + valueSize > sizeof(_image))
+    {
+        return false;
+    }
+
+    uint8_t *entry = _image + sizeof(GoSnapshotHeader) + _used;
+    memcpy(entry, &koNumber, sizeof(koNumber));
+    entry[2] = valueSize;
+    memset(entry + 3, 0, valueSize);
+    _ko[_count] = koNumber;
+    _offset[_count] = sizeof(GoSnapshotHeader) + _used + 3;
+    _count++;
+    _used += 3 + valueSize;
+    take(_count - 1, knx.getGroupObject(koNumber));
+    markDirty(); // The layout changed, even if the value is zero or not initialized yet
+    return true;
+}
+
+/**
+ * @brief Add a range of group objects to the snapshot
+ *
+ * @param first the first group object number
+ * @param last the last group object number (inclusive)
+ * @return true if all group objects were added
+ */
+bool GoSnapshot::addRange(uint16_t first, uint16_t last)
+{
+    bool ret = true;
+    for (uint32_t koNumber = first; koNumber <= last; koNumber++)
+    {
+        ret &= add(koNumber);
+    }
+    return ret;
+}
+
+/**
+ * @brief Write the image, if dirty. The write is padded to full pages
+ *
+ * @return true if the snapshot on flash is up to date
+ */
+bool GoSnapshot::flush()
+{
+    if (!_dirty)
+    {
+        return true;
+    }
+    if (!_fs)
+    {
+        return false;
+    }
+
+    GoSnapshotHeader header;
+    header.magic = GOS_MAGIC;
+    header.version = GOS_VERSION;
+    header.count = _count;
+    header.used = _used;
+    header.reserved = 0;
+    header.crc = extFlashCrc32(_image + sizeof(header), _used);
+    memcpy(_image, &header, sizeof(header));
+
+    const size_t size = sizeof(header) + _used;
+    const size_t padded = min<size_t>(sizeof(_image), (size + PAGE_SIZE_W25Q128_256B - 1) & ~(size_t)(PAGE_SIZE_W25Q128_256B - 1));
+    memset(_image + size, 0, padded - size);
+
+    File file = _fs->open(GOS_FILE, "w");
+    if (!file)
+    {
+        return false;
+    }
+    const bool written = file.write(_image, padded) == padded;
+    file.close();
+    if (written)
+    {
+        _dirty = false;
+        _writes++;
+    }
+    return written;
+}
+
+/**
+ * @brief Remove all group objects from the snapshot and delete the snapshot file
+ *
+ * @return true if the file is gone
+ */
+bool GoSnapshot::clear()
+{
+    _count = 0;
+    _used = 0;
+    _poll = 0;
+    _dirty = false;
+    return !_fs || !_fs->exists(GOS_FILE) || _fs->remove(GOS_FILE);
+}
+
+/**
+ * @brief Find a group object in the snapshot
+ *
+ * @param koNumber the group object number
+ * @return the index of the entry or -1
+ */
+int16_t GoSnapshot::find(uint16_t koNumber) const
+{
+    for (uint16_t i = 0; i < _count; i++)
+    {
+        if (_ko[i] == koNumber)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Copy the value of a group object into the image
+ *
+ * @param index the entry
+ * @param ko the group object
+ * @return true if the value changed
+ */
+bool GoSnapshot::take(uint16_t index, GroupObject &ko)
+{
+    const uint16_t offset = _offset[index];
+    const uint8_t valueSize = _image[offset - 1];
+    if (ko.valueSize() != valueSize || ko.commFlag() == ComFlag::Uninitialized ||
+        memcmp(_image + offset, ko.valueRef(), valueSize) == 0)
+    {
+        return false;
+    }
+    memcpy(_image + offset, ko.valueRef(), valueSize);
+    markDirty();
+    return true;
+}
+
+/**
+ * @brief Mark the image dirty, loop() writes it debounced
+ */
+void GoSnapshot::markDirty()
+{
+    _lastChange = millis();
+    if (!_dirty)
+    {
+        _firstChange = _lastChange;
+        _dirty = true;
+    }
+}
+
+/**
+ * @brief Check a group object number against the group object table
+ *
+ * @param koNumber the group object number
+ * @return true if the group object exists
+ */
+bool GoSnapshot::koValid(uint16_t koNumber)
+{
+    return koNumber > 0 && koNumber <= knx.bau().groupObjectTable().entryCount();
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
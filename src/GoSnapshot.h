@@ -0,0 +1,83 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        GoSnapshot.h
+ * @brief       Compact binary snapshot of selected group object values, restored at boot
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "OpenKNX.h"
+#include "W25Q128.h"
+
+#define GOS_FILE "/gos.bin"          // Snapshot file on the external LittleFS
+#define GOS_MAGIC 0x4E534F47         // "GOSN"
+#define GOS_VERSION 1                // Version of the snapshot layout
+#define GOS_POLL_PER_LOOP 8          // Group objects compared against the snapshot per loop() call
+
+#ifndef GOS_MAX_OBJECTS
+    #define GOS_MAX_OBJECTS 256 // Max number of group objects in the snapshot
+#endif
+#ifndef GOS_MAX_BYTES
+    #define GOS_MAX_BYTES (8 * PAGE_SIZE_W25Q128_256B) // Max size of the snapshot, header included
+#endif
+#ifndef GOS_DEBOUNCE_MS
+    #define GOS_DEBOUNCE_MS 2000 // Write the snapshot after the values were stable for this time
+#endif
+#ifndef GOS_MAX_DELAY_MS
+    #define GOS_MAX_DELAY_MS 30000 // Write the snapshot at the latest this time after the first change
+#endif
+
+// Header of the snapshot. Followed by the entries: uint16_t ko, uint8_t size, uint8_t value[size]
+struct __attribute__((packed)) GoSnapshotHeader
+{
+    uint32_t magic;   // GOS_MAGIC
+    uint16_t version; // GOS_VERSION
+    uint16_t count;   // Number of entries
+    uint16_t used;    // Bytes used by the entries
+    uint16_t reserved;
+    uint32_t crc;     // CRC32 over the entries
+};
+
+class GoSnapshot
+{
+  public:
+    GoSnapshot();
+
+    uint16_t restore(FS *fs);                // Read the snapshot in one go and restore the values, returns the number of restored GOs
+    void loop();                             // Detect changes and write the snapshot debounced
+    void processInputKo(GroupObject &ko);    // Take over a value received from the bus
+    bool add(uint16_t koNumber);             // Add a group object to the snapshot
+    bool addRange(uint16_t first, uint16_t last); // Add a range of group objects to the snapshot
+    bool flush();                            // Write the snapshot now, if dirty
+    bool clear();                            // Remove all group objects and the snapshot file
+
+    inline uint16_t count() const { return _count; }                                          // Number of group objects in the snapshot
+    inline uint16_t bytes() const { return sizeof(GoSnapshotHeader) + _used; }                // Size of the snapshot
+    inline bool dirty() const { return _dirty; }                                              // Unwritten changes
+    inline uint32_t writes() const { return _writes; }                                        // Snapshot writes since boot
+
+  private:
+    int16_t find(uint16_t koNumber) const;  // Index of a group object in the snapshot or -1
+    bool take(uint16_t index, GroupObject &ko); // Copy the value of a group object into the snapshot, true if it changed
+    void markDirty();                       // Write the image with the next debounced flush
+    static bool koValid(uint16_t koNumber); // Check the group object number against the group object table
+
+    FS *_fs;                                  // Filesystem for the snapshot file
+    uint8_t _image[GOS_MAX_BYTES];            // Snapshot image, header followed by the entries
+    uint16_t _ko[GOS_MAX_OBJECTS];            // Group object number per entry
+    uint16_t _offset[GOS_MAX_OBJECTS];        // Offset of the value in _image per entry
+    uint16_t _count;                          // Number of entries
+    uint16_t _used;                           // Bytes used by the entries
+    uint16_t _poll;                           // Next entry to compare in loop()
+    uint32_t _firstChange;                    // millis() of the first unwritten change
+    uint32_t _lastChange;                     // millis() of the last change
+    uint32_t _writes;                         // Snapshot writes since boot
+    bool _dirty;                              // Unwritten changes
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,468 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class LogRing
+ * @brief Circular text log in a raw region of the external flash.
+ *
+ * write() only copies into a RAM ring buffer, so the cost per log line is a few microseconds. The logger is called
+ * from both cores and from several modules, so write() holds a hardware spin lock while it copies; a line written
+ * in one call stays in one piece. loop()
+ * drains the buffer with at most one page program per call: a batch never crosses a page boundary and
+ * partial pages are topped up later (NOR allows programming the remaining 0xFF bytes of a page).
+ *
+ * Every used sector starts with a header holding a sequence number. The sector after the write head is
+ * always erased ahead with a non-blocking erase, so a wrap-around never waits for an erase. While the chip
+ * is busy, loop() returns immediately and the characters stay in RAM.
+ *
+ * The text never contains 0xFF (invalid in UTF-8), so the end of the written data in a sector is found with
+ * a binary search for the first 0xFF byte at boot.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "LogRing.h"
+#if defined(ARDUINO_ARCH_RP2040)
+
+LogRingTee extFlashLogTee(Serial); // Tee of Serial into the log ring of the external flash module
+
+/**
+ * @brief Construct a new Log Ring object
+ */
+LogRing::LogRing() : _flash(nullptr), _start(0), _size(0), _head(0), _offset(0), _seq(0), _nextErased(false), _paused(false),
+                     _in(0), _out(0), _lock(spin_lock_instance(PICO_SPINLOCK_ID_STRIPED_FIRST + 1)), _dropped(0), _lastFlush(0)
+{
+}
+
+/**
+ * @brief Find the write head in the region: the valid sector with the highest sequence number and its
+ *        first unwritten byte. The sector after the head is erased in the background
+ *
+ * @param flash the flash driver
+ * @param start the start address of the region, sector aligned
+ * @param size the size of the region, at least two sectors
+ * @return true if the log is ready
+ */
+bool LogRing::begin(W25Q128 *flash, uint32_t start, uint32_t size)
+{
+    _flash = nullptr;
+    if (!flash || (start % SECTOR_SIZE_W25Q128_4KB) || (size / SECTOR_SIZE_W25Q128_4KB) < 2)
+    {
+        return false;
+    }
+    _flash = flash;
+    _start = start;
+    _size = size - (size % SECTOR_SIZE_W25Q128_4KB);
+
+    bool found = false;
+    for (uint32_t sector = 0; sector < sectors(); sector++)
+    {
+        uint32_t seq;
+        if (readHeader(sector, seq) && (!found || seq > _seq))
+        {
+            _seq = seq;
+            _head = sector;
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        _offset = findFill(_head);
+    }
+    else
+    {
+        // Empty region, start at the first sector
+        _flash->erase(sectorAddr(0));
+        if (!openSector(0, 1))
+        {
+            _flash = nullptr;
+            return false;
+        }
+    }
+
+    // The sector after the head may hold the oldest data or a torn erase, erase it ahead
+    _flash->eraseAsync(sectorAddr((_head + 1) % sectors()));
+    _nextErased = true;
+    _lastFlush = millis();
+    return true;
+}
+
+/**
+ * @brief Write one batch from the RAM buffer to flash. Returns immediately while an erase is running
+ */
+void LogRing::loop()
+{
+    if (!_flash || _flash->isBusy())
+    {
+        return;
+    }
+
+    // Head sector is full, move on to the pre-erased next one and erase the one after it
+    if (_offset >= SECTOR_SIZE_W25Q128_4KB)
+    {
+        const uint32_t next = (_head + 1) % sectors();
+        if (!_nextErased)
+        {
+            _flash->eraseAsync(sectorAddr(next));
+            _nextErased = true;
+            return;
+        }
+        if (openSector(next, _seq + 1))
+        {
+            _flash->eraseAsync(sectorAddr((next + 1) % sectors()));
+            _nextErased = true;
+        }
+        return;
+    }
+
+    const uint16_t count = buffered();
+    if (!count)
+    {
+        return;
+    }
+    const uint32_t room = PAGE_SIZE_W25Q128_256B - (_offset % PAGE_SIZE_W25Q128_256B); // Up to the end of the page
+    if (count < room && (millis() - _lastFlush < LOGRING_FLUSH_INTERVAL_MS))
+    {
+        return; // Wait for a full page
+    }
+
+    uint8_t page[PAGE_SIZE_W25Q128_256B];
+    const uint16_t n = min<uint32_t>(count, room);
+    uint16_t out = _out;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        page[i] = _buffer[out];
+        out = (out + 1) % LOGRING_BUFFER_SIZE;
+    }
+    _flash->program(sectorAddr(_head) + _offset, page, n);
+    _out = out;
+    _offset += n;
+    _lastFlush = millis();
+}
+
+/**
+ * @brief Buffer one character
+ *
+ * @param c the character, 0xFF is dropped because it marks unwritten flash
+ * @return 1
+ */
+size_t LogRing::write(uint8_t c)
+{
+    if (_paused)
+    {
+        return 1;
+    }
+    const uint32_t save = spin_lock_blocking(_lock);
+    push(c);
+    spin_unlock(_lock, save);
+    return 1;
+}
+
+/**
+ * @brief Buffer characters in one piece
+ *
+ * @param buffer the characters
+ * @param size the number of characters
+ * @return size
+ */
+size_t LogRing::write(const uint8_t *buffer, size_t size)
+{
+    if (_paused)
+    {
+        return size;
+    }
+    const uint32_t save = spin_lock_blocking(_lock);
+    for (size_t i = 0; i < size; i++)
+    {
+        push(buffer[i]);
+    }
+    spin_unlock(_lock, save);
+    return size;
+}
+
+/**
+ * @brief Buffer one character, the caller holds _lock
+ *
+ * @param c the character, 0xFF is dropped because it marks unwritten flash
+ */
+void LogRing::push(uint8_t c)
+{
+    if (c == 0xFF)
+    {
+        return;
+    }
+    const uint16_t next = (_in + 1) % LOGRING_BUFFER_SIZE;
+    if (next == _out)
+    {
+        _dropped++;
+        return;
+    }
+    _buffer[_in] = c;
+    _in = next;
+}
+
+/**
+ * @brief Stream the last lines of the log through the callback. Walks backwards from the head
+ *        and counts the line breaks
+ *
+ * @param lines the number of lines
+ * @param cb the callback
+ * @return the number of lines passed to the callback
+ */
+uint32_t LogRing::tail(uint32_t lines, LineCallback cb)
+{
+    if (!_flash || !cb || !lines)
+    {
+        return 0;
+    }
+
+    uint32_t sector = _head;
+    uint32_t seq = _seq;
+    uint32_t offset = _offset;
+    uint32_t found = 0;
+    uint8_t chunk[64];
+    bool done = false;
+    while (!done)
+    {
+        if (offset <= LOGRING_HEADER_SIZE)
+        {
+            // Continue in the previous sector, if it holds the previous sequence number
+            const uint32_t prev = (sector + sectors() - 1) % sectors();
+            uint32_t prevSeq;
+            if (!readHeader(prev, prevSeq) || prevSeq != seq - 1)
+            {
+                break;
+            }
+            sector = prev;
+            seq = prevSeq;
+            offset = findFill(sector);
+            continue;
+        }
+        const uint32_t n = min<uint32_t>(sizeof(chunk), offset - LOGRING_HEADER_SIZE);
+        _flash->read(sectorAddr(sector) + offset - n, chunk, n);
+        for (uint32_t i = n; i > 0; i--)
+        {
+            // The line break that ends the last line does not count
+            if (chunk[i - 1] == '\n' && !(sector == _head && offset - n + i == _offset) && ++found > lines)
+            {
+                offset = offset - n + i;
+                done = true;
+                break;
+            }
+        }
+        if (!done)
+        {
+            offset -= n;
+        }
+    }
+    if (offset < LOGRING_HEADER_SIZE)
+    {
+        offset = LOGRING_HEADER_SIZE;
+    }
+    return streamLines(sector, offset, cb);
+}
+
+/**
+ * @brief Stream the whole log through the callback, oldest line first
+ *
+ * @param cb the callback
+ * @return the number of lines passed to the callback
+ */
+uint32_t LogRing::dump(LineCallback cb)
+{
+    if (!_flash || !cb)
+    {
+        return 0;
+    }
+    uint32_t seq;
+    const uint32_t sector = oldestSector(seq);
+    return streamLines(sector, LOGRING_HEADER_SIZE, cb);
+}
+
+/**
+ * @brief Erase the whole region and start over. Blocks for the erase of all sectors
+ *
+ * @return true if the log is ready again
+ */
+bool LogRing::clear()
+{
+    if (!_flash)
+    {
+        return false;
+    }
+    for (uint32_t sector = 0; sector < sectors(); sector++)
+    {
+        _flash->erase(sectorAddr(sector));
+    }
+    const uint32_t save = spin_lock_blocking(_lock);
+    _out = _in; // Drop the buffered text, it belongs to the old log
+    spin_unlock(_lock, save);
+    if (!openSector(0, 1))
+    {
+        return false;
+    }
+    _nextErased = true; // Erased above
+    return true;
+}
+
+/**
+ * @brief Read and validate the header of a sector
+ *
+ * @param sector the sector in the region
+ * @param seq the sequence number of the sector
+ * @return true if the sector is in use
+ */
+bool LogRing::readHeader(uint32_t sector, uint32_t &seq)
+{
+    LogRingSectorHeader header;
+    _flash->read(sectorAddr(sector), (uint8_t *)&header, sizeof(header));
+    seq = header.seq;
+    return header.magic == LOGRING_MAGIC && header.seq == ~header.seqInv;
+}
+
+/**
+ * @brief Make an erased sector the new head
+ *
+ * @param sector the sector in the region
+ * @param seq the sequence number
+ * @return true if the header was written
+ */
+bool LogRing::openSector(uint32_t sector, uint32_t seq)
+{
+    LogRingSectorHeader header = {LOGRING_MAGIC, seq, ~seq, 0xFFFFFFFF};
+    _flash->program(sectorAddr(sector), (const uint8_t *)&header, sizeof(header));
+    _head = sector;
+    _seq = seq;
+    _offset = LOGRING_HEADER_SIZE;
+    _nextErased = false;
+    return true;
+}
+
+/**
+ * @brief Binary search for the first unwritten (0xFF) byte of a sector
+ *
+ * @param sector the sector in the region
+ * @return the offset of the first unwritten byte, SECTOR_SIZE_W25Q128_4KB if the sector is full
+ */
+uint32_t LogRing::findFill(uint32_t sector)
+{
+    uint32_t lo = LOGRING_HEADER_SIZE;
+    uint32_t hi = SECTOR_SIZE_W25Q128_4KB;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        uint8_t value;
+        _flash->read(sectorAddr(sector) + mid, &value, 1);
+        if (value == 0xFF)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Find the oldest valid sector
+ *
+ * @param seq the sequence number of the oldest sector
+ * @return the oldest sector
+ */
+uint32_t LogRing::oldestSector(uint32_t &seq)
+{
+    uint32_t oldest = _head;
+    seq = _seq;
+    for (uint32_t sector = 0; sector < sectors(); sector++)
+    {
+        uint32_t s;
+        if (readHeader(sector, s) && s < seq)
+        {
+            seq = s;
+            oldest = sector;
+        }
+    }
+    return oldest;
+}
+
+/**
+ * @brief Stream the log from a position up to the write head, line by line. Lines longer than
+ *        the line buffer are split
+ *
+ * @param sector the sector to start in
+ * @param offset the offset in the sector to start at
+ * @param cb the callback
+ * @return the number of lines
+ */
+uint32_t LogRing::streamLines(uint32_t sector, uint32_t offset, LineCallback &cb)
+{
+    uint32_t lines = 0;
+    char line[160];
+    size_t len = 0;
+    uint8_t chunk[64];
+    uint32_t seq;
+    if (!readHeader(sector, seq))
+    {
+        return 0;
+    }
+    const uint32_t headSeq = _seq;
+    const uint32_t headOffset = _offset;
+    while (true)
+    {
+        const uint32_t end = (seq == headSeq) ? headOffset : SECTOR_SIZE_W25Q128_4KB;
+        while (offset < end)
+        {
+            const uint32_t n = min<uint32_t>(sizeof(chunk), end - offset);
+            _flash->read(sectorAddr(sector) + offset, chunk, n);
+            offset += n;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (chunk[i] == 0xFF)
+                {
+                    offset = end; // Unwritten rest of the sector
+                    break;
+                }
+                if (chunk[i] == '\n' || len == sizeof(line) - 1)
+                {
+                    line[len] = 0;
+                    cb(line);
+                    lines++;
+                    len = 0;
+                    if (chunk[i] == '\n')
+                    {
+                        continue;
+                    }
+                }
+                if (chunk[i] != '\r')
+                {
+                    line[len++] = chunk[i];
+                }
+            }
+        }
+        if (seq == headSeq)
+        {
+            break;
+        }
+        // Next sector must continue the sequence
+        const uint32_t next = (sector + 1) % sectors();
+        uint32_t nextSeq;
+        if (!readHeader(next, nextSeq) || nextSeq != seq + 1)
+        {
+            break;
+        }
+        sector = next;
+        seq = nextSeq;
+        offset = LOGRING_HEADER_SIZE;
+    }
+    if (len)
+    {
+        line[len] = 0;
+        cb(line);
+        lines++;
+    }
+    return lines;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,124 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        LogRing.h
+ * @brief       Persistent log sink. Buffers log output in RAM and writes it in page sized
+ *              batches into a circular raw region of the external flash
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "W25Q128.h"
+#include <functional>
+#include <hardware/sync.h>
+
+#define LOGRING_MAGIC 0x53474F4C        // "LOGS" marks a used log sector
+#define LOGRING_HEADER_SIZE 16          // Sector header, the log text follows
+#define LOGRING_SECTOR_DATA (SECTOR_SIZE_W25Q128_4KB - LOGRING_HEADER_SIZE)
+
+#ifndef LOGRING_BUFFER_SIZE
+    #define LOGRING_BUFFER_SIZE 2048 // RAM buffer, filled by write() and drained by loop()
+#endif
+#ifndef LOGRING_FLUSH_INTERVAL_MS
+    #define LOGRING_FLUSH_INTERVAL_MS 1000 // Write a partial page at the latest after this time
+#endif
+
+// Header at the start of each used log sector
+struct __attribute__((packed)) LogRingSectorHeader
+{
+    uint32_t magic;  // LOGRING_MAGIC
+    uint32_t seq;    // Sequence number, increments with every sector
+    uint32_t seqInv; // ~seq, detects a torn header
+    uint32_t reserved;
+};
+
+class LogRing : public Print
+{
+  public:
+    using LineCallback = std::function<void(const char *line)>;
+
+    LogRing();
+
+    bool begin(W25Q128 *flash, uint32_t start, uint32_t size); // Find the write head in the region
+    void loop();                                               // Write one batch if due, never waits for an erase
+    size_t write(uint8_t c) override;                          // Buffer one character
+    size_t write(const uint8_t *buffer, size_t size) override; // Buffer characters
+    using Print::write;
+
+    uint32_t tail(uint32_t lines, LineCallback cb); // Stream the last lines through cb
+    uint32_t dump(LineCallback cb);                 // Stream the whole log through cb, oldest first
+    bool clear();                                   // Erase the region (blocking)
+
+    inline bool isReady() const { return _flash != nullptr; }   // Region found and head set
+    inline uint32_t dropped() const { return _dropped; }        // Characters lost because the buffer was full
+    inline uint32_t buffered() const { return (uint16_t)(_in - _out + LOGRING_BUFFER_SIZE) % LOGRING_BUFFER_SIZE; } // Characters waiting in RAM
+    inline uint32_t size() const { return _size; }              // Size of the region
+    inline uint32_t sequence() const { return _seq; }           // Sequence number of the head sector
+    inline void pause(bool paused) { _paused = paused; }        // Stop capturing (e.g. while dumping the log)
+
+  private:
+    inline uint32_t sectors() const { return _size / SECTOR_SIZE_W25Q128_4KB; }
+    inline uint32_t sectorAddr(uint32_t sector) const { return _start + sector * SECTOR_SIZE_W25Q128_4KB; }
+    bool readHeader(uint32_t sector, uint32_t &seq);             // Read and validate a sector header
+    bool openSector(uint32_t sector, uint32_t seq);              // Write the header of a freshly erased sector
+    uint32_t findFill(uint32_t sector);                          // Binary search for the first unwritten byte
+    uint32_t oldestSector(uint32_t &seq);                        // Oldest valid sector
+    uint32_t streamLines(uint32_t sector, uint32_t offset, LineCallback &cb); // Stream from a position up to the head
+    void push(uint8_t c);                                        // Buffer one character, with _lock held
+
+    W25Q128 *_flash;                        // Flash driver
+    uint32_t _start;                        // Start address of the region
+    uint32_t _size;                         // Size of the region
+    uint32_t _head;                         // Sector of the write head
+    uint32_t _offset;                       // Next byte to write in the head sector
+    uint32_t _seq;                          // Sequence number of the head sector
+    bool _nextErased;                       // The sector after the head is erased (or being erased)
+    bool _paused;                           // Capturing paused
+    uint8_t _buffer[LOGRING_BUFFER_SIZE];   // RAM ring buffer, producers on both cores (write) and one consumer (loop)
+    volatile uint16_t _in;                  // Write position in _buffer, only changed by write() under _lock
+    volatile uint16_t _out;                 // Read position in _buffer, only changed by loop() and clear()
+    spin_lock_t *_lock;                     // Serializes the producers, the logger is called from both cores
+    uint32_t _dropped;                      // Characters lost because the buffer was full
+    uint32_t _lastFlush;                    // millis() of the last write to flash
+};
+
+// Stream that forwards everything to the console stream and copies the output into a LogRing.
+// The OpenKNX logger writes to SERIAL_DEBUG, so build with -D SERIAL_DEBUG=extFlashLogTee to capture it
+class LogRingTee : public Stream
+{
+  public:
+    LogRingTee(Stream &target) : _target(target), _ring(nullptr) {}
+
+    inline void attach(LogRing *ring) { _ring = ring; } // Start (or with nullptr stop) copying into the ring
+    void begin(unsigned long baud) { (void)baud; }      // The console stream is set up by its owner
+
+    size_t write(uint8_t c) override
+    {
+        if (_ring) _ring->write(c);
+        return _target.write(c);
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        if (_ring) _ring->write(buffer, size);
+        return _target.write(buffer, size);
+    }
+    using Print::write;
+    int available() override { return _target.available(); }
+    int read() override { return _target.read(); }
+    int peek() override { return _target.peek(); }
+    void flush() override { _target.flush(); }
+    int availableForWrite() override { return _target.availableForWrite(); }
+    operator bool() { return true; }
+
+  private:
+    Stream &_target; // Console stream
+    LogRing *_ring;  // Ring log or nullptr
+};
+
+extern LogRingTee extFlashLogTee; // Tee of Serial into the log ring of the external flash module
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,417 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class ModuleStore
+ * @brief Module data on a raw partition of the external flash.
+ *
+ * openknx.flash keeps the module data in the internal flash, every save erases and programs it with
+ * flash_range_program(), which stops XIP and idles the other core. The common code can't be redirected to
+ * another backend, so modules that save often can keep their data here instead: they register their RAM
+ * blocks by name with add(), read them back at setup with load() and call save() after a change.
+ *
+ * The partition is split into slots of MSTORE_SLOT_SIZE. A save writes all registered blocks into the slot after
+ * the latest one, the header with the sequence number and the CRC goes into the first page last. Until then the
+ * previous slot stays valid, a power loss during a save loses only that save (double buffering). The slots are
+ * used in rotation, so the erases are spread over the whole partition. The next slot is erased in the background
+ * as soon as a save is committed, so a save is only page programs, one per loop() call. flush() completes a
+ * save blocking, e.g. in savePower().
+ *
+ * A save copies the blocks into a buffer when it starts, so the pages are written from stable data even if a
+ * block changes in between. Without heap for the buffer the pages are read from RAM: the CRC of the blocks is
+ * taken when the save starts and compared with the CRC of the written pages before the commit. If a block
+ * changed, the slot would hold a mix of old and new data, so it is not committed: it is erased again and the save
+ * restarts, up to MSTORE_MAX_RETRIES times. Then the save fails and the previous slot stays the latest.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "ModuleStore.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+#include "ExtFlashMem.h"
+
+/**
+ * @brief Construct a new Module Store object
+ */
+ModuleStore::ModuleStore() : _count(0), _used(0), _slot(-1), _seq(0), _target(0), _erased(0), _state(ModuleStoreState::Erasing),
+                             _pending(false), _entry(0), _entryPos(0), _pos(0), _crc(0), _startCrc(0), _saves(0), _retries(0),
+                             _failures(0), _attempt(0), _copy(nullptr), _copySize(0)
+{
+}
+
+/**
+ * @brief Destroy the Module Store object
+ */
+ModuleStore::~ModuleStore()
+{
+    extFlashMemFree(_copy);
+}
+
+/**
+ * @brief Attach to a raw partition and find the latest valid slot. The next slot is erased by loop()
+ *
+ * @param partition the raw partition, at least 2 slots
+ * @return true if the store is ready
+ */
+bool ModuleStore::begin(const ExtFlashRawPartition &partition)
+{
+    _partition = partition;
+    if (!_partition.isReady() || slots() < 2)
+    {
+        _partition.begin(nullptr, nullptr);
+        return false;
+    }
+
+    _slot = -1;
+    _seq = 0;
+    for (uint16_t slot = 0; slot < slots(); slot++)
+    {
+        ModuleStoreSlotHeader header;
+        if (readSlot(slot, header) && (_slot < 0 || (int32_t)(header.seq - _seq) > 0))
+        {
+            _slot = slot;
+            _seq = header.seq;
+        }
+    }
+    _target = _slot < 0 ? 0 : (_slot + 1) % slots();
+    _erased = 0;
+    _state = ModuleStoreState::Erasing;
+    return true;
+}
+
+/**
+ * @brief Register a RAM block. Every save writes the current content of all registered blocks
+ *
+ * @param name the name of the block, e.g. the module name
+ * @param data the RAM block
+ * @param size the size of the block
+ * @return true if registered
+ */
+bool ModuleStore::add(const char *name, const void *data, uint16_t size)
+{
+    const uint32_t bytes = sizeof(ModuleStoreEntryHeader) + align(size);
+    if (!name || !data || _count >= MSTORE_MAX_ENTRIES || _used + bytes > MSTORE_SLOT_SIZE - PAGE_SIZE_W25Q128_256B)
+    {
+        return false;
+    }
+    const uint32_t k = key(name);
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (_entries[i].key == k)
+        {
+            return false; // Name already registered
+        }
+    }
+    _entries[_count++] = {k, data, size};
+    _used += bytes;
+    return true;
+}
+
+/**
+ * @brief Read the block of a name from the latest slot
+ *
+ * @param name the name of the block
+ * @param data the buffer
+ * @param size the size of the buffer, must match the stored size
+ * @return true if the block was found with this size
+ */
+bool ModuleStore::load(const char *name, void *data, uint16_t size)
+{
+    ModuleStoreSlotHeader header;
+    if (!isReady() || _slot < 0 || !name || !_partition.read(slotAddr(_slot), (uint8_t *)&header, sizeof(header)))
+    {
+        return false;
+    }
+    const uint32_t k = key(name);
+    uint32_t pos = 0;
+    for (uint16_t i = 0; i < header.count; i++)
+    {
+        ModuleStoreEntryHeader entry;
+        if (pos + sizeof(entry) > header.size ||
+            !_partition.read(slotAddr(_slot) + PAGE_SIZE_W25Q128_256B + pos, (uint8_t *)&entry, sizeof(entry)))
+        {
+            return false;
+        }
+        pos += sizeof(entry);
+        if (entry.key == k)
+        {
+            return entry.size == size && pos + size <= header.size &&
+                   _partition.read(slotAddr(_slot) + PAGE_SIZE_W25Q128_256B + pos, (uint8_t *)data, size);
+        }
+        pos += align(entry.size);
+    }
+    return false;
+}
+
+/**
+ * @brief Write all registered blocks into the next slot. loop() writes one page per call, a save requested
+ *        while one is running is written after it
+ */
+void ModuleStore::save()
+{
+    _pending = true;
+}
+
+/**
+ * @brief Complete a pending save now. Waits for a running erase of the next slot
+ *
+ * @return true if nothing is pending anymore and no save failed
+ */
+bool ModuleStore::flush()
+{
+    if (!isReady())
+    {
+        return false;
+    }
+    const uint32_t failures = _failures;
+    while (pending())
+    {
+        step(); // Erase and program wait for a running erase. Ends, a save that keeps changing fails
+    }
+    return _failures == failures;
+}
+
+/**
+ * @brief One erase step of the next slot or one page of a save
+ */
+void ModuleStore::loop()
+{
+    if (!isReady() || _partition.flash()->isBusy())
+    {
+        return;
+    }
+    step();
+}
+
+/**
+ * @brief One erase step of the next slot or one page of a save. The flash is not busy
+ */
+void ModuleStore::step()
+{
+    switch (_state)
+    {
+        case ModuleStoreState::Erasing:
+            if (_partition.eraseAsync(slotAddr(_target) + _erased))
+            {
+                _erased += SECTOR_SIZE_W25Q128_4KB;
+                if (_erased >= MSTORE_SLOT_SIZE)
+                {
+                    _state = ModuleStoreState::Ready; // Done when the erase completes, the next step waits for it
+                }
+            }
+            return;
+        case ModuleStoreState::Ready:
+            if (_pending)
+            {
+                _pending = false;
+                _entry = 0;
+                _entryPos = 0;
+                _pos = PAGE_SIZE_W25Q128_256B;
+                _crc = 0;
+                _startCrc = copyEntries() ? 0 : entriesCrc();
+                _state = ModuleStoreState::Writing;
+            }
+            return;
+        case ModuleStoreState::Writing:
+            if (!writePage())
+            {
+                commit();
+            }
+            return;
+    }
+}
+
+/**
+ * @brief Program the next page of the entries
+ *
+ * @return false if all entries are written
+ */
+bool ModuleStore::writePage()
+{
+    if (_copy)
+    {
+        const uint32_t written = _pos - PAGE_SIZE_W25Q128_256B;
+        const uint32_t n = min<uint32_t>(PAGE_SIZE_W25Q128_256B, _used - written);
+        if (!n)
+        {
+            return false;
+        }
+        _partition.program(slotAddr(_target) + _pos, _copy + written, n);
+        _pos += n;
+        return true;
+    }
+
+    uint8_t page[PAGE_SIZE_W25Q128_256B];
+    uint16_t fill = 0;
+    while (fill < sizeof(page) && _entry < _count)
+    {
+        const Entry &entry = _entries[_entry];
+        const ModuleStoreEntryHeader header = {entry.key, entry.size, 0};
+        const uint32_t total = sizeof(header) + align(entry.size);
+        while (fill < sizeof(page) && _entryPos < total)
+        {
+            const uint32_t pos = _entryPos++;
+            if (pos < sizeof(header))
+            {
+                page[fill++] = ((const uint8_t *)&header)[pos];
+            }
+            else
+            {
+                page[fill++] = (pos - sizeof(header) < entry.size) ? ((const uint8_t *)entry.data)[pos - sizeof(header)] : 0;
+            }
+        }
+        if (_entryPos >= total)
+        {
+            _entry++;
+            _entryPos = 0;
+        }
+    }
+    if (!fill)
+    {
+        return false;
+    }
+    _partition.program(slotAddr(_target) + _pos, page, fill);
+    _crc = extFlashCrc32(page, fill, _crc);
+    _pos += fill;
+    return true;
+}
+
+/**
+ * @brief Write the header of the target slot, it becomes the latest. Starts the erase of the next slot
+ */
+void ModuleStore::commit()
+{
+    if (_copy)
+    {
+        _crc = extFlashCrc32(_copy, _used); // The copy was written, its CRC is the one of the slot
+    }
+    else if (_crc != _startCrc)
+    {
+        // A block changed during the save, erase the slot again and write the current data, or give up
+        _retries++;
+        if (++_attempt < MSTORE_MAX_RETRIES)
+        {
+            _pending = true;
+        }
+        else
+        {
+            _failures++;
+            _attempt = 0;
+        }
+        _erased = 0;
+        _state = ModuleStoreState::Erasing;
+        return;
+    }
+    _attempt = 0;
+    ModuleStoreSlotHeader header;
+    header.magic = MSTORE_MAGIC;
+    header.version = MSTORE_VERSION;
+    header.count = _count;
+    header.seq = _seq + 1;
+    header.size = _pos - PAGE_SIZE_W25Q128_256B;
+    header.crc = _crc;
+    header.headerCrc = extFlashCrc32(&header, offsetof(ModuleStoreSlotHeader, headerCrc));
+    _partition.program(slotAddr(_target), (const uint8_t *)&header, sizeof(header));
+
+    _slot = _target;
+    _seq = header.seq;
+    _saves++;
+    _target = (_target + 1) % slots();
+    _erased = 0;
+    _state = ModuleStoreState::Erasing;
+}
+
+/**
+ * @brief Copy the entries into _copy as writePage() writes them: entry header, data and padding. The buffer is
+ *        kept for the next saves and grows with the registered blocks
+ *
+ * @return true if the entries are copied, false without heap for the buffer
+ */
+bool ModuleStore::copyEntries()
+{
+    if (_copySize < _used)
+    {
+        extFlashMemFree(_copy);
+        _copy = static_cast<uint8_t *>(extFlashMemAlloc(EXTFLASH_MEM_MODULE, _used));
+        _copySize = _copy ? _used : 0;
+    }
+    if (!_copy)
+    {
+        return false;
+    }
+    uint8_t *pos = _copy;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Entry &entry = _entries[i];
+        const ModuleStoreEntryHeader header = {entry.key, entry.size, 0};
+        memcpy(pos, &header, sizeof(header));
+        memcpy(pos + sizeof(header), entry.data, entry.size);
+        memset(pos + sizeof(header) + entry.size, 0, align(entry.size) - entry.size);
+        pos += sizeof(header) + align(entry.size);
+    }
+    return true;
+}
+
+/**
+ * @brief CRC32 of the entries in RAM, the same bytes as writePage() writes: entry header, data and padding
+ *
+ * @return the CRC32
+ */
+uint32_t ModuleStore::entriesCrc() const
+{
+    static const uint8_t padding[MSTORE_ALIGN] = {0};
+    uint32_t crc = 0;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Entry &entry = _entries[i];
+        const ModuleStoreEntryHeader header = {entry.key, entry.size, 0};
+        crc = extFlashCrc32(&header, sizeof(header), crc);
+        crc = extFlashCrc32(entry.data, entry.size, crc);
+        crc = extFlashCrc32(padding, align(entry.size) - entry.size, crc);
+    }
+    return crc;
+}
+
+/**
+ * @brief Read and check the header and the entries of a slot
+ *
+ * @param slot the slot
+ * @param header the header
+ * @return true if the slot is valid
+ */
+bool ModuleStore::readSlot(uint16_t slot, ModuleStoreSlotHeader &header)
+{
+    if (!_partition.read(slotAddr(slot), (uint8_t *)&header, sizeof(header)) || header.magic != MSTORE_MAGIC ||
+        header.version != MSTORE_VERSION || header.headerCrc != extFlashCrc32(&header, offsetof(ModuleStoreSlotHeader, headerCrc)) ||
+        header.size > MSTORE_SLOT_SIZE - PAGE_SIZE_W25Q128_256B)
+    {
+        return false;
+    }
+    uint8_t buffer[PAGE_SIZE_W25Q128_256B];
+    uint32_t crc = 0;
+    for (uint32_t pos = 0; pos < header.size; pos += sizeof(buffer))
+    {
+        const uint32_t n = min<uint32_t>(sizeof(buffer), header.size - pos);
+        _partition.read(slotAddr(slot) + PAGE_SIZE_W25Q128_256B + pos, buffer, n);
+        crc = extFlashCrc32(buffer, n, crc);
+    }
+    return crc == header.crc;
+}
+
+/**
+ * @brief FNV-1a hash of a name
+ *
+ * @param name the name
+ * @return the hash
+ */
+uint32_t ModuleStore::key(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,123 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        ModuleStore.h
+ * @brief       Module data on a raw partition of the external flash instead of the internal flash.
+ *              Double-buffered slots written in rotation, saved in the background by loop()
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+
+#define MSTORE_MAGIC 0x534D4645          // "EFMS"
+#define MSTORE_VERSION 1                 // Version of the slot layout
+#define MSTORE_ALIGN 4                   // Entries start 4 byte aligned
+
+#ifndef MSTORE_SLOT_SIZE
+    #define MSTORE_SLOT_SIZE (2 * SECTOR_SIZE_W25Q128_4KB) // Size of a slot, the first page holds the header
+#endif
+#ifndef MSTORE_MAX_ENTRIES
+    #define MSTORE_MAX_ENTRIES 16 // Max number of registered data blocks
+#endif
+#define MSTORE_MAX_RETRIES 3 // Attempts of a save written from RAM whose blocks keep changing, then it fails
+
+// Header in the first page of a slot. Written last, so a torn save leaves the previous slot valid
+struct __attribute__((packed)) ModuleStoreSlotHeader
+{
+    uint32_t magic;     // MSTORE_MAGIC
+    uint16_t version;   // MSTORE_VERSION
+    uint16_t count;     // Number of entries
+    uint32_t seq;       // Sequence number, increments with every save
+    uint32_t size;      // Bytes of the entries after the header page
+    uint32_t crc;       // CRC32 over the entries
+    uint32_t headerCrc; // CRC32 over the fields above
+};
+
+// Header in front of the data of an entry
+struct __attribute__((packed)) ModuleStoreEntryHeader
+{
+    uint32_t key;  // Hash of the name
+    uint16_t size; // Data bytes, padded to MSTORE_ALIGN
+    uint16_t reserved;
+};
+
+enum class ModuleStoreState : uint8_t
+{
+    Erasing, // Erasing the next slot in the background
+    Ready,   // The next slot is erased, a save is only page programs
+    Writing, // Writing the entries into the next slot
+};
+
+class ModuleStore
+{
+  public:
+    ModuleStore();
+    ~ModuleStore();
+
+    bool begin(const ExtFlashRawPartition &partition);        // Find the latest valid slot
+    bool add(const char *name, const void *data, uint16_t size); // Register a RAM block that is written by every save
+    bool load(const char *name, void *data, uint16_t size);   // Read the block of a name from the latest slot
+    void save();                                              // Write all registered blocks into the next slot in the background
+    bool flush();                                             // Complete a pending save now (blocking), false if it failed
+    void loop();                                              // One erase step or one page of a save
+
+    inline bool isReady() const { return _partition.isReady(); }      // Partition attached
+    inline bool hasData() const { return _slot >= 0; }                // A valid slot was found or written
+    inline bool pending() const { return _pending || _state == ModuleStoreState::Writing; } // A save is not complete
+    inline ModuleStoreState state() const { return _state; }          // State of the next slot
+    inline int16_t slot() const { return _slot; }                     // Latest valid slot or -1
+    inline uint16_t slots() const { return _partition.size() / MSTORE_SLOT_SIZE; } // Number of slots
+    inline uint32_t sequence() const { return _seq; }                 // Sequence number of the latest slot
+    inline uint8_t count() const { return _count; }                   // Registered blocks
+    inline uint32_t used() const { return _used; }                    // Bytes of the registered blocks with entry headers
+    inline uint32_t saves() const { return _saves; }                  // Saves since boot
+    inline uint32_t retries() const { return _retries; }              // Saves discarded, the blocks changed while written
+    inline uint32_t failures() const { return _failures; }            // Saves given up after MSTORE_MAX_RETRIES
+
+  private:
+    struct Entry
+    {
+        uint32_t key;     // Hash of the name
+        const void *data; // RAM block
+        uint16_t size;    // Size of the block
+    };
+
+    inline static uint32_t align(uint32_t value) { return (value + MSTORE_ALIGN - 1) & ~(uint32_t)(MSTORE_ALIGN - 1); }
+    inline uint32_t slotAddr(uint16_t slot) const { return (uint32_t)slot * MSTORE_SLOT_SIZE; }
+    static uint32_t key(const char *name);                        // FNV-1a hash of a name
+    bool readSlot(uint16_t slot, ModuleStoreSlotHeader &header);  // Read and check header and entries of a slot
+    void step();                                                  // One erase step or one page of a save
+    bool writePage();                                             // Program the next page of the entries, false when all are written
+    void commit();                                                // Write the header, the slot becomes the latest
+    uint32_t entriesCrc() const;                                  // CRC32 of the entries as writePage() writes them
+    bool copyEntries();                                           // Copy the entries into _copy as they are written
+
+    ExtFlashRawPartition _partition;    // Raw partition of the slots
+    Entry _entries[MSTORE_MAX_ENTRIES]; // Registered blocks
+    uint8_t _count;                     // Number of registered blocks
+    uint32_t _used;                     // Bytes of the registered blocks with entry headers
+    int16_t _slot;                      // Latest valid slot or -1
+    uint32_t _seq;                      // Sequence number of the latest slot
+    uint16_t _target;                   // Slot of the next save
+    uint32_t _erased;                   // Bytes of the target slot erased
+    ModuleStoreState _state;            // State of the target slot
+    bool _pending;                      // save() was called
+    uint8_t _entry;                     // Entry written next
+    uint32_t _entryPos;                 // Position in the entry, header included
+    uint32_t _pos;                      // Write position in the target slot
+    uint32_t _crc;                      // CRC32 of the written entries
+    uint32_t _startCrc;                 // CRC32 of the entries when the save started
+    uint32_t _saves;                    // Saves since boot
+    uint32_t _retries;                  // Saves discarded because a block changed while it was written
+    uint32_t _failures;                 // Saves given up, the blocks kept changing
+    uint8_t _attempt;                   // Attempts of the running save
+    uint8_t *_copy;                     // Copy of the entries of the running save, nullptr writes from RAM
+    uint32_t _copySize;                 // Size of _copy
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
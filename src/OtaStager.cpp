@@ -0,0 +1,389 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class OtaStager
+ * @brief Staging area for firmware images on a raw partition of the external flash.
+ *
+ * The image is streamed in with write() in chunks of any size, e.g. from KNX or the console, and only a page
+ * buffer is kept in RAM. A running CRC32 is computed while the bytes arrive. The image area is erased up to
+ * OTA_ERASE_AHEAD ahead of the write position with non-blocking sector erases, one per loop(). A sector erase
+ * holds the chip for about 45 ms, LittleFS and the other raw partitions wait that long at most, a 64KB block
+ * erase would hold it for 150 ms to 2 s. While the erase is behind, write() takes over fewer bytes (down to 0)
+ * instead of waiting, so the caller applies backpressure to the sender.
+ *
+ * After finish() the image is read back in loop() in small chunks and compared against the CRC. The header in
+ * the last sector of the partition is written only for a verified image. requestApply() marks the image, at the
+ * next boot apply() copies it to the internal LittleFS and hands it over to picoOTA, which flashes it with the
+ * next reboot. Each apply is counted in the header before it starts, so an image that fails or resets the device
+ * is tried at OTA_APPLY_ATTEMPTS boots only.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "OtaStager.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+#include <LittleFS.h>
+#include <hardware/watchdog.h>
+#include <PicoOTA.h>
+#include <stddef.h>
+
+/**
+ * @brief Construct a new Ota Stager object
+ */
+OtaStager::OtaStager() : _state(OtaState::Idle), _applyPending(false), _applyAttempts(0), _size(0), _expectedCrc(0), _crc(0), _received(0), _written(0),
+                         _erased(0), _verified(0), _verifyCrc(0), _pageFill(0)
+{
+}
+
+/**
+ * @brief Attach to a raw partition and look for a staged image
+ *
+ * @param partition the raw partition, at least two sectors
+ * @return true if the partition can be used
+ */
+bool OtaStager::begin(const ExtFlashRawPartition &partition)
+{
+    _partition = partition;
+    _state = OtaState::Idle;
+    _applyPending = false;
+    _applyAttempts = 0;
+    if (!_partition.isReady() || _partition.size() < 2 * SECTOR_SIZE_W25Q128_4KB)
+    {
+        _partition.begin(nullptr, nullptr);
+        return false;
+    }
+
+    OtaHeader header;
+    _partition.read(headerAddr(), (uint8_t *)&header, sizeof(header));
+    if (header.magic == OTA_MAGIC && header.headerCrc == extFlashCrc32(&header, offsetof(OtaHeader, headerCrc)) &&
+        header.size <= maxImageSize() && header.applied == 0xFFFFFFFF)
+    {
+        _state = OtaState::Staged;
+        _size = header.size;
+        _crc = header.crc;
+        _received = _written = _verified = _size;
+        _applyAttempts = __builtin_popcount(~header.attempts);
+        _applyPending = header.apply == 0 && _applyAttempts < OTA_APPLY_ATTEMPTS;
+    }
+    return true;
+}
+
+/**
+ * @brief Start staging a new image. A staged image is dropped. The erase runs in the background
+ *
+ * @param size the size of the image
+ * @param expectedCrc the CRC32 of the image, 0 if not known
+ * @return true if the image fits into the partition
+ */
+bool OtaStager::start(uint32_t size, uint32_t expectedCrc)
+{
+    if (!isReady() || !size || size > maxImageSize())
+    {
+        return false;
+    }
+    // The header goes first, so an interrupted staging never leaves a valid header behind
+    if (!_partition.eraseAsync(headerAddr()))
+    {
+        return false;
+    }
+    _state = OtaState::Receiving;
+    _applyPending = false;
+    _applyAttempts = 0;
+    _size = size;
+    _expectedCrc = expectedCrc;
+    _crc = 0;
+    _received = 0;
+    _written = 0;
+    _erased = 0;
+    _verified = 0;
+    _verifyCrc = 0;
+    _pageFill = 0;
+    return true;
+}
+
+/**
+ * @brief Take over a chunk of the image. Full pages are programmed right away, as long as the erase is ahead
+ *
+ * @param data the chunk
+ * @param len the length of the chunk
+ * @return the number of bytes taken over, the rest has to be sent again later
+ */
+size_t OtaStager::write(const uint8_t *data, size_t len)
+{
+    if (_state != OtaState::Receiving)
+    {
+        return 0;
+    }
+    size_t accepted = 0;
+    while (accepted < len && _received < _size)
+    {
+        if (_pageFill == sizeof(_page) && !flushPage())
+        {
+            break; // Erase is behind
+        }
+        const size_t n = min<size_t>(min<size_t>(len - accepted, sizeof(_page) - _pageFill), _size - _received);
+        memcpy(_page + _pageFill, data + accepted, n);
+        _crc = extFlashCrc32(data + accepted, n, _crc);
+        _pageFill += n;
+        _received += n;
+        accepted += n;
+    }
+    if (_pageFill == sizeof(_page))
+    {
+        flushPage();
+    }
+    return accepted;
+}
+
+/**
+ * @brief All bytes are written. The last page is flushed and the image is verified by loop()
+ *
+ * @return true if the image is complete
+ */
+bool OtaStager::finish()
+{
+    if (_state != OtaState::Receiving || _received != _size)
+    {
+        return false;
+    }
+    _state = OtaState::Verifying;
+    _verified = 0;
+    _verifyCrc = 0;
+    return true;
+}
+
+/**
+ * @brief Drop the image
+ */
+void OtaStager::abort()
+{
+    if (_state == OtaState::Receiving || _state == OtaState::Verifying || _state == OtaState::Failed)
+    {
+        _state = OtaState::Idle;
+        _pageFill = 0;
+    }
+}
+
+/**
+ * @brief One step of the background work: erase ahead, program a buffered page or verify a chunk.
+ *        Returns right away while the flash is busy
+ */
+void OtaStager::loop()
+{
+    if (!isReady() || _partition.flash()->isBusy())
+    {
+        return;
+    }
+    switch (_state)
+    {
+        case OtaState::Receiving:
+            if (_pageFill < sizeof(_page) || !flushPage())
+            {
+                eraseStep();
+            }
+            break;
+
+        case OtaState::Verifying:
+            if (_pageFill)
+            {
+                if (!flushPage())
+                {
+                    eraseStep();
+                }
+                break;
+            }
+            if (_verified < _size)
+            {
+                uint8_t buffer[OTA_VERIFY_CHUNK];
+                const uint32_t n = min<uint32_t>(sizeof(buffer), _size - _verified);
+                _partition.read(_verified, buffer, n);
+                _verifyCrc = extFlashCrc32(buffer, n, _verifyCrc);
+                _verified += n;
+                break;
+            }
+            _state = (_verifyCrc == _crc && (!_expectedCrc || _expectedCrc == _crc) && writeHeader()) ? OtaState::Staged : OtaState::Failed;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Mark the staged image to be applied at the next boot
+ *
+ * @return true if the flag is set
+ */
+bool OtaStager::requestApply()
+{
+    if (_state != OtaState::Staged || _applyAttempts >= OTA_APPLY_ATTEMPTS)
+    {
+        return false;
+    }
+    _applyPending = clearFlag(offsetof(OtaHeader, apply));
+    return _applyPending;
+}
+
+/**
+ * @brief Copy the staged image to the internal LittleFS, check it again and hand it over to picoOTA.
+ *        Blocks for the copy and reboots on success, so call it at boot only. The attempt is counted first,
+ *        after OTA_APPLY_ATTEMPTS the image is no longer applied
+ *
+ * @return false if the image could not be applied, the device does not reboot then
+ */
+bool OtaStager::apply()
+{
+    if (_state != OtaState::Staged || !_applyPending)
+    {
+        return false;
+    }
+    _applyAttempts++;
+    _applyPending = _applyAttempts < OTA_APPLY_ATTEMPTS;
+    if (!clearFlag(offsetof(OtaHeader, attempts), ~(uint32_t)((1ull << _applyAttempts) - 1)) || !LittleFS.begin())
+    {
+        return false;
+    }
+    File file = LittleFS.open(OTA_FIRMWARE_FILE, "w");
+    if (!file)
+    {
+        LittleFS.end();
+        return false;
+    }
+    uint8_t buffer[OTA_COPY_CHUNK];
+    uint32_t crc = 0;
+    bool ok = true;
+    for (uint32_t pos = 0; pos < _size && ok; pos += sizeof(buffer))
+    {
+        const uint32_t n = min<uint32_t>(sizeof(buffer), _size - pos);
+        ok = _partition.read(pos, buffer, n) && file.write(buffer, n) == n;
+        crc = extFlashCrc32(buffer, n, crc);
+        watchdog_update(); // Up to 2MB, the copy takes longer than the watchdog timeout
+    }
+    file.close();
+
+    if (ok && crc == _crc)
+    {
+        picoOTA.begin();
+        ok = picoOTA.addFile(OTA_FIRMWARE_FILE) && picoOTA.commit();
+    }
+    else
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        LittleFS.remove(OTA_FIRMWARE_FILE);
+        LittleFS.end();
+        return false;
+    }
+    LittleFS.end();
+
+    // The image is handed over, don't apply it again
+    clearFlag(offsetof(OtaHeader, applied));
+    _state = OtaState::Idle;
+    _applyPending = false;
+    rp2040.reboot();
+    return true;
+}
+
+/**
+ * @brief Name of a state
+ *
+ * @param state the state
+ * @return the name
+ */
+const char *OtaStager::stateName(OtaState state)
+{
+    switch (state)
+    {
+        case OtaState::Idle:
+            return "idle";
+        case OtaState::Receiving:
+            return "receiving";
+        case OtaState::Verifying:
+            return "verifying";
+        case OtaState::Staged:
+            return "staged";
+        case OtaState::Failed:
+            return "failed";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @brief Program the page buffer, if the erase is ahead of it and the flash is idle
+ *
+ * @return true if the page buffer is empty afterwards
+ */
+bool OtaStager::flushPage()
+{
+    if (!_pageFill)
+    {
+        return true;
+    }
+    if (_written + _pageFill > _erased || _partition.flash()->isBusy())
+    {
+        return false;
+    }
+    if (!_partition.program(_written, _page, _pageFill))
+    {
+        return false;
+    }
+    _written += _pageFill;
+    _pageFill = 0;
+    return true;
+}
+
+/**
+ * @brief Start the erase of the next sector of the image area, up to OTA_ERASE_AHEAD ahead of the write position
+ *
+ * @return true if an erase was started
+ */
+bool OtaStager::eraseStep()
+{
+    const uint32_t end = (_size + SECTOR_SIZE_W25Q128_4KB - 1) & ~(uint32_t)(SECTOR_SIZE_W25Q128_4KB - 1);
+    if (_erased >= end || _erased >= _written + OTA_ERASE_AHEAD || _partition.flash()->isBusy())
+    {
+        return false;
+    }
+    if (_partition.eraseAsync(_erased))
+    {
+        _erased += SECTOR_SIZE_W25Q128_4KB;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Write the header of the verified image into the erased last sector
+ *
+ * @return true if written
+ */
+bool OtaStager::writeHeader()
+{
+    OtaHeader header;
+    header.magic = OTA_MAGIC;
+    header.size = _size;
+    header.crc = _crc;
+    header.headerCrc = extFlashCrc32(&header, offsetof(OtaHeader, headerCrc));
+    header.apply = 0xFFFFFFFF;
+    header.applied = 0xFFFFFFFF;
+    header.attempts = 0xFFFFFFFF;
+    return _partition.program(headerAddr(), (const uint8_t *)&header, sizeof(header));
+}
+
+/**
+ * @brief Clear bits of a header field. NOR flash can program bits to 0 without an erase
+ *
+ * @param offset the offset of the field in the header
+ * @param value the bits to keep, 0 clears the whole field
+ * @return true if programmed
+ */
+bool OtaStager::clearFlag(uint32_t offset, uint32_t value)
+{
+    return _partition.program(headerAddr() + offset, (const uint8_t *)&value, sizeof(value));
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
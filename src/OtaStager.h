@@ -0,0 +1,95 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        OtaStager.h
+ * @brief       Staging area for firmware images on a raw partition. Streaming write with a running
+ *              CRC32, background erase and verify, apply at the next boot
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+
+#define OTA_MAGIC 0x5341544F            // "OTAS" marks a verified image
+#define OTA_FIRMWARE_FILE "/firmware.bin" // File on the internal LittleFS that picoOTA applies
+#define OTA_VERIFY_CHUNK 1024           // Bytes read back per loop() while verifying
+#define OTA_COPY_CHUNK 1024             // Bytes copied per step while applying
+#define OTA_ERASE_AHEAD (4 * SECTOR_SIZE_W25Q128_4KB) // Sectors erased ahead of the write position
+#define OTA_APPLY_ATTEMPTS 3            // Boots that try to apply a staged image, then it is no longer applied
+
+// Header in the last sector of the partition. Written after the image was verified,
+// the flags are cleared later by programming them to 0 (no erase needed)
+struct __attribute__((packed)) OtaHeader
+{
+    uint32_t magic;     // OTA_MAGIC
+    uint32_t size;      // Size of the image
+    uint32_t crc;       // CRC32 of the image
+    uint32_t headerCrc; // CRC32 of magic, size and crc
+    uint32_t apply;     // 0xFFFFFFFF, 0 when the image shall be applied at the next boot
+    uint32_t applied;   // 0xFFFFFFFF, 0 when the image was handed over to picoOTA
+    uint32_t attempts;  // 0xFFFFFFFF, one more bit programmed to 0 before each apply
+};
+
+enum class OtaState : uint8_t
+{
+    Idle,      // No image staged
+    Receiving, // Erasing ahead and writing the image
+    Verifying, // Reading the image back
+    Staged,    // Verified image waiting to be applied
+    Failed,    // Verification failed or the image was aborted
+};
+
+class OtaStager
+{
+  public:
+    OtaStager();
+
+    bool begin(const ExtFlashRawPartition &partition);    // Find a staged image
+    bool start(uint32_t size, uint32_t expectedCrc = 0);   // Start staging an image, expectedCrc 0 skips the check
+    size_t write(const uint8_t *data, size_t len);         // Stream a chunk, returns the bytes taken over (backpressure)
+    bool finish();                                         // All bytes written, verify in the background
+    void abort();                                          // Drop the image
+    void loop();                                           // One erase, flush or verify step, never waits for the flash
+
+    bool requestApply();                                   // Apply the staged image at the next boot
+    bool apply();                                          // Copy the image to the internal LittleFS and hand it to picoOTA, reboots
+
+    inline OtaState state() const { return _state; }                 // Current state
+    inline bool applyPending() const { return _applyPending; }       // The staged image shall be applied at boot
+    inline uint8_t applyAttempts() const { return _applyAttempts; }  // Boots that tried to apply the staged image
+    inline uint32_t imageSize() const { return _size; }              // Size of the image
+    inline uint32_t received() const { return _received; }           // Bytes taken over by write()
+    inline uint32_t written() const { return _written; }             // Bytes programmed to flash
+    inline uint32_t crc() const { return _crc; }                     // Running CRC32 of the received bytes
+    inline uint32_t maxImageSize() const { return _partition.size() > SECTOR_SIZE_W25Q128_4KB ? _partition.size() - SECTOR_SIZE_W25Q128_4KB : 0; }
+    inline bool isReady() const { return _partition.isReady(); }     // Partition attached
+    static const char *stateName(OtaState state);                    // Name of a state
+
+  private:
+    inline uint32_t headerAddr() const { return _partition.size() - SECTOR_SIZE_W25Q128_4KB; }
+    bool flushPage();             // Program the page buffer, false while the erase is behind
+    bool eraseStep();             // Start the next erase of the image area
+    bool writeHeader();           // Write the header of the verified image
+    bool clearFlag(uint32_t offset, uint32_t value = 0); // Program bits of a header field to 0
+
+    ExtFlashRawPartition _partition;       // Raw partition of the staging area
+    OtaState _state;                       // Current state
+    bool _applyPending;                    // Apply flag of the header is set, attempts left
+    uint8_t _applyAttempts;                // Apply attempts counted in the header
+    uint32_t _size;                        // Size of the image
+    uint32_t _expectedCrc;                 // CRC32 given by the sender, 0 if unknown
+    uint32_t _crc;                         // Running CRC32 of the received bytes
+    uint32_t _received;                    // Bytes taken over by write()
+    uint32_t _written;                     // Bytes programmed to flash
+    uint32_t _erased;                      // Erase frontier, bytes from the start of the partition
+    uint32_t _verified;                    // Bytes read back while verifying
+    uint32_t _verifyCrc;                   // CRC32 of the bytes read back
+    uint8_t _page[PAGE_SIZE_W25Q128_256B]; // Page buffer, programmed when full
+    uint16_t _pageFill;                    // Bytes in the page buffer
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
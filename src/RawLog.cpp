@@ -0,0 +1,377 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class RawLog
+ * @brief Circular append log of CRC framed records on a raw partition.
+ *
+ * The partition is used as a ring of sectors. Every used sector starts with a header holding a sequence number,
+ * the records follow 4 byte aligned: length, inverted length, CRC32 and the payload. A record never crosses a
+ * sector, so an append is one program of header and payload, usually within one page. The sector after the
+ * write head is erased ahead in the background, so wrapping around never waits for an erase. A program waits
+ * for a running erase (tSE, 45 to 400 ms), so loop() starts the pre-erase only after RAWLOG_ERASE_IDLE_MS
+ * without appends, or when the head sector has less than RAWLOG_ERASE_RESERVE bytes left.
+ *
+ * Power loss safety: a torn length (len and ~len don't match) ends the sector and the next append opens a new
+ * one, a torn payload fails the CRC and is skipped when reading. The CRC is seeded with the sequence number of
+ * the sector, so stale records of an earlier round can't be mistaken for current ones.
+ *
+ * At boot the head sector is found by a binary search: starting with sector 0, the sequence numbers of the
+ * sectors increase by one up to the head, the sector after it is erased or older. Only the records of the head
+ * sector are walked to find the first free byte.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "RawLog.h"
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashCrc.h"
+
+/**
+ * @brief Construct a new Raw Log object
+ */
+RawLog::RawLog() : _head(0), _offset(0), _seq(0), _appended(0), _skipped(0), _lastAppend(0), _eraseNext(false)
+{
+}
+
+/**
+ * @brief Attach to a raw partition and find the write head
+ *
+ * @param partition the raw partition, at least 3 sectors
+ * @return true if the log is ready
+ */
+bool RawLog::begin(const ExtFlashRawPartition &partition)
+{
+    _partition = partition;
+    _eraseNext = false;
+    if (!_partition.isReady() || sectors() < 3)
+    {
+        _partition.begin(nullptr, nullptr);
+        return false;
+    }
+
+    uint32_t firstSeq;
+    uint32_t seq;
+    if (readHeader(0, firstSeq))
+    {
+        // Binary search for the last sector of the run that starts in sector 0
+        uint32_t lo = 0;
+        uint32_t hi = sectors() - 1;
+        while (lo < hi)
+        {
+            const uint32_t mid = (lo + hi + 1) / 2;
+            if (inRun(mid, firstSeq))
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid - 1;
+            }
+        }
+        _head = lo;
+        _seq = firstSeq + lo;
+    }
+    else if (readHeader(sectors() - 1, seq))
+    {
+        // Sector 0 is the pre-erased one, the head is the last sector
+        _head = sectors() - 1;
+        _seq = seq;
+    }
+    else
+    {
+        // Empty partition
+        _partition.erase(sectorAddr(0));
+        return openSector(0, 1);
+    }
+    _offset = findEnd(_head);
+
+    // The next sector should be erased already, unless the power failed during its erase
+    const uint32_t next = (_head + 1) % sectors();
+    RawLogSectorHeader header;
+    _partition.read(sectorAddr(next), (uint8_t *)&header, sizeof(header));
+    _eraseNext = header.magic != 0xFFFFFFFF || header.seq != 0xFFFFFFFF || header.seqInv != 0xFFFFFFFF || header.reserved != 0xFFFFFFFF;
+    return true;
+}
+
+/**
+ * @brief Start the pre-erase of the sector after the head, when the log is quiet or the head sector is nearly full
+ */
+void RawLog::loop()
+{
+    if (!_eraseNext || !isReady() || _partition.flash()->isBusy() ||
+        (millis() - _lastAppend < RAWLOG_ERASE_IDLE_MS && _offset + RAWLOG_ERASE_RESERVE < SECTOR_SIZE_W25Q128_4KB))
+    {
+        return;
+    }
+    if (_partition.eraseAsync(sectorAddr((_head + 1) % sectors())))
+    {
+        _eraseNext = false;
+    }
+}
+
+/**
+ * @brief Append one record
+ *
+ * @param data the payload
+ * @param len the length of the payload, 1 to RAWLOG_MAX_RECORD
+ * @return true if the record was written
+ */
+bool RawLog::append(const uint8_t *data, uint16_t len)
+{
+    if (!isReady() || !len || len > RAWLOG_MAX_RECORD)
+    {
+        return false;
+    }
+    if (_offset + RAWLOG_RECORD_HEADER_SIZE + len > SECTOR_SIZE_W25Q128_4KB)
+    {
+        if (!openSector((_head + 1) % sectors(), _seq + 1))
+        {
+            return false;
+        }
+    }
+
+    uint8_t record[RAWLOG_RECORD_HEADER_SIZE + RAWLOG_MAX_RECORD];
+    RawLogRecordHeader header;
+    header.len = len;
+    header.lenInv = ~len;
+    header.crc = extFlashCrc32(data, len, _seq);
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), data, len);
+    if (!_partition.program(sectorAddr(_head) + _offset, record, sizeof(header) + len))
+    {
+        return false;
+    }
+    _offset = align(_offset + sizeof(header) + len);
+    _appended++;
+    _lastAppend = millis();
+    return true;
+}
+
+/**
+ * @brief Erase the whole partition and start over. Blocks for the erase of all sectors
+ *
+ * @return true if the log is ready again
+ */
+bool RawLog::clear()
+{
+    if (!isReady())
+    {
+        return false;
+    }
+    for (uint32_t sector = 0; sector < sectors(); sector++)
+    {
+        _partition.erase(sectorAddr(sector));
+    }
+    _eraseNext = false;
+    return openSector(0, 1);
+}
+
+/**
+ * @brief Set a cursor to the oldest record. After a wrap-around the oldest sector is two sectors after the head
+ *        (the one in between is pre-erased), before the first wrap-around it is sector 0
+ *
+ * @param cursor the cursor
+ * @return true if the log is ready
+ */
+bool RawLog::first(RawLogCursor &cursor)
+{
+    if (!isReady())
+    {
+        return false;
+    }
+    cursor.sector = _head;
+    cursor.seq = _seq;
+    uint32_t seq;
+    for (uint32_t distance = sectors() - 1; distance >= sectors() - 2; distance--)
+    {
+        const uint32_t sector = (_head + sectors() - distance) % sectors();
+        if (_seq > distance && readHeader(sector, seq) && seq == _seq - distance)
+        {
+            cursor.sector = sector;
+            cursor.seq = seq;
+            break;
+        }
+    }
+    if (cursor.sector == _head && _head > 0 && _seq > _head && readHeader(0, seq) && seq == _seq - _head)
+    {
+        cursor.sector = 0;
+        cursor.seq = seq;
+    }
+    cursor.offset = RAWLOG_SECTOR_HEADER_SIZE;
+    return true;
+}
+
+/**
+ * @brief Read the record at the cursor and advance it. Records with a broken CRC are skipped
+ *
+ * @param cursor the cursor, set by first()
+ * @param buffer the buffer for the payload, RAWLOG_MAX_RECORD bytes hold every record
+ * @param size the size of the buffer, larger records are skipped
+ * @param len the length of the payload
+ * @return true if a record was read, false at the end of the log
+ */
+bool RawLog::next(RawLogCursor &cursor, uint8_t *buffer, uint16_t size, uint16_t &len)
+{
+    while (isReady())
+    {
+        if (cursor.seq == _seq && cursor.offset >= _offset)
+        {
+            return false; // Reached the head
+        }
+
+        RawLogRecordHeader header;
+        bool endOfSector = cursor.offset + sizeof(header) > SECTOR_SIZE_W25Q128_4KB;
+        if (!endOfSector)
+        {
+            _partition.read(sectorAddr(cursor.sector) + cursor.offset, (uint8_t *)&header, sizeof(header));
+            endOfSector = (uint16_t)(header.len ^ header.lenInv) != 0xFFFF || header.len > RAWLOG_MAX_RECORD ||
+                          cursor.offset + sizeof(header) + header.len > SECTOR_SIZE_W25Q128_4KB;
+        }
+        if (endOfSector)
+        {
+            // Continue in the next sector, if it continues the sequence
+            const uint32_t sector = (cursor.sector + 1) % sectors();
+            uint32_t seq;
+            if (cursor.seq == _seq || !readHeader(sector, seq) || seq != cursor.seq + 1)
+            {
+                return false;
+            }
+            cursor.sector = sector;
+            cursor.seq = seq;
+            cursor.offset = RAWLOG_SECTOR_HEADER_SIZE;
+            continue;
+        }
+
+        const uint32_t addr = sectorAddr(cursor.sector) + cursor.offset + sizeof(header);
+        cursor.offset = align(cursor.offset + sizeof(header) + header.len);
+        if (header.len > size)
+        {
+            _skipped++;
+            continue;
+        }
+        _partition.read(addr, buffer, header.len);
+        if (extFlashCrc32(buffer, header.len, cursor.seq) != header.crc)
+        {
+            _skipped++; // Torn by a power loss
+            continue;
+        }
+        len = header.len;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Stream all records through the callback, oldest first
+ *
+ * @param callback the callback, return false to stop
+ * @return the number of records passed to the callback
+ */
+uint32_t RawLog::forEach(Callback callback)
+{
+    RawLogCursor cursor;
+    if (!callback || !first(cursor))
+    {
+        return 0;
+    }
+    uint8_t buffer[RAWLOG_MAX_RECORD];
+    uint16_t len;
+    uint32_t count = 0;
+    while (next(cursor, buffer, sizeof(buffer), len))
+    {
+        count++;
+        if (!callback(buffer, len))
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Read and validate the header of a sector
+ *
+ * @param sector the sector in the partition
+ * @param seq the sequence number of the sector
+ * @return true if the sector is in use
+ */
+bool RawLog::readHeader(uint32_t sector, uint32_t &seq)
+{
+    RawLogSectorHeader header;
+    _partition.read(sectorAddr(sector), (uint8_t *)&header, sizeof(header));
+    seq = header.seq;
+    return header.magic == RAWLOG_MAGIC && header.seq == ~header.seqInv;
+}
+
+/**
+ * @brief Check if a sector belongs to the run of sequence numbers that starts in sector 0
+ *
+ * @param sector the sector in the partition
+ * @param firstSeq the sequence number of sector 0
+ * @return true if the sector continues the run
+ */
+bool RawLog::inRun(uint32_t sector, uint32_t firstSeq)
+{
+    uint32_t seq;
+    return readHeader(sector, seq) && seq == firstSeq + sector;
+}
+
+/**
+ * @brief Make a sector the new head, loop() pre-erases the sector after it
+ *
+ * @param sector the sector in the partition, should be pre-erased
+ * @param seq the sequence number
+ * @return true if the header was written
+ */
+bool RawLog::openSector(uint32_t sector, uint32_t seq)
+{
+    // The pre-erase may not have started, or a power loss left it unfinished
+    RawLogSectorHeader header;
+    _partition.read(sectorAddr(sector), (uint8_t *)&header, sizeof(header));
+    if (_eraseNext || header.magic != 0xFFFFFFFF || header.seq != 0xFFFFFFFF)
+    {
+        _partition.erase(sectorAddr(sector));
+    }
+
+    header.magic = RAWLOG_MAGIC;
+    header.seq = seq;
+    header.seqInv = ~seq;
+    header.reserved = 0xFFFFFFFF;
+    if (!_partition.program(sectorAddr(sector), (const uint8_t *)&header, sizeof(header)))
+    {
+        return false;
+    }
+    _head = sector;
+    _seq = seq;
+    _offset = RAWLOG_SECTOR_HEADER_SIZE;
+    _eraseNext = true; // Started by loop(), not now: the next append would wait for it
+    return true;
+}
+
+/**
+ * @brief Walk the record chain of a sector up to the first free byte
+ *
+ * @param sector the sector in the partition
+ * @return the offset of the first free byte, SECTOR_SIZE_W25Q128_4KB if the sector is full or torn
+ */
+uint32_t RawLog::findEnd(uint32_t sector)
+{
+    uint32_t offset = RAWLOG_SECTOR_HEADER_SIZE;
+    while (offset + RAWLOG_RECORD_HEADER_SIZE <= SECTOR_SIZE_W25Q128_4KB)
+    {
+        RawLogRecordHeader header;
+        _partition.read(sectorAddr(sector) + offset, (uint8_t *)&header, sizeof(header));
+        if (header.len == 0xFFFF && header.lenInv == 0xFFFF)
+        {
+            return offset; // Erased
+        }
+        if ((uint16_t)(header.len ^ header.lenInv) != 0xFFFF || offset + sizeof(header) + header.len > SECTOR_SIZE_W25Q128_4KB)
+        {
+            return SECTOR_SIZE_W25Q128_4KB; // Torn length, don't write behind it
+        }
+        offset = align(offset + sizeof(header) + header.len);
+    }
+    return SECTOR_SIZE_W25Q128_4KB;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
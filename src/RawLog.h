@@ -0,0 +1,103 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        RawLog.h
+ * @brief       Circular append log of CRC framed records on a raw partition, without LittleFS.
+ *              One page program per append, head found at boot by binary search
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "ExtFlashPartitions.h"
+#include <functional>
+
+#define RAWLOG_MAGIC 0x474F4C52         // "RLOG" marks a used sector
+#define RAWLOG_SECTOR_HEADER_SIZE 16    // Sector header, the records follow
+#define RAWLOG_RECORD_HEADER_SIZE 8     // Record header in front of the payload
+#define RAWLOG_ALIGN 4                  // Records start 4 byte aligned
+
+#ifndef RAWLOG_MAX_RECORD
+    #define RAWLOG_MAX_RECORD 256 // Max payload of a record, also the stack buffer of append() and forEach()
+#endif
+
+#ifndef RAWLOG_ERASE_IDLE_MS
+    #define RAWLOG_ERASE_IDLE_MS 100 // The pre-erase starts after this quiet time without appends
+#endif
+#ifndef RAWLOG_ERASE_RESERVE
+    #define RAWLOG_ERASE_RESERVE 1024 // Or when the head sector has only this many bytes left
+#endif
+
+// Header at the start of each used sector
+struct __attribute__((packed)) RawLogSectorHeader
+{
+    uint32_t magic;  // RAWLOG_MAGIC
+    uint32_t seq;    // Sequence number, increments with every sector
+    uint32_t seqInv; // ~seq, detects a torn header
+    uint32_t reserved;
+};
+
+// Header in front of each record. A torn length ends the sector, a torn payload fails the CRC and is skipped
+struct __attribute__((packed)) RawLogRecordHeader
+{
+    uint16_t len;    // Payload length
+    uint16_t lenInv; // ~len
+    uint32_t crc;    // CRC32 over the payload, seeded with the sector sequence number
+};
+
+// Read position in the log
+struct RawLogCursor
+{
+    uint32_t sector; // Sector in the partition
+    uint32_t seq;    // Sequence number of the sector
+    uint32_t offset; // Offset of the next record in the sector
+};
+
+class RawLog
+{
+  public:
+    using Callback = std::function<bool(const uint8_t *data, uint16_t len)>; // Return false to stop
+
+    RawLog();
+
+    bool begin(const ExtFlashRawPartition &partition);   // Find head and tail, O(log n) sector reads
+    bool append(const uint8_t *data, uint16_t len);       // Append one record, one page program in the common case
+    bool clear();                                         // Erase the partition (blocking)
+    void loop();                                          // Start the pending pre-erase of the next sector
+
+    bool first(RawLogCursor &cursor);                                             // Cursor to the oldest record
+    bool next(RawLogCursor &cursor, uint8_t *buffer, uint16_t size, uint16_t &len); // Read the record at the cursor and advance
+    uint32_t forEach(Callback callback);                                          // Stream all records, oldest first
+
+    inline bool isReady() const { return _partition.isReady(); } // Partition attached and head found
+    inline uint32_t sequence() const { return _seq; }           // Sequence number of the head sector
+    inline uint32_t headSector() const { return _head; }        // Sector of the write head
+    inline uint32_t headOffset() const { return _offset; }      // Next free byte in the head sector
+    inline uint32_t appended() const { return _appended; }      // Records appended since boot
+    inline uint32_t skipped() const { return _skipped; }        // Torn records skipped by next()
+    inline bool erasePending() const { return _eraseNext; }     // The next sector is not pre-erased yet
+    inline uint32_t size() const { return _partition.size(); }  // Size of the partition
+
+  private:
+    inline uint32_t sectors() const { return _partition.size() / SECTOR_SIZE_W25Q128_4KB; }
+    inline uint32_t sectorAddr(uint32_t sector) const { return sector * SECTOR_SIZE_W25Q128_4KB; }
+    inline static uint32_t align(uint32_t value) { return (value + RAWLOG_ALIGN - 1) & ~(uint32_t)(RAWLOG_ALIGN - 1); }
+    bool readHeader(uint32_t sector, uint32_t &seq);          // Read and validate a sector header
+    bool inRun(uint32_t sector, uint32_t firstSeq);           // Sector continues the sequence that starts in sector 0
+    bool openSector(uint32_t sector, uint32_t seq);           // Write the header of an erased sector and pre-erase the next one
+    uint32_t findEnd(uint32_t sector);                        // Walk the record chain of a sector to the first free byte
+
+    ExtFlashRawPartition _partition; // Raw partition of the log
+    uint32_t _head;                  // Sector of the write head
+    uint32_t _offset;                // Next free byte in the head sector
+    uint32_t _seq;                   // Sequence number of the head sector
+    uint32_t _appended;              // Records appended since boot
+    uint32_t _skipped;               // Torn records skipped by next()
+    uint32_t _lastAppend;            // millis() of the last append
+    bool _eraseNext;                 // The sector after the head still has to be pre-erased
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
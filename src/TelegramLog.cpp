@@ -0,0 +1,532 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class TelegramLog
+ * @brief Append only telegram log, split into fixed size segment files on the external LittleFS.
+ *
+ * Every segment holds up to TLG_SEGMENT_RECORDS fixed size records. When a segment is full a footer
+ * with the min/max timestamp and a group address bitmap is appended ("sealed"). Queries read only the
+ * footers to find the segments that can contain matching records, and stream the matches through a
+ * callback. Segments are written in chronological order, so the first relevant segment is found by a
+ * binary search over the footers and the scan stops at the first segment that starts after the range.
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "TelegramLog.h"
+#if defined(ARDUINO_ARCH_RP2040)
+
+/**
+ * @brief Construct a new Telegram Log object
+ */
+TelegramLog::TelegramLog() : _fs(nullptr), _firstSeq(0), _nextSeq(0), _lastFlush(0), _skipped(0), _scanned(0), _dirty(false)
+{
+    resetSummary();
+}
+
+/**
+ * @brief Scan the segment directory, find the oldest and the newest segment and reopen the active one
+ *
+ * @param fs the filesystem that holds the segments
+ * @return true if the active segment could be opened
+ */
+bool TelegramLog::begin(FS *fs)
+{
+    _fs = fs;
+    if (!_fs)
+    {
+        return false;
+    }
+    _fs->mkdir(TLG_DIR);
+
+    bool found = false;
+    uint32_t minSeq = 0, maxSeq = 0;
+    Dir dir = _fs->openDir(TLG_DIR);
+    while (dir.next())
+    {
+        String name = dir.fileName(); // "sXXXXXXXX.seg"
+        if (name.length() != 13 || name[0] != 's')
+        {
+            continue;
+        }
+        const uint32_t seq = strtoul(name.substring(1, 9).c_str(), nullptr, 16);
+        if (!found || seq < minSeq) minSeq = seq;
+        if (!found || seq > maxSeq) maxSeq = seq;
+        found = true;
+    }
+
+    _firstSeq = found ? minSeq : 0;
+    _nextSeq = maxSeq;
+    TelegramSegmentFooter footer;
+    if (found && readFooter(maxSeq, footer))
+    {
+        _nextSeq = maxSeq + 1; // Newest segment is already sealed, start a new one
+    }
+    return openActive();
+}
+
+/**
+ * @brief Flush and close the active segment
+ */
+void TelegramLog::end()
+{
+    if (_active)
+    {
+        _active.close();
+    }
+    _dirty = false;
+}
+
+/**
+ * @brief Flush the active segment periodically, so a power loss costs at most TLG_FLUSH_INTERVAL_MS of telegrams
+ */
+void TelegramLog::loop()
+{
+    if (_dirty && _active && (millis() - _lastFlush >= TLG_FLUSH_INTERVAL_MS))
+    {
+        _active.flush();
+        _dirty = false;
+        _lastFlush = millis();
+    }
+}
+
+/**
+ * @brief Append a telegram to the active segment. Seals the segment if it is full
+ *
+ * @param ga the group address
+ * @param data the payload
+ * @param len the length of the payload
+ * @param time the timestamp
+ * @param valueType the value type hint (TLG_VALUE_*) for the rollups
+ * @return true if the record was written
+ */
+bool TelegramLog::append(uint16_t ga, const uint8_t *data, uint8_t len, uint32_t time, uint8_t valueType)
+{
+    if (!_active && !openActive())
+    {
+        return false;
+    }
+
+    TelegramRecord record;
+    memset(&record, 0, sizeof(record));
+    record.time = time;
+    record.ga = ga;
+    record.flags = valueType & TLG_VALUE_MASK;
+    record.len = min<uint8_t>(len, sizeof(record.data));
+    if (data && record.len)
+    {
+        memcpy(record.data, data, record.len);
+    }
+
+    if (_active.write((const uint8_t *)&record, sizeof(record)) != sizeof(record))
+    {
+        return false;
+    }
+    addToSummary(record);
+    _dirty = true;
+
+    if (_summary.count >= TLG_SEGMENT_RECORDS)
+    {
+        return sealActive();
+    }
+    return true;
+}
+
+/**
+ * @brief Query the log for a group address in a time range. The matches are streamed through the callback
+ *        and never collected in RAM
+ *
+ * @param ga the group address or TLG_ANY_GA
+ * @param from the start of the time range (inclusive)
+ * @param to the end of the time range (inclusive)
+ * @param cb the callback, return false to stop the query
+ * @return the number of records passed to the callback
+ */
+uint32_t TelegramLog::query(int32_t ga, uint32_t from, uint32_t to, Callback cb)
+{
+    _skipped = 0;
+    _scanned = 0;
+    if (!_fs || !cb || from > to)
+    {
+        return 0;
+    }
+
+    // Binary search for the first sealed segment that ends at or after 'from'
+    TelegramSegmentFooter footer;
+    uint32_t lo = _firstSeq;
+    uint32_t hi = _nextSeq;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (!readFooter(mid, footer))
+        {
+            lo = _firstSeq; // Hole in the sequence. Fall back to a linear scan over the footers
+            break;
+        }
+        if (footer.maxTime < from)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    uint32_t matches = 0;
+    bool stop = false;
+    for (uint32_t seq = lo; seq < _nextSeq && !stop; seq++)
+    {
+        if (!readFooter(seq, footer))
+        {
+            continue;
+        }
+        if (footer.minTime > to)
+        {
+            break; // Chronological order, nothing newer can match
+        }
+        if (!footerMatches(footer, ga, from, to))
+        {
+            _skipped++;
+            continue;
+        }
+        File file = _fs->open(segmentPath(seq).c_str(), "r");
+        if (file)
+        {
+            _scanned++;
+            matches += scanSegment(file, footer.count, ga, from, to, cb, stop);
+            file.close();
+        }
+    }
+
+    // The active segment is summarized in RAM
+    if (!stop && _summary.count)
+    {
+        if (footerMatches(_summary, ga, from, to))
+        {
+            if (_dirty)
+            {
+                _active.flush();
+                _dirty = false;
+            }
+            File file = _fs->open(segmentPath(_nextSeq).c_str(), "r");
+            if (file)
+            {
+                _scanned++;
+                matches += scanSegment(file, _summary.count, ga, from, to, cb, stop);
+                file.close();
+            }
+        }
+        else
+        {
+            _skipped++;
+        }
+    }
+    return matches;
+}
+
+/**
+ * @brief Read and validate the footer of a sealed segment
+ *
+ * @param seq the sequence number of the segment
+ * @param footer the footer to fill
+ * @return true if the segment exists and is sealed
+ */
+bool TelegramLog::readFooter(uint32_t seq, TelegramSegmentFooter &footer)
+{
+    if (!_fs)
+    {
+        return false;
+    }
+    File file = _fs->open(segmentPath(seq).c_str(), "r");
+    if (!file)
+    {
+        return false;
+    }
+    const size_t size = file.size();
+    bool valid = false;
+    if (size >= sizeof(footer) && file.seek(size - sizeof(footer), SeekSet) &&
+        file.read((uint8_t *)&footer, sizeof(footer)) == sizeof(footer))
+    {
+        valid = footer.magic == TLG_FOOTER_MAGIC && footer.version == TLG_FOOTER_VERSION &&
+                size == footer.count * sizeof(TelegramRecord) + sizeof(footer) &&
+                footer.crc == extFlashCrc32(&footer, offsetof(TelegramSegmentFooter, crc));
+    }
+    file.close();
+    return valid;
+}
+
+/**
+ * @brief Remove the oldest sealed segment. A segment that is already gone is skipped
+ *
+ * @param seq the sequence number of the segment, must be the oldest one
+ * @return true if the segment was removed
+ */
+bool TelegramLog::removeSegment(uint32_t seq)
+{
+    if (!_fs || seq != _firstSeq || seq >= _nextSeq)
+    {
+        return false;
+    }
+    const String path = segmentPath(seq);
+    if (_fs->exists(path.c_str()) && !_fs->remove(path.c_str()))
+    {
+        return false;
+    }
+    _firstSeq++;
+    return true;
+}
+
+/**
+ * @brief Decode the numeric value of a record, using the value type hint
+ *
+ * @param record the record
+ * @param value the decoded value
+ * @return true if the record holds a numeric value
+ */
+bool TelegramLog::decodeValue(const TelegramRecord &record, float &value)
+{
+    uint8_t type = record.flags & TLG_VALUE_MASK;
+    if (type == TLG_VALUE_AUTO)
+    {
+        type = (record.len == 2) ? TLG_VALUE_FLOAT16 : (record.len == 4) ? TLG_VALUE_FLOAT32 : (record.len == 1) ? TLG_VALUE_UNSIGNED : TLG_VALUE_NONE;
+    }
+    if (!record.len || record.len > 4)
+    {
+        return false;
+    }
+
+    uint32_t raw = 0;
+    for (uint8_t i = 0; i < record.len; i++)
+    {
+        raw = (raw << 8) | record.data[i]; // KNX is big endian
+    }
+
+    switch (type)
+    {
+        case TLG_VALUE_UNSIGNED:
+            value = (float)raw;
+            return true;
+        case TLG_VALUE_SIGNED:
+        {
+            const uint8_t shift = 32 - record.len * 8;
+            value = (float)((int32_t)(raw << shift) >> shift); // Sign extend
+            return true;
+        }
+        case TLG_VALUE_FLOAT16:
+        {
+            if (record.len != 2 || raw == 0x7FFF) // 0x7FFF is "invalid data"
+            {
+                return false;
+            }
+            int32_t mantissa = raw & 0x07FF;
+            if (raw & 0x8000)
+            {
+                mantissa -= 2048; // 12 bit two's complement
+            }
+            value = 0.01f * mantissa * (float)(1 << ((raw >> 11) & 0x0F));
+            return true;
+        }
+        case TLG_VALUE_FLOAT32:
+        {
+            if (record.len != 4)
+            {
+                return false;
+            }
+            memcpy(&value, &raw, sizeof(value));
+            return value == value; // Skip NaN
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Get the path of a segment file
+ *
+ * @param seq the sequence number
+ * @return String "/tlg/sXXXXXXXX.seg"
+ */
+String TelegramLog::segmentPath(uint32_t seq)
+{
+    char path[24];
+    snprintf(path, sizeof(path), TLG_DIR "/s%08lx.seg", (unsigned long)seq);
+    return String(path);
+}
+
+/**
+ * @brief Parse a group address in three level notation
+ *
+ * @param str "main/middle/sub" or "*" for all group addresses
+ * @param ga the packed group address, TLG_ANY_GA for "*"
+ * @return true if the whole string is a group address or "*"
+ */
+bool TelegramLog::parseGa(const char *str, int32_t &ga)
+{
+    if (str && strcmp(str, "*") == 0)
+    {
+        ga = TLG_ANY_GA;
+        return true;
+    }
+    unsigned main = 0, middle = 0, sub = 0;
+    int end = 0;
+    if (!str || !isdigit(str[0]) || sscanf(str, "%u/%u/%u%n", &main, &middle, &sub, &end) != 3 || str[end] != 0 || main > 31 ||
+        middle > 7 || sub > 255)
+    {
+        return false;
+    }
+    ga = (int32_t)((main << 11) | (middle << 8) | sub);
+    return true;
+}
+
+/**
+ * @brief Format a group address in three level notation
+ *
+ * @param ga the packed group address
+ * @return String "main/middle/sub"
+ */
+String TelegramLog::gaToString(uint16_t ga)
+{
+    char str[12];
+    snprintf(str, sizeof(str), "%u/%u/%u", (ga >> 11) & 0x1F, (ga >> 8) & 0x07, ga & 0xFF);
+    return String(str);
+}
+
+/**
+ * @brief Check if a segment can contain matches, using only its footer
+ */
+bool TelegramLog::footerMatches(const TelegramSegmentFooter &footer, int32_t ga, uint32_t from, uint32_t to)
+{
+    if (!footer.count || footer.maxTime < from || footer.minTime > to)
+    {
+        return false;
+    }
+    if (ga == TLG_ANY_GA)
+    {
+        return true;
+    }
+    const uint8_t bit = gaBit(ga);
+    return footer.gaBitmap[bit >> 3] & (1 << (bit & 7));
+}
+
+/**
+ * @brief Open the active segment in append mode. Rebuilds the RAM summary if the segment already has records
+ *
+ * @return true if the segment is open
+ */
+bool TelegramLog::openActive()
+{
+    if (!_fs)
+    {
+        return false;
+    }
+    resetSummary();
+    const String path = segmentPath(_nextSeq);
+
+    File file = _fs->open(path.c_str(), "r");
+    if (file)
+    {
+        // Unsealed segment from the last run. Drop a torn record at the end and rebuild the summary
+        const size_t size = file.size();
+        const size_t count = size / sizeof(TelegramRecord);
+        TelegramRecord record;
+        for (size_t i = 0; i < count && file.read((uint8_t *)&record, sizeof(record)) == sizeof(record); i++)
+        {
+            addToSummary(record);
+        }
+        file.close();
+        if (size % sizeof(TelegramRecord))
+        {
+            file = _fs->open(path.c_str(), "r+");
+            if (file)
+            {
+                file.truncate(count * sizeof(TelegramRecord));
+                file.close();
+            }
+        }
+    }
+
+    _active = _fs->open(path.c_str(), "a");
+    _lastFlush = millis();
+    _dirty = false;
+    return (bool)_active;
+}
+
+/**
+ * @brief Seal the active segment with its footer and open the next one
+ *
+ * @return true if the next segment is open
+ */
+bool TelegramLog::sealActive()
+{
+    _summary.crc = extFlashCrc32(&_summary, offsetof(TelegramSegmentFooter, crc));
+    const bool sealed = _active.write((const uint8_t *)&_summary, sizeof(_summary)) == sizeof(_summary);
+    _active.close();
+    if (!sealed)
+    {
+        return false;
+    }
+    _nextSeq++;
+    return openActive();
+}
+
+/**
+ * @brief Clear the RAM summary of the active segment
+ */
+void TelegramLog::resetSummary()
+{
+    memset(&_summary, 0, sizeof(_summary));
+    _summary.magic = TLG_FOOTER_MAGIC;
+    _summary.version = TLG_FOOTER_VERSION;
+}
+
+/**
+ * @brief Add a record to the RAM summary of the active segment
+ */
+void TelegramLog::addToSummary(const TelegramRecord &record)
+{
+    if (!_summary.count || record.time < _summary.minTime)
+    {
+        _summary.minTime = record.time;
+    }
+    if (!_summary.count || record.time > _summary.maxTime)
+    {
+        _summary.maxTime = record.time;
+    }
+    const uint8_t bit = gaBit(record.ga);
+    _summary.gaBitmap[bit >> 3] |= (1 << (bit & 7));
+    _summary.count++;
+}
+
+/**
+ * @brief Scan the records of one segment in chunks and pass the matches to the callback
+ *
+ * @return the number of matches
+ */
+uint32_t TelegramLog::scanSegment(File &file, uint32_t count, int32_t ga, uint32_t from, uint32_t to, Callback &cb, bool &stop)
+{
+    TelegramRecord chunk[TLG_READ_CHUNK];
+    uint32_t matches = 0;
+    uint32_t done = 0;
+    while (done < count && !stop)
+    {
+        const uint32_t n = min<uint32_t>(TLG_READ_CHUNK, count - done);
+        if (file.read((uint8_t *)chunk, n * sizeof(TelegramRecord)) != (int)(n * sizeof(TelegramRecord)))
+        {
+            break;
+        }
+        for (uint32_t i = 0; i < n && !stop; i++)
+        {
+            const TelegramRecord &record = chunk[i];
+            if ((ga == TLG_ANY_GA || record.ga == ga) && record.time >= from && record.time <= to)
+            {
+                matches++;
+                stop = !cb(record);
+            }
+        }
+        done += n;
+    }
+    return matches;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,105 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        TelegramLog.h
+ * @brief       Segmented telegram log on the external LittleFS with a footer based
+ *              query engine (group address and time range)
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+#include "ExtFlashCrc.h"
+
+#define TLG_DIR "/tlg"                 // Directory for the telegram log segments
+#define TLG_SEGMENT_RECORDS 512        // Records per segment, 512 * 24 Bytes = 12KB (3 sectors)
+#define TLG_FOOTER_MAGIC 0x46474C54    // "TLGF" marks a sealed segment
+#define TLG_FOOTER_VERSION 1           // Version of the segment footer layout
+#define TLG_GA_BITMAP_BYTES 32         // 256 bit group address summary per segment
+#define TLG_READ_CHUNK 16              // Number of records read at once while scanning a segment
+#define TLG_ANY_GA -1                  // Wildcard group address for queries, outside of the 16 bit addresses
+#define TLG_FLUSH_INTERVAL_MS 5000     // Flush the active segment at least every 5s
+
+// Value type hint stored in TelegramRecord::flags, used to decode numeric values for the rollups
+#define TLG_VALUE_AUTO 0     // Guess by length: 1 = unsigned, 2 = DPT9 float, 4 = DPT14 float
+#define TLG_VALUE_UNSIGNED 1 // Big endian unsigned integer (DPT5, DPT7, DPT12)
+#define TLG_VALUE_SIGNED 2   // Big endian signed integer (DPT6, DPT8, DPT13)
+#define TLG_VALUE_FLOAT16 3  // KNX 2 byte float (DPT9)
+#define TLG_VALUE_FLOAT32 4  // IEEE 754 float (DPT14)
+#define TLG_VALUE_NONE 0x0F  // Not numeric, ignored by the rollups
+#define TLG_VALUE_MASK 0x0F  // Mask of the value type in TelegramRecord::flags
+
+// A single logged telegram. Fixed size, so a segment can be addressed by record index
+struct __attribute__((packed)) TelegramRecord
+{
+    uint32_t time;     // Timestamp (seconds, local time)
+    uint16_t ga;       // Group address (main/middle/sub packed 5/3/8)
+    uint8_t len;       // Number of valid bytes in data
+    uint8_t flags;     // Value type hint (TLG_VALUE_*), upper bits reserved
+    uint8_t data[16];  // Payload, longer telegrams are truncated
+};
+
+// Summary written at the end of a sealed segment. Used to skip segments without reading records
+struct __attribute__((packed)) TelegramSegmentFooter
+{
+    uint32_t magic;                           // TLG_FOOTER_MAGIC
+    uint16_t version;                         // TLG_FOOTER_VERSION
+    uint16_t count;                           // Number of records in the segment
+    uint32_t minTime;                         // Oldest timestamp in the segment
+    uint32_t maxTime;                         // Newest timestamp in the segment
+    uint8_t gaBitmap[TLG_GA_BITMAP_BYTES];    // Bloom style bitmap of the contained group addresses
+    uint32_t crc;                             // CRC32 over the footer without this field
+};
+
+class TelegramLog
+{
+  public:
+    using Callback = std::function<bool(const TelegramRecord &record)>; // Return false to stop the query
+
+    TelegramLog();
+
+    bool begin(FS *fs);                                                     // Scan the segment directory and reopen the active segment
+    void end();                                                             // Seal nothing, just flush and close the active segment
+    void loop();                                                            // Periodic flush of the active segment
+    bool append(uint16_t ga, const uint8_t *data, uint8_t len, uint32_t time, uint8_t valueType = TLG_VALUE_AUTO); // Append a telegram to the active segment
+    uint32_t query(int32_t ga, uint32_t from, uint32_t to, Callback cb);   // Stream matching records through cb, returns the number of matches
+
+    inline uint32_t firstSegment() const { return _firstSeq; }    // Oldest segment on flash
+    inline uint32_t nextSegment() const { return _nextSeq; }      // Sequence number of the active segment
+    inline uint32_t segmentsSkipped() const { return _skipped; }  // Segments skipped by the last query
+    inline uint32_t segmentsScanned() const { return _scanned; }  // Segments scanned by the last query
+
+    bool readFooter(uint32_t seq, TelegramSegmentFooter &footer); // Read the footer of a sealed segment
+    bool removeSegment(uint32_t seq);                              // Remove a sealed segment (only the oldest one)
+    static bool decodeValue(const TelegramRecord &record, float &value); // Decode the numeric value of a record
+    static String segmentPath(uint32_t seq);                       // Path of a segment file
+    static bool parseGa(const char *str, int32_t &ga);             // Parse "1/2/3" or "*" (TLG_ANY_GA), false if malformed
+    static String gaToString(uint16_t ga);                         // Format a group address as "1/2/3"
+
+  private:
+    static inline uint8_t gaBit(uint16_t ga) { return (uint8_t)((ga * 0x9E37u) >> 8); } // Hash of a group address into the bitmap
+    static bool footerMatches(const TelegramSegmentFooter &footer, int32_t ga, uint32_t from, uint32_t to);
+    bool openActive();                                                // Open (or create) the active segment
+    bool sealActive();                                                // Write the footer and start a new segment
+    void resetSummary();                                              // Clear the RAM summary of the active segment
+    void addToSummary(const TelegramRecord &record);                  // Add a record to the RAM summary
+    uint32_t scanSegment(File &file, uint32_t count, int32_t ga, uint32_t from, uint32_t to, Callback &cb, bool &stop);
+
+    FS *_fs;                              // Filesystem that holds the segments
+    File _active;                         // Active (unsealed) segment
+    TelegramSegmentFooter _summary;       // RAM summary of the active segment
+    uint32_t _firstSeq;                   // Oldest sealed segment
+    uint32_t _nextSeq;                    // Sequence number of the active segment
+    uint32_t _lastFlush;                  // millis() of the last flush
+    uint32_t _skipped;                    // Statistics of the last query
+    uint32_t _scanned;                    // Statistics of the last query
+    bool _dirty;                          // Unflushed records in the active segment
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
@@ -0,0 +1,552 @@
+#ifdef EXTERNAL_FLASH_MODULE
+/**
+ * @class TelegramRollup
+ * @brief Background job that downsamples old raw telegram segments into min/max/avg buckets.
+ *
+ * The oldest sealed segment of the TelegramLog is rolled up once it is older than TLR_RAW_RETENTION_S,
+ * or earlier if the filesystem is filled above TLR_FILL_THRESHOLD_PERCENT. Each loop() call aggregates
+ * one chunk of records into RAM tables for the minute, hour and day level. When the segment is done, the
+ * open buckets are appended to one file per group address and level, TLR_COMMIT_PER_LOOP per loop() call,
+ * then the raw segment is deleted.
+ *
+ * A bucket that spans two segments is written twice with the same start time, query() merges them.
+ * Before a rollup file is appended for the first time, its size is written to a journal. If the device
+ * reboots before the raw segment is deleted, begin() truncates the touched files and the segment is
+ * rolled up again, so no value is counted twice.
+ *
+ * A bucket whose file or journal entry can't be written stays in its table and commitSegment() tries again with
+ * the next loop() call, up to TLR_FLUSH_RETRIES times. Then, or when a full table has to evict it, the bucket is
+ * dropped and counted in bucketsLost().
+ *
+ * @copyright Copyright (c) 2024 Erkan Çolak - (Licensed under GNU GPL v3.0)
+ */
+
+#include "TelegramRollup.h"
+#if defined(ARDUINO_ARCH_RP2040)
+
+/**
+ * @brief Construct a new Telegram Rollup object
+ */
+TelegramRollup::TelegramRollup() : _fs(nullptr), _log(nullptr), _state(Idle), _seq(0), _remaining(0), _lastCheck(0), _consumed(0), _lost(0), _flushFailures(0), _commitLevel(0), _compactCount(0), _touchedCount(0)
+{
+    memset(_used, 0, sizeof(_used));
+}
+
+/**
+ * @brief Prepare the rollup directory and roll back an interrupted aggregation
+ *
+ * @param fs the filesystem
+ * @param log the raw telegram log
+ * @return true if ready
+ */
+bool TelegramRollup::begin(FS *fs, TelegramLog *log)
+{
+    _fs = fs;
+    _log = log;
+    if (!_fs || !_log)
+    {
+        return false;
+    }
+    _fs->mkdir(TLR_DIR);
+    recover();
+    _state = Idle;
+    _lastCheck = millis();
+    return true;
+}
+
+/**
+ * @brief Run one step of the background job. While idle the job checks for due segments once per
+ *        TLR_IDLE_INTERVAL_MS, while busy every call processes one chunk
+ *
+ * @param now the current time
+ */
+void TelegramRollup::loop(uint32_t now)
+{
+    if (!_fs || !_log)
+    {
+        return;
+    }
+    switch (_state)
+    {
+        case Idle:
+            if (millis() - _lastCheck >= TLR_IDLE_INTERVAL_MS)
+            {
+                _lastCheck = millis();
+                startSegment(now);
+            }
+            break;
+        case Aggregate:
+            aggregateChunk();
+            break;
+        case Commit:
+            commitSegment();
+            break;
+        case Compact:
+            compactOne();
+            break;
+    }
+}
+
+/**
+ * @brief Stream the buckets of one group address and level in a time range through the callback.
+ *        Buckets split over two segments are merged before they are passed on
+ *
+ * @param level the level
+ * @param ga the group address
+ * @param from the start of the time range
+ * @param to the end of the time range
+ * @param cb the callback, return false to stop
+ * @return the number of buckets passed to the callback
+ */
+uint32_t TelegramRollup::query(TelegramRollupLevel level, uint16_t ga, uint32_t from, uint32_t to, Callback cb)
+{
+    if (!_fs || !cb || from > to || level >= TLR_LEVELS)
+    {
+        return 0;
+    }
+    File file = _fs->open(rollupPath(ga, level).c_str(), "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    // The file is sorted by start time, binary search for the first bucket that overlaps 'from'
+    const uint32_t first = from - (from % period(level));
+    const uint32_t count = file.size() / sizeof(RollupRecord);
+    RollupRecord record;
+    uint32_t lo = 0, hi = count;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (!file.seek(mid * sizeof(RollupRecord), SeekSet) || file.read((uint8_t *)&record, sizeof(record)) != sizeof(record))
+        {
+            file.close();
+            return 0;
+        }
+        if (record.start < first)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    uint32_t matches = 0;
+    bool pending = false;
+    RollupRecord merged;
+    file.seek(lo * sizeof(RollupRecord), SeekSet);
+    for (uint32_t i = lo; i < count; i++)
+    {
+        if (file.read((uint8_t *)&record, sizeof(record)) != sizeof(record) || record.start > to)
+        {
+            break;
+        }
+        if (pending && record.start == merged.start)
+        {
+            merged.count += record.count;
+            merged.min = min(merged.min, record.min);
+            merged.max = max(merged.max, record.max);
+            merged.sum += record.sum;
+            continue;
+        }
+        if (pending)
+        {
+            matches++;
+            if (!cb(merged))
+            {
+                pending = false;
+                break;
+            }
+        }
+        merged = record;
+        pending = true;
+    }
+    if (pending)
+    {
+        matches++;
+        cb(merged);
+    }
+    file.close();
+    return matches;
+}
+
+/**
+ * @brief Get the bucket length of a level
+ *
+ * @param level the level
+ * @return the bucket length in seconds
+ */
+uint32_t TelegramRollup::period(TelegramRollupLevel level)
+{
+    switch (level)
+    {
+        case TLR_MINUTE: return 60;
+        case TLR_HOUR: return 3600;
+        default: return 86400;
+    }
+}
+
+/**
+ * @brief Get the path of a rollup file
+ *
+ * @param ga the group address
+ * @param level the level
+ * @return String "/tlg/r/XXXX.m", ".h" or ".d"
+ */
+String TelegramRollup::rollupPath(uint16_t ga, TelegramRollupLevel level)
+{
+    static const char suffix[TLR_LEVELS] = {'m', 'h', 'd'};
+    char path[24];
+    snprintf(path, sizeof(path), TLR_DIR "/%04x.%c", ga, suffix[level < TLR_LEVELS ? level : TLR_DAY]);
+    return String(path);
+}
+
+/**
+ * @brief Parse a level given as character
+ *
+ * @param c 'm', 'h' or 'd'
+ * @return the level, TLR_DAY for unknown characters
+ */
+TelegramRollupLevel TelegramRollup::parseLevel(char c)
+{
+    return (c == 'm') ? TLR_MINUTE : (c == 'h') ? TLR_HOUR : TLR_DAY;
+}
+
+/**
+ * @brief Start the aggregation of the oldest sealed segment, if it is old enough or the filesystem is filling up
+ *
+ * @param now the current time
+ * @return true if the aggregation was started
+ */
+bool TelegramRollup::startSegment(uint32_t now)
+{
+    const uint32_t seq = _log->firstSegment();
+    if (seq >= _log->nextSegment())
+    {
+        return false; // Only the active segment is left
+    }
+
+    TelegramSegmentFooter footer;
+    if (!_log->readFooter(seq, footer))
+    {
+        _log->removeSegment(seq); // Missing or broken segment, nothing to roll up
+        return false;
+    }
+
+    bool due = now >= TLR_RAW_RETENTION_S && footer.maxTime < now - TLR_RAW_RETENTION_S;
+    FSInfo info;
+    if (!due && _fs->info(info) && info.totalBytes)
+    {
+        due = (info.usedBytes * 100 / info.totalBytes) >= TLR_FILL_THRESHOLD_PERCENT;
+    }
+    if (!due)
+    {
+        return false;
+    }
+
+    _segment = _fs->open(TelegramLog::segmentPath(seq).c_str(), "r");
+    _journal = _fs->open(TLR_JOURNAL, "w");
+    if (!_segment || !_journal || _journal.write((const uint8_t *)&seq, sizeof(seq)) != sizeof(seq))
+    {
+        _segment.close();
+        _journal.close();
+        return false;
+    }
+    _journal.flush();
+    _seq = seq;
+    _remaining = footer.count;
+    _touchedCount = 0;
+    _state = Aggregate;
+    return true;
+}
+
+/**
+ * @brief Aggregate the next chunk of records of the segment into the bucket tables
+ */
+void TelegramRollup::aggregateChunk()
+{
+    TelegramRecord chunk[TLG_READ_CHUNK];
+    const uint32_t n = min<uint32_t>(TLG_READ_CHUNK, _remaining);
+    if (!n || _segment.read((uint8_t *)chunk, n * sizeof(TelegramRecord)) != (int)(n * sizeof(TelegramRecord)))
+    {
+        _remaining = 0;
+        _commitLevel = 0;
+        _state = Commit;
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        float value;
+        if (TelegramLog::decodeValue(chunk[i], value))
+        {
+            add(TLR_MINUTE, chunk[i].ga, chunk[i].time, value);
+            add(TLR_HOUR, chunk[i].ga, chunk[i].time, value);
+            add(TLR_DAY, chunk[i].ga, chunk[i].time, value);
+        }
+    }
+    _remaining -= n;
+    if (!_remaining)
+    {
+        _commitLevel = 0;
+        _state = Commit;
+    }
+}
+
+/**
+ * @brief Write the next TLR_COMMIT_PER_LOOP open buckets in start order. After the last one remove the raw
+ *        segment and then the journal
+ */
+void TelegramRollup::commitSegment()
+{
+    for (uint8_t n = 0; n < TLR_COMMIT_PER_LOOP && _commitLevel < TLR_LEVELS; n++)
+    {
+        const uint8_t level = _commitLevel;
+        uint8_t oldest = 0;
+        for (uint8_t i = 1; i < _used[level]; i++)
+        {
+            if (_tables[level][i].record.start < _tables[level][oldest].record.start)
+            {
+                oldest = i;
+            }
+        }
+        if (_used[level] && !flushBucket((TelegramRollupLevel)level, oldest, false))
+        {
+            return; // Kept, try again with the next loop()
+        }
+        if (!_used[level])
+        {
+            _commitLevel++;
+        }
+    }
+    if (_commitLevel < TLR_LEVELS)
+    {
+        return; // More buckets with the next loop()
+    }
+    _segment.close();
+    _journal.close();
+    if (_log->removeSegment(_seq))
+    {
+        _consumed++;
+    }
+    _fs->remove(TLR_JOURNAL);
+    _touchedCount = 0;
+    _state = _compactCount ? Compact : Idle;
+}
+
+/**
+ * @brief Keep only the newest half of one oversized rollup file. Copies into a temporary file that
+ *        replaces the original by rename, so a reboot leaves either the old or the new file
+ */
+void TelegramRollup::compactOne()
+{
+    if (!_compactCount)
+    {
+        _state = Idle;
+        return;
+    }
+    _compactCount--;
+    const String path = rollupPath(_compactGa[_compactCount], (TelegramRollupLevel)_compactLevel[_compactCount]);
+    const String tmpPath = path + ".tmp";
+
+    File src = _fs->open(path.c_str(), "r");
+    File dst = _fs->open(tmpPath.c_str(), "w");
+    if (src && dst)
+    {
+        const uint32_t count = src.size() / sizeof(RollupRecord);
+        src.seek((count - count / 2) * sizeof(RollupRecord), SeekSet);
+        uint8_t buffer[16 * sizeof(RollupRecord)];
+        int n;
+        while ((n = src.read(buffer, sizeof(buffer))) > 0)
+        {
+            dst.write(buffer, n);
+        }
+    }
+    src.close();
+    dst.close();
+    if (!_fs->rename(tmpPath.c_str(), path.c_str()))
+    {
+        _fs->remove(tmpPath.c_str());
+    }
+    if (!_compactCount)
+    {
+        _state = Idle;
+    }
+}
+
+/**
+ * @brief Roll back an interrupted aggregation. If the journal exists and its segment is still there,
+ *        the touched rollup files are truncated to their old size (latest entry first)
+ */
+void TelegramRollup::recover()
+{
+    // Leftovers of an interrupted compaction, the original file is still intact
+    Dir dir = _fs->openDir(TLR_DIR);
+    while (dir.next())
+    {
+        String name = dir.fileName();
+        if (name.length() > 4 && name.substring(name.length() - 4) == ".tmp")
+        {
+            _fs->remove((String(TLR_DIR "/") + name).c_str());
+        }
+    }
+
+    File journal = _fs->open(TLR_JOURNAL, "r");
+    if (!journal)
+    {
+        return;
+    }
+    uint32_t seq;
+    if (journal.read((uint8_t *)&seq, sizeof(seq)) == sizeof(seq) && _fs->exists(TelegramLog::segmentPath(seq).c_str()))
+    {
+        const uint32_t count = (journal.size() - sizeof(seq)) / sizeof(JournalEntry);
+        for (uint32_t i = count; i > 0; i--)
+        {
+            JournalEntry entry;
+            journal.seek(sizeof(seq) + (i - 1) * sizeof(JournalEntry), SeekSet);
+            if (journal.read((uint8_t *)&entry, sizeof(entry)) != sizeof(entry))
+            {
+                continue;
+            }
+            const String path = rollupPath(entry.ga, (TelegramRollupLevel)entry.level);
+            if (!entry.size)
+            {
+                _fs->remove(path.c_str());
+                continue;
+            }
+            File file = _fs->open(path.c_str(), "r+");
+            if (file)
+            {
+                file.truncate(entry.size);
+                file.close();
+            }
+        }
+    }
+    journal.close();
+    _fs->remove(TLR_JOURNAL);
+}
+
+/**
+ * @brief Add a value to the bucket of its group address and time. Evicts the oldest bucket if the table is full
+ */
+void TelegramRollup::add(TelegramRollupLevel level, uint16_t ga, uint32_t time, float value)
+{
+    const uint32_t start = time - (time % period(level));
+    Bucket *table = _tables[level];
+    for (uint8_t i = 0; i < _used[level]; i++)
+    {
+        if (table[i].ga == ga && table[i].record.start == start)
+        {
+            RollupRecord &record = table[i].record;
+            record.count++;
+            record.min = min(record.min, value);
+            record.max = max(record.max, value);
+            record.sum += value;
+            return;
+        }
+    }
+
+    if (_used[level] >= TLR_TABLE_SIZE)
+    {
+        uint8_t oldest = 0;
+        for (uint8_t i = 1; i < _used[level]; i++)
+        {
+            if (table[i].record.start < table[oldest].record.start)
+            {
+                oldest = i;
+            }
+        }
+        flushBucket(level, oldest, true);
+    }
+
+    Bucket &bucket = table[_used[level]++];
+    bucket.ga = ga;
+    bucket.record.start = start;
+    bucket.record.count = 1;
+    bucket.record.min = value;
+    bucket.record.max = value;
+    bucket.record.sum = value;
+}
+
+/**
+ * @brief Append a bucket to its rollup file and remove it from the table
+ *
+ * @param level the level
+ * @param index the bucket in the table of the level
+ * @param evict true to remove the bucket even if it can't be written, the table needs the room
+ * @return true if the bucket was removed, false if it is kept for another try
+ */
+bool TelegramRollup::flushBucket(TelegramRollupLevel level, uint8_t index, bool evict)
+{
+    Bucket &bucket = _tables[level][index];
+    File file = _fs->open(rollupPath(bucket.ga, level).c_str(), "a");
+    const uint32_t size = file ? file.size() : 0;
+    const bool written = file && journal(bucket.ga, level, size) &&
+                         file.write((const uint8_t *)&bucket.record, sizeof(bucket.record)) == sizeof(bucket.record);
+    if (file && !written && file.size() != size)
+    {
+        file.truncate(size); // Drop a partly written record
+    }
+    file.close();
+    if (!written)
+    {
+        if (!evict && ++_flushFailures < TLR_FLUSH_RETRIES)
+        {
+            return false;
+        }
+        _lost++;
+    }
+    _flushFailures = 0;
+
+    const uint32_t limit = (level == TLR_MINUTE) ? TLR_MINUTE_MAX_BYTES : (level == TLR_HOUR) ? TLR_HOUR_MAX_BYTES : 0;
+    if (written && limit && size + sizeof(RollupRecord) > limit && _compactCount < TLR_COMPACT_QUEUE)
+    {
+        bool queued = false;
+        for (uint8_t i = 0; i < _compactCount; i++)
+        {
+            queued |= (_compactGa[i] == bucket.ga && _compactLevel[i] == level);
+        }
+        if (!queued)
+        {
+            _compactGa[_compactCount] = bucket.ga;
+            _compactLevel[_compactCount] = level;
+            _compactCount++;
+        }
+    }
+    bucket = _tables[level][--_used[level]]; // Move the last entry into the gap
+    return true;
+}
+
+/**
+ * @brief Record the size of a rollup file in the journal before it is appended the first time
+ *
+ * @return true if the journal is up to date
+ */
+bool TelegramRollup::journal(uint16_t ga, TelegramRollupLevel level, uint32_t size)
+{
+    const uint32_t key = ga | ((uint32_t)level << 16);
+    for (uint8_t i = 0; i < _touchedCount; i++)
+    {
+        if (_touched[i] == key)
+        {
+            return true;
+        }
+    }
+
+    // Files beyond TLR_TOUCHED_MAX are journaled again, recover() applies the entries from the last to the first
+    JournalEntry entry = {ga, (uint8_t)level, 0, size};
+    if (!_journal || _journal.write((const uint8_t *)&entry, sizeof(entry)) != sizeof(entry))
+    {
+        return false;
+    }
+    _journal.flush();
+    if (_touchedCount < TLR_TOUCHED_MAX)
+    {
+        _touched[_touchedCount++] = key;
+    }
+    return true;
+}
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
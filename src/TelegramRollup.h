@@ -0,0 +1,134 @@
+#ifdef EXTERNAL_FLASH_MODULE
+#pragma once
+/**
+ * @file        TelegramRollup.h
+ * @brief       Background downsampling of the telegram log into min/max/avg buckets
+ *              at 1 minute, 1 hour and 1 day resolution
+ * @author      Erkan Çolak
+ * @version     1.0.0
+ * @date        2026-10-17
+ * @copyright   Copyright (c) 2024, Erkan Çolak
+ *              Licensed under GNU GPL v3.0
+ */
+#if defined(ARDUINO_ARCH_RP2040)
+#include "TelegramLog.h"
+
+#define TLR_DIR TLG_DIR "/r"                 // Directory for the rollup files, one file per group address and level
+#define TLR_JOURNAL TLG_DIR "/rollup.jnl"    // Journal of the rollup files touched by the running aggregation
+#define TLR_LEVELS 3                         // Minute, hour and day
+#define TLR_TABLE_SIZE 32                    // Open buckets per level kept in RAM
+#define TLR_COMPACT_QUEUE 8                  // Rollup files waiting for compaction
+#define TLR_TOUCHED_MAX 64                   // Touched files remembered in RAM to keep the journal short
+
+#ifndef TLR_RAW_RETENTION_S
+    #define TLR_RAW_RETENTION_S (2 * 86400UL) // Raw segments older than this are rolled up
+#endif
+#ifndef TLR_FILL_THRESHOLD_PERCENT
+    #define TLR_FILL_THRESHOLD_PERCENT 75 // Roll up the oldest segment regardless of its age above this filesystem usage
+#endif
+#ifndef TLR_MINUTE_MAX_BYTES
+    #define TLR_MINUTE_MAX_BYTES (64 * 1024UL) // Max size of a minute rollup file (~2.8 days), the oldest half is dropped
+#endif
+#ifndef TLR_HOUR_MAX_BYTES
+    #define TLR_HOUR_MAX_BYTES (64 * 1024UL) // Max size of an hour rollup file (~170 days), the oldest half is dropped
+#endif
+#ifndef TLR_COMMIT_PER_LOOP
+    #define TLR_COMMIT_PER_LOOP 2 // Buckets appended to their files per loop() call when a segment is committed
+#endif
+#ifndef TLR_FLUSH_RETRIES
+    #define TLR_FLUSH_RETRIES 3 // Commit steps a bucket is kept when its file or the journal can't be written, then it is lost
+#endif
+#ifndef TLR_IDLE_INTERVAL_MS
+    #define TLR_IDLE_INTERVAL_MS 60000 // Check for work once a minute while idle
+#endif
+
+enum TelegramRollupLevel : uint8_t
+{
+    TLR_MINUTE = 0,
+    TLR_HOUR = 1,
+    TLR_DAY = 2
+};
+
+// One aggregated bucket. The group address and the level are given by the file name
+struct __attribute__((packed)) RollupRecord
+{
+    uint32_t start; // Start of the bucket
+    uint32_t count; // Number of values
+    float min;      // Minimum value
+    float max;      // Maximum value
+    float sum;      // Sum of the values, avg = sum / count
+};
+
+class TelegramRollup
+{
+  public:
+    using Callback = std::function<bool(const RollupRecord &record)>; // Return false to stop the query
+
+    TelegramRollup();
+
+    bool begin(FS *fs, TelegramLog *log);                 // Recover an interrupted aggregation
+    void loop(uint32_t now);                              // Run one step of the background job
+    inline bool busy() const { return _state != Idle; }   // Work in progress, call loop() again soon
+    uint32_t query(TelegramRollupLevel level, uint16_t ga, uint32_t from, uint32_t to, Callback cb); // Stream buckets through cb
+
+    inline uint32_t segmentsConsumed() const { return _consumed; } // Raw segments rolled up since boot
+    inline uint32_t bucketsLost() const { return _lost; }          // Buckets dropped because they couldn't be written, since boot
+    static uint32_t period(TelegramRollupLevel level);              // Bucket length in seconds
+    static String rollupPath(uint16_t ga, TelegramRollupLevel level); // Path of a rollup file
+    static TelegramRollupLevel parseLevel(char c);                   // 'm', 'h' or 'd'
+
+  private:
+    enum State : uint8_t
+    {
+        Idle,
+        Aggregate,
+        Commit,
+        Compact
+    };
+
+    struct Bucket
+    {
+        uint16_t ga;         // Group address
+        RollupRecord record; // Aggregated values
+    };
+
+    struct __attribute__((packed)) JournalEntry
+    {
+        uint16_t ga;     // Group address of the touched file
+        uint8_t level;   // Level of the touched file
+        uint8_t reserved;
+        uint32_t size;   // Size of the file before the aggregation
+    };
+
+    bool startSegment(uint32_t now);                        // Pick the oldest segment if it is due
+    void aggregateChunk();                                  // Aggregate the next chunk of records
+    void commitSegment();                                   // Flush a few buckets, at the end remove the segment and the journal
+    void compactOne();                                      // Drop the oldest half of one oversized rollup file
+    void recover();                                         // Roll back an interrupted aggregation
+    void add(TelegramRollupLevel level, uint16_t ga, uint32_t time, float value);
+    bool flushBucket(TelegramRollupLevel level, uint8_t index, bool evict); // Append a bucket to its file and remove it from the table
+    bool journal(uint16_t ga, TelegramRollupLevel level, uint32_t size); // Record the size of a file before the first append
+
+    FS *_fs;                                         // Filesystem that holds the rollups
+    TelegramLog *_log;                               // Raw telegram log
+    State _state;                                    // State of the background job
+    File _segment;                                   // Segment being aggregated
+    File _journal;                                   // Journal of the running aggregation
+    uint32_t _seq;                                   // Sequence number of the segment being aggregated
+    uint32_t _remaining;                             // Records left in the segment
+    uint32_t _lastCheck;                             // millis() of the last idle check
+    uint32_t _consumed;                              // Raw segments rolled up since boot
+    uint32_t _lost;                                  // Buckets dropped since boot
+    uint8_t _flushFailures;                          // Failed writes of the bucket commitSegment() retries
+    Bucket _tables[TLR_LEVELS][TLR_TABLE_SIZE];      // Open buckets per level
+    uint8_t _used[TLR_LEVELS];                       // Used entries per level
+    uint8_t _commitLevel;                            // Level flushed next by commitSegment()
+    uint16_t _compactGa[TLR_COMPACT_QUEUE];          // Rollup files waiting for compaction
+    uint8_t _compactLevel[TLR_COMPACT_QUEUE];        // Level of the queued files
+    uint8_t _compactCount;                           // Queued files
+    uint32_t _touched[TLR_TOUCHED_MAX];              // Files already in the journal (ga | level << 16)
+    uint8_t _touchedCount;                           // Entries in _touched
+};
+
+#endif // ARDUINO_ARCH_RP2040
+#endif // EXTERNAL_FLASH_MODULE
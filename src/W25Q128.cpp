@@ -3,6 +3,9 @@
 #include "W25Q128.h"
 
 W25Q128 *W25Q128::instance = nullptr;
+W25Q128::EraseCallback W25Q128::eraseCallback = nullptr;
+ExtFlashStats extFlashStats; // Counters of the flash subsystem
+const char *const extFlashLatNames[EXTFLASH_LAT_COUNT] = {"read", "program", "erase", "busy", "open", "fread", "fwrite", "close", "stat"};
 
 W25Q128::W25Q128() {}
 
@@ -67,7 +70,7 @@ uint8_t W25Q128::readStatus()
 {
     select();
     sendCommand(CMD_READ_STATUS_REG);
-    uint8_t status = transfer(0x00);
+    uint8_t status = receive();
     deselect();
     return status;
 }
@@ -78,10 +81,15 @@ uint8_t W25Q128::readStatus()
  */
 void W25Q128::waitUntilReady()
 {
+    EXTFLASH_TP_SCOPE("flash.busy", 0);
+    const uint64_t start = time_us_64();
     while (readStatus() & 0x01) // Check if the Flash is busy
     {
         delay(1);
     }
+    const uint32_t us = time_us_64() - start;
+    extFlashStats.busyWaitUs += us;
+    extFlashStats.latency[EXTFLASH_LAT_BUSY].add(us);
 }
 
 /**
@@ -94,6 +102,9 @@ void W25Q128::waitUntilReady()
  */
 int W25Q128::read(uint32_t addr, uint8_t *buffer, size_t size)
 {
+    ExtFlashLatencyScope latency(EXTFLASH_LAT_READ);
+    EXTFLASH_TP_SCOPE("flash.read", size);
+    waitIfBusy();
     select();
     sendCommand(CMD_READ_DATA);
     transfer((addr >> 16) & 0xFF);
@@ -102,9 +113,10 @@ int W25Q128::read(uint32_t addr, uint8_t *buffer, size_t size)
 
     for (size_t i = 0; i < size; i++)
     {
-        buffer[i] = transfer(0x00);
+        buffer[i] = receive();
     }
     deselect();
+    extFlashStats.readBytes += size;
     return 0;
 }
 
@@ -118,8 +130,11 @@ int W25Q128::read(uint32_t addr, uint8_t *buffer, size_t size)
  */
 int W25Q128::program(uint32_t addr, const uint8_t *buffer, size_t size)
 {
+    ExtFlashLatencyScope latency(EXTFLASH_LAT_PROGRAM);
+    EXTFLASH_TP_SCOPE("flash.program", size);
     size_t pageSize = 256;
     size_t written = 0;
+    waitIfBusy();
 
     while (written < size)
     {
@@ -142,6 +157,7 @@ int W25Q128::program(uint32_t addr, const uint8_t *buffer, size_t size)
         addr += chunkSize;
         written += chunkSize;
     }
+    extFlashStats.programBytes += size;
     return 0;
 }
 
@@ -153,7 +169,11 @@ int W25Q128::program(uint32_t addr, const uint8_t *buffer, size_t size)
  */
 int W25Q128::erase(uint32_t addr)
 {
+    ExtFlashLatencyScope latency(EXTFLASH_LAT_ERASE);
+    EXTFLASH_TP_SCOPE("flash.erase", addr);
+    waitIfBusy();
     enableWrite();
+    const uint64_t start = time_us_64();
     select();
     sendCommand(CMD_SECTOR_ERASE);
     transfer((addr >> 16) & 0xFF);
@@ -161,6 +181,11 @@ int W25Q128::erase(uint32_t addr)
     transfer(addr & 0xFF);
     deselect();
     waitUntilReady();
+    extFlashStats.erases++;
+    if (eraseCallback)
+    {
+        eraseCallback(addr, SECTOR_SIZE_W25Q128_4KB, time_us_64() - start);
+    }
     return 0; // Erfolg
 }
 
@@ -170,15 +195,95 @@ int W25Q128::erase(uint32_t addr)
  */
 void W25Q128::chipErase()
 {
+    waitIfBusy();
     enableWrite();
     select();
     sendCommand(CMD_CHIP_ERASE);
     deselect();
     waitUntilReady();
+    if (eraseCallback)
+    {
+        eraseCallback(0, FLASH_SIZE_W25Q128, 0);
+    }
+}
+
+/**
+ * @brief Start a sector erase without waiting for it. The erase takes typically 45ms (max. 400ms),
+ *        use isBusy() to poll for the end. Other commands wait for the erase to finish
+ *
+ * @param addr the address of the sector to erase
+ */
+void W25Q128::eraseAsync(uint32_t addr)
+{
+    waitIfBusy();
+    enableWrite();
+    select();
+    sendCommand(CMD_SECTOR_ERASE);
+    transfer((addr >> 16) & 0xFF);
+    transfer((addr >> 8) & 0xFF);
+    transfer(addr & 0xFF);
+    deselect();
+    _busy = true;
+    extFlashStats.asyncErases++;
+    if (eraseCallback)
+    {
+        eraseCallback(addr, SECTOR_SIZE_W25Q128_4KB, 0);
+    }
+}
+
+/**
+ * @brief Start a 64KB block erase without waiting for it. The erase takes typically 150ms (max. 2s), which is
+ *        much faster than 16 sector erases. Use isBusy() to poll for the end
+ *
+ * @param addr the address of the block to erase, 64KB aligned
+ */
+void W25Q128::eraseBlockAsync(uint32_t addr)
+{
+    waitIfBusy();
+    enableWrite();
+    select();
+    sendCommand(CMD_BLOCK_ERASE_64KB);
+    transfer((addr >> 16) & 0xFF);
+    transfer((addr >> 8) & 0xFF);
+    transfer(addr & 0xFF);
+    deselect();
+    _busy = true;
+    extFlashStats.asyncErases++;
+    if (eraseCallback)
+    {
+        eraseCallback(addr, BLOCK_SIZE_W25Q128_64KB, 0);
+    }
+}
+
+/**
+ * @brief Check if an asynchronous erase is still running. Costs one status register read while busy
+ *
+ * @return true if the erase is still running
+ */
+bool W25Q128::isBusy()
+{
+    if (_busy)
+    {
+        _busy = readStatus() & 0x01;
+    }
+    return _busy;
 }
 
 // Private Methods
 
+/**
+ * @brief Wait for a pending asynchronous erase, the chip ignores commands while busy
+ *
+ */
+void W25Q128::waitIfBusy()
+{
+    if (_busy)
+    {
+        waitUntilReady();
+        _busy = false;
+    }
+}
+
 /**
  * @brief Select the Flash memory
  *
@@ -206,6 +311,37 @@ void W25Q128::deselect()
  */
 void W25Q128::sendCommand(uint8_t cmd)
 {
+    switch (cmd)
+    {
+        case CMD_READ_DATA:
+            extFlashStats.cmdRead++;
+            break;
+        case CMD_PAGE_PROGRAM:
+            extFlashStats.cmdPageProgram++;
+            break;
+        case CMD_SECTOR_ERASE:
+            extFlashStats.cmdSectorErase++;
+            break;
+        case CMD_BLOCK_ERASE_64KB:
+            extFlashStats.cmdBlockErase++;
+            break;
+        case CMD_CHIP_ERASE:
+            extFlashStats.cmdChipErase++;
+            break;
+        case CMD_WRITE_ENABLE:
+            extFlashStats.cmdWriteEnable++;
+            break;
+        case CMD_WRITE_DISABLE:
+            extFlashStats.cmdWriteDisable++;
+            break;
+        case CMD_READ_STATUS_REG:
+            extFlashStats.cmdReadStatus++;
+            break;
+        default:
+            extFlashStats.cmdOther++;
+            break;
+    }
+    EXTFLASH_TP("spi.cmd", cmd);
     transfer(cmd);
 }
 
@@ -217,9 +353,21 @@ void W25Q128::sendCommand(uint8_t cmd)
  */
 uint8_t W25Q128::transfer(uint8_t data)
 {
+    extFlashStats.spiBytesOut++;
     return W25Q128_SPI_PORT.transfer(data);
 }
 
+/**
+ * @brief Receive a byte from the Flash memory, a dummy byte is sent
+ *
+ * @return uint8_t the read data
+ */
+uint8_t W25Q128::receive()
+{
+    extFlashStats.spiBytesIn++;
+    return W25Q128_SPI_PORT.transfer(0x00);
+}
+
 /**
  * @brief Read the ID of the Flash memory
  *
@@ -230,9 +378,9 @@ ChipID W25Q128::readID()
     select();
     sendCommand(CMD_READ_ID);
     ChipID chipID;
-    chipID.manufacturerID = transfer(0x00);
-    chipID.memoryType = transfer(0x00);
-    chipID.capacity = transfer(0x00);
+    chipID.manufacturerID = receive();
+    chipID.memoryType = receive();
+    chipID.capacity = receive();
     deselect();
     return chipID;
 }
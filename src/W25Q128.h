@@ -11,6 +11,8 @@
  */
 
     #if defined(ARDUINO_ARCH_RP2040)
+        #include "ExtFlashStats.h"
+        #include "ExtFlashTracepoints.h"
         #include <Arduino.h>
         #include <FS.h>
         #include <OpenKNX.h>
@@ -53,11 +55,13 @@
         #define CMD_READ_DATA 0x03        // Read Data Command
         #define CMD_PAGE_PROGRAM 0x02     // Page Program Command
         #define CMD_SECTOR_ERASE 0x20     // Sector Erase Command
+        #define CMD_BLOCK_ERASE_64KB 0xD8 // 64KB Block Erase Command
         #define CMD_CHIP_ERASE 0xC7       // Chip Erase Command
         #define CMD_READ_STATUS_REG 0x05  // Read Status Register Command
         #define CMD_WRITE_STATUS_REG 0x01 // Write Status Register Command
 
         #define SECTOR_SIZE_W25Q128_4KB 4096          // The sector size of the W25Q128 Flash Chip is 4KB!
+        #define BLOCK_SIZE_W25Q128_64KB 65536         // Erase block size of the W25Q128 Flash Chip is 64KB
         #define PAGE_SIZE_W25Q128_256B 256            // Page size of the W25Q128 Flash Chip is 256 Bytes
         #define FLASH_SIZE_W25Q128 (16 * 1024 * 1024) // 16MB (128Mbit) --> 16 x 1024 x 1024 Bytes = 16777216 Bytes (Hex: 0x1000000)
 
@@ -85,30 +89,62 @@ class W25Q128
     int erase(uint32_t addr);
     void chipErase();
 
+    // Non-blocking erase. Every other command waits until the erase has finished
+    void eraseAsync(uint32_t addr);      // Start a sector erase and return immediately
+    void eraseBlockAsync(uint32_t addr); // Start a 64KB block erase and return immediately
+    bool isBusy();                  // Check if an asynchronous erase is still running
+
+    // Called after every erase with the start address, the bytes erased and the time of a blocking sector erase in us (0
+    // for background and chip erases)
+    using EraseCallback = void (*)(uint32_t addr, uint32_t size, uint32_t us);
+    static EraseCallback eraseCallback;
+
         #ifdef ARDUINO_ARCH_RP2040
-    // LittleFS Callbacks for RP2040
+    // LittleFS Callbacks for RP2040. The context of the lfs_config may point to the uint32_t start address of the partition
+    inline static uint32_t lfs_base(const struct lfs_config *c)
+    {
+        return c->context ? *static_cast<const uint32_t *>(c->context) : 0;
+    }
+
     inline static int lfs_read(const struct lfs_config *c, lfs_block_t block,
                                lfs_off_t off, void *buffer, lfs_size_t size)
     {
-        uint32_t addr = block * c->block_size + off;
+        EXTFLASH_TP_SCOPE("lfs.read", block);
+        uint32_t addr = lfs_base(c) + block * c->block_size + off;
+        extFlashStats.lfsReads++;
+        extFlashStats.lfsReadBytes += size;
         return instance->read(addr, static_cast<uint8_t *>(buffer), size);
     }
 
     inline static int lfs_prog(const struct lfs_config *c, lfs_block_t block,
                                lfs_off_t off, const void *buffer, lfs_size_t size)
     {
-        uint32_t addr = block * c->block_size + off;
+        EXTFLASH_TP_SCOPE("lfs.prog", block);
+        uint32_t addr = lfs_base(c) + block * c->block_size + off;
+        extFlashStats.lfsProgs++;
+        extFlashStats.lfsProgBytes += size;
+        extFlashStats.wa[extFlashStats.waDir].progBytes += size;
         return instance->program(addr, static_cast<const uint8_t *>(buffer), size);
     }
 
     inline static int lfs_erase(const struct lfs_config *c, lfs_block_t block)
     {
-        uint32_t addr = block * c->block_size;
-        return instance->erase(addr);
+        // A block may span several sectors when block_size is a multiple of the sector size
+        EXTFLASH_TP_SCOPE("lfs.erase", block);
+        uint32_t addr = lfs_base(c) + block * c->block_size;
+        extFlashStats.lfsErases++;
+        extFlashStats.wa[extFlashStats.waDir].eraseBytes += c->block_size;
+        for (uint32_t offset = 0; offset < c->block_size; offset += SECTOR_SIZE_W25Q128_4KB)
+        {
+            instance->erase(addr + offset);
+        }
+        return 0;
     }
 
     inline static int lfs_sync(const struct lfs_config *c)
     {
+        EXTFLASH_TP("lfs.sync", 0);
+        extFlashStats.lfsSyncs++;
         return 0;
     }
         #endif
@@ -118,10 +154,14 @@ class W25Q128
     static W25Q128 *instance;
 
   private:
+    bool _busy = false; // An asynchronous erase was started and not yet seen finished
+
+    void waitIfBusy(); // Wait for a pending asynchronous erase
     void select();
     void deselect();
     void sendCommand(uint8_t cmd);
     uint8_t transfer(uint8_t data);
+    uint8_t receive(); // Transfer a dummy byte and count the received byte
 };
     #endif // ARDUINO_ARCH_RP2040
 #endif     // EXTERNAL_FLASH_MODULE
\ No newline at end of file
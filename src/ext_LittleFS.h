@@ -26,12 +26,35 @@
 #if defined(ARDUINO_ARCH_RP2040)
 #pragma once
 #include "LittleFS.h"
+#include "ExtFlashMem.h"
+#include "ExtFlashPath.h"
 #include "W25Q128.h"
 
 using namespace fs;
 
+#define EXTFLASH_FD_MAX 32 // Slots of the file descriptor table, one bit each in the free bitmap
+
 namespace ext_littlefs_impl // LittleFS implementation for external flash
 {
+    class ext_LittleFSImpl; // Forward declaration of the filesystem implementation
+
+    // Header of the file descriptor table, the slots follow it. A filesystem destroyed with files or directories
+    // still open leaves the table to them, the last one closed frees it
+    struct ext_LittleFSFdTable
+    {
+        ext_LittleFSImpl *fs; // The filesystem, nullptr once it is destroyed
+        uint32_t free;        // Bitmap of the free slots
+        uint32_t all;         // Bitmap of all slots
+        uint32_t dirs;        // Open directories
+    };
+
+    // Slot of the file descriptor table. The cache of the slot follows the slots in the table
+    struct ext_LittleFSFd
+    {
+        lfs_file_t file;            // lfs file, first member, the slot is found from the file
+        lfs_file_config config;     // Points the file to the cache of the slot
+        ext_LittleFSFdTable *table; // The table of the slot
+    };
 
     class ext_LittleFSFileImpl; // Forward declaration of file implementation
     class ext_LittleFSDirImpl;  // Forward declaration of directory implementation
@@ -53,7 +76,13 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
         using LfsSyncCallback = int (*)(const struct lfs_config *);
 
       public:
-        W25Q128 *extFlash = new W25Q128();
+        // Called for every file operation, e.g. by ExtFlashTrace. op: 'o'pen, 'w'rite, 'r'ead, 'f'lush, 'k' seek, 't'runcate,
+        // 'c'lose, 'd'elete, 'm'kdir, 'n' rename from, 'v' rename to. file is the lfs file of open files, size the bytes,
+        // open flags or position. Open and seek are reported after the call, the others before it
+        using FileOpCallback = void (*)(char op, const void *file, const char *path, uint32_t size);
+        static FileOpCallback fileOpCallback;
+
+        W25Q128 *extFlash = nullptr; // Driver of the chip, not owned. W25Q128::instance of the module, set by begin()
 
         /**
          * @brief Construct a new ext_LittleFSImpl object with full configuration support
@@ -62,7 +91,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          * @param size         Set the size of the filesystem in flash
          * @param pageSize     Set the size of a page in flash
          * @param blockSize    Set the size of a block in flash
-         * @param maxOpenFds   Set the maximum number of open file descriptors
+         * @param maxOpenFds   Set the maximum number of open file descriptors, up to EXTFLASH_FD_MAX
          * @param read         Pointer to the read function (optional, can be nullptr)
          * @param prog         Pointer to the program function (optional, can be nullptr)
          * @param erase        Pointer to the erase function (optional, can be nullptr)
@@ -82,6 +111,11 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
               _pageSize(pageSize),                         // Size of a page in flash
               _blockSize(blockSize),                       // Size of a block in flash
               _maxOpenFds(maxOpenFds),                     // Maximum number of open file descriptors
+              _fdTable(nullptr),                           // File descriptor table, allocated by begin()
+              _fds(nullptr),                               // Slots of the table
+              _fdCaches(nullptr),                          // Caches of the slots
+              _fdCacheSize(0),                             // Bytes per cache
+              _lfsBuffers(nullptr),                        // Buffers of littlefs, allocated by begin()
               _mounted(false)                              // Whether the filesystem is mounted
         {
             memset(&_lfs, 0, sizeof(_lfs));         // Clear the LittleFS context
@@ -134,12 +168,57 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         ~ext_LittleFSImpl()
         {
+            _endFds();                         // Close the open files, leave the table to them
             if (_mounted) lfs_unmount(&_lfs); // Unmount the filesystem if it is mounted
+            extFlashMemFree(_lfsBuffers);      // Free the caches and the lookahead buffer of littlefs
         }
 
         FileImplPtr open(const char *path, OpenMode openMode, AccessMode accessMode) override; // Open a file, return a file implementation
         DirImplPtr openDir(const char *path) override;                                         // Open a directory, return a directory implementation
 
+        // Paths with a length, e.g. a part of a console command. Normalized on the stack, invalid paths fail
+        FileImplPtr open(std::string_view path, OpenMode openMode, AccessMode accessMode)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() ? open(p.c_str(), openMode, accessMode) : FileImplPtr();
+        }
+        DirImplPtr openDir(std::string_view path)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() ? openDir(p.c_str()) : DirImplPtr();
+        }
+        bool exists(std::string_view path)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() && exists(p.c_str());
+        }
+        bool rename(std::string_view pathFrom, std::string_view pathTo)
+        {
+            const ExtFlashPath from(pathFrom);
+            const ExtFlashPath to(pathTo);
+            return from.isValid() && to.isValid() && rename(from.c_str(), to.c_str());
+        }
+        bool remove(std::string_view path)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() && remove(p.c_str());
+        }
+        bool mkdir(std::string_view path)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() && mkdir(p.c_str());
+        }
+        bool rmdir(std::string_view path)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() && rmdir(p.c_str());
+        }
+        bool stat(std::string_view path, FSStat *st)
+        {
+            const ExtFlashPath p(path);
+            return p.isValid() && stat(p.c_str(), st);
+        }
+
         bool setLFSConfig(const lfs_config &cfg) // Set the LittleFS configuration
         {
             _lfs_cfg = cfg;                                          // Set the LittleFS configuration
@@ -148,6 +227,9 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
 
         const lfs_config &getLFSConfig() const { return _lfs_cfg; } // Get the current LittleFS configuration
 
+        static void releaseFd(lfs_file_t *fd);                 // Return the slot of a closed file to its table
+        static void releaseDir(ext_LittleFSFdTable *table);    // Count a closed directory off its table
+
         // Setters for the internal LittleFS configuration
         void setReadFunction(LfsReadCallback read) { _lfs_cfg.read = read; }      // Set the read function
         void setProgFunction(LfsProgCallback prog) { _lfs_cfg.prog = prog; }      // Set the program function
@@ -234,10 +316,17 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool rename(const char *pathFrom, const char *pathTo) override
         {
+            EXTFLASH_TP_SCOPE("fs.rename", 0);
+            ExtFlashWaScope wa(pathFrom);
             if (!_mounted || !pathFrom || !pathFrom[0] || !pathTo || !pathTo[0])
             {
                 return false;
             }
+            if (fileOpCallback)
+            {
+                fileOpCallback('n', nullptr, pathFrom, 0);
+                fileOpCallback('v', nullptr, pathTo, 0);
+            }
             const int rc = lfs_rename(&_lfs, pathFrom, pathTo);
             if (rc != 0)
             {
@@ -276,10 +365,16 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool remove(const char *path) override
         {
+            EXTFLASH_TP_SCOPE("fs.remove", 0);
+            ExtFlashWaScope wa(path);
             if (!_mounted || !path || !path[0])
             {
                 return false;
             }
+            if (fileOpCallback)
+            {
+                fileOpCallback('d', nullptr, path, 0);
+            }
             int rc = lfs_remove(&_lfs, path);
             if (rc != 0)
             {
@@ -287,17 +382,10 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
                 return false;
             }
             // Now try and remove any empty subdirs this makes, silently
-            char *pathStr = strdup(path);
-            if (pathStr)
+            ExtFlashPath dir(path);
+            while (dir.parent() && !dir.isRoot())
             {
-                char *ptr = strrchr(pathStr, '/');
-                while (ptr)
-                {
-                    *ptr = 0;
-                    lfs_remove(&_lfs, pathStr); // Don't care if fails if there are files left
-                    ptr = strrchr(pathStr, '/');
-                }
-                free(pathStr);
+                lfs_remove(&_lfs, dir.c_str()); // Don't care if fails if there are files left
             }
             return true;
         }
@@ -310,10 +398,16 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool mkdir(const char *path) override
         {
+            EXTFLASH_TP_SCOPE("fs.mkdir", 0);
+            ExtFlashWaScope wa(path);
             if (!_mounted || !path || !path[0])
             {
                 return false;
             }
+            if (fileOpCallback)
+            {
+                fileOpCallback('m', nullptr, path, 0);
+            }
             int rc = lfs_mkdir(&_lfs, path);
             if ((rc == 0) && _timeCallback)
             {
@@ -363,6 +457,12 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool begin() override
         {
+            if (!extFlash)
+            {
+                // Share the driver started by the module, an own driver only without one
+                static W25Q128 driver;
+                extFlash = W25Q128::instance ? W25Q128::instance : &driver;
+            }
             if (extFlash->begin())
             {
                 if (_mounted)
@@ -374,6 +474,14 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
                     DEBUGV("LittleFS size is <= zero");
                     return false;
                 }
+                if (!_beginFds())
+                {
+                    DEBUGV("No file descriptor table");
+                    return false;
+                }
+                // Read cache, program cache and lookahead buffer in one block, the caches of the open files are in
+                // the file descriptor table
+                _beginBuffers();
                 if (_tryMount())
                 {
                     return true;
@@ -472,6 +580,8 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool stat(const char *path, FSStat *st) override
         {
+            ExtFlashLatencyScope latency(EXTFLASH_LAT_STAT);
+            EXTFLASH_TP_SCOPE("fs.stat", 0);
             if (!_mounted || !path || !path[0])
             {
                 return false;
@@ -606,36 +716,6 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
             return mode;
         }
 
-        /**
-         * @brief Check if the path is valid
-         *
-         * @param path the path to check
-         * @return true if the path is valid else false
-         */
-        static bool pathValid(const char *path)
-        {
-            while (*path)
-            {
-                const char *slash = strchr(path, '/');
-                if (!slash)
-                {
-                    if (strlen(path) >= LFS_NAME_MAX)
-                    {
-                        // Terminal filename is too long
-                        return false;
-                    }
-                    break;
-                }
-                if ((slash - path) >= LFS_NAME_MAX)
-                {
-                    // This subdir name too long
-                    return false;
-                }
-                path = slash + 1;
-            }
-            return true;
-        }
-
         // The actual flash accessing routines
         static int lfs_flash_read(const struct lfs_config *c, lfs_block_t block,
                                   lfs_off_t off, void *buffer, lfs_size_t size);
@@ -655,6 +735,21 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
         uint32_t _blockSize;  // Size of a block in flash
         uint32_t _maxOpenFds; // Maximum number of open file descriptors
 
+        bool _beginFds();             // Allocate the file descriptor table
+        void _endFds();               // Close the open files and free the table, or leave it to the open files
+        ext_LittleFSFd *_acquireFd(); // Take a free slot, nullptr at the max open files
+        void _beginBuffers();         // Allocate the caches and the lookahead buffer of littlefs
+
+        static void _releaseTable(ext_LittleFSFdTable *table); // Free a table left by its filesystem once all is closed
+        static char *_copyNames(std::string_view first, std::string_view second = std::string_view()); // Both terminated in one block, nullptr without heap
+
+        ext_LittleFSFdTable *_fdTable; // File descriptor table, the header and the free bitmap
+        ext_LittleFSFd *_fds;          // Slots of the table, _maxOpenFds after the header
+        uint8_t *_fdCaches;            // Cache of each slot, after the slots
+        uint32_t _fdCacheSize;         // Bytes per cache, the cache size of littlefs
+
+        uint8_t *_lfsBuffers; // Read cache, program cache and lookahead buffer of littlefs in one block, nullptr if not
+
         bool _mounted; // Whether the filesystem is mounted
     };
 
@@ -665,15 +760,14 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          * @brief Construct a new ext_LittleFSFileImpl object
          *
          * @param fs the filesystem implementation
-         * @param name the name of the file
-         * @param fd the file descriptor
+         * @param name the normalized name of the file, a block of ext_LittleFSImpl::_copyNames(), the file frees it
+         * @param fd the file descriptor, a slot of the table of fs, nullptr for a directory
          * @param flags the flags
          * @param creation the creation time
          */
-        ext_LittleFSFileImpl(ext_LittleFSImpl *fs, const char *name, std::shared_ptr<lfs_file_t> fd, int flags, time_t creation) : _fs(fs), _fd(fd), _opened(true), _flags(flags), _creation(creation)
+        ext_LittleFSFileImpl(ext_LittleFSImpl *fs, char *name, lfs_file_t *fd, int flags, time_t creation)
+            : _fs(fs), _fd(fd), _name(name), _opened(true), _flags(flags), _creation(creation)
         {
-            _name = std::shared_ptr<char>(new char[strlen(name) + 1], std::default_delete<char[]>());
-            strcpy(_name.get(), name);
         }
 
         /**
@@ -685,6 +779,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
             {
                 close();
             }
+            extFlashMemFree(_name);
         }
 
         /**
@@ -696,16 +791,26 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         size_t write(const uint8_t *buf, size_t size) override
         {
-            if (!_opened || !_fd || !buf)
+            if (!_isOpen() || !buf)
             {
                 return 0;
             }
+            if (ext_LittleFSImpl::fileOpCallback)
+            {
+                ext_LittleFSImpl::fileOpCallback('w', _getFD(), nullptr, size);
+            }
+            ExtFlashLatencyScope latency(EXTFLASH_LAT_FWRITE);
+            EXTFLASH_TP_SCOPE("fs.write", size);
+            ExtFlashWaScope wa(_name);
             int result = lfs_file_write(_fs->getFS(), _getFD(), (void *)buf, size);
+            extFlashStats.fileWrites++;
             if (result < 0)
             {
                 DEBUGV("lfs_write rc=%d\n", result);
                 return 0;
             }
+            extFlashStats.fileWriteBytes += result;
+            extFlashStats.wa[extFlashStats.waDir].logicalBytes += result;
             return result;
         }
 
@@ -718,16 +823,27 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         int read(uint8_t *buf, size_t size) override
         {
-            if (!_opened || !_fd | !buf)
+            if (!_isOpen() || !buf)
             {
                 return 0;
             }
+            if (ext_LittleFSImpl::fileOpCallback)
+            {
+                ext_LittleFSImpl::fileOpCallback('r', _getFD(), nullptr, size);
+            }
+            ExtFlashLatencyScope latency(EXTFLASH_LAT_FREAD);
+            EXTFLASH_TP_SCOPE("fs.read", size);
+            const uint32_t lfsReads = extFlashStats.lfsReads;
             int result = lfs_file_read(_fs->getFS(), _getFD(), (void *)buf, size);
+            extFlashStats.fileReads++;
             if (result < 0)
             {
                 DEBUGV("lfs_read rc=%d\n", result);
                 return 0;
             }
+            extFlashStats.fileReadBytes += result;
+            // No read callback: the data came from the file cache or the read cache of littlefs
+            (extFlashStats.lfsReads == lfsReads ? extFlashStats.cacheHits : extFlashStats.cacheMisses)++;
 
             return result;
         }
@@ -738,11 +854,18 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         void flush() override
         {
-            if (!_opened || !_fd)
+            if (!_isOpen())
             {
                 return;
             }
+            if (ext_LittleFSImpl::fileOpCallback)
+            {
+                ext_LittleFSImpl::fileOpCallback('f', _getFD(), nullptr, 0);
+            }
+            EXTFLASH_TP_SCOPE("fs.flush", 0);
+            ExtFlashWaScope wa(_name);
             int rc = lfs_file_sync(_fs->getFS(), _getFD());
+            extFlashStats.flushes++;
             if (rc < 0)
             {
                 DEBUGV("lfs_file_sync rc=%d\n", rc);
@@ -758,7 +881,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool seek(uint32_t pos, SeekMode mode) override
         {
-            if (!_opened || !_fd)
+            if (!_isOpen())
             {
                 return false;
             }
@@ -767,6 +890,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
             {
                 offset = -offset; // TODO - this seems like its plain wrong vs. POSIX
             }
+            ExtFlashWaScope wa(_name); // A seek flushes the written data
             auto lastPos = position();
             int rc = lfs_file_seek(_fs->getFS(), _getFD(), offset, (int)mode); // NB. SeekMode === LFS_SEEK_TYPES
             if (rc < 0)
@@ -779,6 +903,10 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
                 seek(lastPos, SeekSet); // Pretend the seek() never happened
                 return false;
             }
+            if (ext_LittleFSImpl::fileOpCallback)
+            {
+                ext_LittleFSImpl::fileOpCallback('k', _getFD(), nullptr, position());
+            }
             return true;
         }
 
@@ -789,7 +917,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         size_t position() const override
         {
-            if (!_opened || !_fd)
+            if (!_isOpen())
             {
                 return 0;
             }
@@ -809,7 +937,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         size_t size() const override
         {
-            return (_opened && _fd) ? lfs_file_size(_fs->getFS(), _getFD()) : 0;
+            return _isOpen() ? lfs_file_size(_fs->getFS(), _getFD()) : 0;
         }
 
         /**
@@ -820,10 +948,15 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool truncate(uint32_t size) override
         {
-            if (!_opened || !_fd)
+            if (!_isOpen())
             {
                 return false;
             }
+            if (ext_LittleFSImpl::fileOpCallback)
+            {
+                ext_LittleFSImpl::fileOpCallback('t', _getFD(), nullptr, size);
+            }
+            ExtFlashWaScope wa(_name);
             int rc = lfs_file_truncate(_fs->getFS(), _getFD(), size);
             if (rc < 0)
             {
@@ -839,28 +972,44 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         void close() override
         {
+            if (_opened && _fd && !_fsExists())
+            {
+                // The filesystem is gone and closed the file, give the slot back to the table it left
+                _opened = false;
+                ext_LittleFSImpl::releaseFd(_getFD());
+                return;
+            }
             if (_opened && _fd)
             {
+                ExtFlashLatencyScope latency(EXTFLASH_LAT_CLOSE); // Including the time attributes
+                EXTFLASH_TP_SCOPE("fs.close", 0);
+                ExtFlashWaScope wa(_name);
+                if (ext_LittleFSImpl::fileOpCallback)
+                {
+                    ext_LittleFSImpl::fileOpCallback('c', _getFD(), nullptr, 0);
+                }
                 lfs_file_close(_fs->getFS(), _getFD());
+                extFlashStats.closes++;
                 _opened = false;
                 DEBUGV("lfs_file_close: fd=%p\n", _getFD());
+                ext_LittleFSImpl::releaseFd(_getFD());
                 if (_timeCallback && (_flags & LFS_O_WRONLY))
                 {
                     // If the file opened with O_CREAT, write the creation time attribute
                     if (_creation)
                     {
-                        int rc = lfs_setattr(_fs->getFS(), _name.get(), 'c', (const void *)&_creation, sizeof(_creation));
+                        int rc = lfs_setattr(_fs->getFS(), _name, 'c', (const void *)&_creation, sizeof(_creation));
                         if (rc < 0)
                         {
-                            DEBUGV("Unable to set creation time on '%s' to %lld\n", _name.get(), _creation);
+                            DEBUGV("Unable to set creation time on '%s' to %lld\n", _name, _creation);
                         }
                     }
                     // Add metadata with last write time
                     time_t now = _timeCallback();
-                    int rc = lfs_setattr(_fs->getFS(), _name.get(), 't', (const void *)&now, sizeof(now));
+                    int rc = lfs_setattr(_fs->getFS(), _name, 't', (const void *)&now, sizeof(now));
                     if (rc < 0)
                     {
-                        DEBUGV("Unable to set last write time on '%s' to %lld\n", _name.get(), now);
+                        DEBUGV("Unable to set last write time on '%s' to %lld\n", _name, now);
                     }
                 }
             }
@@ -874,9 +1023,9 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
         time_t getLastWrite() override
         {
             time_t ftime = 0;
-            if (_opened && _fd)
+            if (_isOpen())
             {
-                int rc = lfs_getattr(_fs->getFS(), _name.get(), 't', (void *)&ftime, sizeof(ftime));
+                int rc = lfs_getattr(_fs->getFS(), _name, 't', (void *)&ftime, sizeof(ftime));
                 if (rc != sizeof(ftime))
                 {
                     ftime = 0; // Error, so clear read value
@@ -893,9 +1042,9 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
         time_t getCreationTime() override
         {
             time_t ftime = 0;
-            if (_opened && _fd)
+            if (_isOpen())
             {
-                int rc = lfs_getattr(_fs->getFS(), _name.get(), 'c', (void *)&ftime, sizeof(ftime));
+                int rc = lfs_getattr(_fs->getFS(), _name, 'c', (void *)&ftime, sizeof(ftime));
                 if (rc != sizeof(ftime))
                 {
                     ftime = 0; // Error, so clear read value
@@ -917,9 +1066,8 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
             }
             else
             {
-                const char *p = _name.get();                // Start at the beginning
-                const char *slash = strrchr(p, '/');        // Find the last slash
-                return (slash && slash[1]) ? slash + 1 : p; // Return the filename
+                const char *slash = strrchr(_name, '/');
+                return (slash && slash[1]) ? slash + 1 : _name; // Return the filename, "/" for the root
             }
         }
 
@@ -930,7 +1078,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         const char *fullName() const override
         {
-            return _opened ? _name.get() : nullptr;
+            return _opened ? _name : nullptr;
         }
 
         /**
@@ -940,7 +1088,7 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool isFile() const override
         {
-            if (!_opened || !_fd)
+            if (!_isOpen())
             {
                 return false;
             }
@@ -964,6 +1112,10 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
             {
                 return true;
             }
+            else if (!_fsExists())
+            {
+                return false;
+            }
             lfs_info info;
             int rc = lfs_stat(_fs->getFS(), fullName(), &info);
             return (rc == 0) && (info.type == LFS_TYPE_DIR);
@@ -977,12 +1129,32 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         lfs_file_t *_getFD() const
         {
-            return _fd.get();
+            return _fd;
+        }
+
+        /**
+         * @brief Check that the filesystem of the file still exists, needs a file descriptor
+         *
+         * @return true if the filesystem exists
+         */
+        bool _fsExists() const
+        {
+            return reinterpret_cast<const ext_LittleFSFd *>(_fd)->table->fs;
+        }
+
+        /**
+         * @brief Check that the file is open, has a file descriptor and its filesystem still exists
+         *
+         * @return true if the file can be used
+         */
+        bool _isOpen() const
+        {
+            return _opened && _fd && _fsExists();
         }
 
         ext_LittleFSImpl *_fs;           // The filesystem implementation
-        std::shared_ptr<lfs_file_t> _fd; // The file descriptor
-        std::shared_ptr<char> _name;     // The name of the file
+        lfs_file_t *_fd;                 // The file descriptor, a slot of the table of _fs
+        char *_name;                     // The normalized name of the file, in a block of its own size
         bool _opened;                    // Whether the file is opened
         int _flags;                      // The flags
         time_t _creation;                // The creation time
@@ -994,20 +1166,17 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
         /**
          * @brief Construct a new ext LittleFSDirImpl object
          *
-         * @param pattern, the pattern to match
          * @param fs, the filesystem implementation
+         * @param table, the file descriptor table of fs, it counts the directory
          * @param dir, the directory
-         * @param dirPath, the path of the directory
+         * @param names, the normalized path of the directory and the pattern to match behind it, a block of
+         *        ext_LittleFSImpl::_copyNames(), the directory frees it
          */
-        ext_LittleFSDirImpl(const String &pattern, ext_LittleFSImpl *fs, std::shared_ptr<lfs_dir_t> dir, const char *dirPath = nullptr)
-            : _pattern(pattern), _fs(fs), _dir(dir), _dirPath(nullptr), _valid(false), _opened(true)
+        ext_LittleFSDirImpl(ext_LittleFSImpl *fs, ext_LittleFSFdTable *table, std::shared_ptr<lfs_dir_t> dir, char *names)
+            : _dirPath(names), _pattern(names + strlen(names) + 1), _fs(fs), _table(table), _dir(dir), _valid(false), _opened(true)
         {
             memset(&_dirent, 0, sizeof(_dirent));
-            if (dirPath)
-            {
-                _dirPath = std::shared_ptr<char>(new char[strlen(dirPath) + 1], std::default_delete<char[]>());
-                strcpy(_dirPath.get(), dirPath);
-            }
+            _table->dirs++;
         }
 
         /**
@@ -1016,10 +1185,12 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         ~ext_LittleFSDirImpl() override
         {
-            if (_opened)
+            if (_opened && _table->fs)
             {
                 lfs_dir_close(_fs->getFS(), _getDir());
             }
+            ext_LittleFSImpl::releaseDir(_table);
+            extFlashMemFree(_dirPath);
         }
 
         /**
@@ -1031,17 +1202,16 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         FileImplPtr openFile(OpenMode openMode, AccessMode accessMode) override
         {
-            if (!_valid)
+            if (!_valid || !_table->fs)
+            {
+                return FileImplPtr();
+            }
+            const ExtFlashPath path(_dirPath, _dirent.name);
+            if (!path.isValid())
             {
                 return FileImplPtr();
             }
-            int nameLen = 3; // Slashes, terminator
-            nameLen += _dirPath.get() ? strlen(_dirPath.get()) : 0;
-            nameLen += strlen(_dirent.name);
-            char tmpName[nameLen];
-            snprintf(tmpName, nameLen, "%s%s%s", _dirPath.get() ? _dirPath.get() : "", _dirPath.get() && _dirPath.get()[0] ? "/" : "", _dirent.name);
-            auto ret = _fs->open((const char *)tmpName, openMode, accessMode);
-            return ret;
+            return _fs->open(path.c_str(), openMode, accessMode);
         }
 
         /**
@@ -1152,6 +1322,10 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
         bool rewind() override
         {
             _valid = false;
+            if (!_table->fs)
+            {
+                return false;
+            }
             int rc = lfs_dir_rewind(_fs->getFS(), _getDir());
             // Skip the . and .. entries
             lfs_info dirent;
@@ -1166,14 +1340,19 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool next() override
         {
-            const int n = _pattern.length();
+            if (!_table->fs)
+            {
+                _valid = false;
+                return false;
+            }
+            const int n = strlen(_pattern);
             bool match;
             do
             {
                 _dirent.name[0] = 0;
                 int rc = lfs_dir_read(_fs->getFS(), _getDir(), &_dirent);
                 _valid = (rc == 1);
-                match = (!n || !strncmp((const char *)_dirent.name, _pattern.c_str(), n));
+                match = (!n || !strncmp((const char *)_dirent.name, _pattern, n));
             }
             while (_valid && !match);
             return _valid;
@@ -1200,23 +1379,24 @@ namespace ext_littlefs_impl // LittleFS implementation for external flash
          */
         bool _getAttr(char attr, int len, void *dest)
         {
-            if (!_valid || !len || !dest)
+            if (!_valid || !len || !dest || !_table->fs)
+            {
+                return false;
+            }
+            const ExtFlashPath path(_dirPath, _dirent.name);
+            if (!path.isValid())
             {
                 return false;
             }
-            int nameLen = 3; // Slashes, terminator
-            nameLen += _dirPath.get() ? strlen(_dirPath.get()) : 0;
-            nameLen += strlen(_dirent.name);
-            char tmpName[nameLen];
-            snprintf(tmpName, nameLen, "%s%s%s", _dirPath.get() ? _dirPath.get() : "", _dirPath.get() && _dirPath.get()[0] ? "/" : "", _dirent.name);
-            int rc = lfs_getattr(_fs->getFS(), tmpName, attr, dest, len);
+            int rc = lfs_getattr(_fs->getFS(), path.c_str(), attr, dest, len);
             return (rc == len);
         }
 
-        String _pattern;                 // THe pattern of the
+        char *_dirPath;                  // The path of the directory, the pattern follows in the same block
+        const char *_pattern;            // The pattern of the names, "" for all
         ext_LittleFSImpl *_fs;           // The filesystem implementation
+        ext_LittleFSFdTable *_table;     // The file descriptor table of _fs, its fs is nullptr once _fs is destroyed
         std::shared_ptr<lfs_dir_t> _dir; // The directory
-        std::shared_ptr<char> _dirPath;  // The path of the directory
         lfs_info _dirent;                // The directory entry
         bool _valid;                     // Whether is valid or not
         bool _opened;                    // Whether is opened or not
@@ -39,6 +39,8 @@
 
 namespace ext_littlefs_impl
 {
+    ext_LittleFSImpl::FileOpCallback ext_LittleFSImpl::fileOpCallback = nullptr;
+
     /**
      * @brief Construct a new ext_LittleFSImpl object with full configuration support
      *
@@ -50,6 +52,8 @@ namespace ext_littlefs_impl
      */
     FileImplPtr ext_LittleFSImpl::open(const char *path, OpenMode openMode, AccessMode accessMode)
     {
+        ExtFlashLatencyScope latency(EXTFLASH_LAT_OPEN);
+        EXTFLASH_TP_SCOPE("fs.open", 0);
         if (!_mounted)
         {
             DEBUGV("ext_LittleFSImpl::open() called on unmounted FS\n");
@@ -60,33 +64,35 @@ namespace ext_littlefs_impl
             DEBUGV("ext_LittleFSImpl::open() called with invalid filename\n");
             return FileImplPtr();
         }
-        if (!ext_LittleFSImpl::pathValid(path))
+        const ExtFlashPath normalized(path); // Copy on the stack, the file keeps one of its own size
+        if (!normalized.isValid())
         {
             DEBUGV("ext_LittleFSImpl::open() called with too long filename\n");
             return FileImplPtr();
         }
+        path = normalized.c_str();
+        ExtFlashWaScope wa(path);
 
         const int flags = _getFlags(openMode, accessMode);
-        auto fd = std::make_shared<lfs_file_t>();
+        ext_LittleFSFd *fd = _acquireFd();
+        if (!fd)
+        {
+            DEBUGV("ext_LittleFSImpl::open() called with all %lu file descriptors open\n", (unsigned long)_maxOpenFds);
+            extFlashStats.openFailures++;
+            extFlashStats.fdRefused++;
+            return FileImplPtr();
+        }
 
-        if ((openMode & OM_CREATE) && strchr(path, '/'))
+        if (openMode & OM_CREATE)
         {
             // For file creation, silently make subdirs as needed.  If any fail,
             // it will be caught by the real file open later on
-            char *pathStr = strdup(path);
-            if (pathStr)
+            for (const char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/'))
             {
                 // Make dirs up to the final fnamepart
-                char *ptr = strchr(pathStr, '/');
-                while (ptr)
-                {
-                    *ptr = 0;
-                    lfs_mkdir(&_lfs, pathStr);
-                    *ptr = '/';
-                    ptr = strchr(ptr + 1, '/');
-                }
+                const ExtFlashPath dir(path, slash - path);
+                lfs_mkdir(&_lfs, dir.c_str());
             }
-            free(pathStr);
         }
 
         time_t creation = 0;
@@ -94,10 +100,10 @@ namespace ext_littlefs_impl
         {
             // O_CREATE means we *may* make the file, but not if it already exists.
             // See if it exists, and only if not update the creation time
-            int rc = lfs_file_open(&_lfs, fd.get(), path, LFS_O_RDONLY);
+            int rc = lfs_file_opencfg(&_lfs, &fd->file, path, LFS_O_RDONLY, &fd->config);
             if (rc == 0)
             {
-                lfs_file_close(&_lfs, fd.get()); // It exists, don't update create time
+                lfs_file_close(&_lfs, &fd->file); // It exists, don't update create time
             }
             else
             {
@@ -105,22 +111,46 @@ namespace ext_littlefs_impl
             }
         }
 
-        int rc = lfs_file_open(&_lfs, fd.get(), path, flags);
+        int rc = lfs_file_opencfg(&_lfs, &fd->file, path, flags, &fd->config);
         if (rc == LFS_ERR_ISDIR)
         {
             // To support the SD.openNextFile, a null FD indicates to the LittleFSFile this is just
             // a directory whose name we are carrying around but which cannot be read or written
-            return std::make_shared<ext_LittleFSFileImpl>(this, path, nullptr, flags, creation);
+            releaseFd(&fd->file);
+            char *name = _copyNames(normalized.view());
+            auto file = name ? extFlashMemMakeShared<ext_LittleFSFileImpl, EXTFLASH_MEM_HANDLE>(this, name, nullptr, flags, creation) : FileImplPtr();
+            if (!file)
+            {
+                extFlashMemFree(name);
+            }
+            return file;
         }
         else if (rc == 0)
         {
-            lfs_file_sync(&_lfs, fd.get());
-            return std::make_shared<ext_LittleFSFileImpl>(this, path, fd, flags, creation);
+            extFlashStats.opens++;
+            if (fileOpCallback)
+            {
+                fileOpCallback('o', &fd->file, path, flags);
+            }
+            lfs_file_sync(&_lfs, &fd->file);
+            char *name = _copyNames(normalized.view());
+            auto file = name ? extFlashMemMakeShared<ext_LittleFSFileImpl, EXTFLASH_MEM_HANDLE>(this, name, &fd->file, flags, creation) : FileImplPtr();
+            if (!file)
+            {
+                // No heap for the handle or its name, close the file and give its slot back
+                extFlashMemFree(name);
+                lfs_file_close(&_lfs, &fd->file);
+                releaseFd(&fd->file);
+                extFlashStats.openFailures++;
+            }
+            return file;
         }
         else
         {
             DEBUGV("LittleFSDirImpl::openFile: rc=%d fd=%p path=`%s` openMode=%d accessMode=%d err=%d\n",
-                   rc, fd.get(), path, openMode, accessMode, rc);
+                   rc, &fd->file, path, openMode, accessMode, rc);
+            releaseFd(&fd->file);
+            extFlashStats.openFailures++;
             return FileImplPtr();
         }
     }
@@ -137,84 +167,229 @@ namespace ext_littlefs_impl
         {
             return DirImplPtr();
         }
-        char *pathStr = strdup(path); // Allow edits on our scratch copy
-        // Get rid of any trailing slashes
-        while (strlen(pathStr) && (pathStr[strlen(pathStr) - 1] == '/'))
+        // Normalized on the stack, without trailing slashes. openDir("") === openDir("/")
+        ExtFlashPath dirPath(path);
+        if (!dirPath.isValid())
         {
-            pathStr[strlen(pathStr) - 1] = 0;
+            return DirImplPtr();
         }
-        // At this point we have a name of "blah/blah/blah" or "blah" or ""
+        const ExtFlashPath full(dirPath);
         // If that references a directory, just open it and we're done.
         lfs_info info;
-        auto dir = std::make_shared<lfs_dir_t>();
+        auto dir = extFlashMemMakeShared<lfs_dir_t, EXTFLASH_MEM_HANDLE>();
+        if (!dir)
+        {
+            return DirImplPtr();
+        }
         int rc;
         const char *filter = "";
-        if (!pathStr[0])
+        if (dirPath.isRoot() || (lfs_stat(&_lfs, dirPath.c_str(), &info) >= 0 && info.type == LFS_TYPE_DIR))
+        {
+            // Easy peasy, path specifies an existing dir!
+            rc = lfs_dir_open(&_lfs, dir.get(), dirPath.c_str());
+        }
+        else
+        {
+            // A file or a name that doesn't exist, so open the containing dir with the name as the filter
+            filter = full.name();
+            dirPath.parent();
+            rc = lfs_dir_open(&_lfs, dir.get(), dirPath.c_str());
+        }
+        if (rc < 0)
+        {
+            DEBUGV("ext_LittleFSImpl::openDir: path=`%s` err=%d\n", path, rc);
+            return DirImplPtr();
+        }
+        // Skip the . and .. entries
+        lfs_info dirent;
+        lfs_dir_read(&_lfs, dir.get(), &dirent);
+        lfs_dir_read(&_lfs, dir.get(), &dirent);
+        char *names = _copyNames(dirPath.view(), filter);
+        auto dirImpl = names ? extFlashMemMakeShared<ext_LittleFSDirImpl, EXTFLASH_MEM_HANDLE>(this, _fdTable, dir, names) : DirImplPtr();
+        if (!dirImpl)
         {
-            // openDir("") === openDir("/")
-            rc = lfs_dir_open(&_lfs, dir.get(), "/");
-            filter = "";
+            extFlashMemFree(names);
+            lfs_dir_close(&_lfs, dir.get());
+            return DirImplPtr();
         }
-        else if (lfs_stat(&_lfs, pathStr, &info) >= 0)
+        extFlashStats.dirOpens++;
+        return dirImpl;
+    }
+
+    /**
+     * @brief Copy the names of an open file or directory into one block of their size, each terminated
+     *
+     * @param first the path of the file or directory
+     * @param second the pattern of a directory, empty for a file
+     * @return the block, free it with extFlashMemFree(), or nullptr
+     */
+    char *ext_LittleFSImpl::_copyNames(std::string_view first, std::string_view second)
+    {
+        char *names = static_cast<char *>(extFlashMemAlloc(EXTFLASH_MEM_HANDLE, first.size() + second.size() + 2));
+        if (names)
         {
-            if (info.type == LFS_TYPE_DIR)
+            memcpy(names, first.data(), first.size());
+            names[first.size()] = 0;
+            memcpy(names + first.size() + 1, second.data(), second.size());
+            names[first.size() + 1 + second.size()] = 0;
+        }
+        return names;
+    }
+
+    /**
+     * @brief Allocate the file descriptor table: an lfs file, its config and a cache per slot, in one block.
+     *        A table with open files is kept, it must fit the cache size of littlefs
+     *
+     * @return true if the table is ready
+     */
+    bool ext_LittleFSImpl::_beginFds()
+    {
+        if (_maxOpenFds > EXTFLASH_FD_MAX)
+        {
+            // The free bitmap has one bit per slot, the limit reported by info() and open() is the real one
+            DEBUGV("ext_LittleFSImpl::begin() %lu file descriptors requested, limited to %u\n", (unsigned long)_maxOpenFds, EXTFLASH_FD_MAX);
+            _maxOpenFds = EXTFLASH_FD_MAX;
+        }
+        const uint32_t slots = _maxOpenFds;
+        if (_fdTable)
+        {
+            if (_fdCacheSize == _lfs_cfg.cache_size)
             {
-                // Easy peasy, path specifies an existing dir!
-                rc = lfs_dir_open(&_lfs, dir.get(), pathStr);
-                filter = "";
+                return true;
             }
-            else
+            if (_fdTable->free != _fdTable->all || _fdTable->dirs)
             {
-                // This is a file, so open the containing dir
-                char *ptr = strrchr(pathStr, '/');
-                if (!ptr)
-                {
-                    // No slashes, open the root dir
-                    rc = lfs_dir_open(&_lfs, dir.get(), "/");
-                    filter = pathStr;
-                }
-                else
-                {
-                    // We've got slashes, open the dir one up
-                    *ptr = 0; // Remove slash, truncate string
-                    rc = lfs_dir_open(&_lfs, dir.get(), pathStr);
-                    filter = ptr + 1;
-                }
+                return false;
             }
+            extFlashMemFree(_fdTable);
+            _fdTable = nullptr;
+            _fds = nullptr;
         }
-        else
+        const uint32_t cacheSize = (_lfs_cfg.cache_size + 7) & ~7ul;
+        _fdTable = static_cast<ext_LittleFSFdTable *>(extFlashMemAlloc(EXTFLASH_MEM_HANDLE, sizeof(ext_LittleFSFdTable) + slots * (sizeof(ext_LittleFSFd) + cacheSize)));
+        if (!_fdTable)
+        {
+            return false;
+        }
+        _fdTable->fs = this;
+        _fdTable->all = slots == 32 ? 0xFFFFFFFF : (1ul << slots) - 1;
+        _fdTable->free = _fdTable->all;
+        _fdTable->dirs = 0;
+        _fds = reinterpret_cast<ext_LittleFSFd *>(_fdTable + 1);
+        _fdCaches = reinterpret_cast<uint8_t *>(_fds + slots);
+        _fdCacheSize = _lfs_cfg.cache_size;
+        return true;
+    }
+
+    /**
+     * @brief Close the files still open, so their data is written, and detach the table from the filesystem. The
+     *        table is freed now, or by releaseFd() or releaseDir() once the last open file or directory is closed
+     */
+    void ext_LittleFSImpl::_endFds()
+    {
+        if (!_fdTable)
+        {
+            return;
+        }
+        for (uint32_t open = _mounted ? _fdTable->all & ~_fdTable->free : 0; open; open &= open - 1)
+        {
+            lfs_file_close(&_lfs, &_fds[__builtin_ctz(open)].file);
+            extFlashStats.closes++;
+        }
+        _fdTable->fs = nullptr;
+        _releaseTable(_fdTable);
+        _fdTable = nullptr;
+        _fds = nullptr;
+    }
+
+    /**
+     * @brief Return the slot of a closed file to its file descriptor table. Works without the filesystem
+     *
+     * @param fd the lfs file of the slot
+     */
+    void ext_LittleFSImpl::releaseFd(lfs_file_t *fd)
+    {
+        ext_LittleFSFdTable *table = reinterpret_cast<ext_LittleFSFd *>(fd)->table;
+        const uint32_t slot = reinterpret_cast<ext_LittleFSFd *>(fd) - reinterpret_cast<ext_LittleFSFd *>(table + 1);
+        table->free |= 1ul << slot;
+        _releaseTable(table);
+    }
+
+    /**
+     * @brief Count a closed directory off its file descriptor table. Works without the filesystem
+     *
+     * @param table the table the directory was opened with
+     */
+    void ext_LittleFSImpl::releaseDir(ext_LittleFSFdTable *table)
+    {
+        table->dirs--;
+        _releaseTable(table);
+    }
+
+    /**
+     * @brief Free a table its filesystem left behind, once no file or directory uses it anymore
+     *
+     * @param table the file descriptor table
+     */
+    void ext_LittleFSImpl::_releaseTable(ext_LittleFSFdTable *table)
+    {
+        if (!table->fs && table->free == table->all && !table->dirs)
+        {
+            extFlashMemFree(table);
+        }
+    }
+
+    /**
+     * @brief Give littlefs its read cache, program cache and lookahead buffer in its config, allocated in one block
+     *        next to the file descriptor table. Buffers set by the user are kept. Called before a mount, the
+     *        block of the last mount is freed first. Without room littlefs allocates the buffers itself
+     */
+    void ext_LittleFSImpl::_beginBuffers()
+    {
+        void **buffers[3] = {&_lfs_cfg.read_buffer, &_lfs_cfg.prog_buffer, &_lfs_cfg.lookahead_buffer};
+        const uint32_t cacheSize = (_lfs_cfg.cache_size + 7) & ~7ul; // The lookahead buffer behind the caches is 8 byte aligned
+        const uint32_t sizes[3] = {cacheSize, cacheSize, _lfs_cfg.lookahead_size};
+        if (_lfsBuffers)
         {
-            // Name doesn't exist, so use the parent dir of whatever was sent in
-            // This is a file, so open the containing dir
-            char *ptr = strrchr(pathStr, '/');
-            if (!ptr)
+            for (void **buffer : buffers)
             {
-                // No slashes, open the root dir
-                rc = lfs_dir_open(&_lfs, dir.get(), "/");
-                filter = pathStr;
+                if (*buffer >= _lfsBuffers && *buffer < _lfsBuffers + sizes[0] + sizes[1] + sizes[2])
+                {
+                    *buffer = nullptr;
+                }
             }
-            else
+            extFlashMemFree(_lfsBuffers);
+        }
+        _lfsBuffers = static_cast<uint8_t *>(extFlashMemAlloc(EXTFLASH_MEM_LFS, sizes[0] + sizes[1] + sizes[2]));
+        uint8_t *next = _lfsBuffers;
+        for (uint8_t i = 0; i < 3 && next; i++)
+        {
+            if (!*buffers[i])
             {
-                // We've got slashes, open the dir one up
-                *ptr = 0; // Remove slash, truncate string
-                rc = lfs_dir_open(&_lfs, dir.get(), pathStr);
-                filter = ptr + 1;
+                *buffers[i] = next;
             }
+            next += sizes[i];
         }
-        if (rc < 0)
+    }
+
+    /**
+     * @brief Take the first free slot of the file descriptor table
+     *
+     * @return the slot with the config pointing to its cache, nullptr if all are open
+     */
+    ext_LittleFSFd *ext_LittleFSImpl::_acquireFd()
+    {
+        if (!_fdTable || !_fdTable->free)
         {
-            DEBUGV("ext_LittleFSImpl::openDir: path=`%s` err=%d\n", path, rc);
-            free(pathStr);
-            return DirImplPtr();
+            return nullptr;
         }
-        // Skip the . and .. entries
-        lfs_info dirent;
-        lfs_dir_read(&_lfs, dir.get(), &dirent);
-        lfs_dir_read(&_lfs, dir.get(), &dirent);
-
-        auto ret = std::make_shared<ext_LittleFSDirImpl>(filter, this, dir, pathStr);
-        free(pathStr);
-        return ret;
+        const uint32_t slot = __builtin_ctz(_fdTable->free);
+        _fdTable->free &= ~(1ul << slot);
+        ext_LittleFSFd *fd = &_fds[slot];
+        memset(fd, 0, sizeof(*fd));
+        fd->table = _fdTable;
+        fd->config.buffer = _fdCaches + slot * ((_fdCacheSize + 7) & ~7ul);
+        return fd;
     }
 
     /**
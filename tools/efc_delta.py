@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""
+Create delta patches for the ExternalFlash module (efc ota patch).
+
+    efc_delta.py old.bin new.bin patch.bin
+
+old.bin is the firmware running on the device, new.bin the new image. The patch is checked by applying it
+again before it is written. Format: see src/DeltaPatch.h.
+"""
+import struct
+import sys
+import zlib
+
+MAGIC = 0x50444645
+VERSION = 1
+OP_END, OP_DIFF, OP_EXTRA, OP_SEEK = 0, 1, 2, 3
+BLOCK = 8        # Size of the blocks indexed in the old image
+MIN_MATCH = 16   # Shorter matches are sent as EXTRA bytes
+WINDOW = 16      # Approximate matches end when a window has more than WINDOW / 2 different bytes
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 31) if value >= 0 else ((-value) << 1) - 1
+
+
+def index(old):
+    table = {}
+    for pos in range(0, len(old) - BLOCK + 1, 4):
+        table.setdefault(old[pos:pos + BLOCK], pos)
+    return table
+
+
+def match(old, new, table, pos, predicted):
+    """Best (old position, length) for new[pos:], exact at first and then extended approximately."""
+    candidates = []
+    if 0 <= predicted < len(old):
+        candidates.append(predicted)
+    found = table.get(new[pos:pos + BLOCK])
+    if found is not None:
+        candidates.append(found)
+    best = (0, 0)
+    for start in candidates:
+        length = 0
+        last_good = 0
+        mismatches = []
+        while pos + length < len(new) and start + length < len(old):
+            if new[pos + length] == old[start + length]:
+                last_good = length + 1
+            else:
+                mismatches.append(length)
+                while mismatches and mismatches[0] <= length - WINDOW:
+                    mismatches.pop(0)
+                if len(mismatches) > WINDOW // 2:
+                    break
+            length += 1
+        if last_good > best[1]:
+            best = (start, last_good)
+    return best
+
+
+def diff_bytes(old, new):
+    out = bytearray()
+    zeros = 0
+    for a, b in zip(old, new):
+        d = (b - a) & 0xFF
+        if d == 0:
+            zeros += 1
+            continue
+        if zeros:
+            out += b"\x00" + varint(zeros)
+            zeros = 0
+        out.append(d)
+    if zeros:
+        out += b"\x00" + varint(zeros)
+    return bytes(out)
+
+
+def create(old, new):
+    table = index(old)
+    body = bytearray()
+    pos = src = 0
+    extra = bytearray()
+    while pos < len(new):
+        start, length = match(old, new, table, pos, src)
+        if length < MIN_MATCH:
+            extra.append(new[pos])
+            pos += 1
+            continue
+        if extra:
+            body += bytes([OP_EXTRA]) + varint(len(extra)) + extra
+            extra = bytearray()
+        if start != src:
+            body += bytes([OP_SEEK]) + varint(zigzag(start - src))
+        body += bytes([OP_DIFF]) + varint(length) + diff_bytes(old[start:start + length], new[pos:pos + length])
+        pos += length
+        src = start + length
+    if extra:
+        body += bytes([OP_EXTRA]) + varint(len(extra)) + extra
+    body.append(OP_END)
+    header = struct.pack("<IHHIIII", MAGIC, VERSION, 0, len(old), zlib.crc32(old), len(new), zlib.crc32(new))
+    return header + bytes(body)
+
+
+def apply(old, patch):
+    magic, version, _, source_size, source_crc, target_size, target_crc = struct.unpack_from("<IHHIIII", patch)
+    assert magic == MAGIC and version == VERSION and source_crc == zlib.crc32(old[:source_size])
+    pos = 24
+    src = 0
+    out = bytearray()
+
+    def read_varint():
+        nonlocal pos
+        value = shift = 0
+        while True:
+            byte = patch[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_SEEK:
+            value = read_varint()
+            src += (value >> 1) ^ -(value & 1)
+        elif op == OP_EXTRA:
+            length = read_varint()
+            out += patch[pos:pos + length]
+            pos += length
+        elif op == OP_DIFF:
+            remaining = read_varint()
+            while remaining:
+                d = patch[pos]
+                pos += 1
+                if d == 0:
+                    run = read_varint()
+                    out += old[src:src + run]
+                    src += run
+                    remaining -= run
+                else:
+                    out.append((old[src] + d) & 0xFF)
+                    src += 1
+                    remaining -= 1
+    assert len(out) == target_size and zlib.crc32(out) == target_crc
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) != 4:
+        print(__doc__.strip())
+        return 1
+    with open(sys.argv[1], "rb") as f:
+        old = f.read()
+    with open(sys.argv[2], "rb") as f:
+        new = f.read()
+    patch = create(old, new)
+    if apply(old, patch) != new:
+        print("Patch check failed")
+        return 1
+    with open(sys.argv[3], "wb") as f:
+        f.write(patch)
+    print(f"{len(new)} bytes -> {len(patch)} bytes patch ({len(new) / max(len(patch), 1):.1f}x)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())